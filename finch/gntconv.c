@@ -964,12 +964,26 @@ chat_flag_text(PurpleChatUserFlags flags)
 	return " ";
 }
 
+/* Sorts the rows in the reverse order of the user list's compare function. */
+static gint
+finch_chat_user_compare_reverse(gconstpointer a, gconstpointer b)
+{
+	PurpleChatUser *chatuser_a = *(PurpleChatUser **)a;
+	PurpleChatUser *chatuser_b = *(PurpleChatUser **)b;
+
+	return g_utf8_collate(purple_chat_user_get_name(chatuser_b),
+	                      purple_chat_user_get_name(chatuser_a));
+}
+
 static void
 finch_chat_add_users(PurpleChatConversation *chat, GList *users, gboolean new_arrivals)
 {
 	PurpleConversation *conv = PURPLE_CONVERSATION(chat);
 	FinchConv *ggc = FINCH_CONV(conv);
 	GntEntry *entry = GNT_ENTRY(ggc->entry);
+	GntTree *tree;
+	GPtrArray *sorted;
+	guint i;
 
 	if (!new_arrivals)
 	{
@@ -995,15 +1009,31 @@ finch_chat_add_users(PurpleChatConversation *chat, GList *users, gboolean new_ar
 		g_string_free(string, TRUE);
 	}
 
+	/* The tree finds the place for each new row by walking from the top
+	 * until it finds a row that sorts after it. Adding the whole batch from
+	 * last to first means that place is found right away instead of after
+	 * every row added before it.
+	 */
+	sorted = g_ptr_array_new();
 	for (; users; users = users->next)
+		g_ptr_array_add(sorted, users->data);
+	g_ptr_array_sort(sorted, finch_chat_user_compare_reverse);
+
+	tree = GNT_TREE(ggc->u.chat->userlist);
+	for (i = 0; i < sorted->len; i++)
 	{
-		PurpleChatUser *chatuser = users->data;
-		GntTree *tree = GNT_TREE(ggc->u.chat->userlist);
-		gnt_entry_add_suggest(entry, purple_chat_user_get_name(chatuser));
-		gnt_entry_add_suggest(entry, purple_chat_user_get_alias(chatuser));
-		gnt_tree_add_row_after(tree, g_strdup(purple_chat_user_get_name(chatuser)),
-				gnt_tree_create_row(tree, chat_flag_text(purple_chat_user_get_flags(chatuser)), purple_chat_user_get_alias(chatuser)), NULL, NULL);
+		PurpleChatUser *chatuser = g_ptr_array_index(sorted, i);
+		const char *name = purple_chat_user_get_name(chatuser);
+		const char *alias = purple_chat_user_get_alias(chatuser);
+
+		gnt_entry_add_suggest(entry, name);
+		if (!purple_strequal(name, alias))
+			gnt_entry_add_suggest(entry, alias);
+		gnt_tree_add_row_after(tree, g_strdup(name),
+				gnt_tree_create_row(tree, chat_flag_text(purple_chat_user_get_flags(chatuser)), alias), NULL, NULL);
 	}
+
+	g_ptr_array_free(sorted, TRUE);
 }
 
 static void
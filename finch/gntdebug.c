@@ -254,6 +254,54 @@ save_debug_win(GntWidget *w, GntTextView *tv)
 	gnt_widget_show(window);
 }
 
+static void
+category_toggled_cb(GntTree *tree, gpointer key, G_GNUC_UNUSED gpointer data)
+{
+	purple_debug_set_enabled(key, PURPLE_DEBUG_ALL,
+	                         gnt_tree_get_choice(tree, key));
+}
+
+static void
+show_categories(G_GNUC_UNUSED GntWidget *w, G_GNUC_UNUSED gpointer data)
+{
+	GntWidget *window, *tree, *button;
+	GList *categories, *l;
+
+	window = gnt_vbox_new(FALSE);
+	gnt_box_set_toplevel(GNT_BOX(window), TRUE);
+	gnt_box_set_title(GNT_BOX(window), _("Debug Categories"));
+	gnt_box_set_alignment(GNT_BOX(window), GNT_ALIGN_MID);
+
+	tree = gnt_tree_new();
+	gnt_tree_set_hash_fns(GNT_TREE(tree), g_str_hash, g_str_equal, g_free);
+
+	/* The list only has the categories that have been logged to so far. */
+	categories = purple_debug_get_categories();
+	for (l = categories; l != NULL; l = l->next) {
+		gchar *category = l->data;
+
+		gnt_tree_add_choice(GNT_TREE(tree), category,
+				gnt_tree_create_row(GNT_TREE(tree), category), NULL, NULL);
+		gnt_tree_set_choice(GNT_TREE(tree), category,
+				purple_debug_is_enabled(PURPLE_DEBUG_ALL, category));
+	}
+	/* The tree owns the strings now. */
+	g_list_free(categories);
+
+	gnt_tree_set_col_width(GNT_TREE(tree), 0, 30);
+	gnt_widget_set_size(tree, 30, 15);
+	g_signal_connect(G_OBJECT(tree), "toggled",
+			G_CALLBACK(category_toggled_cb), NULL);
+	gnt_box_add_widget(GNT_BOX(window), tree);
+
+	button = gnt_button_new(_("Close"));
+	g_signal_connect_swapped(G_OBJECT(button), "activate",
+			G_CALLBACK(gnt_widget_destroy), window);
+	gnt_box_add_widget(GNT_BOX(window), button);
+
+	gnt_widget_show(window);
+}
+
 void finch_debug_window_show()
 {
 	GntWidget *wid, *box, *label;
@@ -304,6 +352,11 @@ void finch_debug_window_show()
 	gnt_box_add_widget(GNT_BOX(box), debug.search);
 	g_signal_connect(G_OBJECT(debug.search), "text_changed", G_CALLBACK(update_filter_string), NULL);
 
+	wid = gnt_button_new(_("Categories"));
+	g_signal_connect(G_OBJECT(wid), "activate", G_CALLBACK(show_categories), NULL);
+	gnt_widget_set_grow_y(wid, TRUE);
+	gnt_box_add_widget(GNT_BOX(box), wid);
+
 	wid = gnt_check_box_new(_("Pause"));
 	g_signal_connect(G_OBJECT(wid), "toggled", G_CALLBACK(toggle_pause), NULL);
 	gnt_widget_set_grow_y(wid, TRUE);
@@ -380,6 +380,7 @@ finch_xfer_dialog_update_xfer(PurpleXfer *xfer)
 	gint64 now;
 	gint64 elapsed = 0;
 	char *kbsec;
+	guint stalls;
 	gboolean send;
 
 	if (purple_xfer_get_start_time(xfer) > 0) {
@@ -390,7 +391,15 @@ finch_xfer_dialog_update_xfer(PurpleXfer *xfer)
 	}
 
 	kb_sent = purple_xfer_get_bytes_sent(xfer) / 1000.0;
-	kbps = (elapsed > 0 ? (kb_sent * G_USEC_PER_SEC) / elapsed : 0);
+
+	/* Show the current rate while running and the average once done. */
+	if (!purple_xfer_is_completed(xfer) &&
+	    purple_xfer_get_throughput(xfer) > 0.0)
+	{
+		kbps = purple_xfer_get_throughput(xfer) / 1000.0;
+	} else {
+		kbps = (elapsed > 0 ? (kb_sent * G_USEC_PER_SEC) / elapsed : 0);
+	}
 
 	g_return_if_fail(xfer_dialog != NULL);
 	g_return_if_fail(xfer != NULL);
@@ -430,6 +439,15 @@ finch_xfer_dialog_update_xfer(PurpleXfer *xfer)
 			g_free(msg);
 		}
 		data->notified = TRUE;
+	} else if ((stalls = purple_xfer_get_stalls(xfer)) > 0) {
+		/* The speed column is too narrow, so note stalls with the status. */
+		char *status = g_strdup_printf(
+		        ngettext("%s (%u stall)", "%s (%u stalls)", stalls),
+		        send ? _("Sending") : _("Receiving"), stalls);
+
+		gnt_tree_change_text(GNT_TREE(xfer_dialog->tree), xfer, COLUMN_STATUS,
+				status);
+		g_free(status);
 	} else {
 		gnt_tree_change_text(GNT_TREE(xfer_dialog->tree), xfer, COLUMN_STATUS,
 				send ? _("Sending") : _("Receiving"));
@@ -490,6 +508,10 @@ finch_xfer_new_xfer(PurpleXfer *xfer)
 
 	g_signal_connect(xfer, "notify::progress",
 	                 G_CALLBACK(finch_xfer_progress_notify), NULL);
+	g_signal_connect(xfer, "notify::throughput",
+	                 G_CALLBACK(finch_xfer_progress_notify), NULL);
+	g_signal_connect(xfer, "notify::stalls",
+	                 G_CALLBACK(finch_xfer_progress_notify), NULL);
 	g_signal_connect(xfer, "notify::status",
 	                 G_CALLBACK(finch_xfer_status_notify), NULL);
 	g_signal_connect(xfer, "notify::visible",
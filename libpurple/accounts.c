@@ -75,7 +75,6 @@ static void
 sync_accounts(void)
 {
 	PurpleXmlNode *node;
-	char *data;
 
 	if (!accounts_loaded)
 	{
@@ -85,10 +84,7 @@ sync_accounts(void)
 	}
 
 	node = accounts_to_xmlnode();
-	data = purple_xmlnode_to_formatted_str(node, NULL);
-	purple_util_write_data_to_config_file("accounts.xml", data, -1);
-	g_free(data);
-	purple_xmlnode_free(node);
+	_purple_util_write_xml_to_config_file("accounts.xml", node);
 }
 
 static gboolean
@@ -30,6 +30,9 @@
 #include "purpleprivate.h"
 #include "purpleprotocolserver.h"
 
+/* The default for purple_buddy_icons_set_cache_budget(). */
+#define PURPLE_BUDDY_ICONS_DEFAULT_CACHE_BUDGET (8 * 1024 * 1024)
+
 /* NOTE: Instances of this struct are allocated without zeroing the memory, so
  * NOTE: be sure to update purple_buddy_icon_new() if you add members. */
 struct _PurpleBuddyIcon
@@ -91,11 +94,58 @@ static GHashTable *icon_data_cache = NULL;
 static GHashTable *icon_file_cache = NULL;
 
 /*
- * This hash table is used for both custom buddy icons on PurpleBlistNodes and
- * account icons.
+ * This hash table is used for custom buddy icons on PurpleBlistNodes, account
+ * icons and the images of PurpleBuddyIcons.
+ *
+ * Key is the PurpleBlistNode, PurpleAccount or PurpleBuddyIcon.
+ * Value is a PurpleBuddyIconCacheEntry, which holds a reference to the image.
+ *
+ * Entries whose image is also in the on-disk cache are kept in
+ * pointer_icon_lru, most recently used first, and are dropped from the tail
+ * once the images in the cache add up to more than pointer_icon_budget. The
+ * next lookup reads them back from disk.
+ *
+ * A PurpleBuddyIcon keeps its image when its entry is dropped, so only the
+ * contents of the image are released, and they're mapped back in from the
+ * on-disk cache the next time the icon is used.
  */
 static GHashTable *pointer_icon_cache = NULL;
 
+/*
+ * The reverse of pointer_icon_cache.
+ *
+ * Key is a PurpleImage.
+ * Value is a GSList of the PurpleBuddyIconCacheEntrys for it.
+ */
+static GHashTable *pointer_icon_images = NULL;
+
+static GQueue      pointer_icon_lru = G_QUEUE_INIT;
+static gsize       pointer_icon_size = 0;
+static gsize       pointer_icon_budget = PURPLE_BUDDY_ICONS_DEFAULT_CACHE_BUDGET;
+static guint64     pointer_icon_evictions = 0;
+static guint64     icon_file_reads = 0;
+
+typedef struct {
+	gpointer key;
+	PurpleImage *img;
+	gsize size;
+
+	/* Whether key is a PurpleBuddyIcon. */
+	gboolean buddy_icon;
+
+	/* Only set for entries that can be evicted. */
+	GList *lru_link;
+} PurpleBuddyIconCacheEntry;
+
+/*
+ * This hash table contains the buddy icons that are being read from the
+ * on-disk cache by purple_buddy_icons_find_async().
+ *
+ * Key is the PurpleBuddy whose icon is being read.
+ * Value is a GSList of the GTasks waiting for it.
+ */
+static GHashTable *pending_loads = NULL;
+
 static char       *cache_dir     = NULL;
 
 /* "Should icons be cached to disk?" */
@@ -222,10 +272,136 @@ purple_buddy_icon_data_uncache_file(const char *filename)
  * Begin functions for dealing with the in-memory icon cache
  */
 
+static void
+pointer_icon_cache_entry_unlink(PurpleBuddyIconCacheEntry *entry)
+{
+	GSList *entries;
+
+	entries = g_hash_table_lookup(pointer_icon_images, entry->img);
+	entries = g_slist_remove(entries, entry);
+	if (entries != NULL)
+		g_hash_table_insert(pointer_icon_images, entry->img, entries);
+	else
+		g_hash_table_remove(pointer_icon_images, entry->img);
+
+	if (entry->lru_link != NULL) {
+		g_queue_delete_link(&pointer_icon_lru, entry->lru_link);
+		entry->lru_link = NULL;
+	}
+
+	pointer_icon_size -= entry->size;
+}
+
+/* Removes key from the cache and returns the reference the cache had to its
+ * image, if there was one. */
+static PurpleImage *
+pointer_icon_cache_steal(gpointer key)
+{
+	PurpleBuddyIconCacheEntry *entry = NULL;
+	PurpleImage *img;
+
+	if (!g_hash_table_steal_extended(pointer_icon_cache, key, NULL,
+	                                 (gpointer *)&entry))
+	{
+		return NULL;
+	}
+
+	pointer_icon_cache_entry_unlink(entry);
+	img = entry->img;
+	g_free(entry);
+
+	return img;
+}
+
+/* Drops the contents of an image that's still in use, which only works if
+ * they can be mapped back in from the on-disk cache and nobody was handed a
+ * pointer to them. */
 static gboolean
-value_equals(gpointer key, gpointer value, gpointer user_data)
+pointer_icon_drop_contents(PurpleImage *img)
 {
-	return (value == user_data);
+	const gchar *filename = image_get_filename(img);
+	gchar *path;
+	gboolean ret = FALSE;
+
+	if (filename == NULL || cache_dir == NULL ||
+	    _purple_image_is_borrowed(img))
+	{
+		return FALSE;
+	}
+
+	path = g_build_filename(cache_dir, filename, NULL);
+	if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+		ret = _purple_image_drop_contents(img, path);
+	g_free(path);
+
+	return ret;
+}
+
+static void
+pointer_icon_cache_evict(void)
+{
+	GList *link = pointer_icon_lru.tail;
+
+	/* The most recently used entry is always kept, since it's the one that's
+	 * about to be returned. */
+	while (pointer_icon_size > pointer_icon_budget && link != NULL &&
+	       link != pointer_icon_lru.head)
+	{
+		PurpleBuddyIconCacheEntry *entry = link->data;
+
+		link = link->prev;
+
+		if (entry->buddy_icon && !pointer_icon_drop_contents(entry->img))
+			continue;
+
+		g_object_unref(pointer_icon_cache_steal(entry->key));
+		pointer_icon_evictions++;
+	}
+}
+
+/* Takes ownership of img, which may only be evicted if it can be read back
+ * from the on-disk cache. */
+static void
+pointer_icon_cache_insert(gpointer key, PurpleImage *img, gboolean evictable,
+                          gboolean buddy_icon)
+{
+	PurpleBuddyIconCacheEntry *entry = g_new0(PurpleBuddyIconCacheEntry, 1);
+	GSList *entries;
+
+	entry->key = key;
+	entry->img = img;
+	entry->size = purple_image_get_data_size(img);
+	entry->buddy_icon = buddy_icon;
+
+	entries = g_hash_table_lookup(pointer_icon_images, img);
+	g_hash_table_insert(pointer_icon_images, img,
+	                    g_slist_prepend(entries, entry));
+	g_hash_table_insert(pointer_icon_cache, key, entry);
+	pointer_icon_size += entry->size;
+
+	if (evictable) {
+		g_queue_push_head(&pointer_icon_lru, entry);
+		entry->lru_link = pointer_icon_lru.head;
+
+		pointer_icon_cache_evict();
+	}
+}
+
+static PurpleImage *
+pointer_icon_cache_lookup(gpointer key)
+{
+	PurpleBuddyIconCacheEntry *entry;
+
+	entry = g_hash_table_lookup(pointer_icon_cache, key);
+	if (entry == NULL)
+		return NULL;
+
+	if (entry->lru_link != NULL) {
+		g_queue_unlink(&pointer_icon_lru, entry->lru_link);
+		g_queue_push_head_link(&pointer_icon_lru, entry->lru_link);
+	}
+
+	return entry->img;
 }
 
 static void
@@ -233,14 +409,21 @@ image_deleting_cb(gpointer _filename)
 {
 	PurpleImage *img;
 	gchar *filename = _filename;
+	GSList *entries;
 
 	img = g_hash_table_lookup(icon_data_cache, filename);
 	purple_buddy_icon_data_uncache_file(filename);
 	g_hash_table_remove(icon_data_cache, filename);
 
-	/* We could make this O(1) by using another hash table, but
-	 * this is probably good enough. */
-	g_hash_table_foreach_remove(pointer_icon_cache, value_equals, (gpointer)img);
+	/* Entries hold a reference to their image, so there shouldn't be any left
+	 * by now, but don't leave them pointing at it if there are. */
+	entries = g_hash_table_lookup(pointer_icon_images, img);
+	while (entries != NULL) {
+		PurpleBuddyIconCacheEntry *entry = entries->data;
+
+		entries = entries->next;
+		pointer_icon_cache_steal(entry->key);
+	}
 
 	g_free(filename);
 }
@@ -281,6 +464,18 @@ purple_buddy_icon_data_new(guchar *icon_data, size_t icon_len)
 	return newimg;
 }
 
+/* Called whenever the contents of a buddy icon are used, which puts it back
+ * in the cache if they were dropped. */
+static void
+purple_buddy_icon_touch(PurpleBuddyIcon *icon)
+{
+	if (icon->img == NULL || pointer_icon_cache == NULL)
+		return;
+
+	if (pointer_icon_cache_lookup(icon) == NULL)
+		pointer_icon_cache_insert(icon, g_object_ref(icon->img), TRUE, TRUE);
+}
+
 /*
  * End functions for dealing with the in-memory icon cache
  */
@@ -369,6 +564,13 @@ purple_buddy_icon_unref(PurpleBuddyIcon *icon)
 		if (icon_cache != NULL)
 			g_hash_table_remove(icon_cache, purple_buddy_icon_get_username(icon));
 
+		if (pointer_icon_cache != NULL) {
+			PurpleImage *cached = pointer_icon_cache_steal(icon);
+
+			if (cached != NULL)
+				g_object_unref(cached);
+		}
+
 		g_free(icon->username);
 		g_free(icon->checksum);
 		g_object_unref(icon->img);
@@ -476,6 +678,16 @@ purple_buddy_icon_set_data(PurpleBuddyIcon *icon, guchar *data,
 	g_free(icon->checksum);
 	icon->checksum = g_strdup(checksum);
 
+	if (pointer_icon_cache != NULL) {
+		PurpleImage *cached = pointer_icon_cache_steal(icon);
+
+		if (cached != NULL)
+			g_object_unref(cached);
+		if (icon->img != NULL)
+			pointer_icon_cache_insert(icon, g_object_ref(icon->img), TRUE,
+			                          TRUE);
+	}
+
 	purple_buddy_icon_update(icon);
 
 	if (old_img)
@@ -486,12 +698,27 @@ gboolean
 purple_buddy_icon_save_to_filename(PurpleBuddyIcon *icon,
                                    const gchar *filename, GError **error)
 {
-	gconstpointer data;
-	size_t len = 0;
+	GBytes *contents = NULL;
+	gboolean ret;
+
+	g_return_val_if_fail(icon != NULL, FALSE);
 
-	data = purple_buddy_icon_get_data(icon, &len);
+	/* The contents are used rather than the data, so that the icon isn't
+	 * stuck in memory afterwards. */
+	if (icon->img != NULL) {
+		purple_buddy_icon_touch(icon);
+		contents = purple_image_get_contents(icon->img);
+	}
+
+	if (contents != NULL) {
+		ret = g_file_set_contents(filename, g_bytes_get_data(contents, NULL),
+		                          g_bytes_get_size(contents), error);
+		g_bytes_unref(contents);
+	} else {
+		ret = g_file_set_contents(filename, "", 0, error);
+	}
 
-	return g_file_set_contents(filename, data, len, error);
+	return ret;
 }
 
 
@@ -526,6 +753,8 @@ purple_buddy_icon_get_data(const PurpleBuddyIcon *icon, size_t *len)
 
 	if (icon->img)
 	{
+		purple_buddy_icon_touch((PurpleBuddyIcon *)icon);
+
 		if (len != NULL)
 			*len = purple_image_get_data_size(icon->img);
 
@@ -537,14 +766,27 @@ purple_buddy_icon_get_data(const PurpleBuddyIcon *icon, size_t *len)
 
 GInputStream *
 purple_buddy_icon_get_stream(PurpleBuddyIcon *icon) {
-	gconstpointer data = NULL;
-	size_t len = 0;
+	GInputStream *stream = NULL;
+	GBytes *contents = NULL;
 
 	g_return_val_if_fail(icon != NULL, NULL);
 
-	data = purple_buddy_icon_get_data(icon, &len);
+	/* The stream holds on to the contents, so unlike
+	 * purple_buddy_icon_get_data() this doesn't keep them in memory for the
+	 * lifetime of the icon. */
+	if(icon->img != NULL) {
+		purple_buddy_icon_touch(icon);
+		contents = purple_image_get_contents(icon->img);
+	}
+
+	if(contents == NULL) {
+		return g_memory_input_stream_new();
+	}
 
-	return g_memory_input_stream_new_from_data(data, (gssize)len, NULL);
+	stream = g_memory_input_stream_new_from_bytes(contents);
+	g_bytes_unref(contents);
+
+	return stream;
 }
 
 const char *
@@ -637,6 +879,8 @@ read_icon_file(const char *path, guchar **data, size_t *len)
 {
 	GError *err = NULL;
 
+	icon_file_reads++;
+
 	if (!g_file_get_contents(path, (gchar **)data, len, &err))
 	{
 		purple_debug_error("buddyicon", "Error reading %s: %s\n",
@@ -649,27 +893,69 @@ read_icon_file(const char *path, guchar **data, size_t *len)
 	return TRUE;
 }
 
+static PurpleBuddyIcon *
+purple_buddy_icons_find_in_memory(PurpleAccount *account, const char *username)
+{
+	GHashTable *icon_cache = g_hash_table_lookup(account_cache, account);
+
+	if (icon_cache == NULL)
+		return NULL;
+
+	return g_hash_table_lookup(icon_cache, username);
+}
+
+/* Creates the icon for buddy from the contents of its file in the on-disk
+ * cache, which are NULL if it couldn't be read. Returns the icon without a
+ * reference for the caller. */
+static PurpleBuddyIcon *
+purple_buddy_icons_loaded(PurpleBuddy *buddy, guchar *data, size_t len)
+{
+	PurpleAccount *account = purple_buddy_get_account(buddy);
+	const char *username = purple_buddy_get_name(buddy);
+	PurpleBuddyIcon *icon;
+	const char *checksum;
+	gboolean caching;
+
+	if (data == NULL) {
+		delete_buddy_icon_settings(PURPLE_BLIST_NODE(buddy), "buddy_icon");
+		return NULL;
+	}
+
+	/* By disabling caching temporarily, we avoid a loop
+	 * and don't have to add special code through several
+	 * functions. */
+	caching = purple_buddy_icons_is_caching();
+	purple_buddy_icons_set_caching(FALSE);
+
+	icon = purple_buddy_icon_create(account, username);
+	icon->img = NULL;
+	checksum = purple_blist_node_get_string(PURPLE_BLIST_NODE(buddy),
+	                                        "icon_checksum");
+	purple_buddy_icon_set_data(icon, data, len, checksum);
+
+	purple_buddy_icons_set_caching(caching);
+
+	return icon;
+}
+
 PurpleBuddyIcon *
 purple_buddy_icons_find(PurpleAccount *account, const char *username)
 {
-	GHashTable *icon_cache;
 	PurpleBuddyIcon *icon = NULL;
 
 	g_return_val_if_fail(account  != NULL, NULL);
 	g_return_val_if_fail(username != NULL, NULL);
 
-	icon_cache = g_hash_table_lookup(account_cache, account);
+	icon = purple_buddy_icons_find_in_memory(account, username);
 
-	if ((icon_cache == NULL) || ((icon = g_hash_table_lookup(icon_cache, username)) == NULL))
+	if (icon == NULL)
 	{
 		/* The icon is not currently cached in memory--try reading from disk */
 		PurpleBuddy *b = purple_blist_find_buddy(account, username);
 		const char *protocol_icon_file;
-		const char *dirname;
-		gboolean caching;
 		gchar *path;
-		guchar *data;
-		size_t len;
+		guchar *data = NULL;
+		size_t len = 0;
 
 		if (!b)
 			return NULL;
@@ -679,33 +965,154 @@ purple_buddy_icons_find(PurpleAccount *account, const char *username)
 		if (protocol_icon_file == NULL)
 			return NULL;
 
-		dirname = purple_buddy_icons_get_cache_dir();
+		path = g_build_filename(purple_buddy_icons_get_cache_dir(),
+		                        protocol_icon_file, NULL);
+		if (!read_icon_file(path, &data, &len))
+			data = NULL;
+		g_free(path);
 
-		caching = purple_buddy_icons_is_caching();
-		/* By disabling caching temporarily, we avoid a loop
-		 * and don't have to add special code through several
-		 * functions. */
-		purple_buddy_icons_set_caching(FALSE);
+		icon = purple_buddy_icons_loaded(b, data, len);
+	}
 
-		path = g_build_filename(dirname, protocol_icon_file, NULL);
-		if (read_icon_file(path, &data, &len)) {
-			const char *checksum;
+	return (icon ? purple_buddy_icon_ref(icon) : NULL);
+}
 
-			icon = purple_buddy_icon_create(account, username);
-			icon->img = NULL;
-			checksum = purple_blist_node_get_string((PurpleBlistNode *)b,
-			                                        "icon_checksum");
-			purple_buddy_icon_set_data(icon, data, len, checksum);
-		} else {
-			delete_buddy_icon_settings((PurpleBlistNode *)b, "buddy_icon");
-		}
+static void
+purple_buddy_icons_find_return(GTask *task, PurpleBuddyIcon *icon)
+{
+	if (icon != NULL) {
+		g_task_return_pointer(task, purple_buddy_icon_ref(icon),
+		                      (GDestroyNotify)purple_buddy_icon_unref);
+	} else {
+		g_task_return_pointer(task, NULL, NULL);
+	}
+	g_object_unref(task);
+}
+
+static void
+purple_buddy_icons_find_async_cb(GObject *obj, GAsyncResult *res,
+                                 gpointer data)
+{
+	PurpleBuddy *buddy = data;
+	PurpleBuddyIcon *icon = NULL;
+	GError *error = NULL;
+	GSList *tasks = NULL;
+	gchar *contents = NULL;
+	gsize len = 0;
 
+	if (!g_file_load_contents_finish(G_FILE(obj), res, &contents, &len, NULL,
+	                                 &error))
+	{
+		gchar *path = g_file_get_path(G_FILE(obj));
+
+		purple_debug_error("buddyicon", "Error reading %s: %s", path,
+		                   error->message);
 		g_free(path);
+		g_clear_error(&error);
+	}
 
-		purple_buddy_icons_set_caching(caching);
+	if (pending_loads == NULL ||
+	    !g_hash_table_steal_extended(pending_loads, buddy, NULL,
+	                                 (gpointer *)&tasks))
+	{
+		/* We were uninitialized while the file was being read. */
+		g_free(contents);
+		g_object_unref(buddy);
+		return;
 	}
 
-	return (icon ? purple_buddy_icon_ref(icon) : NULL);
+	/* Something may have set the icon while it was being read, in which case
+	 * that one wins. */
+	icon = purple_buddy_icons_find_in_memory(purple_buddy_get_account(buddy),
+	                                         purple_buddy_get_name(buddy));
+	if (icon != NULL) {
+		g_free(contents);
+	} else if (purple_blist_node_get_string(PURPLE_BLIST_NODE(buddy),
+	                                        "buddy_icon") != NULL)
+	{
+		icon = purple_buddy_icons_loaded(buddy, (guchar *)contents, len);
+	} else {
+		g_free(contents);
+	}
+
+	/* The buddy list holds a reference to the icon through the buddy, so
+	 * it's still around for the rest of the tasks. */
+	tasks = g_slist_reverse(tasks);
+	while (tasks != NULL) {
+		purple_buddy_icons_find_return(tasks->data, icon);
+		tasks = g_slist_delete_link(tasks, tasks);
+	}
+
+	g_object_unref(buddy);
+}
+
+void
+purple_buddy_icons_find_async(PurpleAccount *account, const char *username,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback, gpointer data)
+{
+	PurpleBuddyIcon *icon;
+	PurpleBuddy *buddy;
+	const char *protocol_icon_file;
+	GSList *tasks;
+	GTask *task;
+	GFile *file;
+	gchar *path;
+
+	g_return_if_fail(account  != NULL);
+	g_return_if_fail(username != NULL);
+	/* The pending loads only exist between init and uninit. */
+	g_return_if_fail(pending_loads != NULL);
+
+	task = g_task_new(NULL, cancellable, callback, data);
+	g_task_set_source_tag(task, purple_buddy_icons_find_async);
+
+	icon = purple_buddy_icons_find_in_memory(account, username);
+	if (icon != NULL) {
+		purple_buddy_icons_find_return(task, icon);
+		return;
+	}
+
+	buddy = purple_blist_find_buddy(account, username);
+	protocol_icon_file = buddy ?
+		purple_blist_node_get_string(PURPLE_BLIST_NODE(buddy), "buddy_icon") :
+		NULL;
+	if (protocol_icon_file == NULL) {
+		purple_buddy_icons_find_return(task, NULL);
+		return;
+	}
+
+	/* Only read the file once for everyone who's waiting for it. */
+	if (g_hash_table_lookup_extended(pending_loads, buddy, NULL,
+	                                 (gpointer *)&tasks))
+	{
+		g_hash_table_insert(pending_loads, buddy,
+		                    g_slist_prepend(tasks, task));
+		return;
+	}
+	g_hash_table_insert(pending_loads, buddy, g_slist_prepend(NULL, task));
+
+	path = g_build_filename(purple_buddy_icons_get_cache_dir(),
+	                        protocol_icon_file, NULL);
+	file = g_file_new_for_path(path);
+	g_free(path);
+
+	/* The read isn't cancelled with any one task, since the others may still
+	 * want it. */
+	icon_file_reads++;
+	g_file_load_contents_async(file, NULL, purple_buddy_icons_find_async_cb,
+	                           g_object_ref(buddy));
+	g_object_unref(file);
+}
+
+PurpleBuddyIcon *
+purple_buddy_icons_find_finish(GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail(G_IS_TASK(res), NULL);
+	g_return_val_if_fail(g_task_get_source_tag(G_TASK(res)) ==
+	                     purple_buddy_icons_find_async, NULL);
+
+	return g_task_propagate_pointer(G_TASK(res), error);
 }
 
 PurpleImage *
@@ -720,7 +1127,7 @@ purple_buddy_icons_find_account_icon(PurpleAccount *account)
 
 	g_return_val_if_fail(account != NULL, NULL);
 
-	img = g_hash_table_lookup(pointer_icon_cache, account);
+	img = pointer_icon_cache_lookup(account);
 	if (img) {
 		g_object_ref(img);
 		return img;
@@ -773,12 +1180,12 @@ purple_buddy_icons_set_account_icon(PurpleAccount *account,
 	}
 	unref_filename(old_icon);
 
-	old_img = g_hash_table_lookup(pointer_icon_cache, account);
+	old_img = pointer_icon_cache_steal(account);
 
+	/* Account icons aren't evicted, since setting one again sends it to the
+	 * server. */
 	if (img)
-		g_hash_table_insert(pointer_icon_cache, account, img);
-	else
-		g_hash_table_remove(pointer_icon_cache, account);
+		pointer_icon_cache_insert(account, img, FALSE, FALSE);
 
 	if (!purple_account_is_disconnected(account))
 	{
@@ -846,7 +1253,7 @@ purple_buddy_icons_node_find_custom_icon(PurpleBlistNode *node)
 
 	g_return_val_if_fail(node != NULL, NULL);
 
-	img = g_hash_table_lookup(pointer_icon_cache, node);
+	img = pointer_icon_cache_lookup(node);
 	if (img) {
 		g_object_ref(img);
 		return img;
@@ -862,8 +1269,17 @@ purple_buddy_icons_node_find_custom_icon(PurpleBlistNode *node)
 	path = g_build_filename(dirname, custom_icon_file, NULL);
 
 	if (read_icon_file(path, &data, &len)) {
+		gboolean caching = purple_buddy_icons_is_caching();
+
 		g_free(path);
-		img = purple_buddy_icons_node_set_custom_icon(node, data, len);
+
+		/* This is the icon the node already has, possibly evicted earlier,
+		 * so it only needs to go back into the cache, not be set again. */
+		purple_buddy_icons_set_caching(FALSE);
+		img = purple_buddy_icon_data_new(data, len);
+		purple_buddy_icons_set_caching(caching);
+
+		pointer_icon_cache_insert(node, img, TRUE, FALSE);
 		g_object_ref(img);
 		return img;
 	}
@@ -889,7 +1305,7 @@ purple_buddy_icons_node_set_custom_icon(PurpleBlistNode *node,
 		return NULL;
 	}
 
-	old_img = g_hash_table_lookup(pointer_icon_cache, node);
+	old_img = pointer_icon_cache_steal(node);
 
 	if (icon_data != NULL && icon_len > 0) {
 		img = purple_buddy_icon_data_new(icon_data, icon_len);
@@ -909,9 +1325,8 @@ purple_buddy_icons_node_set_custom_icon(PurpleBlistNode *node,
 	unref_filename(old_icon);
 
 	if (img)
-		g_hash_table_insert(pointer_icon_cache, node, img);
-	else
-		g_hash_table_remove(pointer_icon_cache, node);
+		pointer_icon_cache_insert(node, img, purple_buddy_icons_is_caching(),
+		                          FALSE);
 
 	manager = purple_conversation_manager_get_default();
 
@@ -1114,6 +1529,35 @@ purple_buddy_icons_get_cache_dir(void)
 	return cache_dir;
 }
 
+void
+purple_buddy_icons_set_cache_budget(gsize budget)
+{
+	pointer_icon_budget = budget;
+
+	if (pointer_icon_cache != NULL)
+		pointer_icon_cache_evict();
+}
+
+gsize
+purple_buddy_icons_get_cache_budget(void)
+{
+	return pointer_icon_budget;
+}
+
+void
+purple_buddy_icons_get_cache_stats(PurpleBuddyIconsCacheStats *stats)
+{
+	g_return_if_fail(stats != NULL);
+
+	stats->entries = pointer_icon_cache ?
+		g_hash_table_size(pointer_icon_cache) : 0;
+	stats->images = pointer_icon_images ?
+		g_hash_table_size(pointer_icon_images) : 0;
+	stats->bytes_held = pointer_icon_size;
+	stats->evictions = pointer_icon_evictions;
+	stats->file_reads = icon_file_reads;
+}
+
 void *
 purple_buddy_icons_get_handle()
 {
@@ -1122,6 +1566,21 @@ purple_buddy_icons_get_handle()
 	return &handle;
 }
 
+static gboolean
+purple_buddy_icons_cancel_load(gpointer key, gpointer value, gpointer data)
+{
+	GSList *tasks = value;
+
+	while (tasks != NULL) {
+		g_task_return_new_error(tasks->data, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+		                        "Buddy icons are shutting down");
+		g_object_unref(tasks->data);
+		tasks = g_slist_delete_link(tasks, tasks);
+	}
+
+	return TRUE;
+}
+
 void
 purple_buddy_icons_init()
 {
@@ -1134,6 +1593,8 @@ purple_buddy_icons_init()
 	icon_file_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
 	                                        g_free, NULL);
 	pointer_icon_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pointer_icon_images = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pending_loads = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	if (!cache_dir)
 		cache_dir = g_build_filename(purple_cache_dir(), "icons", NULL);
@@ -1142,12 +1603,37 @@ purple_buddy_icons_init()
 void
 purple_buddy_icons_uninit()
 {
+	GHashTableIter iter;
+	gpointer value;
+
 	purple_signals_disconnect_by_handle(purple_buddy_icons_get_handle());
 
 	g_hash_table_destroy(account_cache);
 	g_hash_table_destroy(icon_data_cache);
 	g_hash_table_destroy(icon_file_cache);
+
+	/* The images themselves are left alone, since releasing them now could
+	 * remove their files from the on-disk cache. */
+	g_hash_table_iter_init(&iter, pointer_icon_images);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		g_slist_free(value);
+	g_hash_table_destroy(pointer_icon_images);
+	g_queue_clear(&pointer_icon_lru);
+	g_hash_table_iter_init(&iter, pointer_icon_cache);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		g_free(value);
 	g_hash_table_destroy(pointer_icon_cache);
+	pointer_icon_size = 0;
+	pointer_icon_evictions = 0;
+	icon_file_reads = 0;
+	pointer_icon_cache = NULL;
+	pointer_icon_images = NULL;
+
+	/* Reads that are still going see that this is gone and finish on their
+	 * own, so the tasks just need to be told. */
+	g_hash_table_foreach_steal(pending_loads, purple_buddy_icons_cancel_load,
+	                           NULL);
+	g_clear_pointer(&pending_loads, g_hash_table_destroy);
 	g_free(cache_dir);
 
 	cache_dir = NULL;
@@ -92,6 +92,28 @@ struct _PurpleBuddyIconSpec {
 	PurpleBuddyIconScaleFlags scale_rules;
 };
 
+/**
+ * PurpleBuddyIconsCacheStats:
+ * @entries: The number of buddy icons, custom buddy icons and account icons
+ *           in the cache.
+ * @images: The number of distinct images they use.
+ * @bytes_held: The size of the images in the cache.
+ * @evictions: How many times an icon was released to stay within the budget.
+ * @file_reads: How many times an icon was read from the on-disk cache.
+ *
+ * Statistics for the in-memory buddy icon cache, see
+ * purple_buddy_icons_get_cache_stats().
+ *
+ * Since: 3.0.0
+ */
+typedef struct {
+	guint entries;
+	guint images;
+	gsize bytes_held;
+	guint64 evictions;
+	guint64 file_reads;
+} PurpleBuddyIconsCacheStats;
+
 G_BEGIN_DECLS
 
 /**************************************************************************/
@@ -220,6 +242,9 @@ const char *purple_buddy_icon_get_checksum(const PurpleBuddyIcon *icon);
  *
  * Returns the buddy icon's data.
  *
+ * The data stays in memory for as long as @icon is alive, so
+ * purple_buddy_icon_get_stream() should be preferred.
+ *
  * Returns: A pointer to the icon data.
  */
 gconstpointer purple_buddy_icon_get_data(const PurpleBuddyIcon *icon, size_t *len);
@@ -312,6 +337,43 @@ purple_buddy_icons_get_checksum_for_user(PurpleBuddy *buddy);
 PurpleBuddyIcon *
 purple_buddy_icons_find(PurpleAccount *account, const char *username);
 
+/**
+ * purple_buddy_icons_find_async:
+ * @account:     The account the user is on.
+ * @username:    The username of the user.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback:    (scope async): The callback to call with the icon.
+ * @data:        User data to pass to @callback.
+ *
+ * Like purple_buddy_icons_find(), but reads the icon from the on-disk cache
+ * without blocking if it isn't in memory yet.
+ *
+ * Once the icon has been read, it's set on the buddy, so anything that's
+ * showing a placeholder can also wait for #PurpleBuddy:icon to change
+ * instead of passing a @callback.
+ *
+ * Since: 3.0.0
+ */
+void
+purple_buddy_icons_find_async(PurpleAccount *account, const char *username,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback, gpointer data);
+
+/**
+ * purple_buddy_icons_find_finish:
+ * @res:   The #GAsyncResult passed to the callback.
+ * @error: (out) (optional): Return location for a #GError.
+ *
+ * Finishes a call to purple_buddy_icons_find_async().
+ *
+ * Returns: The icon (with a reference for the caller) if found, or %NULL if
+ *          not found or on error.
+ *
+ * Since: 3.0.0
+ */
+PurpleBuddyIcon *
+purple_buddy_icons_find_finish(GAsyncResult *res, GError **error);
+
 /**
  * purple_buddy_icons_find_account_icon:
  * @account: The account
@@ -420,6 +482,42 @@ PurpleImage *
 purple_buddy_icons_node_set_custom_icon_from_file(PurpleBlistNode *node,
                                                   const gchar *filename);
 
+/**
+ * purple_buddy_icons_set_cache_budget:
+ * @budget: The number of bytes.
+ *
+ * Sets how much memory buddy icons and custom buddy icons can use before the
+ * least recently used ones are released. Released icons are read back from the
+ * on-disk cache the next time they're needed, so this only applies when
+ * caching is enabled. Buddy icons whose data was returned by
+ * purple_buddy_icon_get_data() stay in memory.
+ *
+ * Since: 3.0.0
+ */
+void purple_buddy_icons_set_cache_budget(gsize budget);
+
+/**
+ * purple_buddy_icons_get_cache_budget:
+ *
+ * Gets the value set by purple_buddy_icons_set_cache_budget().
+ *
+ * Returns: The number of bytes.
+ *
+ * Since: 3.0.0
+ */
+gsize purple_buddy_icons_get_cache_budget(void);
+
+/**
+ * purple_buddy_icons_get_cache_stats:
+ * @stats: (out caller-allocates): Return location for the statistics.
+ *
+ * Gets statistics for the in-memory buddy icon cache, which is bounded by
+ * purple_buddy_icons_set_cache_budget().
+ *
+ * Since: 3.0.0
+ */
+void purple_buddy_icons_get_cache_stats(PurpleBuddyIconsCacheStats *stats);
+
 /**
  * purple_buddy_icons_set_caching:
  * @caching: TRUE if buddy icon caching should be enabled, or
@@ -22,6 +22,7 @@
  */
 
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #include "internal.h"
 #include "account.h"
@@ -35,6 +36,7 @@
 #include "purpleprotocolchat.h"
 #include "purpleprotocolclient.h"
 #include "purpleconversation.h"
+#include "purplepath.h"
 #include "server.h"
 #include "signals.h"
 #include "util.h"
@@ -66,6 +68,26 @@ static GHashTable *groups_cache = NULL;
 
 static guint          save_timer = 0;
 static gboolean       blist_loaded = FALSE;
+static gboolean       blist_loading = FALSE;
+
+/*
+ * Saving the buddy list only rewrites blist.xml when its structure changed.
+ * Changes to the settings and aliases of buddies and groups, which are by far
+ * the most common, are appended to a journal instead, which is replayed over
+ * blist.xml when loading and compacted into it once it grows too large.
+ *
+ * blist.xml has a generation that's incremented every time it's written and
+ * the journal starts with the generation it applies to, so a journal left
+ * behind by a crash between writing the two is ignored.
+ */
+#define BLIST_JOURNAL_FILENAME "blist-journal.xml"
+#define BLIST_JOURNAL_MIN_ENTRIES 1000
+
+static GHashTable *journal_dirty = NULL;  /* PurpleBlistNode* set */
+static gboolean journal_full = FALSE;     /* Whether to rewrite blist.xml */
+static guint journal_entries = 0;
+static guint journal_generation = 0;
+
 static gchar *localized_default_group_name = NULL;
 
 /*********************************************************************
@@ -299,10 +321,9 @@ chat_to_xmlnode(PurpleChat *chat)
 }
 
 static PurpleXmlNode *
-group_to_xmlnode(PurpleGroup *group)
+group_settings_to_xmlnode(PurpleGroup *group)
 {
-	PurpleXmlNode *node, *child;
-	PurpleBlistNode *cnode;
+	PurpleXmlNode *node;
 
 	node = purple_xmlnode_new("group");
 	if (group != purple_blist_get_default_group())
@@ -312,6 +333,17 @@ group_to_xmlnode(PurpleGroup *group)
 	g_hash_table_foreach(purple_blist_node_get_settings(PURPLE_BLIST_NODE(group)),
 			value_to_xmlnode, node);
 
+	return node;
+}
+
+static PurpleXmlNode *
+group_to_xmlnode(PurpleGroup *group)
+{
+	PurpleXmlNode *node, *child;
+	PurpleBlistNode *cnode;
+
+	node = group_settings_to_xmlnode(group);
+
 	/* Write contacts and chats */
 	for (cnode = PURPLE_BLIST_NODE(group)->child; cnode != NULL; cnode = cnode->next)
 	{
@@ -361,15 +393,18 @@ accountprivacy_to_xmlnode(PurpleAccount *account)
 }
 
 static PurpleXmlNode *
-blist_to_xmlnode(void) {
+blist_to_xmlnode(guint generation) {
 	PurpleAccountManager *manager = purple_account_manager_get_default();
 	PurpleXmlNode *node, *child, *grandchild;
 	PurpleBlistNode *gnode;
 	GList *cur;
 	const gchar *localized_default;
+	char buf[11];
 
 	node = purple_xmlnode_new("purple");
 	purple_xmlnode_set_attrib(node, "version", "1.0");
+	g_snprintf(buf, sizeof(buf), "%u", generation);
+	purple_xmlnode_set_attrib(node, "generation", buf);
 
 	/* Write groups */
 	child = purple_xmlnode_new_child(node, "blist");
@@ -405,11 +440,132 @@ blist_to_xmlnode(void) {
 	return node;
 }
 
+static gchar *
+purple_blist_journal_path(void)
+{
+	return g_build_filename(purple_config_dir(), BLIST_JOURNAL_FILENAME, NULL);
+}
+
+/* Records are separated by newlines, so any in the data have to be escaped.
+ * Nothing else in the unformatted output can contain one.
+ */
+static void
+journal_append_record(GString *journal, PurpleXmlNode *node)
+{
+	char *record, *p;
+
+	record = purple_xmlnode_to_str(node, NULL);
+	for (p = record; *p != '\0'; p++) {
+		if (*p == '\n')
+			g_string_append(journal, "&#10;");
+		else if (*p == '\r')
+			g_string_append(journal, "&#13;");
+		else
+			g_string_append_c(journal, *p);
+	}
+	g_string_append_c(journal, '\n');
+
+	g_free(record);
+}
+
+static PurpleXmlNode *
+journal_node_to_xmlnode(PurpleBlistNode *node)
+{
+	PurpleXmlNode *xnode = NULL;
+
+	if (PURPLE_IS_BUDDY(node)) {
+		PurpleGroup *group = purple_buddy_get_group(PURPLE_BUDDY(node));
+
+		xnode = buddy_to_xmlnode(PURPLE_BUDDY(node));
+		if (group != purple_blist_get_default_group())
+			purple_xmlnode_set_attrib(xnode, "group",
+			                          purple_group_get_name(group));
+	} else if (PURPLE_IS_GROUP(node)) {
+		xnode = group_settings_to_xmlnode(PURPLE_GROUP(node));
+	}
+
+	return xnode;
+}
+
+/* Appends every dirty node to the journal. Returns FALSE if blist.xml needs
+ * to be rewritten instead, because the journal is due to be compacted or
+ * couldn't be written.
+ */
+static gboolean
+purple_blist_journal_append(void)
+{
+	PurpleBuddyListPrivate *priv =
+			purple_buddy_list_get_instance_private(purplebuddylist);
+	GHashTableIter iter;
+	GString *journal;
+	GFile *file;
+	GError *error = NULL;
+	gpointer key;
+	gchar *path;
+	guint limit, entries = 0;
+	gboolean ret;
+
+	limit = MAX(BLIST_JOURNAL_MIN_ENTRIES, g_hash_table_size(priv->buddies));
+	if (journal_entries + g_hash_table_size(journal_dirty) > limit)
+		return FALSE;
+
+	journal = g_string_new(NULL);
+	if (journal_entries == 0)
+		g_string_append_printf(journal, "<journal generation='%u'/>\n",
+		                       journal_generation);
+
+	g_hash_table_iter_init(&iter, journal_dirty);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		PurpleXmlNode *node;
+
+		if (purple_blist_node_is_transient(key))
+			continue;
+
+		node = journal_node_to_xmlnode(key);
+		journal_append_record(journal, node);
+		purple_xmlnode_free(node);
+		entries++;
+	}
+	g_hash_table_remove_all(journal_dirty);
+
+	path = purple_blist_journal_path();
+	file = g_file_new_for_path(path);
+
+	if (journal_entries == 0) {
+		ret = g_file_replace_contents(file, journal->str, journal->len,
+				NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, NULL, &error);
+	} else {
+		GFileOutputStream *stream;
+
+		stream = g_file_append_to(file, G_FILE_CREATE_PRIVATE, NULL, &error);
+		ret = stream != NULL &&
+		      g_output_stream_write_all(G_OUTPUT_STREAM(stream),
+				journal->str, journal->len, NULL, NULL, &error) &&
+		      g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, &error);
+		g_clear_object(&stream);
+	}
+
+	if (ret) {
+		journal_entries += entries;
+	} else {
+		purple_debug_error("buddylist", "Error writing %s: %s", path,
+		                   error ? error->message : "unknown error");
+		g_clear_error(&error);
+	}
+
+	g_object_unref(file);
+	g_free(path);
+	g_string_free(journal, TRUE);
+
+	return ret;
+}
+
 static void
 purple_blist_sync(void)
 {
 	PurpleXmlNode *node;
-	char *data;
+	char *data, *path;
+	guint generation;
 
 	if (!blist_loaded)
 	{
@@ -418,9 +574,27 @@ purple_blist_sync(void)
 		return;
 	}
 
-	node = blist_to_xmlnode();
+	if (!journal_full) {
+		if (g_hash_table_size(journal_dirty) == 0 ||
+		    purple_blist_journal_append())
+			return;
+	}
+
+	/* The new generation makes any journal that's left over stale. */
+	generation = journal_generation + 1;
+
+	node = blist_to_xmlnode(generation);
 	data = purple_xmlnode_to_formatted_str(node, NULL);
-	purple_util_write_data_to_config_file("blist.xml", data, -1);
+	if (purple_util_write_data_to_config_file("blist.xml", data, -1)) {
+		journal_generation = generation;
+		journal_entries = 0;
+		journal_full = FALSE;
+		g_hash_table_remove_all(journal_dirty);
+
+		path = purple_blist_journal_path();
+		g_remove(path);
+		g_free(path);
+	}
 	g_free(data);
 	purple_xmlnode_free(node);
 }
@@ -440,23 +614,55 @@ purple_blist_real_schedule_save(void)
 		save_timer = g_timeout_add_seconds(5, save_cb, NULL);
 }
 
+/* Called for anything the journal can't record, which means blist.xml has to
+ * be rewritten. */
+static void
+purple_blist_journal_invalidate(void)
+{
+	if (blist_loading)
+		return;
+
+	journal_full = TRUE;
+	if (journal_dirty != NULL)
+		g_hash_table_remove_all(journal_dirty);
+}
+
 static void
 purple_blist_real_save_account(PurpleBuddyList *list, PurpleAccount *account)
 {
-#if 1
+	if (blist_loading)
+		return;
+
+	/* Privacy settings and account names are only in blist.xml. */
+	purple_blist_journal_invalidate();
 	purple_blist_real_schedule_save();
-#else
-	if (account != NULL) {
-		/* Save the buddies and privacy data for this account */
-	} else {
-		/* Save all buddies and privacy data */
-	}
-#endif
 }
 
 static void
 purple_blist_real_save_node(PurpleBuddyList *list, PurpleBlistNode *node)
 {
+	if (blist_loading)
+		return;
+
+	if (!journal_full) {
+		if (PURPLE_IS_BUDDY(node) || PURPLE_IS_GROUP(node)) {
+			if (!g_hash_table_contains(journal_dirty, node))
+				g_hash_table_add(journal_dirty, g_object_ref(node));
+		} else {
+			purple_blist_journal_invalidate();
+		}
+	}
+
+	purple_blist_real_schedule_save();
+}
+
+static void
+purple_blist_real_remove_node(PurpleBuddyList *list, PurpleBlistNode *node)
+{
+	if (blist_loading)
+		return;
+
+	purple_blist_journal_invalidate();
 	purple_blist_real_schedule_save();
 }
 
@@ -646,11 +852,152 @@ parse_group(PurpleXmlNode *groupnode)
 	}
 }
 
+static void
+parse_journal_settings(PurpleBlistNode *node, PurpleXmlNode *xnode)
+{
+	PurpleXmlNode *x;
+
+	/* Records have every setting the node had, so anything missing from one
+	 * was removed after blist.xml was written. */
+	g_hash_table_remove_all(purple_blist_node_get_settings(node));
+
+	for (x = purple_xmlnode_get_child(xnode, "setting"); x;
+	     x = purple_xmlnode_get_next_twin(x))
+	{
+		parse_setting(node, x);
+	}
+}
+
+static gboolean
+parse_journal_buddy(PurpleXmlNode *bnode)
+{
+	PurpleAccountManager *manager = purple_account_manager_get_default();
+	PurpleAccount *account;
+	PurpleGroup *group;
+	PurpleBuddy *buddy;
+	PurpleXmlNode *x;
+	const char *acct_name, *proto;
+	char *name = NULL, *alias = NULL;
+
+	acct_name = purple_xmlnode_get_attrib(bnode, "account");
+	proto = purple_xmlnode_get_attrib(bnode, "proto");
+	if (!acct_name || !proto)
+		return FALSE;
+
+	if ((x = purple_xmlnode_get_child(bnode, "name")))
+		name = purple_xmlnode_get_data(x);
+	if (!name)
+		return FALSE;
+
+	/* Buddies on accounts that have since been removed are skipped like they
+	 * are in blist.xml. */
+	account = purple_account_manager_find(manager, acct_name, proto);
+	group = purple_blist_find_group(purple_xmlnode_get_attrib(bnode, "group"));
+	if (!account || !group) {
+		g_free(name);
+		return TRUE;
+	}
+
+	buddy = purple_blist_find_buddy_in_group(account, name, group);
+	g_free(name);
+	if (!buddy)
+		return TRUE;
+
+	if ((x = purple_xmlnode_get_child(bnode, "alias")))
+		alias = purple_xmlnode_get_data(x);
+	if (!purple_strequal(alias, purple_buddy_get_local_alias(buddy)))
+		purple_buddy_set_local_alias(buddy, alias);
+	g_free(alias);
+
+	parse_journal_settings(PURPLE_BLIST_NODE(buddy), bnode);
+
+	return TRUE;
+}
+
+/* Replays the journal over what was just read from blist.xml. Any problem
+ * with it means blist.xml has to be rewritten, which also removes it.
+ */
+static void
+load_blist_journal(void)
+{
+	PurpleXmlNode *header;
+	GError *error = NULL;
+	gchar *path, *contents = NULL;
+	gchar **lines;
+	const char *generation;
+	guint i;
+
+	journal_entries = 0;
+
+	path = purple_blist_journal_path();
+	if (!g_file_get_contents(path, &contents, NULL, &error)) {
+		if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			purple_debug_error("buddylist", "Error reading %s: %s", path,
+			                   error->message);
+			journal_full = TRUE;
+		}
+		g_clear_error(&error);
+		g_free(path);
+		return;
+	}
+	g_free(path);
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	header = lines[0] ? purple_xmlnode_from_str(lines[0], -1) : NULL;
+	generation = header ? purple_xmlnode_get_attrib(header, "generation") : NULL;
+	if (!header || !purple_strequal(header->name, "journal") ||
+	    generation == NULL ||
+	    strtoul(generation, NULL, 10) != journal_generation)
+	{
+		purple_debug_warning("buddylist", "Ignoring stale buddy list journal");
+		journal_full = TRUE;
+	}
+	purple_xmlnode_free(header);
+
+	for (i = 1; !journal_full && lines[i] != NULL; i++) {
+		PurpleXmlNode *record;
+		gboolean ok = FALSE;
+
+		if (*lines[i] == '\0')
+			continue;
+
+		record = purple_xmlnode_from_str(lines[i], -1);
+		if (record == NULL) {
+			/* Most likely a partial write when we crashed. */
+			ok = FALSE;
+		} else if (purple_strequal(record->name, "buddy")) {
+			ok = parse_journal_buddy(record);
+		} else if (purple_strequal(record->name, "group")) {
+			PurpleGroup *group = purple_blist_find_group(
+				purple_xmlnode_get_attrib(record, "name"));
+
+			if (group)
+				parse_journal_settings(PURPLE_BLIST_NODE(group), record);
+			ok = TRUE;
+		}
+		purple_xmlnode_free(record);
+
+		if (!ok) {
+			purple_debug_warning("buddylist",
+			                     "Stopped replaying buddy list journal at "
+			                     "record %u", i);
+			journal_full = TRUE;
+		} else {
+			journal_entries++;
+		}
+	}
+
+	g_strfreev(lines);
+}
+
 static void
 load_blist(void)
 {
 	PurpleAccountManager *manager = NULL;
 	PurpleXmlNode *purple, *blist, *privacy;
+	const char *generation;
 
 	blist_loaded = TRUE;
 
@@ -660,6 +1007,11 @@ load_blist(void)
 		return;
 	}
 
+	blist_loading = TRUE;
+
+	generation = purple_xmlnode_get_attrib(purple, "generation");
+	journal_generation = generation ? strtoul(generation, NULL, 10) : 0;
+
 	manager = purple_account_manager_get_default();
 
 	blist = purple_xmlnode_get_child(purple, "blist");
@@ -726,6 +1078,13 @@ load_blist(void)
 
 	purple_xmlnode_free(purple);
 
+	load_blist_journal();
+
+	blist_loading = FALSE;
+
+	if (journal_full)
+		purple_blist_real_schedule_save();
+
 	/* This tells the buddy icon code to do its thing. */
 	_purple_buddy_icons_blist_loaded_cb();
 }
@@ -754,6 +1113,9 @@ purple_blist_boot(void)
 
 	groups_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
+	journal_dirty = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+	                                      g_object_unref, NULL);
+
 	manager = purple_account_manager_get_default();
 	for(l = purple_account_manager_get_all(manager); l != NULL; l = l->next) {
 		purple_blist_buddies_cache_add_account(PURPLE_ACCOUNT(l->data));
@@ -848,6 +1210,9 @@ void purple_blist_update_buddies_cache(PurpleBuddy *buddy, const char *new_name)
 
 	g_return_if_fail(PURPLE_IS_BUDDY(buddy));
 
+	/* Journal records find buddies by name, so renames need blist.xml. */
+	purple_blist_journal_invalidate();
+
 	account = purple_buddy_get_account(buddy);
 	name = (gchar *)purple_buddy_get_name(buddy);
 
@@ -875,6 +1240,8 @@ void purple_blist_update_groups_cache(PurpleGroup *group, const char *new_name)
 {
 		gchar* key;
 
+		purple_blist_journal_invalidate();
+
 		key = purple_blist_fold_name(purple_group_get_name(group));
 		g_hash_table_remove(groups_cache, key);
 		g_free(key);
@@ -893,6 +1260,8 @@ void purple_blist_add_chat(PurpleChat *chat, PurpleGroup *group, PurpleBlistNode
 	g_return_if_fail(PURPLE_IS_BUDDY_LIST(purplebuddylist));
 	klass = PURPLE_BUDDY_LIST_GET_CLASS(purplebuddylist);
 
+	purple_blist_journal_invalidate();
+
 	if (node == NULL) {
 		if (group == NULL)
 			group = purple_group_new(_("Chats"));
@@ -996,6 +1365,8 @@ void purple_blist_add_buddy(PurpleBuddy *buddy, PurpleContact *contact, PurpleGr
 	g_return_if_fail(PURPLE_IS_BUDDY_LIST(purplebuddylist));
 	g_return_if_fail(PURPLE_IS_BUDDY(buddy));
 
+	purple_blist_journal_invalidate();
+
 	klass = PURPLE_BUDDY_LIST_GET_CLASS(purplebuddylist);
 	priv = purple_buddy_list_get_instance_private(purplebuddylist);
 	bnode = PURPLE_BLIST_NODE(buddy);
@@ -1164,6 +1535,8 @@ void purple_blist_add_contact(PurpleContact *contact, PurpleGroup *group, Purple
 	if (PURPLE_BLIST_NODE(contact) == node)
 		return;
 
+	purple_blist_journal_invalidate();
+
 	klass = PURPLE_BUDDY_LIST_GET_CLASS(purplebuddylist);
 	priv = purple_buddy_list_get_instance_private(purplebuddylist);
 
@@ -1320,6 +1693,8 @@ void purple_blist_add_group(PurpleGroup *group, PurpleBlistNode *node)
 	klass = PURPLE_BUDDY_LIST_GET_CLASS(purplebuddylist);
 	priv = purple_buddy_list_get_instance_private(purplebuddylist);
 
+	purple_blist_journal_invalidate();
+
 	/* if we're moving to overtop of ourselves, do nothing */
 	if (gnode == node) {
 		if (!priv->root) {
@@ -2253,6 +2628,10 @@ purple_blist_uninit(void)
 	buddies_cache = NULL;
 	groups_cache = NULL;
 
+	g_clear_pointer(&journal_dirty, g_hash_table_destroy);
+	journal_full = FALSE;
+	journal_entries = 0;
+
 	g_clear_object(&purplebuddylist);
 
 	g_free(localized_default_group_name);
@@ -2310,6 +2689,6 @@ static void purple_buddy_list_class_init(PurpleBuddyListClass *klass)
 	obj_class->finalize = purple_buddy_list_finalize;
 
 	klass->save_node = purple_blist_real_save_node;
-	klass->remove_node = purple_blist_real_save_node;
+	klass->remove_node = purple_blist_real_remove_node;
 	klass->save_account = purple_blist_real_save_account;
 }
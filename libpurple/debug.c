@@ -20,6 +20,8 @@
  * along with this program; if not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include "debug.h"
 #include "prefs.h"
 
@@ -31,15 +33,194 @@
 static gboolean debug_verbose = FALSE;
 static gboolean debug_unsafe = FALSE;
 
+/*
+ * The enable table. Each category that has been logged to maps to a mask of
+ * its enabled levels, with DEBUG_MASK_OVERRIDDEN set if the mask was set for
+ * that category specifically rather than following debug_default_mask.
+ * Messages are logged from other threads too, so this is behind a lock.
+ *
+ * debug_any_mask is every level that is enabled anywhere, so that checks for
+ * levels that are off everywhere can skip the lock and the table.
+ */
+#define DEBUG_MASK_ALL ((1u << (PURPLE_DEBUG_FATAL + 1)) - (1u << PURPLE_DEBUG_MISC))
+#define DEBUG_MASK_OVERRIDDEN (1u << 31)
+
+static GRWLock debug_lock;
+static GHashTable *debug_categories = NULL;
+static guint debug_default_mask = DEBUG_MASK_ALL;
+static guint debug_any_mask = DEBUG_MASK_ALL;
+
+static guint
+purple_debug_level_mask(PurpleDebugLevel level) {
+	if(level == PURPLE_DEBUG_ALL) {
+		return DEBUG_MASK_ALL;
+	}
+
+	return 1u << level;
+}
+
+/* Must be called with the writer lock held. */
+static void
+purple_debug_update_any_mask(void) {
+	guint mask = debug_default_mask;
+
+	if(debug_categories != NULL) {
+		GHashTableIter iter;
+		gpointer value = NULL;
+
+		g_hash_table_iter_init(&iter, debug_categories);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			if((GPOINTER_TO_UINT(value) & DEBUG_MASK_OVERRIDDEN) != 0) {
+				mask |= GPOINTER_TO_UINT(value);
+			}
+		}
+	}
+
+	g_atomic_int_set(&debug_any_mask, mask & ~DEBUG_MASK_OVERRIDDEN);
+}
+
+gboolean
+purple_debug_is_enabled(PurpleDebugLevel level, const gchar *category) {
+	gpointer value = NULL;
+	guint mask = 0;
+	gboolean found = FALSE;
+
+	/* Nothing wants this level, whatever the category. */
+	if((g_atomic_int_get(&debug_any_mask) &
+	    purple_debug_level_mask(level)) == 0)
+	{
+		return FALSE;
+	}
+
+	if(category == NULL || *category == '\0') {
+		return (g_atomic_int_get(&debug_default_mask) &
+		        purple_debug_level_mask(level)) != 0;
+	}
+
+	g_rw_lock_reader_lock(&debug_lock);
+	if(debug_categories != NULL) {
+		found = g_hash_table_lookup_extended(debug_categories, category, NULL,
+		                                     &value);
+	}
+	g_rw_lock_reader_unlock(&debug_lock);
+
+	if(found) {
+		mask = GPOINTER_TO_UINT(value);
+	}
+
+	if(!found) {
+		/* First time we've seen this category, remember it so that UIs can
+		 * list it.
+		 */
+		g_rw_lock_writer_lock(&debug_lock);
+		if(debug_categories == NULL) {
+			debug_categories = g_hash_table_new_full(g_str_hash, g_str_equal,
+			                                         g_free, NULL);
+		}
+		if(!g_hash_table_contains(debug_categories, category)) {
+			g_hash_table_insert(debug_categories, g_strdup(category),
+			                    GUINT_TO_POINTER(0));
+		}
+		g_rw_lock_writer_unlock(&debug_lock);
+	}
+
+	if((mask & DEBUG_MASK_OVERRIDDEN) == 0) {
+		mask = g_atomic_int_get(&debug_default_mask);
+	}
+
+	return (mask & purple_debug_level_mask(level)) != 0;
+}
+
+void
+purple_debug_set_enabled(const gchar *category, PurpleDebugLevel level,
+                         gboolean enabled)
+{
+	guint bits = purple_debug_level_mask(level);
+	guint mask = 0;
+
+	g_rw_lock_writer_lock(&debug_lock);
+
+	if(category == NULL || *category == '\0') {
+		mask = debug_default_mask;
+		mask = enabled ? (mask | bits) : (mask & ~bits);
+		g_atomic_int_set(&debug_default_mask, mask);
+	} else {
+		gpointer value = NULL;
+
+		if(debug_categories == NULL) {
+			debug_categories = g_hash_table_new_full(g_str_hash, g_str_equal,
+			                                         g_free, NULL);
+		}
+
+		if(g_hash_table_lookup_extended(debug_categories, category, NULL,
+		                                &value) &&
+		   (GPOINTER_TO_UINT(value) & DEBUG_MASK_OVERRIDDEN) != 0)
+		{
+			mask = GPOINTER_TO_UINT(value);
+		} else {
+			mask = debug_default_mask;
+		}
+
+		mask = enabled ? (mask | bits) : (mask & ~bits);
+
+		g_hash_table_insert(debug_categories, g_strdup(category),
+		                    GUINT_TO_POINTER(mask | DEBUG_MASK_OVERRIDDEN));
+	}
+
+	purple_debug_update_any_mask();
+
+	g_rw_lock_writer_unlock(&debug_lock);
+}
+
+void
+purple_debug_reset_enabled(const gchar *category) {
+	g_return_if_fail(category != NULL);
+
+	g_rw_lock_writer_lock(&debug_lock);
+	if(debug_categories != NULL &&
+	   g_hash_table_contains(debug_categories, category))
+	{
+		g_hash_table_insert(debug_categories, g_strdup(category),
+		                    GUINT_TO_POINTER(0));
+		purple_debug_update_any_mask();
+	}
+	g_rw_lock_writer_unlock(&debug_lock);
+}
+
+GList *
+purple_debug_get_categories(void) {
+	GList *categories = NULL;
+
+	g_rw_lock_reader_lock(&debug_lock);
+	if(debug_categories != NULL) {
+		GHashTableIter iter;
+		gpointer key = NULL;
+
+		g_hash_table_iter_init(&iter, debug_categories);
+		while(g_hash_table_iter_next(&iter, &key, NULL)) {
+			categories = g_list_prepend(categories, g_strdup(key));
+		}
+	}
+	g_rw_lock_reader_unlock(&debug_lock);
+
+	return g_list_sort(categories, (GCompareFunc)g_utf8_collate);
+}
+
 static void
 purple_debug_vargs(PurpleDebugLevel level, const gchar *category,
                    const gchar *format, va_list args)
 {
 	GLogLevelFlags log_level = G_LOG_LEVEL_DEBUG;
 	gchar *msg = NULL;
+	gsize len = 0;
 
 	g_return_if_fail(format != NULL);
 
+	/* Bail before doing anything with the message if no one wants it. */
+	if(!purple_debug_is_enabled(level, category)) {
+		return;
+	}
+
 	/* GLib's debug levels are not quite the same as ours, so we need to
 	 * re-assign them. */
 	switch(level) {
@@ -62,12 +243,17 @@ purple_debug_vargs(PurpleDebugLevel level, const gchar *category,
 			g_return_if_reached();
 	}
 
-	/* strip trailing linefeeds */
-	msg = g_strdup(format);
-	g_strchomp(msg);
+	/* strip trailing linefeeds, but only copy the format if there are any */
+	len = strlen(format);
+	if(len > 0 && g_ascii_isspace(format[len - 1])) {
+		msg = g_strdup(format);
+		g_strchomp(msg);
 
-	g_logv(category, log_level, msg, args);
-	g_free(msg);
+		g_logv(category, log_level, msg, args);
+		g_free(msg);
+	} else {
+		g_logv(category, log_level, format, args);
+	}
 }
 
 void
@@ -143,6 +143,70 @@ void purple_debug_error(const gchar *category, const gchar *format, ...) G_GNUC_
  */
 void purple_debug_fatal(const gchar *category, const gchar *format, ...) G_GNUC_PRINTF(2, 3);
 
+/**
+ * PURPLE_DEBUG_LAZY:
+ * @level: The debug level.
+ * @category: The category (or %NULL).
+ * @...: The format string followed by the parameters to insert into it.
+ *
+ * Like purple_debug(), but the parameters are only evaluated if @level is
+ * enabled for @category. Use this when building the parameters is expensive,
+ * such as serializing a stanza.
+ */
+#define PURPLE_DEBUG_LAZY(level, category, ...) G_STMT_START { \
+	if(purple_debug_is_enabled((level), (category))) { \
+		purple_debug((level), (category), __VA_ARGS__); \
+	} \
+} G_STMT_END
+
+/**
+ * purple_debug_is_enabled:
+ * @level: The debug level, or %PURPLE_DEBUG_ALL for any level.
+ * @category: The category (or %NULL).
+ *
+ * Checks whether messages at @level for @category will be logged, so callers
+ * can skip building debug output that would be thrown away.
+ *
+ * If @level is disabled for every category, this returns straight away.
+ * Otherwise @category is looked up in a table behind a read-write lock. The
+ * first time a category is seen, its name is copied into the table so that
+ * purple_debug_get_categories() can list it.
+ *
+ * Returns: %TRUE if @level is enabled for @category.
+ */
+gboolean purple_debug_is_enabled(PurpleDebugLevel level, const gchar *category);
+
+/**
+ * purple_debug_set_enabled:
+ * @category: The category, or %NULL to change the default.
+ * @level: The debug level, or %PURPLE_DEBUG_ALL for every level.
+ * @enabled: Whether messages at @level should be logged.
+ *
+ * Enables or disables logging at @level for @category. Categories that have
+ * not been changed individually follow the default, which starts with every
+ * level enabled.
+ */
+void purple_debug_set_enabled(const gchar *category, PurpleDebugLevel level, gboolean enabled);
+
+/**
+ * purple_debug_reset_enabled:
+ * @category: The category.
+ *
+ * Forgets any changes made to @category with purple_debug_set_enabled() so
+ * that it follows the default again.
+ */
+void purple_debug_reset_enabled(const gchar *category);
+
+/**
+ * purple_debug_get_categories:
+ *
+ * Gets the names of all the categories that have been logged to or
+ * configured so far, sorted for display.
+ *
+ * Returns: (transfer full) (element-type utf8): The category names.
+ */
+GList *purple_debug_get_categories(void);
+
 /**
  * purple_debug_set_verbose:
  * @verbose: %TRUE to enable verbose debugging or %FALSE to disable it.
@@ -19,33 +19,139 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02111-1301 USA
  */
 
+#include "internal.h"
+
 #include "image-store.h"
 
+#include "debug.h"
 #include "eventloop.h"
+#include "purplepath.h"
+#include "purpleprivate.h"
 #include "util.h"
 
 #define TEMP_IMAGE_TIMEOUT 5
 
+/* The default for purple_image_store_set_budget(). */
+#define DEFAULT_BUDGET (32 * 1024 * 1024)
+
+/*
+ * Images added with purple_image_store_add() and
+ * purple_image_store_add_temporary() are deduplicated by their contents, so
+ * the same sticker posted in a dozen rooms is only held once.
+ *
+ * Once the images the store holds take up more than the budget, the least
+ * recently used permanent images are written to the spill directory in a
+ * worker thread and dropped from memory once that's done. Their contents are
+ * mapped back in when they're next used. Images that purple_image_get_data()
+ * has handed out a pointer for are never dropped, since there's no telling
+ * when the caller is done with it.
+ */
+typedef struct {
+	guint id;
+
+	/* The content hash, for images that are deduplicated. */
+	gchar *hash;
+
+	gboolean permanent;
+	guint temp_handle;
+
+	/* Set for permanent images that are in memory. */
+	GList *lru_link;
+
+	gsize size;
+	gboolean counted;
+	gchar *spill_path;
+
+	/* Whether it's being written out to be dropped. */
+	gboolean spilling;
+} PurpleImageStoreEntry;
+
 static GHashTable *id_to_image = NULL;
 static guint last_id = 0;
 
+/* keys: content hash, values: PurpleImage */
+static GHashTable *hash_to_image = NULL;
+
 /* keys: timeout handle */
 static GHashTable *temp_images = NULL;
 
 /* keys: img id */
 static GSList *perm_images = NULL;
 
+/* PurpleImages, most recently used first */
+static GQueue lru = G_QUEUE_INIT;
+
+static gsize budget = DEFAULT_BUDGET;
+static gchar *spill_dir = NULL;
+static PurpleImageStoreStats stats;
+
+/* The size of the images that are being written out. */
+static gsize bytes_spilling = 0;
+
+static PurpleImageStoreEntry *
+image_get_entry(PurpleImage *image)
+{
+	return g_object_get_data(G_OBJECT(image), "purple-image-store-entry");
+}
+
+static guint
+image_get_id(PurpleImage *image)
+{
+	PurpleImageStoreEntry *entry = image_get_entry(image);
+
+	return entry ? entry->id : 0;
+}
+
+/* Keeps the stats in line with whether the store is holding entry's image in
+ * memory. */
+static void
+image_update_stats(PurpleImage *image, PurpleImageStoreEntry *entry)
+{
+	gboolean held = entry->permanent || entry->temp_handle != 0;
+	gboolean spilled = held && _purple_image_is_spilled(image);
+	gboolean counted = held && !spilled;
+
+	if (entry->counted && !counted) {
+		stats.bytes_held -= entry->size;
+	} else if (!entry->counted && counted) {
+		stats.bytes_held += entry->size;
+	}
+	entry->counted = counted;
+}
+
 static void
-image_reset_id(gpointer _id)
+image_entry_free(gpointer data)
 {
+	PurpleImageStoreEntry *entry = data;
+
 	g_return_if_fail(id_to_image != NULL);
 
-	g_hash_table_remove(id_to_image, _id);
+	g_hash_table_remove(id_to_image, GINT_TO_POINTER(entry->id));
+
+	if (entry->hash != NULL) {
+		g_hash_table_remove(hash_to_image, entry->hash);
+	}
+
+	if (entry->counted) {
+		stats.bytes_held -= entry->size;
+	}
+
+	if (entry->spill_path != NULL) {
+		g_remove(entry->spill_path);
+		stats.spill_files--;
+		stats.bytes_spilled -= entry->size;
+	}
+
+	g_free(entry->hash);
+	g_free(entry->spill_path);
+	g_free(entry);
 }
 
-static guint
+static PurpleImageStoreEntry *
 image_set_id(PurpleImage *image)
 {
+	PurpleImageStoreEntry *entry = NULL;
+
 	/* Use the next unused id number. We do it in a loop on the off chance
 	 * that next id wraps back around to 0 and the hash table still contains
 	 * entries from the first time around.
@@ -60,60 +166,202 @@ image_set_id(PurpleImage *image)
 			break;
 	}
 
-	g_object_set_data_full(G_OBJECT(image), "purple-image-store-id",
-		GINT_TO_POINTER(last_id), image_reset_id);
+	entry = g_new0(PurpleImageStoreEntry, 1);
+	entry->id = last_id;
+	entry->size = purple_image_get_data_size(image);
+
+	g_object_set_data_full(G_OBJECT(image), "purple-image-store-entry",
+		entry, image_entry_free);
 	g_hash_table_insert(id_to_image, GINT_TO_POINTER(last_id), image);
-	return last_id;
+	return entry;
 }
 
-static guint
-image_get_id(PurpleImage *image)
+/* Returns the image that's already stored with the same contents as image,
+ * or sets image up to be found for them. */
+static PurpleImage *
+image_deduplicate(PurpleImage *image, PurpleImageStoreEntry *entry)
+{
+	PurpleImage *existing;
+	const gchar *hash;
+
+	stats.adds++;
+
+	hash = purple_image_generate_filename(image);
+	if (hash == NULL)
+		return NULL;
+
+	existing = g_hash_table_lookup(hash_to_image, hash);
+	if (existing != NULL) {
+		stats.hits++;
+		return existing;
+	}
+
+	entry->hash = g_strdup(hash);
+	g_hash_table_insert(hash_to_image, entry->hash, image);
+
+	return NULL;
+}
+
+static const gchar *
+image_get_spill_dir(void)
 {
-	return GPOINTER_TO_INT(g_object_get_data(G_OBJECT(image),
-		"purple-image-store-id"));
+	/* The directory is created by the worker thread. */
+	if (spill_dir == NULL)
+		spill_dir = g_build_filename(purple_cache_dir(), "image-store", NULL);
+
+	return spill_dir;
 }
 
-guint
-purple_image_store_add(PurpleImage *image)
+/* Whether the image is still the one the store has for the entry, since
+ * the store may have been shut down while it was being written. */
+static gboolean
+image_is_stored(PurpleImage *image, PurpleImageStoreEntry *entry)
 {
-	guint id;
+	return id_to_image != NULL && entry != NULL &&
+	       g_hash_table_lookup(id_to_image,
+	                           GINT_TO_POINTER(entry->id)) == image;
+}
 
-	g_return_val_if_fail(PURPLE_IS_IMAGE(image), 0);
+static void
+image_spill_cb(GObject *source, GAsyncResult *result, gpointer data)
+{
+	PurpleImage *image = PURPLE_IMAGE(source);
+	PurpleImageStoreEntry *entry = image_get_entry(image);
+	GError *error = NULL;
+	gchar *path = data;
+	gboolean written;
+
+	written = _purple_image_spill_finish(image, result, &error);
+	if (!written) {
+		purple_debug_error("image-store", "failed to spill to %s: %s",
+		                   path, error->message);
+		g_clear_error(&error);
+	}
 
-	id = image_get_id(image);
-	if (id > 0)
-		return id;
+	if (!image_is_stored(image, entry)) {
+		/* A file the entry knows about is removed along with it. */
+		if (written && entry != NULL && entry->spill_path == NULL)
+			g_remove(path);
+		g_free(path);
+		return;
+	}
 
-	id = image_set_id(image);
+	if (written && entry->spill_path == NULL) {
+		entry->spill_path = g_strdup(path);
+		stats.spill_files++;
+		stats.bytes_spilled += entry->size;
+	}
+	g_free(path);
 
-	g_object_ref(image);
-	perm_images = g_slist_prepend(perm_images, image);
+	/* It was used while it was being written, so it stays, but the file is
+	 * kept for next time. */
+	if (!entry->spilling)
+		return;
 
-	return id;
+	entry->spilling = FALSE;
+	bytes_spilling -= entry->size;
+
+	if (written && _purple_image_drop_contents(image, entry->spill_path)) {
+		g_queue_delete_link(&lru, entry->lru_link);
+		entry->lru_link = NULL;
+		image_update_stats(image, entry);
+	}
 }
 
-guint
-purple_image_store_add_weak(PurpleImage *image)
+static void
+image_spill(PurpleImage *image, PurpleImageStoreEntry *entry)
 {
-	guint id;
+	gchar *path = NULL;
+
+	/* The file is kept when the image is read back, so spilling it again
+	 * doesn't write anything. */
+	if (entry->spill_path != NULL) {
+		path = g_strdup(entry->spill_path);
+	} else {
+		path = g_build_filename(image_get_spill_dir(),
+		                        purple_image_generate_filename(image), NULL);
+	}
 
-	g_return_val_if_fail(PURPLE_IS_IMAGE(image), 0);
+	entry->spilling = TRUE;
+	bytes_spilling += entry->size;
 
-	id = image_get_id(image);
-	if (id > 0)
-		return id;
+	_purple_image_spill_async(image, path, image_spill_cb, path);
+}
+
+static void
+image_evict(void)
+{
+	GList *link = lru.tail;
+
+	while (stats.bytes_held - bytes_spilling > budget && link != NULL &&
+	       link != lru.head)
+	{
+		PurpleImage *image = link->data;
+		PurpleImageStoreEntry *entry = image_get_entry(image);
+
+		if (!entry->spilling && !_purple_image_is_borrowed(image))
+			image_spill(image, entry);
+
+		link = link->prev;
+	}
+}
+
+/* Moves the image to the front of the least recently used list, reading it
+ * back in if it was spilled. */
+static void
+image_touch(PurpleImage *image, PurpleImageStoreEntry *entry)
+{
+	if (entry->spilling) {
+		entry->spilling = FALSE;
+		bytes_spilling -= entry->size;
+	}
+
+	if (entry->lru_link != NULL) {
+		g_queue_unlink(&lru, entry->lru_link);
+		g_queue_push_head_link(&lru, entry->lru_link);
+		return;
+	}
+
+	if (_purple_image_is_spilled(image))
+		return;
 
-	return image_set_id(image);
+	stats.reloads++;
+	g_queue_push_head(&lru, image);
+	entry->lru_link = lru.head;
+	image_update_stats(image, entry);
+	image_evict();
+}
+
+static void
+image_hold_permanent(PurpleImage *image, PurpleImageStoreEntry *entry)
+{
+	if (entry->permanent)
+		return;
+
+	entry->permanent = TRUE;
+
+	g_object_ref(image);
+	perm_images = g_slist_prepend(perm_images, image);
+
+	g_queue_push_head(&lru, image);
+	entry->lru_link = lru.head;
+
+	stats.images++;
+	image_update_stats(image, entry);
+	image_evict();
 }
 
 static gboolean
 remove_temporary(gpointer _image)
 {
 	PurpleImage *image = _image;
-	guint handle;
+	PurpleImageStoreEntry *entry = image_get_entry(image);
+	guint handle = entry->temp_handle;
 
-	handle = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(image),
-		"purple-image-store-handle"));
+	entry->temp_handle = 0;
+	if (!entry->permanent)
+		stats.images--;
+	image_update_stats(image, entry);
 
 	g_hash_table_remove(temp_images, GINT_TO_POINTER(handle));
 
@@ -121,40 +369,120 @@ remove_temporary(gpointer _image)
 }
 
 static void
-cancel_temporary(gpointer key, gpointer value, gpointer _unused)
+image_hold_temporary(PurpleImage *image, PurpleImageStoreEntry *entry)
 {
-	g_source_remove(GPOINTER_TO_INT(key));
+	/* XXX: add_temporary doesn't extend previous temporary call, sorry */
+	if (entry->permanent || entry->temp_handle != 0)
+		return;
+
+	g_object_ref(image);
+	entry->temp_handle = g_timeout_add_seconds(TEMP_IMAGE_TIMEOUT,
+		remove_temporary, image);
+	g_hash_table_insert(temp_images, GINT_TO_POINTER(entry->temp_handle),
+		image);
+
+	stats.images++;
+	image_update_stats(image, entry);
 }
 
 guint
-purple_image_store_add_temporary(PurpleImage *image)
+purple_image_store_add(PurpleImage *image)
+{
+	PurpleImageStoreEntry *entry;
+	PurpleImage *existing;
+
+	g_return_val_if_fail(PURPLE_IS_IMAGE(image), 0);
+
+	entry = image_get_entry(image);
+	if (entry != NULL)
+		return entry->id;
+
+	entry = image_set_id(image);
+
+	existing = image_deduplicate(image, entry);
+	if (existing != NULL) {
+		PurpleImageStoreEntry *existing_entry = image_get_entry(existing);
+
+		/* image doesn't need its own id after all. */
+		g_object_set_data(G_OBJECT(image), "purple-image-store-entry", NULL);
+
+		image_hold_permanent(existing, existing_entry);
+
+		return existing_entry->id;
+	}
+
+	image_hold_permanent(image, entry);
+
+	return entry->id;
+}
+
+guint
+purple_image_store_add_weak(PurpleImage *image)
 {
 	guint id;
-	guint handle;
 
 	g_return_val_if_fail(PURPLE_IS_IMAGE(image), 0);
 
 	id = image_get_id(image);
-	/* XXX: add_temporary doesn't extend previous temporary call, sorry */
 	if (id > 0)
 		return id;
 
-	id = image_set_id(image);
+	return image_set_id(image)->id;
+}
 
-	g_object_ref(image);
-	handle = g_timeout_add_seconds(TEMP_IMAGE_TIMEOUT,
-		remove_temporary, image);
-	g_object_set_data(G_OBJECT(image), "purple-image-store-handle",
-		GINT_TO_POINTER(handle));
-	g_hash_table_insert(temp_images, GINT_TO_POINTER(handle), image);
+static void
+cancel_temporary(gpointer key, gpointer value, gpointer _unused)
+{
+	g_source_remove(GPOINTER_TO_INT(key));
+}
+
+guint
+purple_image_store_add_temporary(PurpleImage *image)
+{
+	PurpleImageStoreEntry *entry;
+	PurpleImage *existing;
+
+	g_return_val_if_fail(PURPLE_IS_IMAGE(image), 0);
+
+	entry = image_get_entry(image);
+	/* XXX: add_temporary doesn't extend previous temporary call, sorry */
+	if (entry != NULL)
+		return entry->id;
+
+	entry = image_set_id(image);
 
-	return id;
+	existing = image_deduplicate(image, entry);
+	if (existing != NULL) {
+		PurpleImageStoreEntry *existing_entry = image_get_entry(existing);
+
+		g_object_set_data(G_OBJECT(image), "purple-image-store-entry", NULL);
+
+		image_hold_temporary(existing, existing_entry);
+
+		return existing_entry->id;
+	}
+
+	image_hold_temporary(image, entry);
+
+	return entry->id;
 }
 
 PurpleImage *
 purple_image_store_get(guint id)
 {
-	return g_hash_table_lookup(id_to_image, GINT_TO_POINTER(id));
+	PurpleImage *image;
+	PurpleImageStoreEntry *entry;
+
+	image = g_hash_table_lookup(id_to_image, GINT_TO_POINTER(id));
+	if (image == NULL)
+		return NULL;
+
+	/* A spilled image is only read back once its contents are used. */
+	entry = image_get_entry(image);
+	if (entry->permanent)
+		image_touch(image, entry);
+
+	return image;
 }
 
 /* TODO: handle PURPLE_IMAGE_STORE_STOCK_PROTOCOL */
@@ -208,17 +536,57 @@ purple_image_store_get_uri(PurpleImage *image)
 	return g_strdup_printf(PURPLE_IMAGE_STORE_PROTOCOL "%u", img_id);
 }
 
+void
+purple_image_store_set_budget(gsize bytes)
+{
+	budget = bytes;
+
+	if (id_to_image != NULL)
+		image_evict();
+}
+
+gsize
+purple_image_store_get_budget(void)
+{
+	return budget;
+}
+
+void
+purple_image_store_get_stats(PurpleImageStoreStats *image_stats)
+{
+	g_return_if_fail(image_stats != NULL);
+
+	*image_stats = stats;
+}
+
+void
+_purple_image_store_touch(PurpleImage *image)
+{
+	PurpleImageStoreEntry *entry = image_get_entry(image);
+
+	if (!image_is_stored(image, entry) || !entry->permanent)
+		return;
+
+	image_touch(image, entry);
+}
+
 void
 _purple_image_store_init(void)
 {
 	id_to_image = g_hash_table_new(g_direct_hash, g_direct_equal);
+	hash_to_image = g_hash_table_new(g_str_hash, g_str_equal);
 	temp_images = g_hash_table_new_full(g_direct_hash, g_direct_equal,
 		NULL, g_object_unref);
+
+	memset(&stats, 0, sizeof(stats));
+	bytes_spilling = 0;
 }
 
 void
 _purple_image_store_uninit(void)
 {
+	g_queue_clear(&lru);
+
 	g_slist_free_full(perm_images, g_object_unref);
 	perm_images = NULL;
 
@@ -226,6 +594,14 @@ _purple_image_store_uninit(void)
 	g_hash_table_destroy(temp_images);
 	temp_images = NULL;
 
+	g_hash_table_destroy(hash_to_image);
+	hash_to_image = NULL;
+
 	g_hash_table_destroy(id_to_image);
 	id_to_image = NULL;
+
+	if (spill_dir != NULL) {
+		g_rmdir(spill_dir);
+		g_clear_pointer(&spill_dir, g_free);
+	}
 }
@@ -57,12 +57,41 @@
 
 G_BEGIN_DECLS
 
+/**
+ * PurpleImageStoreStats:
+ * @adds: The number of images added with purple_image_store_add() or
+ *        purple_image_store_add_temporary().
+ * @hits: How many of @adds were already in the store with the same contents.
+ * @images: The number of images the store is holding a reference to.
+ * @bytes_held: The size of the images the store is holding that are in
+ *              memory.
+ * @reloads: How many times an image had to be read back from the spill
+ *           directory.
+ * @spill_files: The number of images that have been written to the spill
+ *               directory.
+ * @bytes_spilled: The size of the images in the spill directory.
+ *
+ * Statistics for the image store, see purple_image_store_get_stats().
+ *
+ * Since: 3.0.0
+ */
+typedef struct {
+	guint64 adds;
+	guint64 hits;
+	guint images;
+	gsize bytes_held;
+	guint64 reloads;
+	guint spill_files;
+	gsize bytes_spilled;
+} PurpleImageStoreStats;
+
 /**
  * purple_image_store_add:
  * @image: the image.
  *
  * Permanently adds an image to the store. If the @image is already in the
- * store, it will return its current id.
+ * store, it will return its current id. If another image with the same
+ * contents is, its id is returned and @image isn't kept.
  *
  * This function increases @image's reference count, so it won't be destroyed
  * until image store subsystem is shut down. Don't decrease @image's reference
@@ -94,6 +123,8 @@ purple_image_store_add_weak(PurpleImage *image);
  *
  * Adds an image to the store to be used in a short period of time.
  * If the @image is already in the store, it will just return its current id.
+ * Like purple_image_store_add(), an image with the same contents that's
+ * already in the store is used instead of @image.
  *
  * Increases reference count for the @image for a time long enough to display
  * the @image by the UI. In current implementation it's five seconds, but may be
@@ -146,6 +177,46 @@ purple_image_store_get_from_uri(const gchar *uri);
 gchar *
 purple_image_store_get_uri(PurpleImage *image);
 
+/**
+ * purple_image_store_set_budget:
+ * @bytes: The number of bytes.
+ *
+ * Sets how much memory the images held by the store can use. Past that, the
+ * least recently used permanent images are written to a spill directory in
+ * purple_cache_dir() and dropped from memory until their contents are next
+ * used. Images that purple_image_get_data() has been called on are never
+ * dropped, so use purple_image_get_contents() for images that don't need to
+ * stay in memory.
+ *
+ * Since: 3.0.0
+ */
+void
+purple_image_store_set_budget(gsize bytes);
+
+/**
+ * purple_image_store_get_budget:
+ *
+ * Gets the value set by purple_image_store_set_budget().
+ *
+ * Returns: The number of bytes.
+ *
+ * Since: 3.0.0
+ */
+gsize
+purple_image_store_get_budget(void);
+
+/**
+ * purple_image_store_get_stats:
+ * @stats: (out caller-allocates): Return location for the statistics.
+ *
+ * Gets statistics about the image store, such as how often added images were
+ * deduplicated and how much memory it's holding.
+ *
+ * Since: 3.0.0
+ */
+void
+purple_image_store_get_stats(PurpleImageStoreStats *stats);
+
 /**
  * _purple_image_store_init: (skip)
  *
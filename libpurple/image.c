@@ -19,10 +19,13 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111-1301  USA
  */
 
+#include <gio/gio.h>
+
 #include "internal.h"
 
 #include "debug.h"
 #include "image.h"
+#include "purpleprivate.h"
 #include "util.h"
 
 typedef struct {
@@ -30,6 +33,16 @@ typedef struct {
 
 	GBytes *contents;
 
+	/* Where the contents were written when they were dropped from memory by
+	 * _purple_image_drop_contents(). They're mapped back in from here when
+	 * next needed. */
+	gchar *spill_path;
+	gsize spill_size;
+
+	/* Whether purple_image_get_data() has handed out a pointer into the
+	 * contents, which means they can't be dropped any more. */
+	gboolean borrowed;
+
 	const gchar *extension;
 	const gchar *mime;
 	gchar *gen_filename;
@@ -70,6 +83,83 @@ _purple_image_set_contents(PurpleImage *image, GBytes *bytes) {
 	priv->contents = (bytes) ? g_bytes_ref(bytes) : NULL;
 }
 
+/* Gets the contents without telling the image store about it, mapping them
+ * back in if they were spilled. Nothing is read until the pages are touched.
+ */
+static GBytes *
+purple_image_peek_contents(PurpleImage *image) {
+	PurpleImagePrivate *priv = purple_image_get_instance_private(image);
+	GMappedFile *file = NULL;
+	GError *error = NULL;
+
+	if(priv->contents != NULL || priv->spill_path == NULL) {
+		return priv->contents;
+	}
+
+	file = g_mapped_file_new(priv->spill_path, FALSE, &error);
+	if(file == NULL) {
+		purple_debug_error("image", "failed to read back %s: %s",
+		                   priv->spill_path, error->message);
+		g_clear_error(&error);
+
+		return NULL;
+	}
+
+	priv->contents = g_mapped_file_get_bytes(file);
+	g_mapped_file_unref(file);
+
+	return priv->contents;
+}
+
+typedef struct {
+	GBytes *contents;
+	gchar *path;
+} PurpleImageSpillData;
+
+static void
+purple_image_spill_data_free(gpointer data) {
+	PurpleImageSpillData *spill = data;
+
+	g_bytes_unref(spill->contents);
+	g_free(spill->path);
+	g_free(spill);
+}
+
+static void
+purple_image_spill_thread(GTask *task, gpointer source, gpointer data,
+                          GCancellable *cancellable)
+{
+	PurpleImageSpillData *spill = data;
+	GError *error = NULL;
+	gchar *dir = NULL;
+
+	dir = g_path_get_dirname(spill->path);
+	if(g_mkdir_with_parents(dir, S_IRUSR | S_IWUSR | S_IXUSR) == -1) {
+		g_task_return_new_error(task, G_FILE_ERROR,
+		                        g_file_error_from_errno(errno),
+		                        "failed to create %s: %s", dir,
+		                        g_strerror(errno));
+		g_free(dir);
+
+		return;
+	}
+	g_free(dir);
+
+	/* The files are named after the contents, so an existing one is already
+	 * right. */
+	if(!g_file_test(spill->path, G_FILE_TEST_EXISTS) &&
+	   !g_file_set_contents(spill->path,
+	                        g_bytes_get_data(spill->contents, NULL),
+	                        g_bytes_get_size(spill->contents), &error))
+	{
+		g_task_return_error(task, error);
+
+		return;
+	}
+
+	g_task_return_boolean(task, TRUE);
+}
+
 /******************************************************************************
  * Object stuff
  ******************************************************************************/
@@ -86,6 +176,7 @@ purple_image_finalize(GObject *obj) {
 		g_bytes_unref(priv->contents);
 
 	g_free(priv->path);
+	g_free(priv->spill_path);
 	g_free(priv->gen_filename);
 	g_free(priv->friendly_filename);
 
@@ -238,6 +329,7 @@ purple_image_new_take_data(guint8 *data, gsize length) {
 gboolean
 purple_image_save(PurpleImage *image, const gchar *path) {
 	PurpleImagePrivate *priv = NULL;
+	GBytes *contents;
 	gconstpointer data;
 	gsize len;
 	gboolean succ;
@@ -247,10 +339,11 @@ purple_image_save(PurpleImage *image, const gchar *path) {
 	g_return_val_if_fail(path[0] != '\0', FALSE);
 
 	priv = purple_image_get_instance_private(image);
-	data = purple_image_get_data(image);
-	len = purple_image_get_data_size(image);
+	contents = purple_image_peek_contents(image);
+
+	g_return_val_if_fail(contents != NULL, FALSE);
 
-	g_return_val_if_fail(data != NULL, FALSE);
+	data = g_bytes_get_data(contents, &len);
 	g_return_val_if_fail(len > 0, FALSE);
 
 	succ = g_file_set_contents(path, data, len, NULL);
@@ -263,16 +356,17 @@ purple_image_save(PurpleImage *image, const gchar *path) {
 GBytes *
 purple_image_get_contents(PurpleImage *image)
 {
-	PurpleImagePrivate *priv = NULL;
+	GBytes *contents = NULL;
 
 	g_return_val_if_fail(PURPLE_IS_IMAGE(image), NULL);
 
-	priv = purple_image_get_instance_private(image);
+	contents = purple_image_peek_contents(image);
+	if(contents == NULL)
+		return NULL;
 
-	if(priv->contents)
-		return g_bytes_ref(priv->contents);
+	_purple_image_store_touch(image);
 
-	return NULL;
+	return g_bytes_ref(contents);
 }
 
 const gchar *
@@ -297,27 +391,39 @@ purple_image_get_data_size(PurpleImage *image) {
 	if(priv->contents)
 		return g_bytes_get_size(priv->contents);
 
+	/* Don't read the contents back in just for this. */
+	if(priv->spill_path)
+		return priv->spill_size;
+
 	return 0;
 }
 
 gconstpointer
 purple_image_get_data(PurpleImage *image) {
 	PurpleImagePrivate *priv = NULL;
+	GBytes *contents = NULL;
 
 	g_return_val_if_fail(PURPLE_IS_IMAGE(image), NULL);
 
 	priv = purple_image_get_instance_private(image);
 
-	if(priv->contents)
-		return g_bytes_get_data(priv->contents, NULL);
+	contents = purple_image_peek_contents(image);
+	if(contents == NULL)
+		return NULL;
 
-	return NULL;
+	/* There's no telling how long the caller will hold on to this. */
+	priv->borrowed = TRUE;
+	_purple_image_store_touch(image);
+
+	return g_bytes_get_data(contents, NULL);
 }
 
 const gchar *
 purple_image_get_extension(PurpleImage *image) {
 	PurpleImagePrivate *priv = NULL;
+	GBytes *contents;
 	gconstpointer data;
+	gsize len;
 
 	g_return_val_if_fail(PURPLE_IS_IMAGE(image), NULL);
 
@@ -326,11 +432,13 @@ purple_image_get_extension(PurpleImage *image) {
 	if (priv->extension)
 		return priv->extension;
 
-	if (purple_image_get_data_size(image) < 4)
+	contents = purple_image_peek_contents(image);
+	if (contents == NULL)
 		return NULL;
 
-	data = purple_image_get_data(image);
-	g_assert(data != NULL);
+	data = g_bytes_get_data(contents, &len);
+	if (len < 4)
+		return NULL;
 
 	if (memcmp(data, "GIF8", 4) == 0)
 		return priv->extension = "gif";
@@ -383,6 +491,7 @@ purple_image_get_mimetype(PurpleImage *image) {
 const gchar *
 purple_image_generate_filename(PurpleImage *image) {
 	PurpleImagePrivate *priv = NULL;
+	GBytes *contents;
 	gconstpointer data;
 	gsize len;
 	const gchar *ext = NULL;
@@ -396,8 +505,10 @@ purple_image_generate_filename(PurpleImage *image) {
 		return priv->gen_filename;
 
 	/* grab the image's data and size of that data */
-	data = purple_image_get_data(image);
-	len = purple_image_get_data_size(image);
+	contents = purple_image_peek_contents(image);
+	if (contents == NULL)
+		return NULL;
+	data = g_bytes_get_data(contents, &len);
 
 	/* create a checksum of it and use it as the start of our filename */
 	checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, data, len);
@@ -455,3 +566,103 @@ purple_image_get_friendly_filename(PurpleImage *image) {
 	return purple_image_generate_filename(image);
 }
  
+
+/******************************************************************************
+ * Private API
+ ******************************************************************************/
+void
+_purple_image_spill_async(PurpleImage *image, const gchar *path,
+                          GAsyncReadyCallback callback, gpointer data)
+{
+	PurpleImagePrivate *priv = NULL;
+	PurpleImageSpillData *spill = NULL;
+	GTask *task = NULL;
+
+	g_return_if_fail(PURPLE_IS_IMAGE(image));
+	g_return_if_fail(path != NULL);
+
+	priv = purple_image_get_instance_private(image);
+
+	task = g_task_new(image, NULL, callback, data);
+	g_task_set_source_tag(task, _purple_image_spill_async);
+
+	if(priv->contents == NULL) {
+		g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+		                        "image contents aren't in memory");
+		g_object_unref(task);
+
+		return;
+	}
+
+	/* These are all computed from the contents, so make sure they're cached
+	 * before they can be dropped. */
+	purple_image_generate_filename(image);
+	purple_image_get_extension(image);
+
+	spill = g_new0(PurpleImageSpillData, 1);
+	spill->contents = g_bytes_ref(priv->contents);
+	spill->path = g_strdup(path);
+	g_task_set_task_data(task, spill, purple_image_spill_data_free);
+
+	g_task_run_in_thread(task, purple_image_spill_thread);
+	g_object_unref(task);
+}
+
+gboolean
+_purple_image_spill_finish(PurpleImage *image, GAsyncResult *result,
+                           GError **error)
+{
+	g_return_val_if_fail(g_task_is_valid(result, image), FALSE);
+
+	return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+gboolean
+_purple_image_drop_contents(PurpleImage *image, const gchar *path) {
+	PurpleImagePrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_IMAGE(image), FALSE);
+	g_return_val_if_fail(path != NULL, FALSE);
+
+	priv = purple_image_get_instance_private(image);
+
+	if(priv->contents == NULL) {
+		return priv->spill_path != NULL;
+	}
+
+	if(priv->borrowed) {
+		return FALSE;
+	}
+
+	if(!purple_strequal(priv->spill_path, path)) {
+		g_free(priv->spill_path);
+		priv->spill_path = g_strdup(path);
+	}
+	priv->spill_size = g_bytes_get_size(priv->contents);
+
+	g_clear_pointer(&priv->contents, g_bytes_unref);
+
+	return TRUE;
+}
+
+gboolean
+_purple_image_is_borrowed(PurpleImage *image) {
+	PurpleImagePrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_IMAGE(image), FALSE);
+
+	priv = purple_image_get_instance_private(image);
+
+	return priv->borrowed;
+}
+
+gboolean
+_purple_image_is_spilled(PurpleImage *image) {
+	PurpleImagePrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_IMAGE(image), FALSE);
+
+	priv = purple_image_get_instance_private(image);
+
+	return priv->contents == NULL && priv->spill_path != NULL;
+}
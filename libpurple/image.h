@@ -167,6 +167,10 @@ gsize purple_image_get_data_size(PurpleImage *image);
  *
  * Returns the pointer to the buffer containing image data.
  *
+ * The data stays valid for as long as @image does, so images this is called
+ * on are never dropped from memory by the image store. Prefer
+ * purple_image_get_contents() when that's not needed.
+ *
  * Returns: (transfer none): the @image data.
  */
 gconstpointer purple_image_get_data(PurpleImage *image);
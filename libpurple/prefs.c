@@ -31,6 +31,7 @@
 #include "internal.h"
 
 #include "prefs.h"
+#include "purpleprivate.h"
 #include "debug.h"
 #include "purplepath.h"
 #include "util.h"
@@ -225,7 +226,6 @@ static void
 sync_prefs(void)
 {
 	PurpleXmlNode *node;
-	char *data;
 
 	if (!prefs_loaded)
 	{
@@ -241,10 +241,7 @@ sync_prefs(void)
 	PURPLE_PREFS_UI_OP_CALL(save);
 
 	node = prefs_to_xmlnode();
-	data = purple_xmlnode_to_formatted_str(node, NULL);
-	purple_util_write_data_to_config_file("prefs.xml", data, -1);
-	g_free(data);
-	purple_xmlnode_free(node);
+	_purple_util_write_xml_to_config_file("prefs.xml", node);
 }
 
 static gboolean
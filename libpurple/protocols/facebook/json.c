@@ -27,11 +27,20 @@
 #include "json.h"
 #include "util.h"
 
+typedef struct _FbJsonStep FbJsonStep;
 typedef struct _FbJsonValue FbJsonValue;
 
+/* A member name, or an array index when @member is NULL. */
+struct _FbJsonStep
+{
+	gchar *member;
+	guint index;
+};
+
 struct _FbJsonValue
 {
 	const gchar *expr;
+	GArray *path;
 	FbJsonType type;
 	gboolean required;
 	GValue value;
@@ -76,6 +85,10 @@ fb_json_values_dispose(GObject *obj)
 			g_value_unset(&value->value);
 		}
 
+		if (value->path != NULL) {
+			g_array_unref(value->path);
+		}
+
 		g_free(value);
 	}
 
@@ -108,6 +121,169 @@ fb_json_values_init(FbJsonValues *values)
 	priv->queue = g_queue_new();
 }
 
+static void
+fb_json_step_clear(gpointer data)
+{
+	FbJsonStep *step = data;
+
+	g_free(step->member);
+}
+
+/* Compiles the plain member and index paths, such as $.a.b[0].c, which are
+ * all the protocol uses. Anything else returns NULL and is left to #JsonPath.
+ */
+static GArray *
+fb_json_path_compile(const gchar *expr)
+{
+	const gchar *str;
+	FbJsonStep step;
+	GArray *path;
+	gchar *end;
+	gsize size;
+
+	if (expr[0] != '$') {
+		return NULL;
+	}
+
+	path = g_array_new(FALSE, FALSE, sizeof step);
+	g_array_set_clear_func(path, fb_json_step_clear);
+
+	for (str = expr + 1; *str != '\0'; ) {
+		if (*str == '.') {
+			str++;
+			size = strcspn(str, ".[");
+
+			/* Recursive descent or a wildcard. */
+			if ((size == 0) || ((size == 1) && (*str == '*'))) {
+				break;
+			}
+
+			step.member = g_strndup(str, size);
+			step.index = 0;
+			str += size;
+		} else if ((*str == '[') && g_ascii_isdigit(str[1])) {
+			step.member = NULL;
+			step.index = g_ascii_strtoull(str + 1, &end, 10);
+
+			/* Slices and sets of indices. */
+			if (*end != ']') {
+				break;
+			}
+
+			str = end + 1;
+		} else {
+			break;
+		}
+
+		g_array_append_val(path, step);
+	}
+
+	if (*str != '\0') {
+		g_array_unref(path);
+		return NULL;
+	}
+
+	return path;
+}
+
+/* Follows a compiled path. The returned #JsonNode belongs to @root. */
+static JsonNode *
+fb_json_path_get(JsonNode *root, GArray *path, const gchar *expr,
+                 GError **error)
+{
+	FbJsonStep *step;
+	JsonArray *arr;
+	JsonNode *node = root;
+	JsonObject *obj;
+	guint i;
+
+	for (i = 0; (i < path->len) && (node != NULL); i++) {
+		step = &g_array_index(path, FbJsonStep, i);
+
+		if (step->member != NULL) {
+			if (!JSON_NODE_HOLDS_OBJECT(node)) {
+				node = NULL;
+				break;
+			}
+
+			obj = json_node_get_object(node);
+			node = json_object_get_member(obj, step->member);
+		} else {
+			if (!JSON_NODE_HOLDS_ARRAY(node)) {
+				node = NULL;
+				break;
+			}
+
+			arr = json_node_get_array(node);
+
+			if (step->index >= json_array_get_length(arr)) {
+				node = NULL;
+				break;
+			}
+
+			node = json_array_get_element(arr, step->index);
+		}
+	}
+
+	if (node == NULL) {
+		g_set_error(error, FB_JSON_ERROR, FB_JSON_ERROR_NOMATCH,
+		            _("No matches for %s"), expr);
+		return NULL;
+	}
+
+	if (JSON_NODE_HOLDS_NULL(node)) {
+		g_set_error(error, FB_JSON_ERROR, FB_JSON_ERROR_NULL,
+		            _("Null value for %s"), expr);
+		return NULL;
+	}
+
+	return node;
+}
+
+/* Strings from a node that belongs to the root aren't copied, the root
+ * outlives the values read from it.
+ */
+static void
+fb_json_value_set(FbJsonValue *value, JsonNode *node, gboolean borrowed)
+{
+	if (G_VALUE_TYPE(&value->value) != value->type) {
+		if (G_IS_VALUE(&value->value)) {
+			g_value_unset(&value->value);
+		}
+
+		g_value_init(&value->value, value->type);
+	}
+
+	switch (value->type) {
+	case FB_JSON_TYPE_BOOL:
+		g_value_set_boolean(&value->value, json_node_get_boolean(node));
+		break;
+
+	case FB_JSON_TYPE_DBL:
+		g_value_set_double(&value->value, json_node_get_double(node));
+		break;
+
+	case FB_JSON_TYPE_INT:
+		g_value_set_int64(&value->value, json_node_get_int(node));
+		break;
+
+	case FB_JSON_TYPE_STR:
+		if (borrowed) {
+			g_value_set_static_string(&value->value,
+			                          json_node_get_string(node));
+		} else {
+			g_value_set_string(&value->value,
+			                   json_node_get_string(node));
+		}
+		break;
+
+	default:
+		g_value_unset(&value->value);
+		json_node_get_value(node, &value->value);
+		break;
+	}
+}
+
 GQuark
 fb_json_error_quark(void)
 {
@@ -297,6 +473,7 @@ fb_json_node_new(const gchar *data, gssize size, GError **error)
 JsonNode *
 fb_json_node_get(JsonNode *root, const gchar *expr, GError **error)
 {
+	GArray *path;
 	GError *err = NULL;
 	guint size;
 	JsonArray *rslt;
@@ -308,6 +485,14 @@ fb_json_node_get(JsonNode *root, const gchar *expr, GError **error)
 		return json_node_copy(root);
 	}
 
+	path = fb_json_path_compile(expr);
+
+	if (path != NULL) {
+		node = fb_json_path_get(root, path, expr, error);
+		g_array_unref(path);
+		return (node != NULL) ? json_node_copy(node) : NULL;
+	}
+
 	node = json_path_query(expr, root, &err);
 
 	if (err != NULL) {
@@ -473,6 +658,7 @@ fb_json_values_add(FbJsonValues *values, FbJsonType type, gboolean required,
 
 	value = g_new0(FbJsonValue, 1);
 	value->expr = expr;
+	value->path = fb_json_path_compile(expr);
 	value->type = type;
 	value->required = required;
 
@@ -555,14 +741,19 @@ fb_json_values_update(FbJsonValues *values, GError **error)
 
 	for (l = priv->queue->head; l != NULL; l = l->next) {
 		value = l->data;
-		node = fb_json_node_get(root, value->expr, &err);
 
-		if (G_IS_VALUE(&value->value)) {
-			g_value_unset(&value->value);
+		/* Optional values that are missing don't need an error. */
+		if (value->path != NULL) {
+			node = fb_json_path_get(root, value->path, value->expr,
+			                        value->required ? &err : NULL);
+		} else {
+			node = fb_json_node_get(root, value->expr, &err);
 		}
 
-		if (err != NULL) {
-			json_node_free(node);
+		if (node == NULL) {
+			if (G_IS_VALUE(&value->value)) {
+				g_value_unset(&value->value);
+			}
 
 			if (value->required) {
 				g_propagate_error(error, err);
@@ -581,12 +772,20 @@ fb_json_values_update(FbJsonValues *values, GError **error)
 			            g_type_name(value->type),
 			            g_type_name(type),
 				    value->expr);
-			json_node_free(node);
+			g_value_unset(&value->value);
+
+			if (value->path == NULL) {
+				json_node_free(node);
+			}
+
 			return FALSE;
 		}
 
-		json_node_get_value(node, &value->value);
-		json_node_free(node);
+		fb_json_value_set(value, node, value->path != NULL);
+
+		if (value->path == NULL) {
+			json_node_free(node);
+		}
 	}
 
 	priv->next = priv->queue->head;
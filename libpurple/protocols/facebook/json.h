@@ -347,7 +347,9 @@ fb_json_values_new(JsonNode *root);
  * @required: #TRUE if the node is required, otherwise #FALSE.
  * @expr: The #JsonPath expression.
  *
- * Adds a new #FbJsonValue to the #FbJsonValues.
+ * Adds a new #FbJsonValue to the #FbJsonValues. Expressions made up of
+ * only member names and array indices are compiled here, rather than
+ * being evaluated as a #JsonPath on every #fb_json_values_update().
  */
 void
 fb_json_values_add(FbJsonValues *values, FbJsonType type, gboolean required,
@@ -450,7 +452,8 @@ fb_json_values_next_int(FbJsonValues *values, gint64 defval);
  * Gets the next string value from the #FbJsonValues. Before calling
  * this function, #fb_json_values_update() must be called.
  *
- * Returns: The string value.
+ * Returns: The string value, which is valid until the next
+ *          #fb_json_values_update().
  */
 const gchar *
 fb_json_values_next_str(FbJsonValues *values, const gchar *defval);
@@ -0,0 +1,352 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include <purple.h>
+
+#include "protocols/facebook/json.h"
+
+#define TEST_FACEBOOK_JSON_THREADS (500)
+#define TEST_FACEBOOK_JSON_RUNS (20)
+
+/* The fields the thread list callback in api.c reads from each thread. */
+static const struct {
+	FbJsonType type;
+	const gchar *expr;
+} test_facebook_json_fields[] = {
+	{FB_JSON_TYPE_INT, "$.unread_count"},
+	{FB_JSON_TYPE_STR, "$.thread_key.thread_fbid"},
+	{FB_JSON_TYPE_STR, "$.thread_key.other_user_id"},
+	{FB_JSON_TYPE_STR, "$.name"},
+	{FB_JSON_TYPE_STR, "$.thread_image.uri"},
+	{FB_JSON_TYPE_STR, "$.messages.nodes[0].message_sender.messaging_actor.id"},
+	{FB_JSON_TYPE_STR, "$.messages.nodes[0].message.text"},
+	{FB_JSON_TYPE_STR, "$.messages.nodes[0].timestamp_precise"},
+	{FB_JSON_TYPE_BOOL, "$.messages.nodes[0].unread"},
+};
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+
+/* Builds a response shaped like the thread list query that api.c makes, with
+ * some of the optional fields missing or null like they are in practice.
+ */
+static JsonNode *
+test_facebook_json_threads_new(guint count) {
+	GError *error = NULL;
+	GString *str = g_string_new("{\"viewer\":{\"message_threads\":{"
+	                            "\"sync_sequence_id\":\"1234\","
+	                            "\"unread_count\":3,\"nodes\":[");
+	JsonNode *root = NULL;
+
+	for(guint i = 0; i < count; i++) {
+		g_string_append_printf(str,
+			"%s{\"thread_key\":{\"thread_fbid\":%s,"
+			"\"other_user_id\":%s},"
+			"\"name\":%s,\"unread_count\":%u,\"thread_image\":%s,"
+			"\"messages\":{\"nodes\":[{\"message_sender\":"
+			"{\"messaging_actor\":{\"id\":\"%u\"}},"
+			"\"message\":{\"text\":\"message %u\"},"
+			"\"timestamp_precise\":\"1600000000%03u\","
+			"\"unread\":%s,\"sticker\":null}]}}",
+			(i > 0) ? "," : "",
+			(i % 4 == 0) ? "\"1000\"" : "null",
+			(i % 4 == 0) ? "null" : "\"2000\"",
+			(i % 4 == 0) ? "\"group\"" : "null",
+			i % 3,
+			(i % 2 == 0) ? "{\"uri\":\"https://example.com/a.png\"}" : "null",
+			100000 + i, i, i % 1000,
+			(i % 3 == 0) ? "true" : "false");
+	}
+
+	g_string_append(str, "]}}}");
+
+	root = fb_json_node_new(str->str, str->len, &error);
+	g_assert_no_error(error);
+	g_string_free(str, TRUE);
+
+	return root;
+}
+
+/* What fb_json_values_update used to do for every field. */
+static gboolean
+test_facebook_json_query(JsonNode *root, const gchar *expr, GValue *value) {
+	JsonArray *rslt;
+	JsonNode *node, *match;
+
+	node = json_path_query(expr, root, NULL);
+	rslt = json_node_get_array(node);
+
+	if(json_array_get_length(rslt) != 1 ||
+	   json_array_get_null_element(rslt, 0))
+	{
+		json_node_free(node);
+		return FALSE;
+	}
+
+	match = json_array_dup_element(rslt, 0);
+	json_node_get_value(match, value);
+
+	json_node_free(match);
+	json_node_free(node);
+
+	return TRUE;
+}
+
+static FbJsonValues *
+test_facebook_json_values_new(JsonNode *root) {
+	FbJsonValues *values = fb_json_values_new(root);
+
+	for(gsize i = 0; i < G_N_ELEMENTS(test_facebook_json_fields); i++) {
+		fb_json_values_add(values, test_facebook_json_fields[i].type, FALSE,
+		                   test_facebook_json_fields[i].expr);
+	}
+	fb_json_values_set_array(values, FALSE, "$.viewer.message_threads.nodes");
+
+	return values;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_facebook_json_node_get(void) {
+	const gchar *exprs[] = {
+		"$.viewer.message_threads.sync_sequence_id",
+		"$.viewer.message_threads.nodes[1].thread_key.other_user_id",
+		"$.viewer.message_threads.nodes[2].messages.nodes[0].message.text",
+	};
+	GError *error = NULL;
+	JsonNode *root = test_facebook_json_threads_new(3);
+	JsonNode *node = NULL;
+	gchar *str = NULL;
+
+	/* The compiled paths find the same values as JsonPath. */
+	for(gsize i = 0; i < G_N_ELEMENTS(exprs); i++) {
+		GValue value = G_VALUE_INIT;
+
+		g_assert_true(test_facebook_json_query(root, exprs[i], &value));
+
+		str = fb_json_node_get_str(root, exprs[i], &error);
+		g_assert_no_error(error);
+		g_assert_cmpstr(str, ==, g_value_get_string(&value));
+
+		g_free(str);
+		g_value_unset(&value);
+	}
+
+	g_assert_cmpint(fb_json_node_get_int(root,
+	                "$.viewer.message_threads.unread_count", &error), ==, 3);
+	g_assert_no_error(error);
+
+	/* Missing members, indices past the end and null values. */
+	node = fb_json_node_get(root, "$.viewer.missing", &error);
+	g_assert_error(error, FB_JSON_ERROR, FB_JSON_ERROR_NOMATCH);
+	g_assert_null(node);
+	g_clear_error(&error);
+
+	node = fb_json_node_get(root, "$.viewer.message_threads.nodes[3]", &error);
+	g_assert_error(error, FB_JSON_ERROR, FB_JSON_ERROR_NOMATCH);
+	g_assert_null(node);
+	g_clear_error(&error);
+
+	node = fb_json_node_get(root, "$.viewer.message_threads.unread_count.x",
+	                        &error);
+	g_assert_error(error, FB_JSON_ERROR, FB_JSON_ERROR_NOMATCH);
+	g_assert_null(node);
+	g_clear_error(&error);
+
+	node = fb_json_node_get(root, "$.viewer.message_threads.nodes[1].name",
+	                        &error);
+	g_assert_error(error, FB_JSON_ERROR, FB_JSON_ERROR_NULL);
+	g_assert_null(node);
+	g_clear_error(&error);
+
+	/* Anything else is still a JsonPath. */
+	node = fb_json_node_get(root, "$..sync_sequence_id", &error);
+	g_assert_no_error(error);
+	g_assert_cmpstr(json_node_get_string(node), ==, "1234");
+	json_node_free(node);
+
+	node = fb_json_node_get(root, "$..thread_key", &error);
+	g_assert_error(error, FB_JSON_ERROR, FB_JSON_ERROR_AMBIGUOUS);
+	g_assert_null(node);
+	g_clear_error(&error);
+
+	json_node_free(root);
+}
+
+static void
+test_facebook_json_values(void) {
+	FbJsonValues *values = NULL;
+	GError *error = NULL;
+	JsonNode *root = test_facebook_json_threads_new(8);
+	guint count = 0;
+
+	values = test_facebook_json_values_new(root);
+
+	while(fb_json_values_update(values, &error)) {
+		gchar *expected = NULL;
+
+		g_assert_cmpint(fb_json_values_next_int(values, -1), ==, count % 3);
+
+		if(count % 4 == 0) {
+			g_assert_cmpstr(fb_json_values_next_str(values, NULL), ==,
+			                "1000");
+			g_assert_null(fb_json_values_next_str(values, NULL));
+			g_assert_cmpstr(fb_json_values_next_str(values, NULL), ==,
+			                "group");
+		} else {
+			g_assert_null(fb_json_values_next_str(values, NULL));
+			g_assert_cmpstr(fb_json_values_next_str(values, NULL), ==,
+			                "2000");
+			g_assert_cmpstr(fb_json_values_next_str(values, "none"), ==,
+			                "none");
+		}
+
+		if(count % 2 == 0) {
+			g_assert_nonnull(fb_json_values_next_str(values, NULL));
+		} else {
+			g_assert_null(fb_json_values_next_str(values, NULL));
+		}
+
+		expected = g_strdup_printf("%u", 100000 + count);
+		g_assert_cmpstr(fb_json_values_next_str(values, NULL), ==, expected);
+		g_free(expected);
+
+		expected = g_strdup_printf("message %u", count);
+		g_assert_cmpstr(fb_json_values_next_str(values, NULL), ==, expected);
+		g_free(expected);
+
+		g_assert_nonnull(fb_json_values_next_str(values, NULL));
+		g_assert_cmpint(fb_json_values_next_bool(values, FALSE), ==,
+		                count % 3 == 0);
+
+		count++;
+	}
+
+	g_assert_no_error(error);
+	g_assert_cmpuint(count, ==, 8);
+	g_object_unref(values);
+
+	/* Required values have to be there and be the right type. */
+	values = fb_json_values_new(root);
+	fb_json_values_add(values, FB_JSON_TYPE_STR, TRUE, "$.name");
+	fb_json_values_set_array(values, TRUE, "$.viewer.message_threads.nodes");
+
+	g_assert_true(fb_json_values_update(values, &error));
+	g_assert_no_error(error);
+	g_assert_false(fb_json_values_update(values, &error));
+	g_assert_error(error, FB_JSON_ERROR, FB_JSON_ERROR_NULL);
+	g_clear_error(&error);
+	g_object_unref(values);
+
+	values = fb_json_values_new(root);
+	fb_json_values_add(values, FB_JSON_TYPE_STR, TRUE,
+	                   "$.viewer.message_threads.unread_count");
+
+	g_assert_false(fb_json_values_update(values, &error));
+	g_assert_error(error, FB_JSON_ERROR, FB_JSON_ERROR_TYPE);
+	g_clear_error(&error);
+	g_object_unref(values);
+
+	json_node_free(root);
+}
+
+static void
+test_facebook_json_perf_threads(void) {
+	JsonNode *root = NULL;
+	JsonArray *nodes = NULL;
+	GTimer *timer = NULL;
+	gdouble query_time, values_time;
+	guint query_found = 0, values_found = 0;
+
+	root = test_facebook_json_threads_new(TEST_FACEBOOK_JSON_THREADS);
+	nodes = fb_json_node_get_arr(root, "$.viewer.message_threads.nodes", NULL);
+	timer = g_timer_new();
+
+	/* Every field of every thread through JsonPath, like it used to be. */
+	g_timer_start(timer);
+	for(guint run = 0; run < TEST_FACEBOOK_JSON_RUNS; run++) {
+		for(guint i = 0; i < json_array_get_length(nodes); i++) {
+			JsonNode *node = json_array_get_element(nodes, i);
+
+			for(gsize j = 0; j < G_N_ELEMENTS(test_facebook_json_fields); j++) {
+				GValue value = G_VALUE_INIT;
+
+				if(test_facebook_json_query(node,
+				                            test_facebook_json_fields[j].expr,
+				                            &value))
+				{
+					query_found++;
+					g_value_unset(&value);
+				}
+			}
+		}
+	}
+	query_time = g_timer_elapsed(timer, NULL);
+
+	/* The same fields through FbJsonValues. */
+	g_timer_start(timer);
+	for(guint run = 0; run < TEST_FACEBOOK_JSON_RUNS; run++) {
+		FbJsonValues *values = test_facebook_json_values_new(root);
+
+		while(fb_json_values_update(values, NULL)) {
+			for(gsize j = 0; j < G_N_ELEMENTS(test_facebook_json_fields); j++) {
+				if(fb_json_values_next(values) != NULL) {
+					values_found++;
+				}
+			}
+		}
+
+		g_object_unref(values);
+	}
+	values_time = g_timer_elapsed(timer, NULL);
+
+	g_assert_cmpuint(values_found, ==, query_found);
+
+	g_test_message("%u threads, %u runs: JsonPath %.3fs, FbJsonValues %.3fs",
+	               TEST_FACEBOOK_JSON_THREADS, TEST_FACEBOOK_JSON_RUNS,
+	               query_time, values_time);
+	g_test_minimized_result(values_time, "FbJsonValues %.3fs", values_time);
+
+	g_timer_destroy(timer);
+	json_array_unref(nodes);
+	json_node_free(root);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/facebook/json/node-get", test_facebook_json_node_get);
+	g_test_add_func("/facebook/json/values", test_facebook_json_values);
+
+	if(g_test_perf()) {
+		g_test_add_func("/facebook/json/perf/threads",
+		                test_facebook_json_perf_threads);
+	}
+
+	return g_test_run();
+}
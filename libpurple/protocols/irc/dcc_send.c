@@ -207,25 +207,6 @@ static void irc_dccsend_send_read(gpointer data, int source, PurpleInputConditio
 	}
 }
 
-static gssize irc_dccsend_send_write(PurpleXfer *xfer, const guchar *buffer, size_t size)
-{
-	gssize s;
-	gssize ret;
-
-	s = MIN((gssize)purple_xfer_get_bytes_remaining(xfer), (gssize)size);
-	if (!s) {
-		return 0;
-	}
-
-	ret = PURPLE_XFER_CLASS(irc_xfer_parent_class)->write(xfer, buffer, s);
-
-	if (ret < 0 && errno == EAGAIN) {
-		ret = 0;
-	}
-
-	return ret;
-}
-
 static void
 irc_dccsend_send_connected(GSocketService *service,
                            GSocketConnection *connection,
@@ -402,7 +383,6 @@ irc_xfer_class_init(IrcXferClass *klass) {
 
 	xfer_class->init = irc_dccsend_init;
 	xfer_class->ack = irc_dccsend_recv_ack;
-	xfer_class->write = irc_dccsend_send_write;
 }
 
 void
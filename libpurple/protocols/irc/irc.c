@@ -50,6 +50,7 @@ static void irc_close(PurpleConnection *gc);
 static int irc_im_send(PurpleProtocolIM *im, PurpleConnection *gc, PurpleMessage *msg);
 static int irc_chat_send(PurpleProtocolChat *protocol_chat, PurpleConnection *gc, int id, PurpleMessage *msg);
 static void irc_chat_join(PurpleProtocolChat *protocol_chat, PurpleConnection *gc, GHashTable *data);
+static void irc_read_input(PurpleConnection *gc);
 static void irc_read_input_cb(GObject *source, GAsyncResult *res, gpointer data);
 
 static guint irc_nick_hash(const char *nick);
@@ -277,7 +278,9 @@ int irc_send_len(struct irc_conn *irc, const char *buf, int buflen)
 	if (tosend == NULL)
 		return 0;
 
-	if (purple_debug_is_verbose()) {
+	if (purple_debug_is_verbose() &&
+	    purple_debug_is_enabled(PURPLE_DEBUG_MISC, "irc"))
+	{
 		gchar *clean = g_utf8_make_valid(tosend, -1);
 		clean = g_strstrip(clean);
 		purple_debug_misc("irc", "<< %s\n", clean);
@@ -634,12 +637,11 @@ irc_login_cb(GObject *source, GAsyncResult *res, gpointer user_data)
 			g_io_stream_get_output_stream(G_IO_STREAM(irc->conn)));
 
 	if (do_login(gc)) {
-		irc->input = g_data_input_stream_new(
-				g_io_stream_get_input_stream(
-						G_IO_STREAM(irc->conn)));
-		g_data_input_stream_read_line_async(irc->input,
-				G_PRIORITY_DEFAULT, irc->cancellable,
-				irc_read_input_cb, gc);
+		irc->input = g_object_ref(g_io_stream_get_input_stream(
+				G_IO_STREAM(irc->conn)));
+		irc->inbuf = g_malloc(IRC_MAX_BUFSIZE);
+		irc->inbufused = 0;
+		irc_read_input(gc);
 	}
 }
 
@@ -664,9 +666,13 @@ static void irc_close(PurpleConnection *gc)
 				G_OUTPUT_STREAM(irc->output));
 	}
 
+	if (irc->input_idle)
+		g_source_remove(irc->input_idle);
+
 	g_clear_object(&irc->input);
 	g_clear_object(&irc->output);
 	g_clear_object(&irc->conn);
+	g_free(irc->inbuf);
 
 	if (irc->timer)
 		g_source_remove(irc->timer);
@@ -675,6 +681,8 @@ static void irc_close(PurpleConnection *gc)
 	g_hash_table_destroy(irc->buddies);
 	if (irc->motd)
 		g_string_free(irc->motd, TRUE);
+	if (irc->names)
+		g_ptr_array_free(irc->names, TRUE);
 	g_free(irc->server);
 
 	g_free(irc->mode_chars);
@@ -789,24 +797,88 @@ irc_remove_buddy(PurpleProtocolServer *protocol_server, PurpleConnection *gc,
 	}
 }
 
+static void
+irc_read_line_cb(gpointer data, char *line, gsize len)
+{
+	struct irc_conn *irc = data;
+	gsize start = 0;
+
+	/* This is a hack to work around the fact that marv gets messages
+	 * with null bytes in them while using some weird irc server at work
+ 	 */
+	while (start < len && line[start] == '\0')
+		++start;
+
+	if (start < len) {
+		irc_parse_msg(irc, line + start);
+	}
+}
+
+/* Parses the lines that have been read so far, up to
+ * IRC_MAX_LINES_PER_ITERATION of them.  Returns TRUE if there are complete
+ * lines left over for another iteration.
+ */
+static gboolean
+irc_process_input(struct irc_conn *irc)
+{
+	gsize used;
+
+	used = irc_parse_lines(irc->inbuf, irc->inbufused,
+	                       IRC_MAX_LINES_PER_ITERATION, irc_read_line_cb, irc);
+
+	irc->inbufused -= used;
+	memmove(irc->inbuf, irc->inbuf + used, irc->inbufused);
+
+	return memchr(irc->inbuf, '\n', irc->inbufused) != NULL;
+}
+
+static gboolean
+irc_process_input_idle(gpointer data)
+{
+	PurpleConnection *gc = data;
+	struct irc_conn *irc = purple_connection_get_protocol_data(gc);
+
+	if (irc_process_input(irc))
+		return G_SOURCE_CONTINUE;
+
+	irc->input_idle = 0;
+	irc_read_input(gc);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+irc_read_input(PurpleConnection *gc)
+{
+	struct irc_conn *irc = purple_connection_get_protocol_data(gc);
+
+	if (irc->inbufused == IRC_MAX_BUFSIZE) {
+		purple_connection_error(gc, PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
+		                        _("Received a line that was too long"));
+		return;
+	}
+
+	g_input_stream_read_async(irc->input, irc->inbuf + irc->inbufused,
+	                          IRC_MAX_BUFSIZE - irc->inbufused,
+	                          G_PRIORITY_DEFAULT, irc->cancellable,
+	                          irc_read_input_cb, gc);
+}
+
 static void
 irc_read_input_cb(GObject *source, GAsyncResult *res, gpointer data)
 {
 	PurpleConnection *gc = data;
 	struct irc_conn *irc;
-	gchar *line;
-	gsize len;
-	gsize start = 0;
+	gssize len;
 	GError *error = NULL;
 
-	line = g_data_input_stream_read_line_finish(
-			G_DATA_INPUT_STREAM(source), res, &len, &error);
+	len = g_input_stream_read_finish(G_INPUT_STREAM(source), res, &error);
 
-	if (line == NULL && error != NULL) {
+	if (len < 0) {
 		g_prefix_error(&error, "%s", _("Lost connection with server: "));
 		purple_connection_take_error(gc, error);
 		return;
-	} else if (line == NULL) {
+	} else if (len == 0) {
 		purple_connection_take_error(gc, g_error_new_literal(
 			PURPLE_CONNECTION_ERROR,
 			PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
@@ -818,24 +890,17 @@ irc_read_input_cb(GObject *source, GAsyncResult *res, gpointer data)
 
 	purple_connection_update_last_received(gc);
 
-	if (len > 0 && line[len - 1] == '\r')
-		line[len - 1] = '\0';
+	irc->inbufused += len;
 
-	/* This is a hack to work around the fact that marv gets messages
-	 * with null bytes in them while using some weird irc server at work
- 	 */
-	while (start < len && line[start] == '\0')
-		++start;
-
-	if (start < len) {
-		irc_parse_msg(irc, line + start);
+	/* Everything that's already here is handled in one go, but if that's a
+	 * lot, the rest waits for an idle callback so the UI gets a chance to
+	 * update in between.
+	 */
+	if (irc_process_input(irc)) {
+		irc->input_idle = g_idle_add(irc_process_input_idle, gc);
+	} else {
+		irc_read_input(gc);
 	}
-
-	g_free(line);
-
-	g_data_input_stream_read_line_async(irc->input,
-			G_PRIORITY_DEFAULT, irc->cancellable,
-			irc_read_input_cb, gc);
 }
 
 static void
@@ -957,6 +1022,38 @@ static void irc_buddy_free(struct irc_buddy *ib)
 	g_free(ib);
 }
 
+/* Nicks are compared with the rfc1459 case mapping, which is what servers use
+ * unless they say otherwise, so that doesn't need a collation key.
+ */
+static gchar *
+irc_chat_get_user_key(PurpleProtocolChat *protocol_chat, const gchar *who)
+{
+	gchar *key = g_strdup(who);
+	gchar *p;
+
+	for (p = key; *p != '\0'; p++) {
+		switch (*p) {
+			case '[':
+				*p = '{';
+				break;
+			case ']':
+				*p = '}';
+				break;
+			case '\\':
+				*p = '|';
+				break;
+			case '~':
+				*p = '^';
+				break;
+			default:
+				*p = g_ascii_tolower(*p);
+				break;
+		}
+	}
+
+	return key;
+}
+
 static void
 irc_chat_set_topic(PurpleProtocolChat *protocol_chat, PurpleConnection *gc,
                    gint id, const gchar *topic)
@@ -1109,6 +1206,7 @@ irc_protocol_chat_iface_init(PurpleProtocolChatInterface *chat_iface)
 	chat_iface->leave         = irc_chat_leave;
 	chat_iface->send          = irc_chat_send;
 	chat_iface->set_topic     = irc_chat_set_topic;
+	chat_iface->get_user_key  = irc_chat_get_user_key;
 }
 
 static void
@@ -50,6 +50,9 @@ G_DECLARE_FINAL_TYPE(IRCProtocol, irc_protocol, IRC, PROTOCOL, PurpleProtocol)
 
 #define IRC_MAX_MSG_SIZE 512
 
+/* How many lines are parsed before returning to the main loop. */
+#define IRC_MAX_LINES_PER_ITERATION 256
+
 #define IRC_NAMES_FLAG "irc-namelist"
 
 enum { IRC_USEROPT_SERVER, IRC_USEROPT_PORT, IRC_USEROPT_CHARSET };
@@ -68,11 +71,14 @@ struct irc_conn {
 	gboolean ison_outstanding;
 	GList *buddies_outstanding;
 
-	GDataInputStream *input;
+	GInputStream *input;
+	char *inbuf;
+	gsize inbufused;
+	guint input_idle;
 	PurpleQueuedOutputStream *output;
 
 	GString *motd;
-	GString *names;
+	GPtrArray *names;
 	struct _whois {
 		char *nick;
 		char *real;
@@ -115,6 +121,7 @@ struct irc_buddy {
 };
 
 typedef int (*IRCCmdCallback) (struct irc_conn *irc, const char *cmd, const char *target, const char **args);
+typedef void (*IRCLineCallback) (gpointer data, char *line, gsize len);
 
 int irc_send(struct irc_conn *irc, const char *buf);
 int irc_send_len(struct irc_conn *irc, const char *buf, int len);
@@ -135,6 +142,7 @@ void irc_register_commands(void);
 void irc_unregister_commands(void);
 void irc_msg_table_build(struct irc_conn *irc);
 void irc_parse_msg(struct irc_conn *irc, char *input);
+gsize irc_parse_lines(char *buf, gsize len, guint max_lines, IRCLineCallback callback, gpointer data);
 char *irc_parse_ctcp(struct irc_conn *irc, const char *from, const char *to, const char *msg, int notice);
 char *irc_format(struct irc_conn *irc, const char *format, ...);
 
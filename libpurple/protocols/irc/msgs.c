@@ -679,37 +679,46 @@ void irc_msg_unknown(struct irc_conn *irc, const char *name, const char *from, c
 
 void irc_msg_names(struct irc_conn *irc, const char *name, const char *from, char **args)
 {
-	char *names, *cur, *end, *tmp, *msg;
+	GPtrArray *names;
+	char *msg;
 
 	if (purple_strequal(name, "366")) {
 		PurpleConversation *convo;
 		PurpleConversationManager *manager;
 
+		names = irc->names;
+		irc->names = NULL;
+
 		manager = purple_conversation_manager_get_default();
 		convo = purple_conversation_manager_find(manager, irc->account,
 		                                         args[1]);
 		if (!convo) {
 			purple_debug_error("irc", "Got a NAMES list for %s, which doesn't exist", args[1]);
-			g_string_free(irc->names, TRUE);
-			irc->names = NULL;
+			if (names)
+				g_ptr_array_free(names, TRUE);
 			return;
 		}
 
-		names = cur = g_string_free(irc->names, FALSE);
-		irc->names = NULL;
 		if (g_object_get_data(G_OBJECT(convo), IRC_NAMES_FLAG)) {
-			msg = g_strdup_printf(_("Users on %s: %s"), args[1], names ? names : "");
+			char *list = NULL;
+
+			if (names) {
+				g_ptr_array_add(names, NULL);
+				list = g_strjoinv(" ", (char **)names->pdata);
+			}
+			msg = g_strdup_printf(_("Users on %s: %s"), args[1], list ? list : "");
 			purple_conversation_write_system_message(convo, msg, PURPLE_MESSAGE_NO_LOG);
 			g_free(msg);
-		} else if (cur != NULL) {
-			GList *users = NULL;
-			GList *flags = NULL;
-
-			while (*cur) {
+			g_free(list);
+		} else if (names != NULL) {
+			const char **users = g_new(const char *, names->len);
+			PurpleChatUserFlags *flags = g_new(PurpleChatUserFlags, names->len);
+			guint i;
+
+			for (i = 0; i < names->len; i++) {
+				char *cur = g_ptr_array_index(names, i);
 				PurpleChatUserFlags f = PURPLE_CHAT_USER_NONE;
-				end = strchr(cur, ' ');
-				if (!end)
-					end = cur + strlen(cur);
+
 				if (*cur == '@') {
 					f = PURPLE_CHAT_USER_OP;
 					cur++;
@@ -725,32 +734,42 @@ void irc_msg_names(struct irc_conn *irc, const char *name, const char *from, cha
 						f = PURPLE_CHAT_USER_FOUNDER;
 					cur++;
 				}
-				tmp = g_strndup(cur, end - cur);
-				users = g_list_prepend(users, tmp);
-				flags = g_list_prepend(flags, GINT_TO_POINTER(f));
-				cur = end;
-				if (*cur)
-					cur++;
+				users[i] = cur;
+				flags[i] = f;
 			}
 
-			if (users != NULL) {
-				purple_chat_conversation_add_users(PURPLE_CHAT_CONVERSATION(convo), users, NULL, flags, FALSE);
+			/* Large channels send thousands of names, so they're added
+			 * all at once rather than one join at a time.
+			 */
+			purple_chat_conversation_add_users_bulk(PURPLE_CHAT_CONVERSATION(convo),
+			                                        users, flags, names->len);
 
-				g_list_free_full(users, g_free);
-				g_list_free(flags);
-			}
+			g_free(users);
+			g_free(flags);
 
 			g_object_set_data(G_OBJECT(convo), IRC_NAMES_FLAG,
 						   GINT_TO_POINTER(TRUE));
 		}
-		g_free(names);
+		if (names)
+			g_ptr_array_free(names, TRUE);
 	} else {
-		if (!irc->names)
-			irc->names = g_string_new("");
+		char **tokens;
+		int i;
 
-		if (irc->names->len && irc->names->str[irc->names->len - 1] != ' ')
-			irc->names = g_string_append_c(irc->names, ' ');
-		irc->names = g_string_append(irc->names, args[3]);
+		if (!irc->names)
+			irc->names = g_ptr_array_new_with_free_func(g_free);
+
+		/* Split each reply as it arrives instead of joining them all and
+		 * splitting the result when the list ends.
+		 */
+		tokens = g_strsplit(args[3], " ", -1);
+		for (i = 0; tokens[i]; i++) {
+			if (*tokens[i])
+				g_ptr_array_add(irc->names, tokens[i]);
+			else
+				g_free(tokens[i]);
+		}
+		g_free(tokens);
 	}
 }
 
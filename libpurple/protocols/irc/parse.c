@@ -670,6 +670,35 @@ char *irc_format(struct irc_conn *irc, const char *format, ...)
 	return (g_string_free(string, FALSE));
 }
 
+/*
+ * Calls callback for each complete line in buf, terminating them in place so
+ * nothing has to be copied.  At most max_lines lines are handled, or all of
+ * them if it's 0.  Returns how many bytes of buf were used up.
+ */
+gsize irc_parse_lines(char *buf, gsize len, guint max_lines,
+                      IRCLineCallback callback, gpointer data)
+{
+	char *cur = buf, *end = buf + len, *eol;
+	guint lines = 0;
+
+	while (cur < end && (max_lines == 0 || lines < max_lines) &&
+	       (eol = memchr(cur, '\n', end - cur)) != NULL)
+	{
+		gsize line_len = eol - cur;
+
+		*eol = '\0';
+		if (line_len > 0 && cur[line_len - 1] == '\r')
+			cur[--line_len] = '\0';
+
+		callback(data, cur, line_len);
+
+		cur = eol + 1;
+		lines++;
+	}
+
+	return cur - buf;
+}
+
 void irc_parse_msg(struct irc_conn *irc, char *input)
 {
 	struct _irc_msg *msgent;
@@ -688,7 +717,9 @@ void irc_parse_msg(struct irc_conn *irc, char *input)
 	 */
 	purple_signal_emit(_irc_protocol, "irc-receiving-text", gc, &input);
 
-	if (purple_debug_is_verbose()) {
+	if (purple_debug_is_verbose() &&
+	    purple_debug_is_enabled(PURPLE_DEBUG_MISC, "irc"))
+	{
 		char *clean = g_utf8_make_valid(input, -1);
 		clean = g_strstrip(clean);
 		purple_debug_misc("irc", ">> %s\n", clean);
@@ -0,0 +1,172 @@
+#include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include <purple.h>
+
+#include "protocols/irc/irc.h"
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static void
+test_irc_parse_lines_collect(gpointer data, char *line, gsize len) {
+	GPtrArray *lines = data;
+
+	g_assert_cmpuint(strlen(line), ==, len);
+
+	g_ptr_array_add(lines, g_strdup(line));
+}
+
+static void
+test_irc_parse_lines_count(gpointer data, char *line, gsize len) {
+	guint *count = data;
+
+	/* Look at the line like irc_parse_msg would so it isn't optimized out. */
+	if(len > 0 && line[0] == ':') {
+		(*count)++;
+	}
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_irc_parse_lines(void) {
+	GPtrArray *lines = g_ptr_array_new_with_free_func(g_free);
+	char buf[] = "PING :a\r\n:b NOTICE * :c\n\r\nincomplete";
+	gsize used;
+
+	used = irc_parse_lines(buf, strlen(buf), 0, test_irc_parse_lines_collect,
+	                       lines);
+
+	g_assert_cmpuint(lines->len, ==, 3);
+	g_assert_cmpstr(g_ptr_array_index(lines, 0), ==, "PING :a");
+	g_assert_cmpstr(g_ptr_array_index(lines, 1), ==, ":b NOTICE * :c");
+	g_assert_cmpstr(g_ptr_array_index(lines, 2), ==, "");
+
+	/* The incomplete line is left for the next read. */
+	g_assert_cmpstr(buf + used, ==, "incomplete");
+
+	g_ptr_array_free(lines, TRUE);
+}
+
+static void
+test_irc_parse_lines_max(void) {
+	GPtrArray *lines = g_ptr_array_new_with_free_func(g_free);
+	char buf[] = "one\r\ntwo\r\nthree\r\n";
+	gsize used;
+
+	used = irc_parse_lines(buf, strlen(buf), 2, test_irc_parse_lines_collect,
+	                       lines);
+	g_assert_cmpuint(lines->len, ==, 2);
+	g_assert_cmpuint(used, ==, strlen("one\r\ntwo\r\n"));
+
+	used += irc_parse_lines(buf + used, strlen(buf + used), 2,
+	                        test_irc_parse_lines_collect, lines);
+	g_assert_cmpuint(lines->len, ==, 3);
+	g_assert_cmpstr(g_ptr_array_index(lines, 2), ==, "three");
+	g_assert_cmpuint(used, ==, sizeof(buf) - 1);
+
+	g_ptr_array_free(lines, TRUE);
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_IRC_PARSE_PERF_LINES (50000)
+#define TEST_IRC_PARSE_PERF_READ_SIZE (4096)
+
+/* Builds something that looks like a ZNC playback buffer. */
+static GString *
+test_irc_parse_perf_playback(void) {
+	GString *playback = g_string_new(NULL);
+
+	for(guint i = 0; i < TEST_IRC_PARSE_PERF_LINES; i++) {
+		g_string_append_printf(playback,
+			":nick%u!~user@host%u.example.com PRIVMSG #pidgin "
+			":[%02u:%02u:%02u] this is line %u of the playback buffer\r\n",
+			i % 100, i % 100, (i / 3600) % 24, (i / 60) % 60, i % 60, i);
+	}
+
+	return playback;
+}
+
+static void
+test_irc_parse_perf_replay(void) {
+	GString *playback = test_irc_parse_perf_playback();
+	GInputStream *memory = NULL;
+	GDataInputStream *data = NULL;
+	char *buf = g_malloc(IRC_MAX_BUFSIZE);
+	gsize used = 0;
+	gdouble per_line = 0.0, buffered = 0.0;
+	guint count = 0;
+	char *line = NULL;
+
+	/* One line at a time, the way the reader used to work. */
+	memory = g_memory_input_stream_new_from_data(playback->str,
+	                                             playback->len, NULL);
+	data = g_data_input_stream_new(memory);
+
+	g_test_timer_start();
+	while((line = g_data_input_stream_read_line(data, NULL, NULL, NULL))) {
+		test_irc_parse_lines_count(&count, line, strlen(line));
+		g_free(line);
+	}
+	per_line = g_test_timer_elapsed();
+
+	g_assert_cmpuint(count, ==, TEST_IRC_PARSE_PERF_LINES);
+	g_clear_object(&data);
+	g_clear_object(&memory);
+
+	/* Every complete line from each read at once. */
+	count = 0;
+	g_test_timer_start();
+	for(gsize offset = 0; offset < playback->len;
+	    offset += TEST_IRC_PARSE_PERF_READ_SIZE)
+	{
+		gsize len = MIN(TEST_IRC_PARSE_PERF_READ_SIZE,
+		                playback->len - offset);
+		gsize parsed;
+
+		memcpy(buf + used, playback->str + offset, len);
+		used += len;
+
+		parsed = irc_parse_lines(buf, used, 0, test_irc_parse_lines_count,
+		                         &count);
+		used -= parsed;
+		memmove(buf, buf + parsed, used);
+	}
+	buffered = g_test_timer_elapsed();
+
+	g_assert_cmpuint(count, ==, TEST_IRC_PARSE_PERF_LINES);
+	g_assert_cmpuint(used, ==, 0);
+
+	g_test_message("%d lines read one at a time in %f seconds",
+	               TEST_IRC_PARSE_PERF_LINES, per_line);
+	g_test_minimized_result(buffered,
+	                        "%d lines read in %d byte chunks in %f seconds",
+	                        TEST_IRC_PARSE_PERF_LINES,
+	                        TEST_IRC_PARSE_PERF_READ_SIZE, buffered);
+
+	g_free(buf);
+	g_string_free(playback, TRUE);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/irc/parse/lines", test_irc_parse_lines);
+	g_test_add_func("/irc/parse/lines/max", test_irc_parse_lines_max);
+
+	if(g_test_perf()) {
+		g_test_add_func("/irc/parse/perf/replay",
+		                test_irc_parse_perf_replay);
+	}
+
+	return g_test_run();
+}
@@ -38,6 +38,12 @@ keep-alive (sends connection: close).
 
 #define JABBER_BOSH_TIMEOUT 10
 
+/* The most requests we keep open at once, whatever the server allows. */
+#define JABBER_BOSH_MAX_REQUESTS 4
+
+/* Flush right away once this much is buffered, instead of batching more. */
+#define JABBER_BOSH_MAX_BATCH (16 * 1024)
+
 static gchar *jabber_bosh_useragent = NULL;
 
 struct _PurpleJabberBOSHConnection {
@@ -53,6 +59,8 @@ struct _PurpleJabberBOSHConnection {
 
 	GString *send_buff;
 	guint send_timer;
+
+	JabberBOSHWindow window;
 };
 
 static SoupMessage *jabber_bosh_connection_http_request_new(
@@ -61,6 +69,115 @@ static void
 jabber_bosh_connection_session_create(PurpleJabberBOSHConnection *conn);
 static void
 jabber_bosh_connection_send_now(PurpleJabberBOSHConnection *conn);
+static void
+jabber_bosh_connection_schedule(PurpleJabberBOSHConnection *conn);
+
+/******************************************************************************
+ * Request window
+ *****************************************************************************/
+
+void
+jabber_bosh_window_init(JabberBOSHWindow *window)
+{
+	g_return_if_fail(window != NULL);
+
+	memset(window, 0, sizeof(JabberBOSHWindow));
+
+	/* What the specification recommends until the server tells us. */
+	window->requests = 2;
+	window->hold = 1;
+}
+
+void
+jabber_bosh_window_set_limits(JabberBOSHWindow *window, guint requests,
+                              guint hold)
+{
+	g_return_if_fail(window != NULL);
+
+	window->requests = CLAMP(requests, 1, JABBER_BOSH_MAX_REQUESTS);
+	/* One request always has to be left for sending. */
+	window->hold = MIN(hold, window->requests - 1);
+}
+
+gint
+jabber_bosh_window_next_flush(JabberBOSHWindow *window, gsize pending)
+{
+	g_return_val_if_fail(window != NULL, -1);
+
+	if (window->outstanding >= window->requests)
+		return -1;
+
+	if (pending == 0) {
+		/* Keep enough requests at the server for it to answer with.
+		 * A server that doesn't hold any still needs to be polled. */
+		return window->outstanding < MAX(window->hold, 1) ?
+			JABBER_BOSH_SEND_DELAY : -1;
+	}
+
+	if (pending >= JABBER_BOSH_MAX_BATCH)
+		return 0;
+
+	return window->batch_delay;
+}
+
+void
+jabber_bosh_window_sent(JabberBOSHWindow *window, gsize size, gint64 now)
+{
+	g_return_if_fail(window != NULL);
+
+	window->outstanding++;
+
+	if (size == 0)
+		return;
+
+	/* Batch for longer while data keeps coming in quick succession, and
+	 * go back to sending right away once things calm down. */
+	if (window->last_flush != 0) {
+		gint64 interval = (now - window->last_flush) / 1000;
+
+		if (interval < JABBER_BOSH_SEND_DELAY) {
+			window->batch_delay = CLAMP(window->batch_delay * 2, 10,
+				JABBER_BOSH_SEND_DELAY);
+		} else if (interval < 4 * JABBER_BOSH_SEND_DELAY) {
+			window->batch_delay /= 2;
+		} else {
+			window->batch_delay = 0;
+		}
+	}
+	window->last_flush = now;
+
+	if (window->probe_start == 0)
+		window->probe_start = now;
+}
+
+void
+jabber_bosh_window_received(JabberBOSHWindow *window, gint64 now)
+{
+	g_return_if_fail(window != NULL);
+	g_return_if_fail(window->outstanding > 0);
+
+	window->outstanding--;
+
+	/* The server answers a held request as soon as a new one comes in, so
+	 * the first response after sending data is a fair round trip. */
+	if (window->probe_start != 0) {
+		gint64 sample = now - window->probe_start;
+
+		if (window->srtt == 0)
+			window->srtt = sample;
+		else
+			window->srtt += (sample - window->srtt) / 8;
+		window->probe_start = 0;
+	}
+}
+
+gint64
+jabber_bosh_window_get_rtt(const JabberBOSHWindow *window)
+{
+	g_return_val_if_fail(window != NULL, 0);
+
+	return window->srtt;
+}
 
 void
 jabber_bosh_init(void)
@@ -121,11 +238,14 @@ jabber_bosh_connection_new(JabberStream *js, const gchar *url)
 	        "proxy-resolver", resolver,
 	        "timeout", JABBER_BOSH_TIMEOUT + 2,
 	        "user-agent", jabber_bosh_useragent,
+	        /* one more for the terminate request */
+	        "max-conns-per-host", JABBER_BOSH_MAX_REQUESTS + 1,
 	        NULL);
 	conn->url = g_strdup(url);
 	conn->js = js;
 	conn->is_ssl = g_str_equal(scheme, "https");
 	conn->send_buff = g_string_new(NULL);
+	jabber_bosh_window_init(&conn->window);
 
 	/*
 	 * Random 64-bit integer masked off by 2^52 - 1.
@@ -153,7 +273,8 @@ jabber_bosh_connection_destroy(PurpleJabberBOSHConnection *conn)
 
 	if (conn->sid != NULL) {
 		purple_debug_info("jabber-bosh",
-			"Terminating a session for %p\n", conn);
+			"Terminating a session for %p (round trip %" G_GINT64_FORMAT
+			" ms)\n", conn, jabber_bosh_window_get_rtt(&conn->window) / 1000);
 		jabber_bosh_connection_send_now(conn);
 	}
 
@@ -226,10 +347,20 @@ jabber_bosh_connection_recv(SoupSession *session, SoupMessage *msg,
 {
 	PurpleJabberBOSHConnection *bosh_conn = user_data;
 	PurpleXmlNode *node, *child;
+	gint64 rtt = jabber_bosh_window_get_rtt(&bosh_conn->window);
 
-	if (purple_debug_is_verbose() && purple_debug_is_unsafe()) {
-		purple_debug_misc("jabber-bosh", "received: %s\n",
-		                  msg->response_body->data);
+	jabber_bosh_window_received(&bosh_conn->window, g_get_monotonic_time());
+
+	if (purple_debug_is_verbose()) {
+		if (rtt != jabber_bosh_window_get_rtt(&bosh_conn->window)) {
+			purple_debug_misc("jabber-bosh", "round trip %" G_GINT64_FORMAT
+				" ms\n",
+				jabber_bosh_window_get_rtt(&bosh_conn->window) / 1000);
+		}
+		if (purple_debug_is_unsafe()) {
+			purple_debug_misc("jabber-bosh", "received: %s\n",
+			                  msg->response_body->data);
+		}
 	}
 
 	node = jabber_bosh_connection_parse(bosh_conn, msg);
@@ -264,7 +395,7 @@ jabber_bosh_connection_recv(SoupSession *session, SoupMessage *msg,
 		child = next;
 	}
 
-	jabber_bosh_connection_send(bosh_conn, NULL);
+	jabber_bosh_connection_schedule(bosh_conn);
 }
 
 static void
@@ -272,6 +403,8 @@ jabber_bosh_connection_send_now(PurpleJabberBOSHConnection *conn)
 {
 	SoupMessage *req;
 	GString *data;
+	gchar *head;
+	gsize payload;
 
 	g_return_if_fail(conn != NULL);
 
@@ -283,10 +416,15 @@ jabber_bosh_connection_send_now(PurpleJabberBOSHConnection *conn)
 	if (conn->sid == NULL)
 		return;
 
-	data = g_string_new(NULL);
+	/* Everything goes out once a response frees up a request. */
+	if (!conn->is_terminating &&
+	    conn->window.outstanding >= conn->window.requests)
+	{
+		return;
+	}
 
 	/* missing parameters: route, from, ack */
-	g_string_printf(data, "<body "
+	head = g_strdup_printf("<body "
 		"rid='%" G_GUINT64_FORMAT "' "
 		"sid='%s' "
 		"xmlns='" NS_BOSH "' "
@@ -294,17 +432,23 @@ jabber_bosh_connection_send_now(PurpleJabberBOSHConnection *conn)
 		++conn->rid, conn->sid);
 
 	if (conn->js->reinit && !conn->is_terminating) {
+		data = g_string_new(head);
 		g_string_append(data, "xmpp:restart='true'/>");
 		conn->js->reinit = FALSE;
+		payload = 0;
 	} else {
-		if (conn->is_terminating)
-			g_string_append(data, "type='terminate' ");
-		g_string_append_c(data, '>');
-		g_string_append_len(data, conn->send_buff->str,
-			conn->send_buff->len);
+		/* The buffered stanzas become the request body, rather than
+		 * being copied into a new one. */
+		data = conn->send_buff;
+		conn->send_buff = g_string_new(NULL);
+		payload = data->len;
+
 		g_string_append(data, "</body>");
-		g_string_set_size(conn->send_buff, 0);
+		g_string_prepend(data, conn->is_terminating ?
+			"type='terminate' >" : ">");
+		g_string_prepend(data, head);
 	}
+	g_free(head);
 
 	if (purple_debug_is_verbose() && purple_debug_is_unsafe())
 		purple_debug_misc("jabber-bosh", "sending: %s\n", data->str);
@@ -317,6 +461,8 @@ jabber_bosh_connection_send_now(PurpleJabberBOSHConnection *conn)
 		g_free(conn->sid);
 		conn->sid = NULL;
 	} else {
+		jabber_bosh_window_sent(&conn->window, payload,
+		                        g_get_monotonic_time());
 		soup_session_queue_message(conn->payload_reqs, req,
 		                           jabber_bosh_connection_recv, conn);
 	}
@@ -333,6 +479,32 @@ jabber_bosh_connection_send_delayed(gpointer _conn)
 	return FALSE;
 }
 
+/* Sends the buffered data, or an empty request for the server to hold, when
+ * the request window allows for it. */
+static void
+jabber_bosh_connection_schedule(PurpleJabberBOSHConnection *conn)
+{
+	gsize pending;
+	gint delay;
+
+	if (conn->sid == NULL || conn->is_terminating)
+		return;
+
+	/* A stream restart has to be sent even without any data. */
+	pending = conn->send_buff->len + (conn->js->reinit ? 1 : 0);
+	delay = jabber_bosh_window_next_flush(&conn->window, pending);
+
+	if (delay < 0)
+		return;
+
+	if (delay == 0) {
+		jabber_bosh_connection_send_now(conn);
+	} else if (conn->send_timer == 0) {
+		conn->send_timer = g_timeout_add(delay,
+			jabber_bosh_connection_send_delayed, conn);
+	}
+}
+
 void
 jabber_bosh_connection_send(PurpleJabberBOSHConnection *conn,
 	const gchar *data)
@@ -342,11 +514,7 @@ jabber_bosh_connection_send(PurpleJabberBOSHConnection *conn,
 	if (data)
 		g_string_append(conn->send_buff, data);
 
-	if (conn->send_timer == 0) {
-		conn->send_timer = g_timeout_add(
-			JABBER_BOSH_SEND_DELAY,
-			jabber_bosh_connection_send_delayed, conn);
-	}
+	jabber_bosh_connection_schedule(conn);
 }
 
 void
@@ -384,9 +552,11 @@ jabber_bosh_connection_session_created(SoupSession *session, SoupMessage *msg,
 {
 	PurpleJabberBOSHConnection *bosh_conn = user_data;
 	PurpleXmlNode *node, *features;
-	const gchar *sid, *ver, *inactivity_str;
+	const gchar *sid, *ver, *inactivity_str, *requests_str, *hold_str;
 	int inactivity = 0;
 
+	jabber_bosh_window_received(&bosh_conn->window, g_get_monotonic_time());
+
 	if (purple_debug_is_verbose() && purple_debug_is_unsafe()) {
 		purple_debug_misc("jabber-bosh", "received (session creation): %s\n",
 		                  msg->response_body->data);
@@ -399,7 +569,8 @@ jabber_bosh_connection_session_created(SoupSession *session, SoupMessage *msg,
 	sid = purple_xmlnode_get_attrib(node, "sid");
 	ver = purple_xmlnode_get_attrib(node, "ver");
 	inactivity_str = purple_xmlnode_get_attrib(node, "inactivity");
-	/* requests = purple_xmlnode_get_attrib(node, "requests"); */
+	requests_str = purple_xmlnode_get_attrib(node, "requests");
+	hold_str = purple_xmlnode_get_attrib(node, "hold");
 
 	if (!sid) {
 		purple_connection_error(bosh_conn->js->gc,
@@ -425,6 +596,13 @@ jabber_bosh_connection_session_created(SoupSession *session, SoupMessage *msg,
 
 	bosh_conn->sid = g_strdup(sid);
 
+	if (requests_str != NULL && hold_str != NULL) {
+		jabber_bosh_window_set_limits(&bosh_conn->window,
+			atoi(requests_str), atoi(hold_str));
+	}
+	purple_debug_misc("jabber-bosh", "Using %u requests, %u held\n",
+		bosh_conn->window.requests, bosh_conn->window.hold);
+
 	if (inactivity_str)
 		inactivity = atoi(inactivity_str);
 	if (inactivity < 0 || inactivity > 3600) {
@@ -453,7 +631,7 @@ jabber_bosh_connection_session_created(SoupSession *session, SoupMessage *msg,
 
 	purple_xmlnode_free(node);
 
-	jabber_bosh_connection_send(bosh_conn, NULL);
+	jabber_bosh_connection_schedule(bosh_conn);
 }
 
 static void
@@ -484,6 +662,7 @@ jabber_bosh_connection_session_create(PurpleJabberBOSHConnection *conn)
 	req = jabber_bosh_connection_http_request_new(conn, data);
 	g_string_free(data, FALSE);
 
+	jabber_bosh_window_sent(&conn->window, 0, g_get_monotonic_time());
 	soup_session_queue_message(conn->payload_reqs, req,
 	                           jabber_bosh_connection_session_created, conn);
 }
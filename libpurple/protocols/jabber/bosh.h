@@ -30,6 +30,48 @@ typedef struct _PurpleJabberBOSHConnection PurpleJabberBOSHConnection;
 
 #include "jabber.h"
 
+/*
+ * Bookkeeping for the HTTP requests of a BOSH session: how many may be open
+ * at once and how many the server holds on to, as negotiated at session
+ * creation, how many are open now, how long to batch outgoing data before
+ * sending it, and the smoothed round trip time in microseconds.
+ */
+typedef struct {
+	guint requests;
+	guint hold;
+	guint outstanding;
+
+	guint batch_delay;
+	gint64 last_flush;
+
+	gint64 probe_start;
+	gint64 srtt;
+} JabberBOSHWindow;
+
+void
+jabber_bosh_window_init(JabberBOSHWindow *window);
+
+void
+jabber_bosh_window_set_limits(JabberBOSHWindow *window, guint requests,
+                              guint hold);
+
+/*
+ * Returns the number of milliseconds to wait before sending a request with
+ * pending bytes of data (0 to send it right away), or -1 if no request
+ * should be sent until a response comes in.
+ */
+gint
+jabber_bosh_window_next_flush(JabberBOSHWindow *window, gsize pending);
+
+void
+jabber_bosh_window_sent(JabberBOSHWindow *window, gsize size, gint64 now);
+
+void
+jabber_bosh_window_received(JabberBOSHWindow *window, gint64 now);
+
+gint64
+jabber_bosh_window_get_rtt(const JabberBOSHWindow *window);
+
 void
 jabber_bosh_init(void);
 
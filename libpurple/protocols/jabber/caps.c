@@ -22,6 +22,9 @@
  */
 
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+#include <string.h>
 
 #include <purple.h>
 
@@ -30,17 +33,37 @@
 #include "presence.h"
 #include "xdata.h"
 
+/*
+ * The cache has one <client/> per line, and loading it only parses the start
+ * tag of each to index it, leaving the rest until that client is looked up.
+ * Newly discovered clients are appended to a journal in the same layout,
+ * which is folded back into xmpp-caps.xml once it grows too large. Reading a
+ * record twice is harmless, so a journal left behind by a crash between
+ * writing the two is simply read again.
+ */
 #define JABBER_CAPS_FILENAME "xmpp-caps.xml"
+#define JABBER_CAPS_JOURNAL_FILENAME "xmpp-caps-journal.xml"
+#define JABBER_CAPS_JOURNAL_MIN_ENTRIES 250
 
 typedef struct {
 	gchar *var;
 	GList *values;
 } JabberDataFormField;
 
+typedef struct {
+	JabberCapsTuple tuple;
+	gchar *record;
+} JabberCapsRecord;
+
 static GHashTable *capstable = NULL; /* JabberCapsTuple -> JabberCapsClientInfo */
+static GHashTable *recordtable = NULL; /* JabberCapsTuple -> JabberCapsRecord */
 static GHashTable *nodetable = NULL; /* char *node -> JabberCapsNodeExts */
 static guint       save_timer = 0;
 
+static GPtrArray *journal_pending = NULL; /* JabberCapsClientInfo, unwritten */
+static gboolean journal_full = FALSE;     /* Whether to rewrite xmpp-caps.xml */
+static guint journal_entries = 0;
+
 /* Free a GList of allocated char* */
 static void
 free_string_glist(GList *list)
@@ -147,11 +170,11 @@ exts_to_xmlnode(gconstpointer key, gconstpointer value, gpointer user_data)
 	}
 }
 
-static void jabber_caps_store_client(gpointer key, gpointer value, gpointer user_data) {
-	const JabberCapsTuple *tuple = key;
-	const JabberCapsClientInfo *props = value;
-	PurpleXmlNode *root = user_data;
-	PurpleXmlNode *client = purple_xmlnode_new_child(root, "client");
+static PurpleXmlNode *
+jabber_caps_client_to_xmlnode(const JabberCapsClientInfo *props)
+{
+	const JabberCapsTuple *tuple = &props->tuple;
+	PurpleXmlNode *client = purple_xmlnode_new("client");
 	GList *iter;
 
 	purple_xmlnode_set_attrib(client, "node", tuple->node);
@@ -184,22 +207,236 @@ static void jabber_caps_store_client(gpointer key, gpointer value, gpointer user
 	/* TODO: Ideally, only save this once-per-node... */
 	if (props->exts)
 		g_hash_table_foreach(props->exts->exts, (GHFunc)exts_to_xmlnode, client);
+
+	return client;
+}
+
+static JabberCapsClientInfo *
+jabber_caps_client_info_from_xmlnode(PurpleXmlNode *client)
+{
+	JabberCapsClientInfo *value;
+	JabberCapsTuple *key;
+	PurpleXmlNode *child;
+	JabberCapsNodeExts *exts = NULL;
+	const char *node = purple_xmlnode_get_attrib(client, "node");
+	const char *ver = purple_xmlnode_get_attrib(client, "ver");
+
+	if (!purple_strequal(client->name, "client") || !node || !ver)
+		return NULL;
+
+	value = g_new0(JabberCapsClientInfo, 1);
+	key = (JabberCapsTuple*)&value->tuple;
+	key->node = g_strdup(node);
+	key->ver  = g_strdup(ver);
+	key->hash = g_strdup(purple_xmlnode_get_attrib(client,"hash"));
+
+	/* v1.3 capabilities */
+	if (key->hash == NULL)
+		exts = jabber_caps_find_exts_by_node(key->node);
+
+	for (child = client->child; child; child = child->next) {
+		if (child->type != PURPLE_XMLNODE_TYPE_TAG)
+			continue;
+		if (purple_strequal(child->name, "feature")) {
+			const char *var = purple_xmlnode_get_attrib(child, "var");
+			if(!var)
+				continue;
+			value->features = g_list_append(value->features,g_strdup(var));
+		} else if (purple_strequal(child->name, "identity")) {
+			const char *category = purple_xmlnode_get_attrib(child, "category");
+			const char *type = purple_xmlnode_get_attrib(child, "type");
+			const char *name = purple_xmlnode_get_attrib(child, "name");
+			const char *lang = purple_xmlnode_get_attrib(child, "lang");
+			JabberIdentity *id;
+
+			if (!category || !type)
+				continue;
+
+			id = jabber_identity_new(category, type, lang, name);
+			value->identities = g_list_append(value->identities,id);
+		} else if (purple_strequal(child->name, "x")) {
+			/* TODO: See #7814 -- this might cause problems if anyone
+			 * ever actually specifies forms. In fact, for this to
+			 * work properly, that bug needs to be fixed in
+			 * purple_xmlnode_from_str, not the output version... */
+			value->forms = g_list_append(value->forms, purple_xmlnode_copy(child));
+		} else if (purple_strequal(child->name, "ext")) {
+			if (key->hash != NULL)
+				purple_debug_warning("jabber", "Ignoring exts when reading new-style caps\n");
+			else {
+				/* TODO: Do we care about reading in the identities listed here? */
+				const char *identifier = purple_xmlnode_get_attrib(child, "identifier");
+				PurpleXmlNode *node;
+				GList *features = NULL;
+
+				if (!identifier)
+					continue;
+
+				for (node = child->child; node; node = node->next) {
+					if (node->type != PURPLE_XMLNODE_TYPE_TAG)
+						continue;
+					if (purple_strequal(node->name, "feature")) {
+						const char *var = purple_xmlnode_get_attrib(node, "var");
+						if (!var)
+							continue;
+						features = g_list_prepend(features, g_strdup(var));
+					}
+				}
+
+				if (features) {
+					g_hash_table_insert(exts->exts, g_strdup(identifier),
+					                    features);
+				} else
+					purple_debug_warning("jabber", "Caps ext %s had no features.\n",
+					                     identifier);
+			}
+		}
+	}
+
+	value->exts = exts;
+
+	return value;
 }
 
+static void
+jabber_caps_record_free(JabberCapsRecord *record)
+{
+	g_free((char *)record->tuple.node);
+	g_free((char *)record->tuple.ver);
+	g_free((char *)record->tuple.hash);
+	g_free(record->record);
+	g_free(record);
+}
+
+/* Records are separated by newlines, so any in the data have to be escaped.
+ * Nothing else in the unformatted output can contain one.
+ */
+static void
+jabber_caps_append_record(GString *str, const JabberCapsClientInfo *info)
+{
+	PurpleXmlNode *client = jabber_caps_client_to_xmlnode(info);
+	char *record, *p;
+
+	record = purple_xmlnode_to_str(client, NULL);
+	for (p = record; *p != '\0'; p++) {
+		if (*p == '\n')
+			g_string_append(str, "&#10;");
+		else if (*p == '\r')
+			g_string_append(str, "&#13;");
+		else
+			g_string_append_c(str, *p);
+	}
+	g_string_append_c(str, '\n');
+
+	g_free(record);
+	purple_xmlnode_free(client);
+}
+
+static gchar *
+jabber_caps_journal_path(void)
+{
+	return g_build_filename(purple_cache_dir(), JABBER_CAPS_JOURNAL_FILENAME,
+	                        NULL);
+}
+
+/* Appends every new client to the journal. Returns FALSE if xmpp-caps.xml
+ * needs to be rewritten instead, because the journal is due to be compacted
+ * or couldn't be written.
+ */
 static gboolean
-do_jabber_caps_store(gpointer data)
+jabber_caps_journal_append(void)
 {
-	char *str;
-	int length = 0;
-	PurpleXmlNode *root = purple_xmlnode_new("capabilities");
+	GString *journal;
+	GFile *file;
+	GFileOutputStream *stream;
+	GError *error = NULL;
+	gchar *path;
+	guint entries, size, limit;
+	gboolean ret;
+
+	/* Every client in the journal is also in the tables, so what's left is
+	 * roughly what xmpp-caps.xml holds. */
+	entries = journal_entries + journal_pending->len;
+	size = g_hash_table_size(capstable) + g_hash_table_size(recordtable);
+	limit = MAX(JABBER_CAPS_JOURNAL_MIN_ENTRIES,
+	            size > entries ? size - entries : 0);
+	if (entries > limit)
+		return FALSE;
+
+	journal = g_string_new(NULL);
+	for (guint i = 0; i < journal_pending->len; i++)
+		jabber_caps_append_record(journal, journal_pending->pdata[i]);
+
+	path = jabber_caps_journal_path();
+	file = g_file_new_for_path(path);
+
+	stream = g_file_append_to(file, G_FILE_CREATE_PRIVATE, NULL, &error);
+	ret = stream != NULL &&
+	      g_output_stream_write_all(G_OUTPUT_STREAM(stream),
+			journal->str, journal->len, NULL, NULL, &error) &&
+	      g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, &error);
+	g_clear_object(&stream);
+
+	if (ret) {
+		journal_entries += journal_pending->len;
+		g_ptr_array_set_size(journal_pending, 0);
+	} else {
+		purple_debug_error("jabber", "Error writing %s: %s", path,
+		                   error ? error->message : "unknown error");
+		g_clear_error(&error);
+	}
 
-	g_hash_table_foreach(capstable, jabber_caps_store_client, root);
-	str = purple_xmlnode_to_formatted_str(root, &length);
-	purple_xmlnode_free(root);
-	purple_util_write_data_to_cache_file(JABBER_CAPS_FILENAME, str, length);
-	g_free(str);
+	g_object_unref(file);
+	g_free(path);
+	g_string_free(journal, TRUE);
+
+	return ret;
+}
+
+static gboolean
+do_jabber_caps_store(gpointer data)
+{
+	GString *str;
+	GHashTableIter iter;
+	gpointer value;
+	gchar *path;
 
 	save_timer = 0;
+
+	if (!journal_full) {
+		if (journal_pending->len == 0 || jabber_caps_journal_append())
+			return FALSE;
+	}
+
+	str = g_string_new("<?xml version='1.0' encoding='UTF-8' ?>\n"
+	                   "<capabilities>\n");
+
+	g_hash_table_iter_init(&iter, capstable);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		jabber_caps_append_record(str, value);
+
+	/* Clients that were never looked up are written back as they were read. */
+	g_hash_table_iter_init(&iter, recordtable);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		g_string_append(str, ((JabberCapsRecord *)value)->record);
+		g_string_append_c(str, '\n');
+	}
+
+	g_string_append(str, "</capabilities>\n");
+
+	if (purple_util_write_data_to_cache_file(JABBER_CAPS_FILENAME, str->str,
+	                                         str->len))
+	{
+		journal_entries = 0;
+		journal_full = FALSE;
+		g_ptr_array_set_size(journal_pending, 0);
+
+		path = jabber_caps_journal_path();
+		g_remove(path);
+		g_free(path);
+	}
+	g_string_free(str, TRUE);
+
 	return FALSE;
 }
 
@@ -211,7 +448,193 @@ schedule_caps_save(void)
 }
 
 static void
-jabber_caps_load(void)
+jabber_caps_add(JabberCapsClientInfo *info)
+{
+	g_hash_table_replace(capstable, (gpointer)&info->tuple, info);
+	g_hash_table_remove(recordtable, &info->tuple);
+}
+
+/* Returns the cached info for the tuple, parsing it first if it hasn't been
+ * looked up since it was read from the cache.
+ */
+static JabberCapsClientInfo *
+jabber_caps_lookup(const JabberCapsTuple *key)
+{
+	JabberCapsClientInfo *info;
+	JabberCapsRecord *record;
+	PurpleXmlNode *client;
+
+	if ((info = g_hash_table_lookup(capstable, key)) != NULL)
+		return info;
+
+	if ((record = g_hash_table_lookup(recordtable, key)) == NULL)
+		return NULL;
+
+	client = purple_xmlnode_from_str(record->record, -1);
+	if (client != NULL) {
+		info = jabber_caps_client_info_from_xmlnode(client);
+		purple_xmlnode_free(client);
+	}
+
+	if (info == NULL || !jabber_caps_compare(&info->tuple, key)) {
+		purple_debug_warning("jabber", "Dropping unreadable caps for %s#%s",
+		                     key->node, key->ver);
+		jabber_caps_client_info_destroy(info);
+		g_hash_table_remove(recordtable, key);
+		journal_full = TRUE;
+		return NULL;
+	}
+
+	jabber_caps_add(info);
+
+	return info;
+}
+
+/* Reads node, ver and hash from the start tag of a record, which runs up to
+ * end. Entities in their values are unescaped, but nothing else about the tag
+ * is checked; a record that doesn't parse is dropped when it's looked up.
+ */
+static gboolean
+jabber_caps_record_parse_tag(const char *line, const char *end,
+                             JabberCapsTuple *tuple)
+{
+	const char *p = line + strlen("<client");
+
+	while (TRUE) {
+		const char *name, *value, *quote;
+		const char **attrib = NULL;
+		gsize len;
+
+		while (p < end && g_ascii_isspace(*p))
+			p++;
+		if (p == end || *p == '/')
+			return TRUE;
+
+		name = p;
+		while (p < end && *p != '=' && !g_ascii_isspace(*p))
+			p++;
+		len = p - name;
+
+		while (p < end && g_ascii_isspace(*p))
+			p++;
+		if (p == end || *p++ != '=')
+			return FALSE;
+		while (p < end && g_ascii_isspace(*p))
+			p++;
+		if (p == end || (*p != '\'' && *p != '"'))
+			return FALSE;
+
+		value = p + 1;
+		if ((quote = memchr(value, *p, end - value)) == NULL)
+			return FALSE;
+		p = quote + 1;
+
+		if (len == 4 && strncmp(name, "node", len) == 0)
+			attrib = &tuple->node;
+		else if (len == 3 && strncmp(name, "ver", len) == 0)
+			attrib = &tuple->ver;
+		else if (len == 4 && strncmp(name, "hash", len) == 0)
+			attrib = &tuple->hash;
+
+		if (attrib == NULL || *attrib != NULL)
+			continue;
+
+		if (memchr(value, '&', quote - value) != NULL) {
+			char *escaped = g_strndup(value, quote - value);
+			*attrib = purple_unescape_text(escaped);
+			g_free(escaped);
+		} else {
+			*attrib = g_strndup(value, quote - value);
+		}
+	}
+}
+
+/* Indexes one record by its start tag, taking ownership of the line. Only
+ * v1.3 clients are parsed right away, because their exts are shared by node.
+ */
+static gboolean
+jabber_caps_load_record(gchar *line)
+{
+	JabberCapsRecord *record;
+	char *end;
+
+	if ((end = strchr(line, '>')) == NULL)
+		return FALSE;
+
+	record = g_new0(JabberCapsRecord, 1);
+	if (!jabber_caps_record_parse_tag(line, end, &record->tuple) ||
+	    record->tuple.node == NULL || record->tuple.ver == NULL)
+	{
+		jabber_caps_record_free(record);
+		return FALSE;
+	}
+	record->record = line;
+
+	g_hash_table_remove(capstable, &record->tuple);
+	g_hash_table_replace(recordtable, &record->tuple, record);
+
+	/* If this fails, the record is dropped and the cache gets rewritten. */
+	if (record->tuple.hash == NULL)
+		jabber_caps_lookup(&record->tuple);
+
+	return TRUE;
+}
+
+/* Reads a file with one <client/> per line. Returns FALSE if it isn't laid
+ * out like that, which is the case for caches written by older versions.
+ */
+static gboolean
+jabber_caps_load_records(const char *filename, guint *count,
+                         gboolean *damaged)
+{
+	gchar *path, *contents = NULL;
+	gchar **lines;
+	GError *error = NULL;
+	gboolean ret = TRUE;
+
+	path = g_build_filename(purple_cache_dir(), filename, NULL);
+	if (!g_file_get_contents(path, &contents, NULL, &error)) {
+		if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			purple_debug_error("jabber", "Error reading %s: %s", path,
+			                   error->message);
+		g_clear_error(&error);
+		g_free(path);
+		return TRUE;
+	}
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	/* Records keep their line, so the array is freed by hand. */
+	for (guint i = 0; lines[i] != NULL; i++) {
+		gchar *line = lines[i];
+
+		if (!ret) {
+			/* Not in this layout, just free the rest. */
+		} else if (g_str_has_prefix(line, "<client")) {
+			if (jabber_caps_load_record(line)) {
+				(*count)++;
+				continue;
+			}
+			*damaged = TRUE;
+		} else if (*line != '\0' && !g_str_has_prefix(line, "<?xml") &&
+		           !g_str_has_prefix(line, "<capabilities") &&
+		           !g_str_has_prefix(line, "</capabilities"))
+		{
+			ret = FALSE;
+		}
+
+		g_free(line);
+	}
+	g_free(lines);
+
+	g_free(path);
+
+	return ret;
+}
+
+static void
+jabber_caps_load_legacy(void)
 {
 	PurpleXmlNode *capsdata = purple_util_read_xml_from_cache_file(JABBER_CAPS_FILENAME, "XMPP capabilities cache");
 	PurpleXmlNode *client;
@@ -225,92 +648,60 @@ jabber_caps_load(void)
 	}
 
 	for (client = capsdata->child; client; client = client->next) {
+		JabberCapsClientInfo *value;
+
 		if (client->type != PURPLE_XMLNODE_TYPE_TAG)
 			continue;
-		if (purple_strequal(client->name, "client")) {
-			JabberCapsClientInfo *value = g_new0(JabberCapsClientInfo, 1);
-			JabberCapsTuple *key = (JabberCapsTuple*)&value->tuple;
-			PurpleXmlNode *child;
-			JabberCapsNodeExts *exts = NULL;
-			key->node = g_strdup(purple_xmlnode_get_attrib(client,"node"));
-			key->ver  = g_strdup(purple_xmlnode_get_attrib(client,"ver"));
-			key->hash = g_strdup(purple_xmlnode_get_attrib(client,"hash"));
-
-			/* v1.3 capabilities */
-			if (key->hash == NULL)
-				exts = jabber_caps_find_exts_by_node(key->node);
-
-			for (child = client->child; child; child = child->next) {
-				if (child->type != PURPLE_XMLNODE_TYPE_TAG)
-					continue;
-				if (purple_strequal(child->name, "feature")) {
-					const char *var = purple_xmlnode_get_attrib(child, "var");
-					if(!var)
-						continue;
-					value->features = g_list_append(value->features,g_strdup(var));
-				} else if (purple_strequal(child->name, "identity")) {
-					const char *category = purple_xmlnode_get_attrib(child, "category");
-					const char *type = purple_xmlnode_get_attrib(child, "type");
-					const char *name = purple_xmlnode_get_attrib(child, "name");
-					const char *lang = purple_xmlnode_get_attrib(child, "lang");
-					JabberIdentity *id;
-
-					if (!category || !type)
-						continue;
 
-					id = jabber_identity_new(category, type, lang, name);
-					value->identities = g_list_append(value->identities,id);
-				} else if (purple_strequal(child->name, "x")) {
-					/* TODO: See #7814 -- this might cause problems if anyone
-					 * ever actually specifies forms. In fact, for this to
-					 * work properly, that bug needs to be fixed in
-					 * purple_xmlnode_from_str, not the output version... */
-					value->forms = g_list_append(value->forms, purple_xmlnode_copy(child));
-				} else if (purple_strequal(child->name, "ext")) {
-					if (key->hash != NULL)
-						purple_debug_warning("jabber", "Ignoring exts when reading new-style caps\n");
-					else {
-						/* TODO: Do we care about reading in the identities listed here? */
-						const char *identifier = purple_xmlnode_get_attrib(child, "identifier");
-						PurpleXmlNode *node;
-						GList *features = NULL;
-
-						if (!identifier)
-							continue;
+		value = jabber_caps_client_info_from_xmlnode(client);
+		if (value != NULL)
+			jabber_caps_add(value);
+	}
+	purple_xmlnode_free(capsdata);
+}
 
-						for (node = child->child; node; node = node->next) {
-							if (node->type != PURPLE_XMLNODE_TYPE_TAG)
-								continue;
-							if (purple_strequal(node->name, "feature")) {
-								const char *var = purple_xmlnode_get_attrib(node, "var");
-								if (!var)
-									continue;
-								features = g_list_prepend(features, g_strdup(var));
-							}
-						}
-
-						if (features) {
-							g_hash_table_insert(exts->exts, g_strdup(identifier),
-							                    features);
-						} else
-							purple_debug_warning("jabber", "Caps ext %s had no features.\n",
-							                     identifier);
-					}
-				}
-			}
+static void
+jabber_caps_load(void)
+{
+	gboolean damaged = FALSE;
+	guint count = 0;
+	gchar *path;
+
+	if (!jabber_caps_load_records(JABBER_CAPS_FILENAME, &count, &damaged)) {
+		/* Written by an older version, so it gets rewritten in this layout
+		 * once the journal is read. */
+		g_hash_table_remove_all(recordtable);
+		g_hash_table_remove_all(capstable);
+		jabber_caps_load_legacy();
+		damaged = TRUE;
+	}
 
-			value->exts = exts;
-			g_hash_table_replace(capstable, key, value);
+	if (!jabber_caps_load_records(JABBER_CAPS_JOURNAL_FILENAME,
+	                              &journal_entries, &damaged))
+	{
+		path = jabber_caps_journal_path();
+		purple_debug_warning("jabber", "Ignoring unreadable %s", path);
+		g_free(path);
+		damaged = TRUE;
+	}
 
-		}
+	purple_debug_info("jabber", "Indexed %u cached clients and %u journal "
+	                  "entries", count, journal_entries);
+
+	if (damaged) {
+		journal_full = TRUE;
+		schedule_caps_save();
 	}
-	purple_xmlnode_free(capsdata);
 }
 
 void jabber_caps_init(void)
 {
 	nodetable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)jabber_caps_node_exts_unref);
 	capstable = g_hash_table_new_full(jabber_caps_hash, jabber_caps_compare, NULL, (GDestroyNotify)jabber_caps_client_info_destroy);
+	recordtable = g_hash_table_new_full(jabber_caps_hash, jabber_caps_compare, NULL, (GDestroyNotify)jabber_caps_record_free);
+	journal_pending = g_ptr_array_new();
+	journal_full = FALSE;
+	journal_entries = 0;
 	jabber_caps_load();
 }
 
@@ -322,8 +713,23 @@ void jabber_caps_uninit(void)
 		do_jabber_caps_store(NULL);
 	}
 	g_hash_table_destroy(capstable);
+	g_hash_table_destroy(recordtable);
 	g_hash_table_destroy(nodetable);
-	capstable = nodetable = NULL;
+	g_ptr_array_free(journal_pending, TRUE);
+	capstable = recordtable = nodetable = NULL;
+	journal_pending = NULL;
+}
+
+void
+jabber_caps_store_client(JabberCapsClientInfo *info)
+{
+	g_return_if_fail(info != NULL);
+	g_return_if_fail(info->tuple.node != NULL && info->tuple.ver != NULL);
+
+	jabber_caps_add(info);
+	if (!journal_full)
+		g_ptr_array_add(journal_pending, info);
+	schedule_caps_save();
 }
 
 gboolean jabber_caps_exts_known(const JabberCapsClientInfo *info,
@@ -476,7 +882,7 @@ jabber_caps_client_iqcb(JabberStream *js, const char *from, JabberIqType type,
 
 	/* Use the copy of this data already in the table if it exists or insert
 	 * a new one if we need to */
-	if ((value = g_hash_table_lookup(capstable, &key))) {
+	if ((value = jabber_caps_lookup(&key))) {
 		jabber_caps_client_info_destroy(info);
 		info = value;
 	} else {
@@ -494,8 +900,7 @@ jabber_caps_client_iqcb(JabberStream *js, const char *from, JabberIqType type,
 		userdata->node = userdata->ver = userdata->hash = NULL;
 
 		/* The capstable gets a reference */
-		g_hash_table_insert(capstable, n_key, info);
-		schedule_caps_save();
+		jabber_caps_store_client(info);
 	}
 
 	userdata->info = info;
@@ -561,6 +966,8 @@ jabber_caps_ext_iqcb(JabberStream *js, const char *from, JabberIqType type,
 	}
 
 	g_hash_table_insert(node_exts->exts, g_strdup(cbdata->key), features);
+	/* The exts are written with every client for the node. */
+	journal_full = TRUE;
 	schedule_caps_save();
 
 	/* Are we done? */
@@ -591,7 +998,7 @@ void jabber_caps_get_info(JabberStream *js, const char *who, const char *node,
 	key.ver = (char *)ver;
 	key.hash = (char *)hash;
 
-	info = g_hash_table_lookup(capstable, &key);
+	info = jabber_caps_lookup(&key);
 	if (info && hash) {
 		/* v1.5 - We already have all the information we care about */
 		if (cb)
@@ -70,6 +70,12 @@ typedef void (*jabber_caps_get_info_cb)(JabberCapsClientInfo *info, GList *exts,
 void jabber_caps_init(void);
 void jabber_caps_uninit(void);
 
+/**
+ * Adds a newly discovered client, with its tuple filled in, to the cache and
+ * schedules it to be saved. The cache takes ownership of info.
+ */
+void jabber_caps_store_client(JabberCapsClientInfo *info);
+
 /**
  * Check whether all of the exts in a char* array are known to the given info.
  */
@@ -383,6 +383,17 @@ jabber_push_bytes_cb(GObject *source, GAsyncResult *res, gpointer data)
 	}
 }
 
+static void
+do_jabber_send_bytes(JabberStream *js, GBytes *output)
+{
+	if (js->state == JABBER_STREAM_CONNECTED)
+		jabber_stream_restart_inactivity_timer(js);
+
+	purple_queued_output_stream_push_bytes_async(
+	        js->output, output, G_PRIORITY_DEFAULT, js->cancellable,
+	        jabber_push_bytes_cb, js);
+}
+
 static gboolean do_jabber_send_raw(JabberStream *js, const char *data, int len)
 {
 	GBytes *output;
@@ -390,24 +401,22 @@ static gboolean do_jabber_send_raw(JabberStream *js, const char *data, int len)
 
 	g_return_val_if_fail(len > 0, FALSE);
 
-	if (js->state == JABBER_STREAM_CONNECTED)
-		jabber_stream_restart_inactivity_timer(js);
-
 	output = g_bytes_new(data, len);
-	purple_queued_output_stream_push_bytes_async(
-	        js->output, output, G_PRIORITY_DEFAULT, js->cancellable,
-	        jabber_push_bytes_cb, js);
+	do_jabber_send_bytes(js, output);
 	g_bytes_unref(output);
 
 	return success;
 }
 
-void
-jabber_send_raw(PurpleProtocolServer *protocol_server, JabberStream *js,
-                const gchar *data, gint len)
+/* Does the work of jabber_send_raw(). If bytes is given, it holds data and
+ * is pushed to the output stream as it is, instead of being copied, as long
+ * as nothing along the way replaced data. */
+static void
+jabber_send_data(JabberStream *js, const gchar *data, gint len, GBytes *bytes)
 {
 	PurpleConnection *gc;
 	PurpleAccount *account;
+	const gchar *original = data;
 
 	gc = js->gc;
 	account = purple_connection_get_account(gc);
@@ -415,7 +424,9 @@ jabber_send_raw(PurpleProtocolServer *protocol_server, JabberStream *js,
 	g_return_if_fail(data != NULL);
 
 	/* because printing a tab to debug every minute gets old */
-	if (!purple_strequal(data, "\t")) {
+	if (purple_debug_is_enabled(PURPLE_DEBUG_MISC, "jabber") &&
+	    !purple_strequal(data, "\t"))
+	{
 		const char *username;
 		char *text = NULL, *last_part = NULL, *tag_start = NULL;
 
@@ -506,10 +517,19 @@ jabber_send_raw(PurpleProtocolServer *protocol_server, JabberStream *js,
 
 	if (js->bosh)
 		jabber_bosh_connection_send(js->bosh, data);
+	else if (bytes != NULL && data == original)
+		do_jabber_send_bytes(js, bytes);
 	else
 		do_jabber_send_raw(js, data, len);
 }
 
+void
+jabber_send_raw(PurpleProtocolServer *protocol_server, JabberStream *js,
+                const gchar *data, gint len)
+{
+	jabber_send_data(js, data, len, NULL);
+}
+
 gint
 jabber_protocol_send_raw(PurpleProtocolServer *protocol_server,
                          PurpleConnection *gc, const gchar *buf, gint len)
@@ -530,8 +550,8 @@ void jabber_send_signal_cb(PurpleConnection *pc, PurpleXmlNode **packet,
                            gpointer unused)
 {
 	JabberStream *js;
-	char *txt;
-	int len;
+	GString *txt;
+	GBytes *bytes;
 
 	if (NULL == packet)
 		return;
@@ -548,9 +568,16 @@ void jabber_send_signal_cb(PurpleConnection *pc, PurpleXmlNode **packet,
 				purple_strequal((*packet)->name, "iq") ||
 				purple_strequal((*packet)->name, "presence"))
 			purple_xmlnode_set_namespace(*packet, NS_XMPP_CLIENT);
-	txt = purple_xmlnode_to_str(*packet, &len);
-	jabber_send_raw(NULL, js, txt, len);
-	g_free(txt);
+
+	/* Serialize straight into the buffer that's handed to the output
+	 * stream, rather than into a string that then gets copied. The buffer
+	 * stays nul-terminated for the debug output and signal handlers. */
+	txt = g_string_sized_new(256);
+	purple_xmlnode_append_to_string(*packet, txt);
+	bytes = g_string_free_to_bytes(txt);
+	jabber_send_data(js, g_bytes_get_data(bytes, NULL),
+	                 g_bytes_get_size(bytes), bytes);
+	g_bytes_unref(bytes);
 }
 
 void jabber_send(JabberStream *js, PurpleXmlNode *packet)
@@ -3763,6 +3790,7 @@ jabber_do_uninit(void)
 #endif
 
 	jabber_auth_uninit();
+	jabber_parser_uninit();
 	g_list_free_full(jabber_features, (GDestroyNotify)jabber_feature_free);
 	g_list_free_full(jabber_identities, (GDestroyNotify)jabber_identity_free);
 
@@ -3964,6 +3992,16 @@ jabber_protocol_chat_invite(PurpleProtocolChat *protocol_chat,
 	jabber_chat_invite(connection, id, message, who);
 }
 
+/* Occupant nicks are resources, which jabber_id_new() has already run through
+ * resourceprep by the time they're added to a chat, so they can be compared
+ * as they are.
+ */
+static gchar *
+jabber_chat_get_user_key(PurpleProtocolChat *protocol_chat, const gchar *who)
+{
+	return g_strdup(who);
+}
+
 static void
 jabber_protocol_chat_iface_init(PurpleProtocolChatInterface *chat_iface)
 {
@@ -3976,6 +4014,7 @@ jabber_protocol_chat_iface_init(PurpleProtocolChatInterface *chat_iface)
 	chat_iface->send               = jabber_message_send_chat;
 	chat_iface->get_user_real_name = jabber_chat_user_real_name;
 	chat_iface->set_topic          = jabber_chat_set_topic;
+	chat_iface->get_user_key       = jabber_chat_get_user_key;
 }
 
 static void
@@ -106,6 +106,8 @@ struct _JabberStream
 
 	xmlParserCtxt *context;
 	PurpleXmlNode *current;
+	PurpleMemoryPool *stanza_pool;
+	gboolean stanza_pool_shared;
 
 	struct {
 		guint8 major;
@@ -23,12 +23,137 @@
 #include <glib/gi18n-lib.h>
 
 #include <libxml/parser.h>
+#include <string.h>
 
 #include <purple.h>
 
 #include "jabber.h"
 #include "parser.h"
 
+/* Stanzas are built in a memory pool that is emptied once they've been
+ * dispatched, so most of them only need a single block. */
+#define JABBER_PARSER_POOL_BLOCK_SIZE (4096)
+
+/* The most element and attribute names and namespaces that will be interned.
+ * Anything after that is copied into the stanza's pool, so a misbehaving
+ * server can't make the table grow without bounds. */
+#define JABBER_PARSER_INTERN_MAX (1024)
+
+static GHashTable *interned = NULL;
+static GStringChunk *interned_chunk = NULL;
+
+static const char *
+jabber_parser_intern(PurpleMemoryPool *pool, const xmlChar *str)
+{
+	const char *ret;
+
+	if(str == NULL) {
+		return NULL;
+	}
+
+	if(interned == NULL) {
+		interned = g_hash_table_new(g_str_hash, g_str_equal);
+		interned_chunk = g_string_chunk_new(JABBER_PARSER_POOL_BLOCK_SIZE);
+	}
+
+	ret = g_hash_table_lookup(interned, str);
+	if(ret != NULL) {
+		return ret;
+	}
+
+	if(g_hash_table_size(interned) >= JABBER_PARSER_INTERN_MAX) {
+		return purple_memory_pool_strdup(pool, (const char *)str);
+	}
+
+	ret = g_string_chunk_insert(interned_chunk, (const char *)str);
+	g_hash_table_add(interned, (gpointer)ret);
+
+	return ret;
+}
+
+static char *
+jabber_parser_attrib_value(PurpleMemoryPool *pool, const xmlChar *begin,
+                           const xmlChar *end)
+{
+	gsize len = end - begin;
+	char *value;
+
+	if(memchr(begin, '&', len) == NULL) {
+		/* Nothing to unescape, so it can go straight into the pool. */
+		value = purple_memory_pool_alloc(pool, len + 1, sizeof(gchar));
+		memcpy(value, begin, len);
+		value[len] = '\0';
+	} else {
+		char *escaped = g_strndup((const gchar *)begin, len);
+		char *unescaped = purple_unescape_text(escaped);
+
+		value = purple_memory_pool_strdup(pool, unescaped);
+
+		g_free(escaped);
+		g_free(unescaped);
+	}
+
+	return value;
+}
+
+/* The parser only holds a toggle reference on the stanza pool, so this tells
+ * us whether any node still refers to it without peeking at the ref count. */
+static void
+jabber_parser_pool_toggled(gpointer data, G_GNUC_UNUSED GObject *pool,
+                           gboolean is_last_ref)
+{
+	JabberStream *js = data;
+
+	js->stanza_pool_shared = !is_last_ref;
+}
+
+static PurpleMemoryPool *
+jabber_parser_get_pool(JabberStream *js)
+{
+	if(js->stanza_pool == NULL) {
+		js->stanza_pool = purple_memory_pool_new();
+		purple_memory_pool_set_block_size(js->stanza_pool,
+		                                  JABBER_PARSER_POOL_BLOCK_SIZE);
+
+		g_object_add_toggle_ref(G_OBJECT(js->stanza_pool),
+		                        jabber_parser_pool_toggled, js);
+		g_object_unref(js->stanza_pool);
+	}
+
+	return js->stanza_pool;
+}
+
+static void
+jabber_parser_release_pool(JabberStream *js)
+{
+	PurpleMemoryPool *pool = js->stanza_pool;
+
+	if(pool == NULL) {
+		return;
+	}
+
+	js->stanza_pool = NULL;
+	js->stanza_pool_shared = FALSE;
+	g_object_remove_toggle_ref(G_OBJECT(pool), jabber_parser_pool_toggled, js);
+}
+
+static void
+jabber_parser_recycle_pool(JabberStream *js)
+{
+	if(js->stanza_pool == NULL) {
+		return;
+	}
+
+	/* If a handler held on to the stanza, it keeps the pool alive and we
+	 * start a new one for the next stanza. Otherwise the pool is emptied and
+	 * used again, which saves creating a new object for every stanza. */
+	if(js->stanza_pool_shared) {
+		jabber_parser_release_pool(js);
+	} else {
+		purple_memory_pool_cleanup(js->stanza_pool);
+	}
+}
+
 static void
 jabber_parser_element_start_libxml(void *user_data,
 				   const xmlChar *element_name, const xmlChar *prefix, const xmlChar *namespace,
@@ -102,13 +227,14 @@ jabber_parser_element_start_libxml(void *user_data,
 			                  "to be a MUST; digest legacy auth may fail.\n");
 		}
 	} else {
+		PurpleMemoryPool *pool;
 
-		if(js->current)
-			node = purple_xmlnode_new_child(js->current, (const char*) element_name);
-		else
-			node = purple_xmlnode_new((const char*) element_name);
-		purple_xmlnode_set_namespace(node, (const char*) namespace);
-		purple_xmlnode_set_prefix(node, (const char *)prefix);
+		pool = jabber_parser_get_pool(js);
+
+		node = purple_xmlnode_new_pooled(pool, js->current,
+		                                 jabber_parser_intern(pool, element_name),
+		                                 jabber_parser_intern(pool, namespace),
+		                                 jabber_parser_intern(pool, prefix));
 
 		if (nb_namespaces != 0) {
 			node->namespace_map = g_hash_table_new_full(
@@ -122,18 +248,12 @@ jabber_parser_element_start_libxml(void *user_data,
 			}
 		}
 		for(i=0; i < nb_attributes * 5; i+=5) {
-			const char *name = (const char *)attributes[i];
-			const char *prefix = (const char *)attributes[i+1];
-			const char *attrib_ns = (const char *)attributes[i+2];
-			char *txt;
-			int attrib_len = attributes[i+4] - attributes[i+3];
-			char *attrib = g_strndup((gchar *)attributes[i+3], attrib_len);
-
-			txt = attrib;
-			attrib = purple_unescape_text(txt);
-			g_free(txt);
-			purple_xmlnode_set_attrib_full(node, name, attrib_ns, prefix, attrib);
-			g_free(attrib);
+			purple_xmlnode_add_attrib_pooled(node,
+				jabber_parser_intern(pool, attributes[i]),
+				jabber_parser_intern(pool, attributes[i+2]),
+				jabber_parser_intern(pool, attributes[i+1]),
+				jabber_parser_attrib_value(pool, attributes[i+3],
+				                           attributes[i+4]));
 		}
 
 		js->current = node;
@@ -158,6 +278,7 @@ jabber_parser_element_end_libxml(void *user_data, const xmlChar *element_name,
 		jabber_process_packet(js, &packet);
 		if (packet != NULL)
 			purple_xmlnode_free(packet);
+		jabber_parser_recycle_pool(js);
 	}
 }
 
@@ -254,6 +375,28 @@ void jabber_parser_free(JabberStream *js) {
 		xmlFreeParserCtxt(js->context);
 		js->context = NULL;
 	}
+
+	/* Drop any stanza that was cut off in the middle. */
+	if (js->current) {
+		PurpleXmlNode *root = js->current;
+
+		while (root->parent)
+			root = root->parent;
+		js->current = NULL;
+		purple_xmlnode_free(root);
+	}
+
+	jabber_parser_release_pool(js);
+}
+
+void
+jabber_parser_uninit(void)
+{
+	g_clear_pointer(&interned, g_hash_table_destroy);
+	if (interned_chunk) {
+		g_string_chunk_free(interned_chunk);
+		interned_chunk = NULL;
+	}
 }
 
 void jabber_parser_process(JabberStream *js, const char *buf, int len)
@@ -30,5 +30,6 @@
 void jabber_parser_setup(JabberStream *js);
 void jabber_parser_free(JabberStream *js);
 void jabber_parser_process(JabberStream *js, const char *buf, int len);
+void jabber_parser_uninit(void);
 
 #endif /* PURPLE_JABBER_PARSER_H */
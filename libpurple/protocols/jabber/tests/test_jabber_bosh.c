@@ -0,0 +1,686 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include <purple.h>
+
+#include <libsoup/soup.h>
+
+#include "tests/test_ui.h"
+#include "protocols/jabber/bosh.h"
+
+#define TEST_BOSH_MESSAGE_SIZE (200)
+#define TEST_BOSH_DURATION (20 * G_USEC_PER_SEC)
+#define TEST_BOSH_WAIT (10 * G_USEC_PER_SEC)
+#define TEST_BOSH_MS (1000)
+
+/* How long to wait for the real connection to do something, and how long to
+ * watch it to make sure it doesn't. The latter is longer than the delay
+ * before an empty request is sent.
+ */
+#define TEST_BOSH_DEADLINE (5 * G_USEC_PER_SEC)
+#define TEST_BOSH_SETTLE (500 * TEST_BOSH_MS)
+
+/******************************************************************************
+ * Stand-in connection manager
+ *
+ * Runs the request window against a simulated BOSH server on a virtual clock.
+ * The server holds on to at most `hold` requests and answers the oldest one
+ * as soon as a new one comes in, or once it's been held for the wait time.
+ * Each direction of the connection takes `one_way` microseconds, which is
+ * where an HTTP proxy in the path shows up.
+ *****************************************************************************/
+typedef struct {
+	gint64 arrival;
+	GArray *queued; /* when each message in the request was queued */
+} TestBoshRequest;
+
+typedef struct {
+	JabberBOSHWindow window;
+	gint64 now;
+	gint64 one_way;
+	gint64 timer;
+
+	GArray *pending;
+	GQueue to_server;
+	GQueue held; /* of gint64 *, when each request was parked */
+	GQueue to_client; /* of gint64 *, when each response arrives */
+
+	guint requests_sent;
+	guint max_outstanding;
+	guint delivered;
+	gint64 total_latency;
+	gint64 max_latency;
+} TestBoshSim;
+
+static void
+test_bosh_sim_flush(TestBoshSim *sim) {
+	TestBoshRequest *request = NULL;
+
+	if(sim->window.outstanding >= sim->window.requests) {
+		return;
+	}
+	sim->timer = -1;
+
+	request = g_new0(TestBoshRequest, 1);
+	request->arrival = sim->now + sim->one_way;
+	request->queued = sim->pending;
+	sim->pending = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+	jabber_bosh_window_sent(&sim->window,
+	                        request->queued->len * TEST_BOSH_MESSAGE_SIZE,
+	                        sim->now);
+	g_queue_push_tail(&sim->to_server, request);
+
+	sim->requests_sent++;
+	sim->max_outstanding = MAX(sim->max_outstanding,
+	                           sim->window.outstanding);
+}
+
+static void
+test_bosh_sim_schedule(TestBoshSim *sim) {
+	gint delay = jabber_bosh_window_next_flush(&sim->window,
+		sim->pending->len * TEST_BOSH_MESSAGE_SIZE);
+
+	if(delay == 0) {
+		test_bosh_sim_flush(sim);
+	} else if(delay > 0 && sim->timer < 0) {
+		sim->timer = sim->now + delay * TEST_BOSH_MS;
+	}
+}
+
+static void
+test_bosh_sim_respond(TestBoshSim *sim) {
+	gint64 *arrival = g_new(gint64, 1);
+
+	g_free(g_queue_pop_head(&sim->held));
+	*arrival = sim->now + sim->one_way;
+	g_queue_push_tail(&sim->to_client, arrival);
+}
+
+static void
+test_bosh_sim_step(TestBoshSim *sim) {
+	TestBoshRequest *request = NULL;
+	gint64 *when = NULL;
+
+	while((when = g_queue_peek_head(&sim->to_client)) != NULL &&
+	      *when <= sim->now)
+	{
+		g_free(g_queue_pop_head(&sim->to_client));
+		jabber_bosh_window_received(&sim->window, sim->now);
+		test_bosh_sim_schedule(sim);
+	}
+
+	while((request = g_queue_peek_head(&sim->to_server)) != NULL &&
+	      request->arrival <= sim->now)
+	{
+		g_queue_pop_head(&sim->to_server);
+
+		for(guint i = 0; i < request->queued->len; i++) {
+			gint64 latency = sim->now -
+			                 g_array_index(request->queued, gint64, i);
+
+			sim->delivered++;
+			sim->total_latency += latency;
+			sim->max_latency = MAX(sim->max_latency, latency);
+		}
+
+		when = g_new(gint64, 1);
+		*when = sim->now;
+		g_queue_push_tail(&sim->held, when);
+		while(g_queue_get_length(&sim->held) > MAX(sim->window.hold, 1)) {
+			test_bosh_sim_respond(sim);
+		}
+
+		g_array_free(request->queued, TRUE);
+		g_free(request);
+	}
+
+	while((when = g_queue_peek_head(&sim->held)) != NULL &&
+	      sim->now - *when >= TEST_BOSH_WAIT)
+	{
+		test_bosh_sim_respond(sim);
+	}
+
+	if(sim->timer >= 0 && sim->timer <= sim->now) {
+		sim->timer = -1;
+		test_bosh_sim_flush(sim);
+	}
+}
+
+static void
+test_bosh_sim_queue(TestBoshSim *sim) {
+	g_array_append_val(sim->pending, sim->now);
+	test_bosh_sim_schedule(sim);
+}
+
+/* Every 2 seconds a burst of 100 stanzas, like a roster or presence flood,
+ * with a chat message every 300ms in between. */
+static void
+test_bosh_sim_run(const gchar *name, gint64 one_way) {
+	TestBoshSim sim = {
+		.one_way = one_way,
+		.timer = -1,
+	};
+	guint queued = 0;
+
+	jabber_bosh_window_init(&sim.window);
+	jabber_bosh_window_set_limits(&sim.window, 2, 1);
+	sim.pending = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+	/* Session creation. */
+	jabber_bosh_window_sent(&sim.window, 0, sim.now);
+	sim.now += 2 * one_way;
+	jabber_bosh_window_received(&sim.window, sim.now);
+	test_bosh_sim_schedule(&sim);
+
+	for(; sim.now < TEST_BOSH_DURATION + TEST_BOSH_WAIT;
+	    sim.now += TEST_BOSH_MS)
+	{
+		gint64 ms = sim.now / TEST_BOSH_MS;
+
+		if(sim.now < TEST_BOSH_DURATION) {
+			if(ms % 2000 < 100) {
+				test_bosh_sim_queue(&sim);
+				queued++;
+			} else if(ms % 300 == 0) {
+				test_bosh_sim_queue(&sim);
+				queued++;
+			}
+		}
+
+		test_bosh_sim_step(&sim);
+	}
+
+	g_test_message("%s (%" G_GINT64_FORMAT " ms each way): %u stanzas in "
+	               "%u requests, latency %" G_GINT64_FORMAT " ms average, %"
+	               G_GINT64_FORMAT " ms worst, round trip %" G_GINT64_FORMAT
+	               " ms, %.1f stanzas/s",
+	               name, one_way / TEST_BOSH_MS, sim.delivered,
+	               sim.requests_sent,
+	               sim.total_latency / MAX(sim.delivered, 1) / TEST_BOSH_MS,
+	               sim.max_latency / TEST_BOSH_MS,
+	               jabber_bosh_window_get_rtt(&sim.window) / TEST_BOSH_MS,
+	               sim.delivered * (gdouble)G_USEC_PER_SEC /
+	               TEST_BOSH_DURATION);
+
+	/* Everything arrived, without going over the negotiated window. */
+	g_assert_cmpuint(sim.delivered, ==, queued);
+	g_assert_cmpuint(sim.max_outstanding, <=, 2);
+
+	/* Bursts were batched, but nothing waited much longer than the batching
+	 * delay and a round trip for a free request. */
+	g_assert_cmpuint(sim.requests_sent, <, queued / 2);
+	g_assert_cmpint(sim.max_latency, <=, 250 * TEST_BOSH_MS + 4 * one_way);
+
+	/* The measured round trip is about what the network takes. */
+	g_assert_cmpint(jabber_bosh_window_get_rtt(&sim.window), >=,
+	                2 * one_way);
+	g_assert_cmpint(jabber_bosh_window_get_rtt(&sim.window), <=,
+	                2 * one_way + 10 * TEST_BOSH_MS);
+
+	g_array_free(sim.pending, TRUE);
+	g_queue_clear_full(&sim.held, g_free);
+	g_queue_clear_full(&sim.to_client, g_free);
+}
+
+/******************************************************************************
+ * In-process connection manager
+ *
+ * A SoupServer that creates sessions with the given requests and hold
+ * values, and then holds on to every request it gets until the test tells it
+ * to answer. A real PurpleJabberBOSHConnection talks to it over HTTP, so
+ * what shows up here is what would go out on the wire.
+ *****************************************************************************/
+typedef struct {
+	SoupServer *server;
+	gchar *url;
+
+	/* The session creation attributes, NULL to leave them out. */
+	const gchar *requests;
+	const gchar *hold;
+
+	gboolean created;
+	guint64 rid;
+
+	GPtrArray *bodies; /* of gchar *, every request after session creation */
+	GQueue held; /* of SoupMessage * */
+	guint max_held;
+} TestBoshServer;
+
+typedef struct {
+	TestBoshServer server;
+
+	PurpleConnection *connection;
+	JabberStream *js;
+	PurpleJabberBOSHConnection *conn;
+} TestBoshFixture;
+
+static PurpleAccount *account = NULL;
+
+static void
+test_bosh_server_finished_cb(SoupMessage *msg, gpointer data) {
+	TestBoshServer *server = data;
+
+	g_queue_remove(&server->held, msg);
+}
+
+static void
+test_bosh_server_cb(SoupServer *soup_server, SoupMessage *msg,
+                    G_GNUC_UNUSED const char *path,
+                    G_GNUC_UNUSED GHashTable *query,
+                    G_GNUC_UNUSED SoupClientContext *client, gpointer data)
+{
+	TestBoshServer *server = data;
+	SoupBuffer *buffer = NULL;
+	PurpleXmlNode *body = NULL;
+
+	buffer = soup_message_body_flatten(msg->request_body);
+	body = purple_xmlnode_from_str(buffer->data, buffer->length);
+	g_assert_nonnull(body);
+
+	if(purple_xmlnode_get_attrib(body, "to") != NULL) {
+		GString *response = g_string_new(
+			"<body xmlns='http://jabber.org/protocol/httpbind' "
+			"sid='test-sid' ver='1.10'");
+
+		g_assert_false(server->created);
+		server->created = TRUE;
+		server->rid = g_ascii_strtoull(purple_xmlnode_get_attrib(body, "rid"),
+		                               NULL, 10);
+
+		if(server->requests != NULL) {
+			g_string_append_printf(response, " requests='%s'",
+			                       server->requests);
+		}
+		if(server->hold != NULL) {
+			g_string_append_printf(response, " hold='%s'", server->hold);
+		}
+		g_string_append(response,
+			"><stream:features xmlns:stream='http://etherx.jabber.org/streams'>"
+			"<ver xmlns='urn:xmpp:features:rosterver'/>"
+			"</stream:features></body>");
+
+		soup_message_set_status(msg, SOUP_STATUS_OK);
+		soup_message_set_response(msg, "text/xml; charset=utf-8",
+		                          SOUP_MEMORY_TAKE, response->str,
+		                          response->len);
+		g_string_free(response, FALSE);
+	} else {
+		g_ptr_array_add(server->bodies,
+		                g_strndup(buffer->data, buffer->length));
+
+		g_signal_connect(msg, "finished",
+		                 G_CALLBACK(test_bosh_server_finished_cb), server);
+		g_queue_push_tail(&server->held, msg);
+		server->max_held = MAX(server->max_held,
+		                       g_queue_get_length(&server->held));
+		soup_server_pause_message(soup_server, msg);
+	}
+
+	purple_xmlnode_free(body);
+	soup_buffer_free(buffer);
+}
+
+/* Answers the oldest held request with an empty body. */
+static void
+test_bosh_server_respond(TestBoshServer *server) {
+	static const gchar response[] =
+		"<body xmlns='http://jabber.org/protocol/httpbind'/>";
+	SoupMessage *msg = g_queue_pop_head(&server->held);
+
+	g_assert_nonnull(msg);
+
+	g_signal_handlers_disconnect_by_func(msg, test_bosh_server_finished_cb,
+	                                     server);
+	soup_message_set_status(msg, SOUP_STATUS_OK);
+	soup_message_set_response(msg, "text/xml; charset=utf-8",
+	                          SOUP_MEMORY_STATIC, response,
+	                          sizeof(response) - 1);
+	soup_server_unpause_message(server->server, msg);
+}
+
+/* The body the connection is expected to send for the nth request after
+ * session creation, with the given stanzas in it.
+ */
+static gchar *
+test_bosh_server_expected(TestBoshServer *server, guint n,
+                          const gchar *stanzas)
+{
+	return g_strdup_printf("<body rid='%" G_GUINT64_FORMAT "' "
+	                       "sid='test-sid' "
+	                       "xmlns='http://jabber.org/protocol/httpbind' "
+	                       "xmlns:xmpp='urn:xmpp:xbosh' >%s</body>",
+	                       server->rid + n + 1, stanzas);
+}
+
+static gboolean
+test_bosh_wakeup_cb(G_GNUC_UNUSED gpointer data) {
+	return G_SOURCE_CONTINUE;
+}
+
+/* Runs the main loop until the server has seen the given number of requests
+ * after session creation.
+ */
+static void
+test_bosh_wait_for(TestBoshServer *server, guint requests) {
+	gint64 deadline = g_get_monotonic_time() + TEST_BOSH_DEADLINE;
+	guint wakeup = g_timeout_add(10, test_bosh_wakeup_cb, NULL);
+
+	while(server->bodies->len < requests) {
+		g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	g_source_remove(wakeup);
+}
+
+/* Runs the main loop for a while, to give the connection a chance to send
+ * anything it shouldn't.
+ */
+static void
+test_bosh_settle(void) {
+	gint64 deadline = g_get_monotonic_time() + TEST_BOSH_SETTLE;
+	guint wakeup = g_timeout_add(10, test_bosh_wakeup_cb, NULL);
+
+	while(g_get_monotonic_time() < deadline) {
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	g_source_remove(wakeup);
+}
+
+static void
+test_bosh_fixture_setup(TestBoshFixture *fixture, gconstpointer data) {
+	TestBoshServer *server = &fixture->server;
+	const gchar * const *limits = data;
+	GSList *uris = NULL;
+	GError *error = NULL;
+
+	server->requests = limits[0];
+	server->hold = limits[1];
+	server->bodies = g_ptr_array_new_with_free_func(g_free);
+	server->server = soup_server_new(NULL, NULL);
+	soup_server_add_handler(server->server, NULL, test_bosh_server_cb,
+	                        server, NULL);
+	soup_server_listen_local(server->server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY,
+	                         &error);
+	g_assert_no_error(error);
+
+	uris = soup_server_get_uris(server->server);
+	g_assert_nonnull(uris);
+	server->url = soup_uri_to_string(uris->data, FALSE);
+	g_slist_free_full(uris, (GDestroyNotify)soup_uri_free);
+
+	fixture->connection = g_object_new(PURPLE_TYPE_CONNECTION,
+	                                   "account", account,
+	                                   NULL);
+	fixture->js = g_new0(JabberStream, 1);
+	fixture->js->gc = fixture->connection;
+	fixture->js->user = jabber_id_new("romeo@example.net/orchard");
+	fixture->js->max_inactivity = 120;
+
+	fixture->conn = jabber_bosh_connection_new(fixture->js, server->url);
+	g_assert_nonnull(fixture->conn);
+}
+
+static void
+test_bosh_fixture_teardown(TestBoshFixture *fixture,
+                           G_GNUC_UNUSED gconstpointer data)
+{
+	TestBoshServer *server = &fixture->server;
+	SoupMessage *msg = NULL;
+
+	jabber_bosh_connection_destroy(fixture->conn);
+
+	g_clear_handle_id(&fixture->js->inactivity_timer, g_source_remove);
+	jabber_id_free(fixture->js->user);
+	g_free(fixture->js);
+	g_clear_object(&fixture->connection);
+
+	while((msg = g_queue_pop_head(&server->held)) != NULL) {
+		g_signal_handlers_disconnect_by_func(msg,
+		                                     test_bosh_server_finished_cb,
+		                                     server);
+		soup_message_set_status(msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+		soup_server_unpause_message(server->server, msg);
+	}
+	soup_server_disconnect(server->server);
+	g_clear_object(&server->server);
+
+	g_ptr_array_free(server->bodies, TRUE);
+	g_free(server->url);
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_jabber_bosh_window_limits(void) {
+	JabberBOSHWindow window;
+
+	jabber_bosh_window_init(&window);
+	g_assert_cmpuint(window.requests, ==, 2);
+	g_assert_cmpuint(window.hold, ==, 1);
+
+	/* Never more than we're willing to keep open, and always one request
+	 * left for sending. */
+	jabber_bosh_window_set_limits(&window, 100, 100);
+	g_assert_cmpuint(window.requests, ==, 4);
+	g_assert_cmpuint(window.hold, ==, 3);
+
+	jabber_bosh_window_set_limits(&window, 0, 1);
+	g_assert_cmpuint(window.requests, ==, 1);
+	g_assert_cmpuint(window.hold, ==, 0);
+}
+
+static void
+test_jabber_bosh_window_flush(void) {
+	JabberBOSHWindow window;
+	gint64 now = G_USEC_PER_SEC;
+
+	jabber_bosh_window_init(&window);
+
+	/* Nothing open, so poll, and send data right away. */
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 0), >, 0);
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 10), ==, 0);
+
+	/* The held request is there, so there's no need to poll. */
+	jabber_bosh_window_sent(&window, 0, now);
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 0), ==, -1);
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 10), ==, 0);
+
+	/* Both requests are open, so data has to wait for a response. */
+	jabber_bosh_window_sent(&window, 10, now);
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 10), ==, -1);
+
+	now += 50 * TEST_BOSH_MS;
+	jabber_bosh_window_received(&window, now);
+	g_assert_cmpint(jabber_bosh_window_get_rtt(&window), ==,
+	                50 * TEST_BOSH_MS);
+
+	/* Data keeps coming, so it gets batched for a little while. */
+	jabber_bosh_window_sent(&window, 10, now);
+	jabber_bosh_window_received(&window, now);
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 10), >, 0);
+
+	/* Unless there's a lot of it. */
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 1024 * 1024), ==,
+	                0);
+
+	/* And once things are quiet, it goes out right away again. */
+	now += 10 * G_USEC_PER_SEC;
+	jabber_bosh_window_sent(&window, 10, now);
+	jabber_bosh_window_received(&window, now);
+	g_assert_cmpint(jabber_bosh_window_next_flush(&window, 10), ==, 0);
+}
+
+static void
+test_jabber_bosh_direct(void) {
+	test_bosh_sim_run("direct", 10 * TEST_BOSH_MS);
+}
+
+static void
+test_jabber_bosh_proxy(void) {
+	test_bosh_sim_run("proxied", 120 * TEST_BOSH_MS);
+}
+
+static void
+test_jabber_bosh_connection_window(TestBoshFixture *fixture,
+                                   G_GNUC_UNUSED gconstpointer data)
+{
+	TestBoshServer *server = &fixture->server;
+	const gchar *stanzas[] = {"<a/>", "<b/>", "<c/>"};
+	gchar *expected = NULL;
+
+	/* Once the session is up, an empty request is left with the server. */
+	test_bosh_wait_for(server, 1);
+	expected = test_bosh_server_expected(server, 0, "");
+	g_assert_cmpstr(server->bodies->pdata[0], ==, expected);
+	g_free(expected);
+
+	/* The server allowed four requests and the session allows for as many
+	 * connections, so they're all open at once.
+	 */
+	for(guint i = 0; i < G_N_ELEMENTS(stanzas); i++) {
+		jabber_bosh_connection_send(fixture->conn, stanzas[i]);
+		test_bosh_wait_for(server, i + 2);
+
+		expected = test_bosh_server_expected(server, i + 1, stanzas[i]);
+		g_assert_cmpstr(server->bodies->pdata[i + 1], ==, expected);
+		g_free(expected);
+	}
+	g_assert_cmpuint(server->max_held, ==, 4);
+
+	/* With every request in use, more data has to wait. */
+	jabber_bosh_connection_send(fixture->conn, "<d/>");
+	jabber_bosh_connection_send(fixture->conn, "<e/>");
+	test_bosh_settle();
+	g_assert_cmpuint(server->bodies->len, ==, 4);
+
+	/* A response frees up exactly one request, which takes everything that
+	 * was buffered in the meantime.
+	 */
+	test_bosh_server_respond(server);
+	test_bosh_wait_for(server, 5);
+	expected = test_bosh_server_expected(server, 4, "<d/><e/>");
+	g_assert_cmpstr(server->bodies->pdata[4], ==, expected);
+	g_free(expected);
+
+	jabber_bosh_connection_send(fixture->conn, "<f/>");
+	test_bosh_settle();
+	g_assert_cmpuint(server->bodies->len, ==, 5);
+	g_assert_cmpuint(server->max_held, ==, 4);
+}
+
+static void
+test_jabber_bosh_connection_single(TestBoshFixture *fixture,
+                                   G_GNUC_UNUSED gconstpointer data)
+{
+	TestBoshServer *server = &fixture->server;
+	gchar *expected = NULL;
+
+	/* A server that doesn't hold anything still gets polled. */
+	test_bosh_wait_for(server, 1);
+
+	/* But only one request is allowed, so data waits for the poll to come
+	 * back.
+	 */
+	jabber_bosh_connection_send(fixture->conn, "<a/>");
+	test_bosh_settle();
+	g_assert_cmpuint(server->bodies->len, ==, 1);
+
+	test_bosh_server_respond(server);
+	test_bosh_wait_for(server, 2);
+	expected = test_bosh_server_expected(server, 1, "<a/>");
+	g_assert_cmpstr(server->bodies->pdata[1], ==, expected);
+	g_free(expected);
+
+	g_assert_cmpuint(server->max_held, ==, 1);
+}
+
+static void
+test_jabber_bosh_connection_default(TestBoshFixture *fixture,
+                                    G_GNUC_UNUSED gconstpointer data)
+{
+	TestBoshServer *server = &fixture->server;
+
+	/* Without requests and hold from the server, two requests are used. */
+	test_bosh_wait_for(server, 1);
+	jabber_bosh_connection_send(fixture->conn, "<a/>");
+	test_bosh_wait_for(server, 2);
+
+	jabber_bosh_connection_send(fixture->conn, "<b/>");
+	test_bosh_settle();
+	g_assert_cmpuint(server->bodies->len, ==, 2);
+	g_assert_cmpuint(server->max_held, ==, 2);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar **argv) {
+	static const gchar *window_limits[] = {"4", "3"};
+	static const gchar *single_limits[] = {"1", "0"};
+	static const gchar *default_limits[] = {NULL, NULL};
+	PurpleProxyInfo *info = NULL;
+	gint ret = 0;
+
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+	jabber_bosh_init();
+
+	/* Connect straight to the local server, and don't give up on it for a
+	 * lack of TLS.
+	 */
+	account = purple_account_new("romeo@example.net", "prpl-jabber");
+	info = purple_proxy_info_new();
+	purple_proxy_info_set_proxy_type(info, PURPLE_PROXY_TYPE_NONE);
+	purple_account_set_proxy_info(account, info);
+	g_object_unref(info);
+	purple_account_set_string(account, "connection_security",
+	                          "opportunistic_tls");
+
+	g_test_add_func("/jabber/bosh/window/limits",
+	                test_jabber_bosh_window_limits);
+	g_test_add_func("/jabber/bosh/window/flush",
+	                test_jabber_bosh_window_flush);
+	g_test_add_func("/jabber/bosh/direct", test_jabber_bosh_direct);
+	g_test_add_func("/jabber/bosh/proxy", test_jabber_bosh_proxy);
+
+	g_test_add("/jabber/bosh/connection/window", TestBoshFixture,
+	           window_limits, test_bosh_fixture_setup,
+	           test_jabber_bosh_connection_window, test_bosh_fixture_teardown);
+	g_test_add("/jabber/bosh/connection/single", TestBoshFixture,
+	           single_limits, test_bosh_fixture_setup,
+	           test_jabber_bosh_connection_single, test_bosh_fixture_teardown);
+	g_test_add("/jabber/bosh/connection/default", TestBoshFixture,
+	           default_limits, test_bosh_fixture_setup,
+	           test_jabber_bosh_connection_default,
+	           test_bosh_fixture_teardown);
+
+	ret = g_test_run();
+
+	g_clear_object(&account);
+	jabber_bosh_uninit();
+
+	return ret;
+}
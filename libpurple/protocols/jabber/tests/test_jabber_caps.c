@@ -1,4 +1,7 @@
 #include <glib.h>
+#include <glib/gstdio.h>
+
+#include <string.h>
 
 #include <purple.h>
 
@@ -44,6 +47,260 @@ test_jabber_caps_calculate_from_xmlnode(void) {
 	);
 }
 
+static void
+test_jabber_caps_cache_cb(JabberCapsClientInfo *info, GList *exts,
+                          gpointer data)
+{
+	gchar **feature = data;
+
+	g_assert_nonnull(info);
+	g_assert_nonnull(info->features);
+	*feature = g_strdup(info->features->data);
+}
+
+static gchar *
+test_jabber_caps_cache_lookup(const gchar *node, const gchar *ver) {
+	gchar *feature = NULL;
+
+	jabber_caps_get_info(NULL, "juliet@example.com/balcony", node, ver,
+	                     "sha-1", NULL, test_jabber_caps_cache_cb, &feature);
+
+	return feature;
+}
+
+static void
+test_jabber_caps_cache(void) {
+	GError *error = NULL;
+	gchar *user_dir, *cache_dir, *path, *journal, *contents = NULL;
+	gchar *feature;
+	gchar **lines;
+	guint records = 0;
+
+	user_dir = g_dir_make_tmp("purple-test-jabber-caps-XXXXXX", &error);
+	g_assert_no_error(error);
+	purple_util_set_user_dir(user_dir);
+	cache_dir = g_build_filename(user_dir, "cache", NULL);
+	path = g_build_filename(cache_dir, "xmpp-caps.xml", NULL);
+	journal = g_build_filename(cache_dir, "xmpp-caps-journal.xml", NULL);
+
+	/* A cache written by an older version is still read... */
+	g_assert_true(purple_util_write_data_to_cache_file("xmpp-caps.xml",
+		"<?xml version='1.0' encoding='UTF-8' ?>\n\n"
+		"<capabilities>\n"
+		"\t<client node='http://pidgin.im/' ver='AAA=' hash='sha-1'>\n"
+		"\t\t<identity category='client' type='pc' name='Pidgin'/>\n"
+		"\t\t<feature var='urn:xmpp:ping'/>\n"
+		"\t</client>\n"
+		"</capabilities>\n", -1));
+
+	jabber_caps_init();
+	feature = test_jabber_caps_cache_lookup("http://pidgin.im/", "AAA=");
+	g_assert_cmpstr(feature, ==, "urn:xmpp:ping");
+	g_free(feature);
+	jabber_caps_uninit();
+
+	/* ...and rewritten with one client per line. */
+	g_assert_true(g_file_get_contents(path, &contents, NULL, &error));
+	g_assert_no_error(error);
+	lines = g_strsplit(contents, "\n", -1);
+	for(guint i = 0; lines[i] != NULL; i++) {
+		if(g_str_has_prefix(lines[i], "<client")) {
+			g_assert_nonnull(strstr(lines[i], "ver='AAA='"));
+			g_assert_true(g_str_has_suffix(lines[i], "</client>"));
+			records++;
+		}
+	}
+	g_assert_cmpuint(records, ==, 1);
+	g_strfreev(lines);
+	g_free(contents);
+
+	/* Records in the journal are read over it. */
+	g_assert_true(g_file_set_contents(journal,
+		"<client node='http://example.com/' ver='BBB=' hash='sha-1'>"
+		"<feature var='jabber:iq:version'/></client>\n", -1, &error));
+	g_assert_no_error(error);
+
+	jabber_caps_init();
+	feature = test_jabber_caps_cache_lookup("http://example.com/", "BBB=");
+	g_assert_cmpstr(feature, ==, "jabber:iq:version");
+	g_free(feature);
+	feature = test_jabber_caps_cache_lookup("http://pidgin.im/", "AAA=");
+	g_assert_cmpstr(feature, ==, "urn:xmpp:ping");
+	g_free(feature);
+	jabber_caps_uninit();
+
+	/* Nothing changed, so neither file was rewritten. */
+	g_assert_true(g_file_test(journal, G_FILE_TEST_EXISTS));
+
+	g_remove(journal);
+	g_remove(path);
+	g_rmdir(cache_dir);
+	g_rmdir(user_dir);
+	purple_util_set_user_dir(NULL);
+
+	g_free(journal);
+	g_free(path);
+	g_free(cache_dir);
+	g_free(user_dir);
+}
+
+static JabberCapsClientInfo *
+test_jabber_caps_client_new(const gchar *ver, const gchar *feature) {
+	PurpleXmlNode *query, *child;
+	JabberCapsClientInfo *info;
+	JabberCapsTuple *tuple;
+
+	query = purple_xmlnode_new("query");
+	purple_xmlnode_set_namespace(query,
+	                             "http://jabber.org/protocol/disco#info");
+	child = purple_xmlnode_new_child(query, "feature");
+	purple_xmlnode_set_attrib(child, "var", feature);
+
+	info = jabber_caps_parse_client_info(query);
+	purple_xmlnode_free(query);
+
+	tuple = (JabberCapsTuple *)&info->tuple;
+	tuple->node = g_strdup("http://example.com/");
+	tuple->ver = g_strdup(ver);
+	tuple->hash = g_strdup("sha-1");
+
+	return info;
+}
+
+/* Returns the lines of a file that hold a record, or NULL if it's missing. */
+static gchar **
+test_jabber_caps_read_records(const gchar *path) {
+	GPtrArray *records;
+	gchar *contents = NULL;
+	gchar **lines;
+
+	if(!g_file_get_contents(path, &contents, NULL, NULL)) {
+		return NULL;
+	}
+
+	records = g_ptr_array_new();
+	lines = g_strsplit(contents, "\n", -1);
+	for(guint i = 0; lines[i] != NULL; i++) {
+		if(g_str_has_prefix(lines[i], "<client")) {
+			g_ptr_array_add(records, g_strdup(lines[i]));
+		}
+	}
+	g_ptr_array_add(records, NULL);
+	g_strfreev(lines);
+	g_free(contents);
+
+	return (gchar **)g_ptr_array_free(records, FALSE);
+}
+
+static void
+test_jabber_caps_journal(void) {
+	const gchar *untouched =
+		"<client node=\"http://example.com/\" ver=\"DDD=\" hash=\"sha-1\">"
+		"<feature var=\"urn:xmpp:receipts\"/></client>";
+	GError *error = NULL;
+	gchar *user_dir, *cache_dir, *path, *journal, *contents;
+	gchar *feature;
+	gchar **records;
+	guint i;
+
+	user_dir = g_dir_make_tmp("purple-test-jabber-caps-XXXXXX", &error);
+	g_assert_no_error(error);
+	purple_util_set_user_dir(user_dir);
+	cache_dir = g_build_filename(user_dir, "cache", NULL);
+	path = g_build_filename(cache_dir, "xmpp-caps.xml", NULL);
+	journal = g_build_filename(cache_dir, "xmpp-caps-journal.xml", NULL);
+
+	/* Start tags are read directly, so they may be laid out differently than
+	 * they're written, as long as entities are taken care of. */
+	contents = g_strdup_printf(
+		"<?xml version='1.0' encoding='UTF-8' ?>\n"
+		"<capabilities>\n"
+		"<client node=\"http://example.com/?a&amp;b\" ver=\"CCC=\" "
+		"hash=\"sha-1\"><feature var=\"urn:xmpp:ping\"/></client>\n"
+		"%s\n"
+		"</capabilities>\n", untouched);
+	g_assert_true(purple_util_write_data_to_cache_file("xmpp-caps.xml",
+	                                                   contents, -1));
+	g_free(contents);
+
+	/* New clients go to the journal, one per line even with a newline in
+	 * them, and xmpp-caps.xml is left alone. */
+	jabber_caps_init();
+	jabber_caps_store_client(test_jabber_caps_client_new("V000=",
+	                                                     "line1\nline2"));
+	for(i = 1; i < 250; i++) {
+		gchar *ver = g_strdup_printf("V%03u=", i);
+
+		feature = g_strdup_printf("urn:test:%u", i);
+		jabber_caps_store_client(test_jabber_caps_client_new(ver, feature));
+		g_free(feature);
+		g_free(ver);
+	}
+	jabber_caps_uninit();
+
+	records = test_jabber_caps_read_records(journal);
+	g_assert_nonnull(records);
+	g_assert_cmpuint(g_strv_length(records), ==, 250);
+	g_assert_nonnull(strstr(records[0], "ver='V000='"));
+	g_assert_nonnull(strstr(records[0], "line1&#10;line2"));
+	g_strfreev(records);
+
+	records = test_jabber_caps_read_records(path);
+	g_assert_cmpuint(g_strv_length(records), ==, 2);
+	g_strfreev(records);
+
+	/* Everything is read back, entities and all. */
+	jabber_caps_init();
+	feature = test_jabber_caps_cache_lookup("http://example.com/", "V000=");
+	g_assert_cmpstr(feature, ==, "line1\nline2");
+	g_free(feature);
+	feature = test_jabber_caps_cache_lookup("http://example.com/?a&b",
+	                                        "CCC=");
+	g_assert_cmpstr(feature, ==, "urn:xmpp:ping");
+	g_free(feature);
+
+	/* The journal now holds more clients than xmpp-caps.xml and more than
+	 * the minimum, so the next client compacts it. */
+	jabber_caps_store_client(test_jabber_caps_client_new("V250=",
+	                                                     "urn:test:250"));
+	jabber_caps_uninit();
+
+	g_assert_false(g_file_test(journal, G_FILE_TEST_EXISTS));
+	records = test_jabber_caps_read_records(path);
+	g_assert_nonnull(records);
+	g_assert_cmpuint(g_strv_length(records), ==, 253);
+
+	/* A client that was never looked up is written back as it was read. */
+	g_assert_true(g_strv_contains((const gchar * const *)records,
+	                              untouched));
+	g_strfreev(records);
+
+	jabber_caps_init();
+	feature = test_jabber_caps_cache_lookup("http://example.com/", "V250=");
+	g_assert_cmpstr(feature, ==, "urn:test:250");
+	g_free(feature);
+	feature = test_jabber_caps_cache_lookup("http://example.com/", "V000=");
+	g_assert_cmpstr(feature, ==, "line1\nline2");
+	g_free(feature);
+	feature = test_jabber_caps_cache_lookup("http://example.com/", "DDD=");
+	g_assert_cmpstr(feature, ==, "urn:xmpp:receipts");
+	g_free(feature);
+	jabber_caps_uninit();
+
+	/* Nothing new, so there's still no journal. */
+	g_assert_false(g_file_test(journal, G_FILE_TEST_EXISTS));
+
+	g_remove(path);
+	g_rmdir(cache_dir);
+	g_rmdir(user_dir);
+	purple_util_set_user_dir(NULL);
+
+	g_free(journal);
+	g_free(path);
+	g_free(cache_dir);
+	g_free(user_dir);
+}
+
 gint
 main(gint argc, gchar **argv) {
 	g_test_init(&argc, &argv, NULL);
@@ -54,5 +311,8 @@ main(gint argc, gchar **argv) {
 	g_test_add_func("/jabber/caps/calculate from xmlnode",
 	                test_jabber_caps_calculate_from_xmlnode);
 
+	g_test_add_func("/jabber/caps/cache", test_jabber_caps_cache);
+	g_test_add_func("/jabber/caps/journal", test_jabber_caps_journal);
+
 	return g_test_run();
 }
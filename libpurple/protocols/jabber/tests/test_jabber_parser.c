@@ -0,0 +1,335 @@
+#include <glib.h>
+#include <string.h>
+
+#include <purple.h>
+
+#include "tests/test_ui.h"
+#include "protocols/jabber/jabber.h"
+#include "protocols/jabber/parser.h"
+
+#define TEST_JABBER_PARSER_STREAM_HEADER \
+	"<?xml version='1.0'?>" \
+	"<stream:stream xmlns='jabber:client' " \
+	"xmlns:stream='http://etherx.jabber.org/streams' " \
+	"id='c2s_123' from='example.com' version='1.0'>"
+
+/******************************************************************************
+ * Test Protocol
+ *****************************************************************************/
+static GType test_jabber_parser_protocol_get_type(void);
+
+typedef struct {
+	PurpleProtocol parent;
+} TestJabberParserProtocol;
+
+typedef struct {
+	PurpleProtocolClass parent;
+} TestJabberParserProtocolClass;
+
+G_DEFINE_TYPE(TestJabberParserProtocol, test_jabber_parser_protocol,
+              PURPLE_TYPE_PROTOCOL)
+
+static void
+test_jabber_parser_protocol_init(TestJabberParserProtocol *protocol) {
+}
+
+static void
+test_jabber_parser_protocol_class_init(TestJabberParserProtocolClass *klass) {
+}
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+typedef struct {
+	/* Whether stanzas are kept rather than freed when they're received. */
+	gboolean keep;
+	GPtrArray *stanzas;
+	guint count;
+} TestJabberParserData;
+
+static PurpleProtocol *protocol = NULL;
+static PurpleConnection *connection = NULL;
+static TestJabberParserData received;
+
+/* Every stanza is taken from the signal so the stream, which has nothing but
+ * a connection, never gets as far as the real handlers.
+ */
+static void
+test_jabber_parser_receiving_cb(G_GNUC_UNUSED PurpleConnection *gc,
+                                PurpleXmlNode **packet, gpointer data)
+{
+	TestJabberParserData *test_data = data;
+
+	test_data->count++;
+
+	if(test_data->keep) {
+		g_ptr_array_add(test_data->stanzas, *packet);
+	} else {
+		purple_xmlnode_free(*packet);
+	}
+
+	*packet = NULL;
+}
+
+static void
+test_jabber_parser_feed(JabberStream *js, const char *str) {
+	jabber_parser_process(js, str, strlen(str));
+}
+
+static JabberStream *
+test_jabber_parser_stream_new(void) {
+	JabberStream *js = g_new0(JabberStream, 1);
+
+	js->gc = connection;
+
+	jabber_parser_setup(js);
+	test_jabber_parser_feed(js, TEST_JABBER_PARSER_STREAM_HEADER);
+	g_assert_cmpstr(js->stream_id, ==, "c2s_123");
+
+	received.keep = FALSE;
+	received.count = 0;
+
+	return js;
+}
+
+static void
+test_jabber_parser_stream_free(JabberStream *js) {
+	jabber_parser_free(js);
+	g_assert_null(js->stanza_pool);
+
+	g_free(js->stream_id);
+	g_free(js);
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_jabber_parser_stanza(void) {
+	JabberStream *js = test_jabber_parser_stream_new();
+	PurpleXmlNode *message, *body, *x;
+	char *data;
+
+	received.keep = TRUE;
+	test_jabber_parser_feed(js,
+		"<message from='juliet@example.com/balcony' to='romeo@example.net' "
+		"type='chat' xml:lang='en'>"
+		"<body>Wherefore art thou, &amp; Romeo?</body>"
+		"<x xmlns='jabber:x:oob' desc='1 &lt; 2'/>"
+		"</message>");
+
+	g_assert_cmpuint(received.count, ==, 1);
+	message = g_ptr_array_index(received.stanzas, 0);
+
+	g_assert_cmpstr(message->name, ==, "message");
+	g_assert_cmpstr(purple_xmlnode_get_namespace(message), ==,
+	                "jabber:client");
+	g_assert_cmpstr(purple_xmlnode_get_attrib(message, "from"), ==,
+	                "juliet@example.com/balcony");
+	g_assert_cmpstr(purple_xmlnode_get_attrib_with_namespace(message, "lang",
+	                "http://www.w3.org/XML/1998/namespace"), ==, "en");
+
+	body = purple_xmlnode_get_child(message, "body");
+	g_assert_nonnull(body);
+	data = purple_xmlnode_get_data(body);
+	g_assert_cmpstr(data, ==, "Wherefore art thou, & Romeo?");
+	g_free(data);
+
+	x = purple_xmlnode_get_child_with_namespace(message, "x", "jabber:x:oob");
+	g_assert_nonnull(x);
+	g_assert_cmpstr(purple_xmlnode_get_attrib(x, "desc"), ==, "1 < 2");
+
+	/* Handlers modify the stanzas they're given, which has to work the same
+	 * way it does for nodes that aren't from a pool.
+	 */
+	purple_xmlnode_set_attrib(message, "type", "normal");
+	g_assert_cmpstr(purple_xmlnode_get_attrib(message, "type"), ==, "normal");
+	purple_xmlnode_remove_attrib(message, "to");
+	g_assert_null(purple_xmlnode_get_attrib(message, "to"));
+	purple_xmlnode_set_namespace(x, "jabber:x:data");
+	g_assert_cmpstr(purple_xmlnode_get_namespace(x), ==, "jabber:x:data");
+	purple_xmlnode_free(body);
+	body = purple_xmlnode_new_child(message, "subject");
+	purple_xmlnode_insert_data(body, "balcony", -1);
+	data = purple_xmlnode_get_data(body);
+	g_assert_cmpstr(data, ==, "balcony");
+	g_free(data);
+
+	g_ptr_array_set_size(received.stanzas, 0);
+	purple_xmlnode_free(message);
+
+	test_jabber_parser_stream_free(js);
+}
+
+static void
+test_jabber_parser_pool_reuse(void) {
+	JabberStream *js = test_jabber_parser_stream_new();
+	PurpleMemoryPool *pool;
+	PurpleXmlNode *presence;
+
+	test_jabber_parser_feed(js, "<presence from='a@example.com/b'/>");
+	pool = js->stanza_pool;
+	g_assert_nonnull(pool);
+
+	/* Nothing kept the last stanza, so its pool should be reused. */
+	test_jabber_parser_feed(js, "<presence from='c@example.com/d'/>");
+	g_assert_true(js->stanza_pool == pool);
+
+	/* Keeping a stanza keeps its pool, so the next one needs a new one. */
+	received.keep = TRUE;
+	test_jabber_parser_feed(js,
+		"<presence from='e@example.com/f'><show>away</show></presence>");
+	g_assert_null(js->stanza_pool);
+
+	received.keep = FALSE;
+	test_jabber_parser_feed(js, "<presence from='g@example.com/h'/>");
+	g_assert_cmpuint(received.count, ==, 4);
+
+	/* The kept stanza should outlive the parser that created it. */
+	test_jabber_parser_stream_free(js);
+
+	presence = g_ptr_array_index(received.stanzas, 0);
+	g_assert_cmpstr(purple_xmlnode_get_attrib(presence, "from"), ==,
+	                "e@example.com/f");
+	g_assert_nonnull(purple_xmlnode_get_child(presence, "show"));
+
+	g_ptr_array_set_size(received.stanzas, 0);
+	purple_xmlnode_free(presence);
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_JABBER_PARSER_PERF_ROSTER_ITEMS (2000)
+#define TEST_JABBER_PARSER_PERF_MUC_HISTORY (500)
+#define TEST_JABBER_PARSER_PERF_PEP_EVENTS (500)
+#define TEST_JABBER_PARSER_PERF_REPLAYS (20)
+#define TEST_JABBER_PARSER_PERF_READ_SIZE (4096)
+
+/* Builds a stream like the ones captured from a login to a busy server: a
+ * large roster, a burst of MUC history and a burst of PEP notifications.
+ */
+static GString *
+test_jabber_parser_perf_capture(guint *n_stanzas) {
+	GString *capture = g_string_new(NULL);
+
+	g_string_append(capture,
+		"<iq type='result' id='roster_1' to='romeo@example.net/orchard'>"
+		"<query xmlns='jabber:iq:roster' ver='ver14'>");
+	for(guint i = 0; i < TEST_JABBER_PARSER_PERF_ROSTER_ITEMS; i++) {
+		g_string_append_printf(capture,
+			"<item jid='contact%u@example.org' name='Contact &amp; %u' "
+			"subscription='both'><group>Group %u</group></item>",
+			i, i, i % 10);
+	}
+	g_string_append(capture, "</query></iq>");
+
+	for(guint i = 0; i < TEST_JABBER_PARSER_PERF_MUC_HISTORY; i++) {
+		g_string_append_printf(capture,
+			"<message from='coven@chat.shakespeare.lit/nick%u' "
+			"to='romeo@example.net/orchard' type='groupchat' id='h%u'>"
+			"<body>Thrice the brinded cat hath mew&apos;d, %u times.</body>"
+			"<delay xmlns='urn:xmpp:delay' "
+			"from='coven@chat.shakespeare.lit' "
+			"stamp='2002-10-13T23:58:37Z'/>"
+			"</message>", i % 20, i, i);
+	}
+
+	for(guint i = 0; i < TEST_JABBER_PARSER_PERF_PEP_EVENTS; i++) {
+		g_string_append_printf(capture,
+			"<message from='contact%u@example.org' "
+			"to='romeo@example.net/orchard' type='headline'>"
+			"<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+			"<items node='http://jabber.org/protocol/nick'>"
+			"<item id='current'>"
+			"<nick xmlns='http://jabber.org/protocol/nick'>Nick %u</nick>"
+			"</item></items></event></message>", i, i);
+	}
+
+	*n_stanzas = 1 + TEST_JABBER_PARSER_PERF_MUC_HISTORY +
+	             TEST_JABBER_PARSER_PERF_PEP_EVENTS;
+
+	return capture;
+}
+
+static void
+test_jabber_parser_perf_replay(void) {
+	GString *capture;
+	guint n_stanzas = 0;
+	gdouble elapsed = 0.0;
+
+	capture = test_jabber_parser_perf_capture(&n_stanzas);
+
+	for(guint i = 0; i < TEST_JABBER_PARSER_PERF_REPLAYS; i++) {
+		JabberStream *js = test_jabber_parser_stream_new();
+
+		g_test_timer_start();
+		for(gsize offset = 0; offset < capture->len;
+		    offset += TEST_JABBER_PARSER_PERF_READ_SIZE)
+		{
+			gsize len = MIN(TEST_JABBER_PARSER_PERF_READ_SIZE,
+			                capture->len - offset);
+
+			jabber_parser_process(js, capture->str + offset, len);
+		}
+		elapsed += g_test_timer_elapsed();
+
+		g_assert_cmpuint(received.count, ==, n_stanzas);
+
+		test_jabber_parser_stream_free(js);
+	}
+
+	g_test_minimized_result(elapsed,
+	                        "%d replays of %u stanzas (%" G_GSIZE_FORMAT
+	                        " bytes) in %f seconds",
+	                        TEST_JABBER_PARSER_PERF_REPLAYS, n_stanzas,
+	                        capture->len, elapsed);
+
+	g_string_free(capture, TRUE);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar **argv) {
+	PurpleAccount *account = NULL;
+	gint ret = 0;
+
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+	protocol = g_object_new(test_jabber_parser_protocol_get_type(),
+	                        "id", "prpl-jabber-parser-test", NULL);
+	account = purple_account_new("romeo@example.net",
+	                             "prpl-jabber-parser-test");
+	connection = g_object_new(PURPLE_TYPE_CONNECTION,
+	                          "account", account,
+	                          "protocol", protocol,
+	                          NULL);
+
+	received.stanzas = g_ptr_array_new();
+	purple_signal_register(protocol, "jabber-receiving-xmlnode",
+	                       purple_marshal_VOID__POINTER_POINTER, G_TYPE_NONE,
+	                       2, PURPLE_TYPE_CONNECTION, G_TYPE_POINTER);
+	purple_signal_connect(protocol, "jabber-receiving-xmlnode", &received,
+	                      G_CALLBACK(test_jabber_parser_receiving_cb),
+	                      &received);
+
+	g_test_add_func("/jabber/parser/stanza", test_jabber_parser_stanza);
+	g_test_add_func("/jabber/parser/pool-reuse",
+	                test_jabber_parser_pool_reuse);
+
+	if(g_test_perf()) {
+		g_test_add_func("/jabber/parser/perf/replay",
+		                test_jabber_parser_perf_replay);
+	}
+
+	ret = g_test_run();
+
+	jabber_parser_uninit();
+	g_ptr_array_free(received.stanzas, TRUE);
+
+	return ret;
+}
@@ -22,6 +22,9 @@
 #include "account.h"
 #include "accounts.h"
 #include "core.h"
+#include "purpleprotocolclient.h"
+#include "purpleprotocolmanager.h"
+#include "util.h"
 
 enum {
 	SIG_ADDED,
@@ -34,12 +37,209 @@ struct _PurpleAccountManager {
 	GObject parent;
 
 	GList *accounts;
+
+	/* Maps each account to its PurpleAccountManagerEntry which is also used
+	 * as the key in the two indexes below.
+	 */
+	GHashTable *entries;
+
+	GHashTable *ids;
+	GHashTable *usernames;
 };
 
+typedef struct {
+	gchar *id;
+	gchar *protocol_id;
+	gchar *username;
+} PurpleAccountManagerEntry;
+
 static PurpleAccountManager *default_manager = NULL;
 
 G_DEFINE_TYPE(PurpleAccountManager, purple_account_manager, G_TYPE_OBJECT)
 
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static guint
+purple_account_manager_id_hash(gconstpointer key) {
+	const PurpleAccountManagerEntry *entry = key;
+
+	return g_str_hash(entry->id);
+}
+
+static gboolean
+purple_account_manager_id_equal(gconstpointer a, gconstpointer b) {
+	const PurpleAccountManagerEntry *entry_a = a;
+	const PurpleAccountManagerEntry *entry_b = b;
+
+	return g_str_equal(entry_a->id, entry_b->id);
+}
+
+static guint
+purple_account_manager_username_hash(gconstpointer key) {
+	const PurpleAccountManagerEntry *entry = key;
+
+	return g_str_hash(entry->protocol_id) ^ g_str_hash(entry->username);
+}
+
+static gboolean
+purple_account_manager_username_equal(gconstpointer a, gconstpointer b) {
+	const PurpleAccountManagerEntry *entry_a = a;
+	const PurpleAccountManagerEntry *entry_b = b;
+
+	return g_str_equal(entry_a->protocol_id, entry_b->protocol_id) &&
+	       g_str_equal(entry_a->username, entry_b->username);
+}
+
+/* This is purple_normalize() for when we only know the protocol id. All of the
+ * protocols that implement normalize handle a NULL account.
+ */
+static const gchar *
+purple_account_manager_normalize(const gchar *protocol_id,
+                                 const gchar *username)
+{
+	PurpleProtocolManager *protocol_manager = NULL;
+	PurpleProtocol *protocol = NULL;
+	const gchar *normalized = NULL;
+
+	protocol_manager = purple_protocol_manager_get_default();
+	if(protocol_manager != NULL) {
+		protocol = purple_protocol_manager_find(protocol_manager, protocol_id);
+	}
+
+	if(PURPLE_IS_PROTOCOL_CLIENT(protocol)) {
+		normalized = purple_protocol_client_normalize(PURPLE_PROTOCOL_CLIENT(protocol),
+		                                              NULL, username);
+	}
+
+	if(normalized == NULL) {
+		normalized = purple_normalize(NULL, username);
+	}
+
+	return normalized;
+}
+
+static void
+purple_account_manager_entry_clear(PurpleAccountManagerEntry *entry) {
+	g_clear_pointer(&entry->id, g_free);
+	g_clear_pointer(&entry->protocol_id, g_free);
+	g_clear_pointer(&entry->username, g_free);
+}
+
+static void
+purple_account_manager_entry_free(gpointer data) {
+	PurpleAccountManagerEntry *entry = data;
+
+	purple_account_manager_entry_clear(entry);
+	g_free(entry);
+}
+
+static void
+purple_account_manager_entry_update(PurpleAccountManagerEntry *entry,
+                                    PurpleAccount *account)
+{
+	const gchar *username = NULL;
+
+	purple_account_manager_entry_clear(entry);
+
+	entry->id = g_strdup(purple_account_get_id(account));
+	entry->protocol_id = g_strdup(purple_account_get_protocol_id(account));
+
+	username = purple_account_get_username(account);
+	if(entry->protocol_id != NULL && username != NULL) {
+		username = purple_account_manager_normalize(entry->protocol_id,
+		                                            username);
+		entry->username = g_strdup(username);
+	}
+}
+
+static void
+purple_account_manager_add_index(PurpleAccountManager *manager,
+                                 PurpleAccount *account,
+                                 PurpleAccountManagerEntry *entry)
+{
+	if(entry->id != NULL) {
+		g_hash_table_insert(manager->ids, entry, account);
+	}
+
+	if(entry->username != NULL) {
+		g_hash_table_insert(manager->usernames, entry, account);
+	}
+}
+
+static void
+purple_account_manager_remove_index(PurpleAccountManager *manager,
+                                    PurpleAccount *account,
+                                    PurpleAccountManagerEntry *entry)
+{
+	/* If two accounts somehow share a key, the newest one owns the index, so
+	 * make sure we don't remove someone else.
+	 */
+	if(entry->id != NULL &&
+	   g_hash_table_lookup(manager->ids, entry) == account)
+	{
+		g_hash_table_remove(manager->ids, entry);
+	}
+
+	if(entry->username != NULL &&
+	   g_hash_table_lookup(manager->usernames, entry) == account)
+	{
+		g_hash_table_remove(manager->usernames, entry);
+	}
+}
+
+static void
+purple_account_manager_reindex(PurpleAccountManager *manager,
+                               PurpleAccount *account)
+{
+	PurpleAccountManagerEntry *entry = NULL;
+
+	entry = g_hash_table_lookup(manager->entries, account);
+	if(entry == NULL) {
+		return;
+	}
+
+	/* The entry is the key in the indexes, so it has to come out of them
+	 * before it can be updated.
+	 */
+	purple_account_manager_remove_index(manager, account, entry);
+	purple_account_manager_entry_update(entry, account);
+	purple_account_manager_add_index(manager, account, entry);
+}
+
+/******************************************************************************
+ * Callbacks
+ *****************************************************************************/
+static void
+purple_account_manager_account_changed_cb(GObject *obj,
+                                          G_GNUC_UNUSED GParamSpec *pspec,
+                                          gpointer data)
+{
+	purple_account_manager_reindex(data, PURPLE_ACCOUNT(obj));
+}
+
+/* Normalized usernames depend on the protocol, so they have to be redone when
+ * one comes or goes.
+ */
+static void
+purple_account_manager_protocols_changed_cb(G_GNUC_UNUSED PurpleProtocolManager *protocol_manager,
+                                            PurpleProtocol *protocol,
+                                            gpointer data)
+{
+	PurpleAccountManager *manager = data;
+	const gchar *protocol_id = purple_protocol_get_id(protocol);
+
+	for(GList *l = manager->accounts; l != NULL; l = l->next) {
+		PurpleAccount *account = PURPLE_ACCOUNT(l->data);
+
+		if(purple_strequal(purple_account_get_protocol_id(account),
+		                   protocol_id))
+		{
+			purple_account_manager_reindex(manager, account);
+		}
+	}
+}
+
 /******************************************************************************
  * GObject Implementation
  *****************************************************************************/
@@ -49,14 +249,38 @@ purple_account_manager_finalize(GObject *obj) {
 	GList *l = NULL;
 
 	for(l = manager->accounts; l != NULL; l = l->next) {
+		g_signal_handlers_disconnect_by_data(l->data, manager);
 		g_object_unref(l->data);
 	}
 
+	g_hash_table_destroy(manager->ids);
+	g_hash_table_destroy(manager->usernames);
+	g_hash_table_destroy(manager->entries);
+
 	G_OBJECT_CLASS(purple_account_manager_parent_class)->finalize(obj);
 }
 
 static void
 purple_account_manager_init(PurpleAccountManager *manager) {
+	PurpleProtocolManager *protocol_manager = NULL;
+
+	manager->entries = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+	                                         NULL,
+	                                         purple_account_manager_entry_free);
+	manager->ids = g_hash_table_new(purple_account_manager_id_hash,
+	                                purple_account_manager_id_equal);
+	manager->usernames = g_hash_table_new(purple_account_manager_username_hash,
+	                                      purple_account_manager_username_equal);
+
+	protocol_manager = purple_protocol_manager_get_default();
+	if(protocol_manager != NULL) {
+		g_signal_connect_object(protocol_manager, "registered",
+		                        G_CALLBACK(purple_account_manager_protocols_changed_cb),
+		                        manager, 0);
+		g_signal_connect_object(protocol_manager, "unregistered",
+		                        G_CALLBACK(purple_account_manager_protocols_changed_cb),
+		                        manager, 0);
+	}
 }
 
 static void
@@ -135,11 +359,13 @@ void
 purple_account_manager_add(PurpleAccountManager *manager,
                            PurpleAccount *account)
 {
+	PurpleAccountManagerEntry *entry = NULL;
+
 	g_return_if_fail(PURPLE_IS_ACCOUNT_MANAGER(manager));
 	g_return_if_fail(PURPLE_IS_ACCOUNT(account));
 
 	/* If the manager already knows about the account, we do nothing. */
-	if(g_list_find(manager->accounts, account) != NULL) {
+	if(g_hash_table_contains(manager->entries, account)) {
 		return;
 	}
 
@@ -150,6 +376,22 @@ purple_account_manager_add(PurpleAccountManager *manager,
 	 */
 	manager->accounts = g_list_prepend(manager->accounts, account);
 
+	entry = g_new0(PurpleAccountManagerEntry, 1);
+	purple_account_manager_entry_update(entry, account);
+	g_hash_table_insert(manager->entries, account, entry);
+	purple_account_manager_add_index(manager, account, entry);
+
+	/* Keep the indexes up to date if anything they're keyed on changes. */
+	g_signal_connect(account, "notify::id",
+	                 G_CALLBACK(purple_account_manager_account_changed_cb),
+	                 manager);
+	g_signal_connect(account, "notify::username",
+	                 G_CALLBACK(purple_account_manager_account_changed_cb),
+	                 manager);
+	g_signal_connect(account, "notify::protocol-id",
+	                 G_CALLBACK(purple_account_manager_account_changed_cb),
+	                 manager);
+
 	purple_accounts_schedule_save();
 
 	g_signal_emit(manager, signals[SIG_ADDED], 0, account);
@@ -162,11 +404,20 @@ void
 purple_account_manager_remove(PurpleAccountManager *manager,
                               PurpleAccount *account)
 {
+	PurpleAccountManagerEntry *entry = NULL;
+
 	g_return_if_fail(PURPLE_IS_ACCOUNT_MANAGER(manager));
 	g_return_if_fail(PURPLE_IS_ACCOUNT(account));
 
 	manager->accounts = g_list_remove(manager->accounts, account);
 
+	entry = g_hash_table_lookup(manager->entries, account);
+	if(entry != NULL) {
+		g_signal_handlers_disconnect_by_data(account, manager);
+		purple_account_manager_remove_index(manager, account, entry);
+		g_hash_table_remove(manager->entries, account);
+	}
+
 	purple_accounts_schedule_save();
 
 	/* Clearing the error ensures that account-error-changed is emitted,
@@ -271,59 +522,35 @@ PurpleAccount *
 purple_account_manager_find_by_id(PurpleAccountManager *manager,
                                   const gchar *id)
 {
-	GList *l = NULL;
+	PurpleAccountManagerEntry key = {
+		.id = (gchar *)id,
+	};
 
 	g_return_val_if_fail(PURPLE_IS_ACCOUNT_MANAGER(manager), NULL);
 	g_return_val_if_fail(id != NULL, NULL);
 
-	for(l = manager->accounts; l != NULL; l = l->next) {
-		PurpleAccount *account = PURPLE_ACCOUNT(l->data);
-
-		if(purple_strequal(purple_account_get_id(account), id)) {
-			return account;
-		}
-	}
-
-	return NULL;
+	return g_hash_table_lookup(manager->ids, &key);
 }
 
 PurpleAccount *
 purple_account_manager_find(PurpleAccountManager *manager,
                             const gchar *username, const gchar *protocol_id)
 {
-	GList *l;
+	PurpleAccountManagerEntry key = {
+		.protocol_id = (gchar *)protocol_id,
+	};
 
 	g_return_val_if_fail(PURPLE_IS_ACCOUNT_MANAGER(manager), NULL);
 	g_return_val_if_fail(username != NULL, NULL);
 	g_return_val_if_fail(protocol_id != NULL, NULL);
 
-	for(l = manager->accounts; l != NULL; l = l->next) {
-		PurpleAccount *account = PURPLE_ACCOUNT(l->data);
-		gchar *normalized = NULL;
-		const gchar *existing_protocol_id = NULL;
-		const gchar *existing_username = NULL;
-		const gchar *existing_normalized = NULL;
-
-		/* Check if the protocol id matches what the user asked for. */
-		existing_protocol_id = purple_account_get_protocol_id(account);
-		if(!purple_strequal(existing_protocol_id, protocol_id)) {
-			continue;
-		}
-
-		/* Finally verify the username. */
-		existing_username = purple_account_get_username(account);
-		normalized = g_strdup(purple_normalize(account, username));
-		existing_normalized = purple_normalize(account, existing_username);
-
-		if(purple_strequal(existing_normalized, normalized)) {
-			g_free(normalized);
-
-			return account;
-		}
-		g_free(normalized);
+	key.username = (gchar *)purple_account_manager_normalize(protocol_id,
+	                                                         username);
+	if(key.username == NULL) {
+		return NULL;
 	}
 
-	return NULL;
+	return g_hash_table_lookup(manager->usernames, &key);
 }
 
 void
@@ -28,6 +28,7 @@
 #include "purplechatconversation.h"
 #include "purpleenums.h"
 #include "purpleprivate.h"
+#include "purpleprotocolchat.h"
 #include "server.h"
 
 typedef struct {
@@ -38,6 +39,9 @@ typedef struct {
 	char *nick;         /* Your nick in this chat.                   */
 	gboolean left;      /* We left the chat and kept the window open */
 	GHashTable *users;  /* Hash table of the users in the room.      */
+
+	/* The protocol that provides the keys for users, if any. */
+	PurpleProtocolChat *protocol_chat;
 } PurpleChatConversationPrivate;
 
 /* Chat Property enums */
@@ -58,21 +62,85 @@ G_DEFINE_TYPE_WITH_PRIVATE(PurpleChatConversation, purple_chat_conversation,
 /**************************************************************************
  * Helpers
  **************************************************************************/
-static guint
-purple_conversation_user_hash(gconstpointer data) {
-	gchar *collated;
-	guint hash;
+static gchar *
+purple_chat_conversation_user_key(PurpleChatConversation *chat,
+                                  const gchar *name)
+{
+	PurpleChatConversationPrivate *priv = NULL;
 
-	collated = g_utf8_collate_key((const gchar *)data, -1);
-	hash = g_str_hash(collated);
-	g_free(collated);
+	priv = purple_chat_conversation_get_instance_private(chat);
+
+	if(priv->protocol_chat != NULL) {
+		gchar *key = purple_protocol_chat_get_user_key(priv->protocol_chat,
+		                                               name);
+
+		if(key != NULL) {
+			return key;
+		}
+	}
 
-	return hash;
+	return g_utf8_collate_key(name, -1);
 }
 
-static gboolean
-purple_conversation_user_equal(gconstpointer a, gconstpointer b) {
-	return !g_utf8_collate(a, b);
+/* The users table is keyed by a string owned by each user so that the key is
+ * only computed once per user rather than on every hash and comparison.
+ */
+static void
+purple_chat_conversation_insert_user(PurpleChatConversation *chat,
+                                     PurpleChatUser *chat_user)
+{
+	PurpleChatConversationPrivate *priv = NULL;
+	gchar *key = NULL;
+
+	priv = purple_chat_conversation_get_instance_private(chat);
+
+	key = purple_chat_conversation_user_key(chat,
+	                                        purple_chat_user_get_name(chat_user));
+	_purple_chat_user_set_key(chat_user, key);
+
+	g_hash_table_replace(priv->users, key, chat_user);
+}
+
+static void
+purple_chat_conversation_remove_user_from_table(PurpleChatConversation *chat,
+                                                PurpleChatUser *chat_user)
+{
+	PurpleChatConversationPrivate *priv = NULL;
+
+	priv = purple_chat_conversation_get_instance_private(chat);
+
+	g_hash_table_remove(priv->users, _purple_chat_user_get_key(chat_user));
+}
+
+/* Collects every buddy of @account by normalized name so that adding a large
+ * number of users doesn't have to search every group of the buddy list for
+ * each of them. Returns %NULL if @account has no buddies at all.
+ */
+static GHashTable *
+purple_chat_conversation_find_buddies(PurpleAccount *account) {
+	GHashTable *buddies = NULL;
+	GSList *list = NULL;
+
+	list = purple_blist_find_buddies(account, NULL);
+	if(list == NULL) {
+		return NULL;
+	}
+
+	buddies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	for(GSList *l = list; l != NULL; l = l->next) {
+		PurpleBuddy *buddy = l->data;
+		const gchar *name = purple_normalize(account,
+		                                     purple_buddy_get_name(buddy));
+
+		if(!g_hash_table_contains(buddies, name)) {
+			g_hash_table_insert(buddies, g_strdup(name), buddy);
+		}
+	}
+
+	g_slist_free(list);
+
+	return buddies;
 }
 
 static void
@@ -178,23 +246,36 @@ purple_chat_conversation_init(PurpleChatConversation *chat) {
 
 	priv = purple_chat_conversation_get_instance_private(chat);
 
-	priv->users = g_hash_table_new_full(purple_conversation_user_hash,
-	                                    purple_conversation_user_equal,
-	                                    g_free, g_object_unref);
+	priv->users = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+	                                    g_object_unref);
 }
 
 static void
 purple_chat_conversation_constructed(GObject *obj) {
 	PurpleChatConversation *chat = PURPLE_CHAT_CONVERSATION(obj);
+	PurpleChatConversationPrivate *priv = NULL;
 	PurpleAccount *account = NULL;
 	PurpleConnection *connection = NULL;
+	PurpleProtocol *protocol = NULL;
 	const gchar *display_name = NULL;
 
 	G_OBJECT_CLASS(purple_chat_conversation_parent_class)->constructed(obj);
 
+	priv = purple_chat_conversation_get_instance_private(chat);
+
 	g_object_get(obj, "account", &account, NULL);
 
 	connection = purple_account_get_connection(account);
+
+	/* The keys have to stay the same for the life of the chat, so the
+	 * protocol is remembered even if the connection goes away.
+	 */
+	if(PURPLE_IS_CONNECTION(connection)) {
+		protocol = purple_connection_get_protocol(connection);
+	}
+	if(PURPLE_IS_PROTOCOL_CHAT(protocol)) {
+		priv->protocol_chat = PURPLE_PROTOCOL_CHAT(protocol);
+	}
 	display_name = purple_connection_get_display_name(connection);
 	if(display_name != NULL) {
 		purple_chat_conversation_set_nick(chat, display_name);
@@ -662,9 +743,7 @@ purple_chat_conversation_add_users(PurpleChatConversation *chat, GList *users,
 
 		chatuser = purple_chat_user_new(chat, user, alias, flag);
 
-		g_hash_table_replace(priv->users,
-			g_strdup(purple_chat_user_get_name(chatuser)),
-			chatuser);
+		purple_chat_conversation_insert_user(chat, chatuser);
 
 		cbuddies = g_list_prepend(cbuddies, chatuser);
 
@@ -706,6 +785,115 @@ purple_chat_conversation_add_users(PurpleChatConversation *chat, GList *users,
 	g_list_free(cbuddies);
 }
 
+void
+purple_chat_conversation_add_users_bulk(PurpleChatConversation *chat,
+                                        const gchar * const *users,
+                                        const PurpleChatUserFlags *flags,
+                                        guint n_users)
+{
+	PurpleChatConversationPrivate *priv = NULL;
+	PurpleConversation *conv = NULL;
+	PurpleConversationUiOps *ops = NULL;
+	PurpleAccount *account = NULL;
+	PurpleConnection *gc = NULL;
+	PurpleProtocol *protocol = NULL;
+	GHashTable *buddies = NULL;
+	GPtrArray *chat_users = NULL;
+	GList *cbuddies = NULL;
+	const gchar *self_alias = NULL;
+	gboolean unique_names = FALSE;
+
+	g_return_if_fail(PURPLE_IS_CHAT_CONVERSATION(chat));
+	g_return_if_fail(users != NULL || n_users == 0);
+	g_return_if_fail(flags != NULL || n_users == 0);
+
+	if(n_users == 0) {
+		return;
+	}
+
+	priv = purple_chat_conversation_get_instance_private(chat);
+	conv = PURPLE_CONVERSATION(chat);
+	ops = purple_conversation_get_ui_ops(conv);
+
+	account = purple_conversation_get_account(conv);
+	gc = purple_conversation_get_connection(conv);
+	g_return_if_fail(PURPLE_IS_CONNECTION(gc));
+
+	protocol = purple_connection_get_protocol(gc);
+	g_return_if_fail(PURPLE_IS_PROTOCOL(protocol));
+
+	unique_names = purple_protocol_get_options(protocol) &
+	               OPT_PROTO_UNIQUE_CHATNAME;
+
+	buddies = purple_chat_conversation_find_buddies(account);
+
+	self_alias = purple_account_get_private_alias(account);
+	if(self_alias == NULL) {
+		self_alias = purple_connection_get_display_name(gc);
+	}
+
+	/* The users are referenced here as well as in the table in case @users
+	 * has duplicates and a later one replaces an earlier one.
+	 */
+	chat_users = g_ptr_array_new_full(n_users, g_object_unref);
+
+	for(guint i = 0; i < n_users; i++) {
+		PurpleChatUser *chat_user = NULL;
+		PurpleBuddy *buddy = NULL;
+		const gchar *alias = users[i];
+
+		if(buddies != NULL || !unique_names) {
+			const gchar *normalized = purple_normalize(account, users[i]);
+
+			if(buddies != NULL) {
+				buddy = g_hash_table_lookup(buddies, normalized);
+			}
+
+			if(!unique_names) {
+				if(purple_strequal(priv->nick, normalized)) {
+					if(self_alias != NULL) {
+						alias = self_alias;
+					}
+				} else if(buddy != NULL) {
+					alias = purple_buddy_get_contact_alias(buddy);
+				}
+			}
+		}
+
+		chat_user = g_object_new(PURPLE_TYPE_CHAT_USER,
+		                         "chat", chat,
+		                         "name", users[i],
+		                         "alias", alias,
+		                         "flags", flags[i],
+		                         "buddy", buddy != NULL,
+		                         NULL);
+
+		purple_chat_conversation_insert_user(chat, chat_user);
+
+		g_ptr_array_add(chat_users, g_object_ref(chat_user));
+	}
+
+	g_clear_pointer(&buddies, g_hash_table_destroy);
+
+	/* Both UIs keep their user lists sorted themselves, so unlike
+	 * purple_chat_conversation_add_users() this isn't sorted first.
+	 */
+	for(guint i = chat_users->len; i > 0; i--) {
+		cbuddies = g_list_prepend(cbuddies,
+		                          g_ptr_array_index(chat_users, i - 1));
+	}
+
+	purple_signal_emit(purple_conversations_get_handle(), "chat-users-joined",
+	                   chat, cbuddies);
+
+	if(ops != NULL && ops->chat_add_users != NULL) {
+		ops->chat_add_users(chat, cbuddies, FALSE);
+	}
+
+	g_list_free(cbuddies);
+	g_ptr_array_free(chat_users, TRUE);
+}
+
 void
 purple_chat_conversation_rename_user(PurpleChatConversation *chat,
                                      const gchar *old_user,
@@ -716,7 +904,7 @@ purple_chat_conversation_rename_user(PurpleChatConversation *chat,
 	PurpleAccount *account;
 	PurpleConnection *gc;
 	PurpleProtocol *protocol;
-	PurpleChatUser *cb;
+	PurpleChatUser *cb, *new_cb;
 	PurpleChatUserFlags flags;
 	PurpleChatConversationPrivate *priv;
 	const gchar *new_alias = new_user;
@@ -761,19 +949,33 @@ purple_chat_conversation_rename_user(PurpleChatConversation *chat,
 		}
 	}
 
-	flags = purple_chat_user_get_flags(purple_chat_conversation_find_user(chat, old_user));
-	cb = purple_chat_user_new(chat, new_user, new_alias, flags);
+	cb = purple_chat_conversation_find_user(chat, old_user);
 
-	g_hash_table_replace(priv->users,
-		g_strdup(purple_chat_user_get_name(cb)), cb);
+	if(cb != NULL && purple_chat_conversation_find_user(chat, new_user) == cb) {
+		/* The protocol considers both names the same, for example when only
+		 * the case changed on IRC. A second user can't share the key, so
+		 * rename the existing one in place and let the UI find it under
+		 * either name.
+		 */
+		g_object_set(G_OBJECT(cb), "name", new_user, "alias", new_alias,
+		             NULL);
 
-	if(ops != NULL && ops->chat_rename_user != NULL) {
-		ops->chat_rename_user(chat, old_user, new_user, new_alias);
-	}
+		if(ops != NULL && ops->chat_rename_user != NULL) {
+			ops->chat_rename_user(chat, old_user, new_user, new_alias);
+		}
+	} else {
+		flags = purple_chat_user_get_flags(cb);
+		new_cb = purple_chat_user_new(chat, new_user, new_alias, flags);
 
-	cb = purple_chat_conversation_find_user(chat, old_user);
-	if(cb) {
-		g_hash_table_remove(priv->users, purple_chat_user_get_name(cb));
+		purple_chat_conversation_insert_user(chat, new_cb);
+
+		if(ops != NULL && ops->chat_rename_user != NULL) {
+			ops->chat_rename_user(chat, old_user, new_user, new_alias);
+		}
+
+		if(cb != NULL) {
+			purple_chat_conversation_remove_user_from_table(chat, cb);
+		}
 	}
 
 	if(purple_chat_conversation_is_ignored_user(chat, old_user)) {
@@ -846,7 +1048,6 @@ purple_chat_conversation_remove_users(PurpleChatConversation *chat,
 	PurpleProtocol *protocol;
 	PurpleConversationUiOps *ops;
 	PurpleChatUser *cb;
-	PurpleChatConversationPrivate *priv;
 	GList *l;
 	gboolean quiet;
 	gpointer handle;
@@ -854,7 +1055,6 @@ purple_chat_conversation_remove_users(PurpleChatConversation *chat,
 	g_return_if_fail(PURPLE_IS_CHAT_CONVERSATION(chat));
 	g_return_if_fail(users != NULL);
 
-	priv = purple_chat_conversation_get_instance_private(chat);
 	conv = PURPLE_CONVERSATION(chat);
 
 	gc = purple_conversation_get_connection(conv);
@@ -875,7 +1075,7 @@ purple_chat_conversation_remove_users(PurpleChatConversation *chat,
 		cb = purple_chat_conversation_find_user(chat, user);
 
 		if(cb) {
-			g_hash_table_remove(priv->users, purple_chat_user_get_name(cb));
+			purple_chat_conversation_remove_user_from_table(chat, cb);
 		}
 
 		/* NOTE: Don't remove them from ignored in case they re-enter. */
@@ -917,17 +1117,65 @@ purple_chat_conversation_remove_users(PurpleChatConversation *chat,
 	}
 }
 
+void
+purple_chat_conversation_remove_users_bulk(PurpleChatConversation *chat,
+                                           const gchar * const *users,
+                                           guint n_users, const gchar *reason)
+{
+	PurpleConversationUiOps *ops = NULL;
+	GList *names = NULL;
+
+	g_return_if_fail(PURPLE_IS_CHAT_CONVERSATION(chat));
+	g_return_if_fail(users != NULL || n_users == 0);
+
+	ops = purple_conversation_get_ui_ops(PURPLE_CONVERSATION(chat));
+
+	for(guint i = n_users; i > 0; i--) {
+		PurpleChatUser *chat_user = NULL;
+
+		chat_user = purple_chat_conversation_find_user(chat, users[i - 1]);
+		if(chat_user == NULL) {
+			continue;
+		}
+
+		/* NOTE: Don't remove them from ignored in case they re-enter. */
+		purple_chat_conversation_remove_user_from_table(chat, chat_user);
+
+		names = g_list_prepend(names, (gpointer)users[i - 1]);
+	}
+
+	if(names == NULL) {
+		return;
+	}
+
+	purple_signal_emit(purple_conversations_get_handle(), "chat-users-left",
+	                   chat, names, reason);
+
+	if(ops != NULL && ops->chat_remove_users != NULL) {
+		ops->chat_remove_users(chat, names);
+	}
+
+	g_list_free(names);
+}
+
 void
 purple_chat_conversation_clear_users(PurpleChatConversation *chat) {
 	PurpleChatConversationPrivate *priv = NULL;
 	PurpleConversationUiOps *ops = NULL;
+	GHashTableIter iter;
+	gpointer value;
 	GList *names = NULL;
 
 	g_return_if_fail(PURPLE_IS_CHAT_CONVERSATION(chat));
 
 	priv = purple_chat_conversation_get_instance_private(chat);
 	ops = purple_conversation_get_ui_ops(PURPLE_CONVERSATION(chat));
-	names = g_hash_table_get_keys(priv->users);
+
+	g_hash_table_iter_init(&iter, priv->users);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		names = g_list_prepend(names,
+		                       (gpointer)purple_chat_user_get_name(value));
+	}
 
 	if(ops != NULL && ops->chat_remove_users != NULL) {
 		ops->chat_remove_users(chat, names);
@@ -1078,11 +1326,17 @@ purple_chat_conversation_find_user(PurpleChatConversation *chat,
                                    const gchar *name)
 {
 	PurpleChatConversationPrivate *priv = NULL;
+	PurpleChatUser *chat_user = NULL;
+	gchar *key = NULL;
 
 	g_return_val_if_fail(PURPLE_IS_CHAT_CONVERSATION(chat), NULL);
 	g_return_val_if_fail(name != NULL, NULL);
 
 	priv = purple_chat_conversation_get_instance_private(chat);
 
-	return g_hash_table_lookup(priv->users, name);
+	key = purple_chat_conversation_user_key(chat, name);
+	chat_user = g_hash_table_lookup(priv->users, key);
+	g_free(key);
+
+	return chat_user;
 }
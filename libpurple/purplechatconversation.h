@@ -256,6 +256,25 @@ void purple_chat_conversation_add_user(PurpleChatConversation *chat, const gchar
  */
 void purple_chat_conversation_add_users(PurpleChatConversation *chat, GList *users, GList *extra_msgs, GList *flags, gboolean new_arrivals);
 
+/**
+ * purple_chat_conversation_add_users_bulk:
+ * @chat: The chat.
+ * @users: (array length=n_users): The users to add.
+ * @flags: (array length=n_users): The flags for each user.
+ * @n_users: The number of users in @users and @flags.
+ *
+ * Adds a large number of users to a chat at once, such as the initial list
+ * of users in a room.
+ *
+ * Unlike purple_chat_conversation_add_users(), no join notices are shown and
+ * the chat-user-joining and chat-user-joined signals are not emitted for each
+ * user. Instead the chat-users-joined signal is emitted once with all of the
+ * users that were added.
+ *
+ * Since: 3.0.0
+ */
+void purple_chat_conversation_add_users_bulk(PurpleChatConversation *chat, const gchar * const *users, const PurpleChatUserFlags *flags, guint n_users);
+
 /**
  * purple_chat_conversation_rename_user:
  * @chat: The chat.
@@ -288,6 +307,24 @@ void purple_chat_conversation_remove_user(PurpleChatConversation *chat, const gc
  */
 void purple_chat_conversation_remove_users(PurpleChatConversation *chat, GList *users, const gchar *reason);
 
+/**
+ * purple_chat_conversation_remove_users_bulk:
+ * @chat: The chat.
+ * @users: (array length=n_users): The users to remove.
+ * @n_users: The number of users in @users.
+ * @reason: (nullable): The optional reason given for the removal.
+ *
+ * Removes a large number of users from a chat at once.
+ *
+ * Unlike purple_chat_conversation_remove_users(), no leave notices are shown
+ * and the chat-user-leaving and chat-user-left signals are not emitted for
+ * each user. Instead the chat-users-left signal is emitted once with all of
+ * the users that were removed.
+ *
+ * Since: 3.0.0
+ */
+void purple_chat_conversation_remove_users_bulk(PurpleChatConversation *chat, const gchar * const *users, guint n_users, const gchar *reason);
+
 /**
  * purple_chat_conversation_has_user:
  * @chat: The chat.
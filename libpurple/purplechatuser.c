@@ -24,6 +24,7 @@
 
 #include "conversations.h"
 #include "purpleenums.h"
+#include "purpleprivate.h"
 
 struct _PurpleChatUser {
 	GObject parent;
@@ -38,6 +39,11 @@ struct _PurpleChatUser {
 	PurpleChatUserFlags flags;     /* A bitwise OR of flags for this
 	                                  participant, such as whether they
 	                                  are a channel operator.               */
+	gchar *key;                    /* The key the chat looks this
+	                                  participant up by.                    */
+	gboolean buddy_set;            /* TRUE if buddy was given at
+	                                  construction and doesn't need to be
+	                                  looked up.                            */
 
 	gboolean constructed;
 };
@@ -48,6 +54,7 @@ enum {
 	PROP_NAME,
 	PROP_ALIAS,
 	PROP_FLAGS,
+	PROP_BUDDY,
 	N_PROPERTIES,
 };
 static GParamSpec *properties[N_PROPERTIES] = {NULL, };
@@ -99,6 +106,10 @@ purple_chat_user_set_property(GObject *obj, guint param_id, const GValue *value,
 		case PROP_FLAGS:
 			purple_chat_user_set_flags(chat_user, g_value_get_flags(value));
 			break;
+		case PROP_BUDDY:
+			chat_user->buddy = g_value_get_boolean(value);
+			chat_user->buddy_set = TRUE;
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, param_id, pspec);
 			break;
@@ -124,6 +135,9 @@ purple_chat_user_get_property(GObject *obj, guint param_id, GValue *value,
 		case PROP_FLAGS:
 			g_value_set_flags(value, purple_chat_user_get_flags(chat_user));
 			break;
+		case PROP_BUDDY:
+			g_value_set_boolean(value, purple_chat_user_is_buddy(chat_user));
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, param_id, pspec);
 			break;
@@ -145,7 +159,10 @@ purple_chat_user_constructed(GObject *object) {
 	chat_user = PURPLE_CHAT_USER(object);
 	account = purple_conversation_get_account(PURPLE_CONVERSATION(chat_user->chat));
 
-	if(purple_blist_find_buddy(account, chat_user->name) != NULL) {
+	/* Callers adding a lot of users at once have already looked this up. */
+	if(!chat_user->buddy_set &&
+	   purple_blist_find_buddy(account, chat_user->name) != NULL)
+	{
 		chat_user->buddy = TRUE;
 	}
 
@@ -158,6 +175,7 @@ purple_chat_user_finalize(GObject *object) {
 
 	g_free(chat_user->alias);
 	g_free(chat_user->name);
+	g_free(chat_user->key);
 
 	G_OBJECT_CLASS(purple_chat_user_parent_class)->finalize(object);
 }
@@ -196,9 +214,33 @@ purple_chat_user_class_init(PurpleChatUserClass *klass) {
 		PURPLE_CHAT_USER_NONE,
 		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
 
+	properties[PROP_BUDDY] = g_param_spec_boolean(
+		"buddy", "Buddy",
+		"Whether the chat user is on the buddy list.",
+		FALSE,
+		G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties(obj_class, N_PROPERTIES, properties);
 }
 
+/******************************************************************************
+ * Private API
+ *****************************************************************************/
+void
+_purple_chat_user_set_key(PurpleChatUser *chat_user, gchar *key) {
+	g_return_if_fail(PURPLE_IS_CHAT_USER(chat_user));
+
+	g_free(chat_user->key);
+	chat_user->key = key;
+}
+
+const gchar *
+_purple_chat_user_get_key(PurpleChatUser *chat_user) {
+	g_return_val_if_fail(PURPLE_IS_CHAT_USER(chat_user), NULL);
+
+	return chat_user->key;
+}
+
 /******************************************************************************
  * Public API
  *****************************************************************************/
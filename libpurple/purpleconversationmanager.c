@@ -21,6 +21,7 @@
 #include <purplechatconversation.h>
 #include <purpleimconversation.h>
 #include <purpleprivate.h>
+#include <util.h>
 
 enum {
 	SIG_REGISTERED,
@@ -32,86 +33,281 @@ static guint signals[N_SIGNALS] = {0, };
 struct _PurpleConversationManager {
 	GObject parent;
 
+	/* Maps each registered conversation to its PurpleConversationManagerEntry
+	 * which is also used as the key in the two indexes below.
+	 */
 	GHashTable *conversations;
+
+	GHashTable *names;
+	GHashTable *chat_ids;
+
+	/* The number of registered conversations that are missing from an index
+	 * because another conversation with the same key replaced them.
+	 */
+	guint shadowed;
 };
 
+typedef enum {
+	PURPLE_CONVERSATION_MANAGER_KIND_OTHER,
+	PURPLE_CONVERSATION_MANAGER_KIND_IM,
+	PURPLE_CONVERSATION_MANAGER_KIND_CHAT,
+} PurpleConversationManagerKind;
+
+typedef struct {
+	PurpleAccount *account;
+	PurpleConversationManagerKind kind;
+	gchar *name;
+	gint id;
+} PurpleConversationManagerEntry;
+
 static PurpleConversationManager *default_manager = NULL;
 
 G_DEFINE_TYPE(PurpleConversationManager, purple_conversation_manager,
               G_TYPE_OBJECT)
 
-typedef gboolean (*PurpleConversationManagerCompareFunc)(PurpleConversation *conversation, gpointer userdata);
-
 /******************************************************************************
  * Helpers
  *****************************************************************************/
+static guint
+purple_conversation_manager_name_hash(gconstpointer key) {
+	const PurpleConversationManagerEntry *entry = key;
+
+	return g_direct_hash(entry->account) ^ g_str_hash(entry->name) ^
+	       entry->kind;
+}
+
+static gboolean
+purple_conversation_manager_name_equal(gconstpointer a, gconstpointer b) {
+	const PurpleConversationManagerEntry *entry_a = a;
+	const PurpleConversationManagerEntry *entry_b = b;
+
+	return entry_a->account == entry_b->account &&
+	       entry_a->kind == entry_b->kind &&
+	       g_str_equal(entry_a->name, entry_b->name);
+}
+
+static guint
+purple_conversation_manager_chat_id_hash(gconstpointer key) {
+	const PurpleConversationManagerEntry *entry = key;
+
+	return g_direct_hash(entry->account) ^ g_int_hash(&entry->id);
+}
+
 static gboolean
-purple_conversation_is_im(PurpleConversation *conversation,
-                          G_GNUC_UNUSED gpointer userdata)
+purple_conversation_manager_chat_id_equal(gconstpointer a, gconstpointer b) {
+	const PurpleConversationManagerEntry *entry_a = a;
+	const PurpleConversationManagerEntry *entry_b = b;
+
+	return entry_a->account == entry_b->account && entry_a->id == entry_b->id;
+}
+
+static void
+purple_conversation_manager_entry_clear(PurpleConversationManagerEntry *entry) {
+	g_clear_object(&entry->account);
+	g_clear_pointer(&entry->name, g_free);
+	entry->id = 0;
+}
+
+static void
+purple_conversation_manager_entry_free(gpointer data) {
+	PurpleConversationManagerEntry *entry = data;
+
+	purple_conversation_manager_entry_clear(entry);
+	g_free(entry);
+}
+
+static void
+purple_conversation_manager_entry_update(PurpleConversationManagerEntry *entry,
+                                         PurpleConversation *conversation)
 {
-	return PURPLE_IS_IM_CONVERSATION(conversation);
+	PurpleAccount *account = NULL;
+	const gchar *name = NULL;
+
+	purple_conversation_manager_entry_clear(entry);
+
+	if(PURPLE_IS_IM_CONVERSATION(conversation)) {
+		entry->kind = PURPLE_CONVERSATION_MANAGER_KIND_IM;
+	} else if(PURPLE_IS_CHAT_CONVERSATION(conversation)) {
+		PurpleChatConversation *chat = PURPLE_CHAT_CONVERSATION(conversation);
+
+		entry->kind = PURPLE_CONVERSATION_MANAGER_KIND_CHAT;
+		entry->id = purple_chat_conversation_get_id(chat);
+	} else {
+		entry->kind = PURPLE_CONVERSATION_MANAGER_KIND_OTHER;
+	}
+
+	account = purple_conversation_get_account(conversation);
+	if(PURPLE_IS_ACCOUNT(account)) {
+		entry->account = g_object_ref(account);
+	}
+
+	name = purple_conversation_get_name(conversation);
+	if(name != NULL) {
+		entry->name = g_strdup(purple_normalize(account, name));
+	}
 }
 
 static gboolean
-purple_conversation_is_chat(PurpleConversation *conversation,
-                            G_GNUC_UNUSED gpointer userdata)
+purple_conversation_manager_entry_has_name(PurpleConversationManagerEntry *entry)
 {
-	return PURPLE_IS_CHAT_CONVERSATION(conversation);
+	return entry->account != NULL && entry->name != NULL;
 }
 
 static gboolean
-purple_conversation_chat_has_id(PurpleConversation *conversation,
-                                gpointer userdata)
+purple_conversation_manager_entry_has_chat_id(PurpleConversationManagerEntry *entry)
 {
-	PurpleChatConversation *chat = NULL;
-	gint id = GPOINTER_TO_INT(userdata);
+	return entry->account != NULL &&
+	       entry->kind == PURPLE_CONVERSATION_MANAGER_KIND_CHAT;
+}
 
+static void
+purple_conversation_manager_index_insert(PurpleConversationManager *manager,
+                                         GHashTable *index,
+                                         PurpleConversation *conversation,
+                                         PurpleConversationManagerEntry *entry)
+{
+	PurpleConversation *existing = g_hash_table_lookup(index, entry);
 
-	if(!PURPLE_IS_CHAT_CONVERSATION(conversation)) {
-		return FALSE;
+	/* The constructors of the conversation types reuse existing
+	 * conversations, so two registered conversations should rarely share a
+	 * key. If they do, the newest one wins and the older one is put back
+	 * when the newest one goes away.
+	 *
+	 * The key has to be replaced as well as the value, as the entry of the
+	 * older conversation is freed when it is unregistered.
+	 */
+	if(existing != NULL && existing != conversation) {
+		manager->shadowed++;
 	}
 
-	chat = PURPLE_CHAT_CONVERSATION(conversation);
-
-	return (purple_chat_conversation_get_id(chat) == id);
+	g_hash_table_replace(index, entry, conversation);
 }
 
-static PurpleConversation *
-purple_conversation_manager_find_internal(PurpleConversationManager *manager,
-                                          PurpleAccount *account,
-                                          const gchar *name,
-                                          PurpleConversationManagerCompareFunc func,
-                                          gpointer userdata)
+static void
+purple_conversation_manager_index_remove(PurpleConversationManager *manager,
+                                         GHashTable *index,
+                                         gboolean (*has_key)(PurpleConversationManagerEntry *entry),
+                                         GEqualFunc equal,
+                                         PurpleConversation *conversation,
+                                         PurpleConversationManagerEntry *entry)
 {
 	GHashTableIter iter;
-	gpointer key;
+	gpointer key = NULL, value = NULL;
 
-	g_return_val_if_fail(PURPLE_IS_ACCOUNT(account), NULL);
+	if(!g_hash_table_lookup_extended(index, entry, NULL, &value)) {
+		return;
+	}
 
-	g_hash_table_iter_init(&iter, manager->conversations);
-	while(g_hash_table_iter_next(&iter, &key, NULL)) {
-		PurpleConversation *conversation = PURPLE_CONVERSATION(key);
+	if(value != conversation) {
+		/* This conversation was shadowed, so it isn't in the index. */
+		manager->shadowed--;
 
-		if(name != NULL) {
-			const gchar *conv_name = purple_conversation_get_name(conversation);
+		return;
+	}
 
-			if(!purple_strequal(conv_name, name)) {
-				continue;
-			}
-		}
+	g_hash_table_remove(index, entry);
 
-		if(purple_conversation_get_account(conversation) != account) {
-			continue;
-		}
+	if(manager->shadowed == 0) {
+		return;
+	}
 
-		if(func != NULL && !func(conversation, userdata)) {
+	/* Put back a conversation that this one was shadowing, if any. */
+	g_hash_table_iter_init(&iter, manager->conversations);
+	while(g_hash_table_iter_next(&iter, &key, &value)) {
+		PurpleConversationManagerEntry *other = value;
+
+		if(key == conversation || !has_key(other) || !equal(other, entry)) {
 			continue;
 		}
 
-		return conversation;
+		g_hash_table_insert(index, other, key);
+		manager->shadowed--;
+
+		break;
+	}
+}
+
+static void
+purple_conversation_manager_add_index(PurpleConversationManager *manager,
+                                      PurpleConversation *conversation,
+                                      PurpleConversationManagerEntry *entry)
+{
+	/* Conversations without an account can never be found, so there's no
+	 * point in indexing them.
+	 */
+	if(purple_conversation_manager_entry_has_name(entry)) {
+		purple_conversation_manager_index_insert(manager, manager->names,
+		                                         conversation, entry);
+	}
+
+	if(purple_conversation_manager_entry_has_chat_id(entry)) {
+		purple_conversation_manager_index_insert(manager, manager->chat_ids,
+		                                         conversation, entry);
+	}
+}
+
+static void
+purple_conversation_manager_remove_index(PurpleConversationManager *manager,
+                                         PurpleConversation *conversation,
+                                         PurpleConversationManagerEntry *entry)
+{
+	if(purple_conversation_manager_entry_has_name(entry)) {
+		purple_conversation_manager_index_remove(manager, manager->names,
+		                                         purple_conversation_manager_entry_has_name,
+		                                         purple_conversation_manager_name_equal,
+		                                         conversation, entry);
+	}
+
+	if(purple_conversation_manager_entry_has_chat_id(entry)) {
+		purple_conversation_manager_index_remove(manager, manager->chat_ids,
+		                                         purple_conversation_manager_entry_has_chat_id,
+		                                         purple_conversation_manager_chat_id_equal,
+		                                         conversation, entry);
+	}
+}
+
+static PurpleConversation *
+purple_conversation_manager_find_internal(PurpleConversationManager *manager,
+                                          PurpleAccount *account,
+                                          const gchar *name,
+                                          PurpleConversationManagerKind kind)
+{
+	PurpleConversationManagerEntry key = {
+		.account = account,
+		.kind = kind,
+	};
+	PurpleConversation *conversation = NULL;
+
+	key.name = g_strdup(purple_normalize(account, name));
+	conversation = g_hash_table_lookup(manager->names, &key);
+	g_free(key.name);
+
+	return conversation;
+}
+
+/******************************************************************************
+ * Callbacks
+ *****************************************************************************/
+static void
+purple_conversation_manager_conversation_changed_cb(GObject *obj,
+                                                    G_GNUC_UNUSED GParamSpec *pspec,
+                                                    gpointer data)
+{
+	PurpleConversationManager *manager = data;
+	PurpleConversation *conversation = PURPLE_CONVERSATION(obj);
+	PurpleConversationManagerEntry *entry = NULL;
+
+	entry = g_hash_table_lookup(manager->conversations, conversation);
+	if(entry == NULL) {
+		return;
 	}
 
-	return NULL;
+	/* The entry is the key in the indexes, so it has to come out of them
+	 * before it can be updated.
+	 */
+	purple_conversation_manager_remove_index(manager, conversation, entry);
+	purple_conversation_manager_entry_update(entry, conversation);
+	purple_conversation_manager_add_index(manager, conversation, entry);
 }
 
 /******************************************************************************
@@ -121,13 +317,28 @@ static void
 purple_conversation_manager_init(PurpleConversationManager *manager) {
 	manager->conversations = g_hash_table_new_full(g_direct_hash,
 	                                               g_direct_equal,
-	                                               g_object_unref, NULL);
+	                                               g_object_unref,
+	                                               purple_conversation_manager_entry_free);
+
+	manager->names = g_hash_table_new(purple_conversation_manager_name_hash,
+	                                  purple_conversation_manager_name_equal);
+	manager->chat_ids = g_hash_table_new(purple_conversation_manager_chat_id_hash,
+	                                     purple_conversation_manager_chat_id_equal);
 }
 
 static void
 purple_conversation_manager_finalize(GObject *obj) {
 	PurpleConversationManager *manager = PURPLE_CONVERSATION_MANAGER(obj);
+	GHashTableIter iter;
+	gpointer key;
 
+	g_hash_table_iter_init(&iter, manager->conversations);
+	while(g_hash_table_iter_next(&iter, &key, NULL)) {
+		g_signal_handlers_disconnect_by_data(key, manager);
+	}
+
+	g_hash_table_destroy(manager->names);
+	g_hash_table_destroy(manager->chat_ids);
 	g_hash_table_destroy(manager->conversations);
 
 	G_OBJECT_CLASS(purple_conversation_manager_parent_class)->finalize(obj);
@@ -209,41 +420,62 @@ gboolean
 purple_conversation_manager_register(PurpleConversationManager *manager,
                                      PurpleConversation *conversation)
 {
-	gboolean registered = FALSE;
+	PurpleConversationManagerEntry *entry = NULL;
 
 	g_return_val_if_fail(PURPLE_IS_CONVERSATION_MANAGER(manager), FALSE);
 	g_return_val_if_fail(PURPLE_IS_CONVERSATION(conversation), FALSE);
 
-	registered = g_hash_table_insert(manager->conversations,
-	                                 g_object_ref(conversation), NULL);
-	if(registered) {
-		g_signal_emit(manager, signals[SIG_REGISTERED], 0, conversation);
-	} else {
-		/* We need to clean up the ref we created above if the insert failed as
-		 * the key destroy function won't be called until the manager is
-		 * destroyed which will leave the conversation floating around.
-		 */
-		g_object_unref(conversation);
+	if(g_hash_table_contains(manager->conversations, conversation)) {
+		return FALSE;
+	}
+
+	entry = g_new0(PurpleConversationManagerEntry, 1);
+	purple_conversation_manager_entry_update(entry, conversation);
+
+	g_hash_table_insert(manager->conversations, g_object_ref(conversation),
+	                    entry);
+	purple_conversation_manager_add_index(manager, conversation, entry);
+
+	/* Keep the indexes up to date if anything they're keyed on changes. */
+	g_signal_connect(conversation, "notify::account",
+	                 G_CALLBACK(purple_conversation_manager_conversation_changed_cb),
+	                 manager);
+	g_signal_connect(conversation, "notify::name",
+	                 G_CALLBACK(purple_conversation_manager_conversation_changed_cb),
+	                 manager);
+	if(PURPLE_IS_CHAT_CONVERSATION(conversation)) {
+		g_signal_connect(conversation, "notify::chat-id",
+		                 G_CALLBACK(purple_conversation_manager_conversation_changed_cb),
+		                 manager);
 	}
 
-	return registered;
+	g_signal_emit(manager, signals[SIG_REGISTERED], 0, conversation);
+
+	return TRUE;
 }
 
 gboolean
 purple_conversation_manager_unregister(PurpleConversationManager *manager,
                                        PurpleConversation *conversation)
 {
-	gboolean unregistered = FALSE;
+	PurpleConversationManagerEntry *entry = NULL;
 
 	g_return_val_if_fail(PURPLE_IS_CONVERSATION_MANAGER(manager), FALSE);
 	g_return_val_if_fail(PURPLE_IS_CONVERSATION(conversation), FALSE);
 
-	unregistered = g_hash_table_remove(manager->conversations, conversation);
-	if(unregistered) {
-		g_signal_emit(manager, signals[SIG_UNREGISTERED], 0, conversation);
+	entry = g_hash_table_lookup(manager->conversations, conversation);
+	if(entry == NULL) {
+		return FALSE;
 	}
 
-	return unregistered;
+	g_signal_handlers_disconnect_by_data(conversation, manager);
+	purple_conversation_manager_remove_index(manager, conversation, entry);
+
+	g_hash_table_remove(manager->conversations, conversation);
+
+	g_signal_emit(manager, signals[SIG_UNREGISTERED], 0, conversation);
+
+	return TRUE;
 }
 
 gboolean
@@ -286,12 +518,27 @@ PurpleConversation *
 purple_conversation_manager_find(PurpleConversationManager *manager,
                                  PurpleAccount *account, const gchar *name)
 {
+	PurpleConversation *conversation = NULL;
+
 	g_return_val_if_fail(PURPLE_IS_CONVERSATION_MANAGER(manager), NULL);
 	g_return_val_if_fail(PURPLE_IS_ACCOUNT(account), NULL);
 	g_return_val_if_fail(name != NULL, NULL);
 
-	return purple_conversation_manager_find_internal(manager, account, name,
-	                                                 NULL, NULL);
+	conversation = purple_conversation_manager_find_internal(manager, account,
+	                                                         name,
+	                                                         PURPLE_CONVERSATION_MANAGER_KIND_IM);
+	if(conversation == NULL) {
+		conversation = purple_conversation_manager_find_internal(manager,
+		                                                         account, name,
+		                                                         PURPLE_CONVERSATION_MANAGER_KIND_CHAT);
+	}
+	if(conversation == NULL) {
+		conversation = purple_conversation_manager_find_internal(manager,
+		                                                         account, name,
+		                                                         PURPLE_CONVERSATION_MANAGER_KIND_OTHER);
+	}
+
+	return conversation;
 }
 
 PurpleConversation *
@@ -303,8 +550,7 @@ purple_conversation_manager_find_im(PurpleConversationManager *manager,
 	g_return_val_if_fail(name != NULL, NULL);
 
 	return purple_conversation_manager_find_internal(manager, account, name,
-	                                                 purple_conversation_is_im,
-	                                                 NULL);
+	                                                 PURPLE_CONVERSATION_MANAGER_KIND_IM);
 }
 
 PurpleConversation *
@@ -317,18 +563,21 @@ purple_conversation_manager_find_chat(PurpleConversationManager *manager,
 	g_return_val_if_fail(name != NULL, NULL);
 
 	return purple_conversation_manager_find_internal(manager, account, name,
-	                                                 purple_conversation_is_chat,
-	                                                 NULL);
+	                                                 PURPLE_CONVERSATION_MANAGER_KIND_CHAT);
 }
 
 PurpleConversation *
 purple_conversation_manager_find_chat_by_id(PurpleConversationManager *manager,
                                             PurpleAccount *account, gint id)
 {
+	PurpleConversationManagerEntry key = {
+		.account = account,
+		.kind = PURPLE_CONVERSATION_MANAGER_KIND_CHAT,
+		.id = id,
+	};
+
 	g_return_val_if_fail(PURPLE_IS_CONVERSATION_MANAGER(manager), NULL);
 	g_return_val_if_fail(PURPLE_IS_ACCOUNT(account), NULL);
 
-	return purple_conversation_manager_find_internal(manager, account, NULL,
-	                                                 purple_conversation_chat_has_id,
-	                                                 GINT_TO_POINTER(id));
+	return g_hash_table_lookup(manager->chat_ids, &key);
 }
@@ -54,6 +54,10 @@ G_BEGIN_DECLS
  * #PurpleConversationManager keeps track of all #PurpleConversation's inside
  * of libpurple and allows searching of them.
  *
+ * Conversations are indexed by their account and normalized name, and chats
+ * by their account and id as well, so finding a conversation does not depend
+ * on how many are registered.
+ *
  * Since: 3.0.0
  */
 G_DECLARE_FINAL_TYPE(PurpleConversationManager, purple_conversation_manager,
@@ -159,6 +163,8 @@ GList *purple_conversation_manager_get_all(PurpleConversationManager *manager);
  * specifically need an im or chat see purple_conversation_manager_find_im()
  * or purple_conversation_manager_find_chat().
  *
+ * Names are compared after being normalized with purple_normalize().
+ *
  * Returns: (transfer none): The #PurpleConversation if found, otherwise %NULL.
  *
  * Since: 3.0.0
@@ -179,8 +179,21 @@ GdkPixbuf *purple_gdk_pixbuf_from_data(const guchar *buf, gsize count)
 GdkPixbuf *
 purple_gdk_pixbuf_from_image(PurpleImage *image)
 {
-	return purple_gdk_pixbuf_from_data(purple_image_get_data(image),
-		purple_image_get_data_size(image));
+	GdkPixbuf *pixbuf;
+	GBytes *contents;
+	gconstpointer data;
+	gsize size;
+
+	/* Don't keep the image in memory just to turn it into a pixbuf. */
+	contents = purple_image_get_contents(image);
+	if (contents == NULL)
+		return NULL;
+
+	data = g_bytes_get_data(contents, &size);
+	pixbuf = purple_gdk_pixbuf_from_data(data, size);
+	g_bytes_unref(contents);
+
+	return pixbuf;
 }
 
 GdkPixbuf *purple_gdk_pixbuf_new_from_file(const gchar *filename)
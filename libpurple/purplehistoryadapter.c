@@ -255,6 +255,117 @@ purple_history_adapter_query(PurpleHistoryAdapter *adapter,
 	return NULL;
 }
 
+GList *
+purple_history_adapter_query_page(PurpleHistoryAdapter *adapter,
+                                  const gchar *query,
+                                  const gchar *cursor,
+                                  guint limit,
+                                  gchar **next_cursor,
+                                  GError **error)
+{
+	PurpleHistoryAdapterClass *klass = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_HISTORY_ADAPTER(adapter), NULL);
+	g_return_val_if_fail(query != NULL, NULL);
+	g_return_val_if_fail(limit > 0, NULL);
+
+	if(next_cursor != NULL) {
+		*next_cursor = NULL;
+	}
+
+	klass = PURPLE_HISTORY_ADAPTER_GET_CLASS(adapter);
+	if(klass != NULL && klass->query_page != NULL) {
+		return klass->query_page(adapter, query, cursor, limit, next_cursor,
+		                         error);
+	}
+
+	g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+	            "%s does not implement the query_page function.",
+	            G_OBJECT_TYPE_NAME(G_OBJECT(adapter)));
+
+	return NULL;
+}
+
+void
+purple_history_adapter_query_async(PurpleHistoryAdapter *adapter,
+                                   const gchar *query,
+                                   GListStore *store,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer data)
+{
+	PurpleHistoryAdapterClass *klass = NULL;
+	GTask *task = NULL;
+	GList *results = NULL;
+	GError *error = NULL;
+
+	g_return_if_fail(PURPLE_IS_HISTORY_ADAPTER(adapter));
+	g_return_if_fail(query != NULL);
+	g_return_if_fail(G_IS_LIST_STORE(store));
+
+	klass = PURPLE_HISTORY_ADAPTER_GET_CLASS(adapter);
+	if(klass != NULL && klass->query_async != NULL) {
+		klass->query_async(adapter, query, store, cancellable, callback, data);
+
+		return;
+	}
+
+	/* The adapter doesn't support async queries so fall back to the
+	 * synchronous version and hand everything over at once.
+	 */
+	task = g_task_new(adapter, cancellable, callback, data);
+	g_task_set_source_tag(task, purple_history_adapter_query_async);
+
+	if(klass == NULL || klass->query == NULL) {
+		g_task_return_new_error(task, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		                        "%s does not implement the query function.",
+		                        G_OBJECT_TYPE_NAME(G_OBJECT(adapter)));
+		g_object_unref(task);
+
+		return;
+	}
+
+	results = klass->query(adapter, query, &error);
+	if(error != NULL) {
+		g_task_return_error(task, error);
+	} else {
+		for(GList *l = results; l != NULL; l = l->next) {
+			g_list_store_append(store, l->data);
+		}
+
+		g_task_return_boolean(task, TRUE);
+	}
+
+	g_list_free_full(results, g_object_unref);
+	g_object_unref(task);
+}
+
+gboolean
+purple_history_adapter_query_finish(PurpleHistoryAdapter *adapter,
+                                    GAsyncResult *result,
+                                    GError **error)
+{
+	PurpleHistoryAdapterClass *klass = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_HISTORY_ADAPTER(adapter), FALSE);
+	g_return_val_if_fail(G_IS_ASYNC_RESULT(result), FALSE);
+
+	if(g_async_result_is_tagged(result, purple_history_adapter_query_async)) {
+		return g_task_propagate_boolean(G_TASK(result), error);
+	}
+
+	klass = PURPLE_HISTORY_ADAPTER_GET_CLASS(adapter);
+	if(klass != NULL && klass->query_finish != NULL) {
+		return klass->query_finish(adapter, result, error);
+	}
+
+	g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+	            "%s does not implement the query_finish function.",
+	            G_OBJECT_TYPE_NAME(G_OBJECT(adapter)));
+
+	return FALSE;
+}
+
 gboolean
 purple_history_adapter_remove(PurpleHistoryAdapter *adapter,
                               const gchar *query,
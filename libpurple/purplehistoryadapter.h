@@ -25,6 +25,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <purplemessage.h>
 #include <purpleconversation.h>
@@ -72,11 +73,14 @@ struct _PurpleHistoryAdapterClass {
 	GList* (*query)(PurpleHistoryAdapter *adapter, const gchar *query, GError **error);
 	gboolean (*remove)(PurpleHistoryAdapter *adapter, const gchar *query, GError **error);
 	gboolean (*write)(PurpleHistoryAdapter *adapter, PurpleConversation *conversation, PurpleMessage *message, GError **error);
+	GList* (*query_page)(PurpleHistoryAdapter *adapter, const gchar *query, const gchar *cursor, guint limit, gchar **next_cursor, GError **error);
+	void (*query_async)(PurpleHistoryAdapter *adapter, const gchar *query, GListStore *store, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer data);
+	gboolean (*query_finish)(PurpleHistoryAdapter *adapter, GAsyncResult *result, GError **error);
 
 	/*< private >*/
 
 	/* Some extra padding to play it safe. */
-	gpointer reserved[8];
+	gpointer reserved[5];
 };
 
 /**
@@ -137,6 +141,81 @@ GList *purple_history_adapter_query(PurpleHistoryAdapter *adapter,
                                     const gchar *query,
                                     GError **error);
 
+/**
+ * purple_history_adapter_query_page:
+ * @adapter: The #PurpleHistoryAdapter instance.
+ * @query: The query to send to the @adapter.
+ * @cursor: (nullable): The cursor returned from a previous call, or %NULL to
+ *          start with the most recent messages.
+ * @limit: The maximum number of messages to return.
+ * @next_cursor: (out) (optional) (transfer full): A return address for the
+ *               cursor of the next page.
+ * @error: A return address for a #GError.
+ *
+ * Runs @query against @adapter, but only returns up to @limit of the newest
+ * messages that are older than @cursor. This allows a user interface to load
+ * scrollback a page at a time rather than loading everything that matches
+ * @query.
+ *
+ * The messages in each page are in chronological order. @next_cursor will be
+ * set to an opaque string that can be passed to the next call to get the page
+ * before this one, or %NULL when there are no older messages. Relevance
+ * ordering is not supported when paging.
+ *
+ * Returns: (element-type PurpleMessage) (transfer full): A list of messages
+ *          that match @query.
+ *
+ * Since: 3.0.0
+ */
+GList *purple_history_adapter_query_page(PurpleHistoryAdapter *adapter,
+                                         const gchar *query,
+                                         const gchar *cursor,
+                                         guint limit,
+                                         gchar **next_cursor,
+                                         GError **error);
+
+/**
+ * purple_history_adapter_query_async:
+ * @adapter: The #PurpleHistoryAdapter instance.
+ * @query: The query to send to the @adapter.
+ * @store: The #GListStore of #PurpleMessage's to add the results to.
+ * @cancellable: (nullable): An optional #GCancellable.
+ * @callback: (scope async): The callback to call when the query is done.
+ * @data: User data to pass to @callback.
+ *
+ * Runs @query against @adapter without blocking the thread-default main
+ * context. Results are appended to @store as they become available, which
+ * may happen in multiple batches before @callback is called. Once @callback
+ * has been called no more results will be added to @store.
+ *
+ * If @adapter does not implement this function, purple_history_adapter_query()
+ * is called instead and all of the results are added at once.
+ *
+ * Since: 3.0.0
+ */
+void purple_history_adapter_query_async(PurpleHistoryAdapter *adapter,
+                                        const gchar *query,
+                                        GListStore *store,
+                                        GCancellable *cancellable,
+                                        GAsyncReadyCallback callback,
+                                        gpointer data);
+
+/**
+ * purple_history_adapter_query_finish:
+ * @adapter: The #PurpleHistoryAdapter instance.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: A return address for a #GError.
+ *
+ * Finishes a query started with purple_history_adapter_query_async().
+ *
+ * Returns: %TRUE if the query completed, otherwise %FALSE with @error set.
+ *
+ * Since: 3.0.0
+ */
+gboolean purple_history_adapter_query_finish(PurpleHistoryAdapter *adapter,
+                                             GAsyncResult *result,
+                                             GError **error);
+
 /**
  * purple_history_adapter_remove:
  * @adapter: The #PurpleHistoryAdapter instance.
@@ -45,6 +45,27 @@ G_DEFINE_TYPE(PurpleHistoryManager, purple_history_manager, G_TYPE_OBJECT);
 
 static PurpleHistoryManager *default_manager = NULL;
 
+/******************************************************************************
+ * Callbacks
+ *****************************************************************************/
+static void
+purple_history_manager_query_cb(GObject *obj, GAsyncResult *result,
+                                gpointer data)
+{
+	GTask *task = data;
+	GError *error = NULL;
+
+	if(purple_history_adapter_query_finish(PURPLE_HISTORY_ADAPTER(obj), result,
+	                                       &error))
+	{
+		g_task_return_boolean(task, TRUE);
+	} else {
+		g_task_return_error(task, error);
+	}
+
+	g_object_unref(task);
+}
+
 /******************************************************************************
  * GObject Implementation
  *****************************************************************************/
@@ -344,6 +365,76 @@ purple_history_manager_query(PurpleHistoryManager *manager,
 	return purple_history_adapter_query(manager->active_adapter, query, error);
 }
 
+GList *
+purple_history_manager_query_page(PurpleHistoryManager *manager,
+                                  const gchar *query,
+                                  const gchar *cursor,
+                                  guint limit,
+                                  gchar **next_cursor,
+                                  GError **error)
+{
+	g_return_val_if_fail(PURPLE_IS_HISTORY_MANAGER(manager), NULL);
+
+	if(next_cursor != NULL) {
+		*next_cursor = NULL;
+	}
+
+	if(manager->active_adapter == NULL) {
+		g_set_error_literal(error, PURPLE_HISTORY_MANAGER_DOMAIN, 0,
+		                    _("no active history adapter"));
+		return NULL;
+	}
+
+	return purple_history_adapter_query_page(manager->active_adapter, query,
+	                                         cursor, limit, next_cursor,
+	                                         error);
+}
+
+void
+purple_history_manager_query_async(PurpleHistoryManager *manager,
+                                   const gchar *query,
+                                   GListStore *store,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer data)
+{
+	GTask *task = NULL;
+
+	g_return_if_fail(PURPLE_IS_HISTORY_MANAGER(manager));
+
+	task = g_task_new(manager, cancellable, callback, data);
+	g_task_set_source_tag(task, purple_history_manager_query_async);
+
+	if(manager->active_adapter == NULL) {
+		g_task_return_new_error(task, PURPLE_HISTORY_MANAGER_DOMAIN, 0,
+		                        _("no active history adapter"));
+		g_object_unref(task);
+
+		return;
+	}
+
+	/* Hold on to the adapter so we can finish the query even if the active
+	 * adapter changes while it's running.
+	 */
+	g_task_set_task_data(task, g_object_ref(manager->active_adapter),
+	                     g_object_unref);
+
+	purple_history_adapter_query_async(manager->active_adapter, query, store,
+	                                   cancellable,
+	                                   purple_history_manager_query_cb, task);
+}
+
+gboolean
+purple_history_manager_query_finish(PurpleHistoryManager *manager,
+                                    GAsyncResult *result,
+                                    GError **error)
+{
+	g_return_val_if_fail(PURPLE_IS_HISTORY_MANAGER(manager), FALSE);
+	g_return_val_if_fail(g_task_is_valid(result, manager), FALSE);
+
+	return g_task_propagate_boolean(G_TASK(result), error);
+}
+
 gboolean
 purple_history_manager_remove(PurpleHistoryManager *manager,
                               const gchar *query,
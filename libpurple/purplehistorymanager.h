@@ -180,6 +180,57 @@ GList *purple_history_manager_get_all(PurpleHistoryManager *manager);
  */
 GList *purple_history_manager_query(PurpleHistoryManager *manager, const gchar *query, GError **error);
 
+/**
+ * purple_history_manager_query_page:
+ * @manager: The #PurpleHistoryManager instance.
+ * @query: A query to send to the @manager instance.
+ * @cursor: (nullable): The cursor returned from a previous call, or %NULL to
+ *          start with the most recent messages.
+ * @limit: The maximum number of messages to return.
+ * @next_cursor: (out) (optional) (transfer full): A return address for the
+ *               cursor of the next page.
+ * @error: A return address for a #GError.
+ *
+ * Sends a paginated query to the active #PurpleHistoryAdapter of @manager.
+ * See purple_history_adapter_query_page() for details.
+ *
+ * Returns: (transfer full) (element-type PurpleMessage): The page of
+ *          #PurpleMessage's that matched the query.
+ *
+ * Since: 3.0.0
+ */
+GList *purple_history_manager_query_page(PurpleHistoryManager *manager, const gchar *query, const gchar *cursor, guint limit, gchar **next_cursor, GError **error);
+
+/**
+ * purple_history_manager_query_async:
+ * @manager: The #PurpleHistoryManager instance.
+ * @query: A query to send to the @manager instance.
+ * @store: The #GListStore of #PurpleMessage's to add the results to.
+ * @cancellable: (nullable): An optional #GCancellable.
+ * @callback: (scope async): The callback to call when the query is done.
+ * @data: User data to pass to @callback.
+ *
+ * Sends a query to the active #PurpleHistoryAdapter of @manager without
+ * blocking. See purple_history_adapter_query_async() for details.
+ *
+ * Since: 3.0.0
+ */
+void purple_history_manager_query_async(PurpleHistoryManager *manager, const gchar *query, GListStore *store, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer data);
+
+/**
+ * purple_history_manager_query_finish:
+ * @manager: The #PurpleHistoryManager instance.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: A return address for a #GError.
+ *
+ * Finishes a query started with purple_history_manager_query_async().
+ *
+ * Returns: %TRUE if the query completed, otherwise %FALSE with @error set.
+ *
+ * Since: 3.0.0
+ */
+gboolean purple_history_manager_query_finish(PurpleHistoryManager *manager, GAsyncResult *result, GError **error);
+
 /**
  * purple_history_manager_remove:
  * @manager: The #PurpleHistoryManager instance.
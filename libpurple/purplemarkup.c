@@ -917,13 +917,16 @@ purple_markup_html_to_xhtml(const char *html, char **xhtml_out,
 				cdata = g_string_append_len(cdata, c, len);
 			c += len;
 		} else {
+			/* Copy everything up to the next tag or entity at once. */
+			gsize len = strcspn(c, "<&");
+
 			if(xhtml)
-				xhtml = g_string_append_c(xhtml, *c);
+				xhtml = g_string_append_len(xhtml, c, len);
 			if(plain)
-				plain = g_string_append_c(plain, *c);
+				plain = g_string_append_len(plain, c, len);
 			if(cdata)
-				cdata = g_string_append_c(cdata, *c);
-			c++;
+				cdata = g_string_append_len(cdata, c, len);
+			c += len;
 		}
 	}
 	if(xhtml) {
@@ -972,6 +975,20 @@ purple_markup_strip_html(const char *str)
 
 	for (i = 0, j = 0; str2[i]; i++)
 	{
+		/* Visible plain text is copied as it is, apart from whitespace that
+		 * isn't a space, so do runs of it at once. */
+		if (visible && !cdata_close_tag)
+		{
+			k = strcspn(str2 + i, "<&\t\n\v\f\r");
+			if (k > 0)
+			{
+				memmove(str2 + j, str2 + i, k);
+				j += k;
+				i += k - 1;
+				continue;
+			}
+		}
+
 		if (str2[i] == '<')
 		{
 			if (cdata_close_tag)
@@ -1133,6 +1150,42 @@ purple_markup_strip_html(const char *str)
 	return str2;
 }
 
+/* The bytes that purple_markup_linkify() has to look at outside of tags:
+ * parentheses, tags, the '@' of email addresses and the first letter of each
+ * URL scheme it knows. Runs of anything else are copied as they are. */
+static const gboolean linkify_special[256] = {
+	['\0'] = TRUE,
+	['('] = TRUE, [')'] = TRUE, ['<'] = TRUE, ['@'] = TRUE,
+	['f'] = TRUE, ['F'] = TRUE, /* ftp://, file://, ftp. */
+	['h'] = TRUE, ['H'] = TRUE, /* http://, https:// */
+	['m'] = TRUE, ['M'] = TRUE, /* mailto: */
+	['s'] = TRUE, ['S'] = TRUE, /* sftp:// */
+	['w'] = TRUE, ['W'] = TRUE, /* www. */
+	['x'] = TRUE, ['X'] = TRUE, /* xmpp: */
+};
+
+#define LINKIFY_WORD_START 0x01 /* Only at the start of a word. */
+#define LINKIFY_NO_DOT     0x02 /* Not followed by another '.'. */
+
+/* The URL schemes purple_markup_linkify() recognizes, other than mailto:,
+ * which is handled separately. Only the entries with the right first letter
+ * are compared, so at most two are tried at any position. */
+static const struct {
+	const char *scheme;
+	int len;
+	const char *urlprefix;
+	int flags;
+} linkify_schemes[] = {
+	{ "file://", 7, "", 0 },
+	{ "ftp://", 6, "", 0 },
+	{ "ftp.", 4, "ftp://", LINKIFY_WORD_START | LINKIFY_NO_DOT },
+	{ "http://", 7, "", 0 },
+	{ "https://", 8, "", 0 },
+	{ "sftp://", 7, "", 0 },
+	{ "www.", 4, "http://", LINKIFY_WORD_START | LINKIFY_NO_DOT },
+	{ "xmpp:", 5, "", LINKIFY_WORD_START },
+};
+
 static gboolean
 badchar(char c)
 {
@@ -1201,6 +1254,34 @@ process_link(GString *ret,
 	return c;
 }
 
+/* Returns the index of the entry in linkify_schemes that c starts with, or
+ * -1 if there isn't one. */
+static int
+linkify_match_scheme(const char *text, const char *c)
+{
+	gchar lower = g_ascii_tolower(*c);
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS(linkify_schemes); i++) {
+		int flags = linkify_schemes[i].flags;
+
+		if (linkify_schemes[i].scheme[0] != lower ||
+		    g_ascii_strncasecmp(c, linkify_schemes[i].scheme,
+		                        linkify_schemes[i].len))
+			continue;
+
+		if ((flags & LINKIFY_NO_DOT) && c[linkify_schemes[i].len] == '.')
+			continue;
+		if ((flags & LINKIFY_WORD_START) &&
+		    !(c == text || badchar(c[-1]) || badentity(c - 1)))
+			continue;
+
+		return i;
+	}
+
+	return -1;
+}
+
 char *
 purple_markup_linkify(const char *text)
 {
@@ -1218,6 +1299,22 @@ purple_markup_linkify(const char *text)
 
 	c = text;
 	while (*c) {
+		int scheme;
+
+		if (!inside_html) {
+			const char *run = c;
+
+			while (!linkify_special[(guchar)*run])
+				run++;
+
+			if (run != c) {
+				g_string_append_len(ret, c, run - c);
+				c = run;
+
+				if (*c == '\0')
+					break;
+			}
+		}
 
 		if(*c == '(' && !inside_html) {
 			inside_paren++;
@@ -1248,22 +1345,11 @@ purple_markup_linkify(const char *text)
 						break;
 				}
 			}
-		} else if (!g_ascii_strncasecmp(c, "http://", 7)) {
-			c = process_link(ret, text, c, 7, "", inside_paren);
-		} else if (!g_ascii_strncasecmp(c, "https://", 8)) {
-			c = process_link(ret, text, c, 8, "", inside_paren);
-		} else if (!g_ascii_strncasecmp(c, "ftp://", 6)) {
-			c = process_link(ret, text, c, 6, "", inside_paren);
-		} else if (!g_ascii_strncasecmp(c, "sftp://", 7)) {
-			c = process_link(ret, text, c, 7, "", inside_paren);
-		} else if (!g_ascii_strncasecmp(c, "file://", 7)) {
-			c = process_link(ret, text, c, 7, "", inside_paren);
-		} else if (!g_ascii_strncasecmp(c, "www.", 4) && c[4] != '.' && (c == text || badchar(c[-1]) || badentity(c-1))) {
-			c = process_link(ret, text, c, 4, "http://", inside_paren);
-		} else if (!g_ascii_strncasecmp(c, "ftp.", 4) && c[4] != '.' && (c == text || badchar(c[-1]) || badentity(c-1))) {
-			c = process_link(ret, text, c, 4, "ftp://", inside_paren);
-		} else if (!g_ascii_strncasecmp(c, "xmpp:", 5) && (c == text || badchar(c[-1]) || badentity(c-1))) {
-			c = process_link(ret, text, c, 5, "", inside_paren);
+		} else if (!linkify_special[(guchar)*c]) {
+			/* Nothing below can match here, so don't bother trying. */
+		} else if ((scheme = linkify_match_scheme(text, c)) >= 0) {
+			c = process_link(ret, text, c, linkify_schemes[scheme].len,
+			                 linkify_schemes[scheme].urlprefix, inside_paren);
 		} else if (!g_ascii_strncasecmp(c, "mailto:", 7)) {
 			t = c;
 			while (1) {
@@ -32,7 +32,10 @@
 #include "accounts.h"
 #include "connection.h"
 #include "purplecredentialprovider.h"
+#include "image.h"
 #include "purplehistoryadapter.h"
+#include "xfer.h"
+#include "xmlnode.h"
 
 #define PURPLE_STATIC_ASSERT(condition, message) \
 	{ typedef char static_assertion_failed_ ## message \
@@ -153,6 +156,29 @@ void _purple_connection_add_active_chat(PurpleConnection *gc,
 void _purple_connection_remove_active_chat(PurpleConnection *gc,
                                            PurpleChatConversation *chat);
 
+/**
+ * _purple_chat_user_set_key:
+ * @chat_user: The chat user.
+ * @key: (transfer full): The key.
+ *
+ * Sets the key that the chat of @chat_user uses to look it up.
+ *
+ * Note: This function should only be called by purplechatconversation.c.
+ */
+void _purple_chat_user_set_key(PurpleChatUser *chat_user, gchar *key);
+
+/**
+ * _purple_chat_user_get_key:
+ * @chat_user: The chat user.
+ *
+ * Gets the key that the chat of @chat_user uses to look it up.
+ *
+ * Note: This function should only be called by purplechatconversation.c.
+ *
+ * Returns: The key.
+ */
+const gchar *_purple_chat_user_get_key(PurpleChatUser *chat_user);
+
 /**
  * _purple_statuses_get_primitive_scores:
  *
@@ -356,6 +382,119 @@ void purple_whiteboard_manager_startup(void);
  */
 void purple_whiteboard_manager_shutdown(void);
 
+/**
+ * _purple_image_spill_async:
+ * @image: The image.
+ * @path: The file to write the contents of @image to.
+ * @callback: The callback to call when the file has been written.
+ * @data: User data to pass to @callback.
+ *
+ * Writes the contents of @image to @path in a worker thread, unless it
+ * already exists. The contents stay in memory until
+ * _purple_image_drop_contents() is called.
+ *
+ * Note: This function should only be called by image-store.c.
+ */
+void _purple_image_spill_async(PurpleImage *image, const gchar *path,
+                               GAsyncReadyCallback callback, gpointer data);
+
+/**
+ * _purple_image_spill_finish:
+ * @image: The image.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError, or %NULL.
+ *
+ * Note: This function should only be called by image-store.c.
+ *
+ * Returns: %TRUE if the file was written.
+ */
+gboolean _purple_image_spill_finish(PurpleImage *image, GAsyncResult *result,
+                                    GError **error);
+
+/**
+ * _purple_image_drop_contents:
+ * @image: The image.
+ * @path: The file the contents of @image were written to.
+ *
+ * Drops the contents of @image from memory. They're mapped back in from
+ * @path the next time they're needed, so @path must not be removed while
+ * @image is alive. Nothing is dropped once purple_image_get_data() has handed
+ * out a pointer to the contents.
+ *
+ * Note: This function should only be called by image-store.c and
+ * buddyicon.c.
+ *
+ * Returns: %TRUE if the contents were dropped.
+ */
+gboolean _purple_image_drop_contents(PurpleImage *image, const gchar *path);
+
+/**
+ * _purple_image_is_borrowed:
+ * @image: The image.
+ *
+ * Note: This function should only be called by image-store.c and
+ * buddyicon.c.
+ *
+ * Returns: %TRUE if purple_image_get_data() has been called on @image, so its
+ *          contents have to stay in memory.
+ */
+gboolean _purple_image_is_borrowed(PurpleImage *image);
+
+/**
+ * _purple_image_is_spilled:
+ * @image: The image.
+ *
+ * Note: This function should only be called by image-store.c.
+ *
+ * Returns: %TRUE if the contents of @image are only on disk.
+ */
+gboolean _purple_image_is_spilled(PurpleImage *image);
+
+/**
+ * _purple_image_store_touch:
+ * @image: The image.
+ *
+ * Tells the image store that the contents of @image were just used, so it
+ * can keep its least recently used list and statistics up to date.
+ *
+ * Note: This function should only be called by image.c.
+ */
+void _purple_image_store_touch(PurpleImage *image);
+
+/**
+ * _purple_util_write_xml_to_config_file:
+ * @filename: The name of the file in the config directory.
+ * @node: (transfer full): A snapshot of the contents of the file.
+ *
+ * Formats @node and writes it to @filename in a worker thread. If an earlier
+ * snapshot of @filename hasn't been written yet, @node replaces it.
+ *
+ * @node must not be shared with anything else, since it's formatted and freed
+ * outside of the main thread.
+ */
+void _purple_util_write_xml_to_config_file(const char *filename, PurpleXmlNode *node);
+
+/**
+ * _purple_util_write_flush:
+ *
+ * Waits for every write queued with _purple_util_write_xml_to_config_file()
+ * to finish.
+ */
+void _purple_util_write_flush(void);
+
+/**
+ * _purple_xfer_sample_throughput:
+ * @xfer: The file transfer.
+ * @bytes: How many bytes moved, or 0 if the transfer was woken up but none
+ *         did.
+ * @now: The monotonic time, in microseconds.
+ *
+ * Updates the throughput and stall count of @xfer.
+ *
+ * Note: This function should only be called by xfer.c and its tests.
+ */
+void _purple_xfer_sample_throughput(PurpleXfer *xfer, goffset bytes, gint64 now);
+
 G_END_DECLS
 
 #endif /* PURPLE_PRIVATE_H */
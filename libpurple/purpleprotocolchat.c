@@ -206,3 +206,20 @@ purple_protocol_chat_set_topic(PurpleProtocolChat *protocol_chat,
 		iface->set_topic(protocol_chat, connection, id, topic);
 	}
 }
+
+gchar *
+purple_protocol_chat_get_user_key(PurpleProtocolChat *protocol_chat,
+                                  const gchar *who)
+{
+	PurpleProtocolChatInterface *iface = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_PROTOCOL_CHAT(protocol_chat), NULL);
+	g_return_val_if_fail(who != NULL, NULL);
+
+	iface = PURPLE_PROTOCOL_CHAT_GET_IFACE(protocol_chat);
+	if(iface != NULL && iface->get_user_key != NULL) {
+		return iface->get_user_key(protocol_chat, who);
+	}
+
+	return NULL;
+}
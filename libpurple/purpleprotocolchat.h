@@ -91,6 +91,11 @@ G_BEGIN_DECLS
  *                      <literal>foo</literal> into
  *                      <literal>room\@server/foo</literal>.
  * @set_topic: Called to set the topic for the given chat.
+ * @get_user_key: Returns the key used to look up a participant of a chat.
+ *                Names that refer to the same participant must have the same
+ *                key, for example by applying the protocol's case mapping.
+ *                If this isn't implemented, a locale aware collation key is
+ *                used, which is much slower to compute.
  *
  * The protocol chat interface.
  *
@@ -121,8 +126,10 @@ struct _PurpleProtocolChatInterface {
 
 	void (*set_topic)(PurpleProtocolChat *protocol_chat, PurpleConnection *connection, gint id, const gchar *topic);
 
+	gchar *(*get_user_key)(PurpleProtocolChat *protocol_chat, const gchar *who);
+
 	/*< private >*/
-	gpointer reserved[8];
+	gpointer reserved[7];
 };
 
 /**
@@ -265,6 +272,20 @@ gchar *purple_protocol_chat_get_user_real_name(PurpleProtocolChat *protocol_chat
  */
 void purple_protocol_chat_set_topic(PurpleProtocolChat *protocol_chat, PurpleConnection *connection, gint id, const gchar *topic);
 
+/**
+ * purple_protocol_chat_get_user_key:
+ * @protocol_chat: The #PurpleProtocolChat instance.
+ * @who: The name of a participant of a chat.
+ *
+ * Gets the key that chats use to look up @who in their list of participants.
+ *
+ * Returns: (transfer full) (nullable): The key for @who, or %NULL if
+ *          @protocol_chat doesn't provide its own keys.
+ *
+ * Since: 3.0.0
+ */
+gchar *purple_protocol_chat_get_user_key(PurpleProtocolChat *protocol_chat, const gchar *who);
+
 G_END_DECLS
 
 #endif /* PURPLE_PROTOCOL_CHAT_H */
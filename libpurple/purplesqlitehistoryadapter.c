@@ -21,9 +21,13 @@
 #include "purplesqlitehistoryadapter.h"
 
 #include "account.h"
+#include "debug.h"
+#include "purpleenums.h"
 #include "purpleprivate.h"
 #include "purpleresources.h"
 
+#include <string.h>
+
 #include <sqlite3.h>
 
 struct _PurpleSqliteHistoryAdapter {
@@ -33,11 +37,74 @@ struct _PurpleSqliteHistoryAdapter {
 typedef struct {
 	gchar *filename;
 	sqlite3 *db;
+
+	/* Async queries step their statements from a worker thread, so any use
+	 * of db or insert_statement has to hold the lock. The generation is
+	 * bumped on every deactivation so that a worker can tell that the
+	 * connection it started on has gone away.
+	 */
+	GMutex lock;
+	guint generation;
+
+	sqlite3_stmt *insert_statement;
+
+	PurpleSqliteHistoryAdapterSynchronous synchronous;
+	guint batch_size;
+	guint batch_interval;
+
+	GQueue *pending;
+	guint flush_id;
 } PurpleSqliteHistoryAdapterPrivate;
 
+/* A snapshot of a message that is waiting to be written. We copy everything
+ * out of the message and conversation when it is queued so that we don't
+ * depend on them staying alive or unchanged until the batch is flushed.
+ */
+typedef struct {
+	gchar *protocol;
+	gchar *account;
+	gchar *conversation_id;
+	gchar *message_id;
+	gchar *author;
+	gchar *author_name_color;
+	gchar *author_alias;
+	gchar *recipient;
+	const gchar *content_type;
+	gchar *content;
+	gchar *timestamp;
+} PurpleSqliteHistoryAdapterRow;
+
+/* The position of a message in the log. Cursors handed out by
+ * purple_sqlite_history_adapter_query_page() are this serialized as
+ * "<client_timestamp>|<rowid>".
+ */
+typedef struct {
+	gchar *timestamp;
+	gint64 rowid;
+} PurpleSqliteHistoryAdapterCursor;
+
+typedef struct {
+	gchar *query;
+	GListStore *store;
+	guint generation;
+} PurpleSqliteHistoryAdapterQueryData;
+
+typedef struct {
+	GListStore *store;
+	GCancellable *cancellable;
+	GPtrArray *messages;
+} PurpleSqliteHistoryAdapterQueryBatch;
+
+#define PURPLE_SQLITE_HISTORY_ADAPTER_DEFAULT_BATCH_SIZE (100)
+#define PURPLE_SQLITE_HISTORY_ADAPTER_QUERY_BATCH_SIZE (100)
+#define PURPLE_SQLITE_HISTORY_ADAPTER_DEFAULT_BATCH_INTERVAL (250)
+
 enum {
 	PROP_0,
 	PROP_FILENAME,
+	PROP_SYNCHRONOUS,
+	PROP_BATCH_SIZE,
+	PROP_BATCH_INTERVAL,
 	N_PROPERTIES,
 };
 static GParamSpec *properties[N_PROPERTIES] = {NULL, };
@@ -63,44 +130,98 @@ purple_sqlite_history_adapter_set_filename(PurpleSqliteHistoryAdapter *adapter,
 	g_object_notify_by_pspec(G_OBJECT(adapter), properties[PROP_FILENAME]);
 }
 
+static gint
+purple_sqlite_history_adapter_get_schema_version(PurpleSqliteHistoryAdapter *adapter)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	sqlite3_stmt *prepared_statement = NULL;
+	gint version = 0;
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	sqlite3_prepare_v2(priv->db, "PRAGMA user_version;", -1,
+	                   &prepared_statement, NULL);
+	if(prepared_statement == NULL) {
+		return 0;
+	}
+
+	if(sqlite3_step(prepared_statement) == SQLITE_ROW) {
+		version = sqlite3_column_int(prepared_statement, 0);
+	}
+
+	sqlite3_finalize(prepared_statement);
+
+	return version;
+}
+
 static gboolean
 purple_sqlite_history_adapter_run_migrations(PurpleSqliteHistoryAdapter *adapter,
                                              GError **error)
 {
-	GBytes *bytes = NULL;
+	/* Migrations are applied in order and each one is only ever run once. The
+	 * number of migrations that have been applied is tracked with sqlite's
+	 * user_version pragma, so new migrations must only ever be appended.
+	 */
+	const gchar *migrations[] = {
+		"01-schema.sql",
+		"02-fulltext.sql",
+		"03-indexes.sql",
+	};
 	GResource *resource = NULL;
 	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
-	gchar *error_msg = NULL;
-	const gchar *script = NULL;
+	gint version = 0;
 
 	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
 
 	resource = purple_get_resource();
 
-	bytes = g_resource_lookup_data(resource,
-	                               "/im/pidgin/libpurple/sqlitehistoryadapter/01-schema.sql",
-	                               G_RESOURCE_LOOKUP_FLAGS_NONE, error);
-	if(bytes == NULL) {
-		return FALSE;
-	}
+	version = purple_sqlite_history_adapter_get_schema_version(adapter);
 
-	script = (const gchar *)g_bytes_get_data(bytes, NULL);
-	sqlite3_exec(priv->db, script, NULL, NULL, &error_msg);
-	g_bytes_unref(bytes);
+	for(gint i = version; i < (gint)G_N_ELEMENTS(migrations); i++) {
+		GBytes *bytes = NULL;
+		gchar *path = NULL;
+		gchar *script = NULL;
+		gchar *error_msg = NULL;
 
-	if(error_msg != NULL) {
-		g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
-		            "failed to run migrations: %s", error_msg);
+		path = g_strdup_printf("/im/pidgin/libpurple/sqlitehistoryadapter/%s",
+		                       migrations[i]);
+		bytes = g_resource_lookup_data(resource, path,
+		                               G_RESOURCE_LOOKUP_FLAGS_NONE, error);
+		g_free(path);
 
-		sqlite3_free(error_msg);
+		if(bytes == NULL) {
+			return FALSE;
+		}
 
-		return FALSE;
+		/* Each migration and the version bump are run in a single
+		 * transaction so a failure can't leave the schema half applied.
+		 */
+		script = g_strdup_printf("BEGIN;\n%s\nPRAGMA user_version = %d;\n"
+		                         "COMMIT;",
+		                         (const gchar *)g_bytes_get_data(bytes, NULL),
+		                         i + 1);
+		g_bytes_unref(bytes);
+
+		sqlite3_exec(priv->db, script, NULL, NULL, &error_msg);
+		g_free(script);
+
+		if(error_msg != NULL) {
+			g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+			            "failed to run migration %s: %s", migrations[i],
+			            error_msg);
+
+			sqlite3_free(error_msg);
+
+			sqlite3_exec(priv->db, "ROLLBACK;", NULL, NULL, NULL);
+
+			return FALSE;
+		}
 	}
 
 	return TRUE;
 }
 
-static gchar *
+static const gchar *
 purple_sqlite_history_adapter_get_content_type(PurpleMessageContentType content_type) {
 	switch(content_type) {
 		case PURPLE_MESSAGE_CONTENT_TYPE_PLAIN:
@@ -139,20 +260,288 @@ purple_sqlite_history_adapter_get_content_type_enum(const gchar *content_type)
 	return PURPLE_MESSAGE_CONTENT_TYPE_PLAIN;
 }
 
+static PurpleSqliteHistoryAdapterRow *
+purple_sqlite_history_adapter_row_new(PurpleConversation *conversation,
+                                      PurpleMessage *message)
+{
+	PurpleSqliteHistoryAdapterRow *row = NULL;
+	PurpleAccount *account = NULL;
+	PurpleMessageContentType content_type;
+	const gchar *message_id = NULL;
+
+	account = purple_conversation_get_account(conversation);
+
+	row = g_new0(PurpleSqliteHistoryAdapterRow, 1);
+	row->protocol = g_strdup(purple_account_get_protocol_name(account));
+	row->account = g_strdup(purple_account_get_username(account));
+	row->conversation_id = g_strdup(purple_conversation_get_name(conversation));
+
+	message_id = purple_message_get_id(message);
+	if(message_id != NULL) {
+		row->message_id = g_strdup(message_id);
+	} else {
+		row->message_id = g_uuid_string_random();
+	}
+
+	row->author = g_strdup(purple_message_get_author(message));
+	row->author_name_color = g_strdup(purple_message_get_author_name_color(message));
+	row->author_alias = g_strdup(purple_message_get_author_alias(message));
+	row->recipient = g_strdup(purple_message_get_recipient(message));
+	content_type = purple_message_get_content_type(message);
+	row->content_type = purple_sqlite_history_adapter_get_content_type(content_type);
+	row->content = g_strdup(purple_message_get_contents(message));
+	row->timestamp = g_date_time_format_iso8601(purple_message_get_timestamp(message));
+
+	return row;
+}
+
+static void
+purple_sqlite_history_adapter_row_free(PurpleSqliteHistoryAdapterRow *row) {
+	g_free(row->protocol);
+	g_free(row->account);
+	g_free(row->conversation_id);
+	g_free(row->message_id);
+	g_free(row->author);
+	g_free(row->author_name_color);
+	g_free(row->author_alias);
+	g_free(row->recipient);
+	g_free(row->content);
+	g_free(row->timestamp);
+	g_free(row);
+}
+
+static gboolean
+purple_sqlite_history_adapter_insert_row(PurpleSqliteHistoryAdapter *adapter,
+                                         PurpleSqliteHistoryAdapterRow *row,
+                                         GError **error)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	sqlite3_stmt *stmt = NULL;
+	gint result = 0;
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+	stmt = priv->insert_statement;
+
+	sqlite3_bind_text(stmt, 1, row->protocol, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, row->account, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 3, row->conversation_id, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 4, row->message_id, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 5, row->author, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 6, row->author_name_color, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 7, row->author_alias, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 8, row->recipient, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 9, row->content_type, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 10, row->content, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 11, row->timestamp, -1, SQLITE_STATIC);
+
+	result = sqlite3_step(stmt);
+
+	if(result != SQLITE_DONE) {
+		g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		            "Error writing to the database: %s",
+		            sqlite3_errmsg(priv->db));
+	}
+
+	/* The statement is reused for every insert, so reset it and drop our
+	 * bindings before the row that they point to is freed.
+	 */
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	return result == SQLITE_DONE;
+}
+
+static gboolean
+purple_sqlite_history_adapter_flush_cb(gpointer data) {
+	PurpleSqliteHistoryAdapter *adapter = data;
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	GError *error = NULL;
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	/* We're returning G_SOURCE_REMOVE, so clear the id to keep the flush from
+	 * trying to remove this source as well.
+	 */
+	priv->flush_id = 0;
+
+	if(!purple_sqlite_history_adapter_flush(adapter, &error)) {
+		purple_debug_warning("sqlite-history-adapter",
+		                     "failed to write messages: %s",
+		                     error != NULL ? error->message : "unknown error");
+		g_clear_error(&error);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+purple_sqlite_history_adapter_apply_synchronous(PurpleSqliteHistoryAdapter *adapter)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	gchar *pragma = NULL;
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	if(priv->db == NULL) {
+		return;
+	}
+
+	pragma = g_strdup_printf("PRAGMA synchronous = %d;", priv->synchronous);
+	g_mutex_lock(&priv->lock);
+	sqlite3_exec(priv->db, pragma, NULL, NULL, NULL);
+	g_mutex_unlock(&priv->lock);
+	g_free(pragma);
+}
+
+/* Splits a query on whitespace, but keeps anything between double quotes
+ * together so that phrases like from:"Some One" or "hello world" end up as a
+ * single token.
+ */
+static GPtrArray *
+purple_sqlite_history_adapter_split_query(const gchar *search_query) {
+	GPtrArray *tokens = g_ptr_array_new_with_free_func(g_free);
+	const gchar *p = search_query;
+
+	while(*p != '\0') {
+		const gchar *start = NULL;
+		gboolean quoted = FALSE;
+
+		while(g_ascii_isspace(*p)) {
+			p++;
+		}
+
+		if(*p == '\0') {
+			break;
+		}
+
+		start = p;
+		while(*p != '\0' && (quoted || !g_ascii_isspace(*p))) {
+			if(*p == '"') {
+				quoted = !quoted;
+			}
+			p++;
+		}
+
+		g_ptr_array_add(tokens, g_strndup(start, p - start));
+	}
+
+	return tokens;
+}
+
+static gchar *
+purple_sqlite_history_adapter_unquote(const gchar *value) {
+	GString *str = g_string_new(NULL);
+
+	for(; *value != '\0'; value++) {
+		if(*value != '"') {
+			g_string_append_c(str, *value);
+		}
+	}
+
+	return g_string_free(str, FALSE);
+}
+
+/* Turns a single search term into an fts5 string. Every term is quoted so
+ * that punctuation in the search can't be interpreted as fts5 syntax.
+ */
+static gchar *
+purple_sqlite_history_adapter_fts_term(const gchar *token) {
+	gchar *text = NULL;
+	gchar *term = NULL;
+	gboolean prefix = FALSE;
+	gsize len = strlen(token);
+
+	if(len > 1 && token[len - 1] == '*') {
+		prefix = TRUE;
+	}
+
+	text = purple_sqlite_history_adapter_unquote(token);
+	if(prefix) {
+		text[strlen(text) - 1] = '\0';
+	}
+
+	if(*text == '\0') {
+		g_free(text);
+
+		return NULL;
+	}
+
+	term = g_strdup_printf("\"%s\"%s", text, prefix ? "*" : "");
+	g_free(text);
+
+	return term;
+}
+
+/* Converts a snippet returned from sqlite into markup. The match markers are
+ * \002 and \003 so that we can escape plain text contents without mangling
+ * the highlighting.
+ */
+static gchar *
+purple_sqlite_history_adapter_format_snippet(const gchar *snippet,
+                                             PurpleMessageContentType *content_type)
+{
+	GString *str = g_string_new(NULL);
+	gboolean escape = TRUE;
+
+	if(*content_type == PURPLE_MESSAGE_CONTENT_TYPE_HTML ||
+	   *content_type == PURPLE_MESSAGE_CONTENT_TYPE_XHTML)
+	{
+		escape = FALSE;
+	}
+
+	while(*snippet != '\0') {
+		gsize len = strcspn(snippet, "\002\003");
+
+		if(len > 0) {
+			if(escape) {
+				gchar *escaped = g_markup_escape_text(snippet, len);
+
+				g_string_append(str, escaped);
+				g_free(escaped);
+			} else {
+				g_string_append_len(str, snippet, len);
+			}
+
+			snippet += len;
+		}
+
+		if(*snippet == '\002') {
+			g_string_append(str, "<b>");
+			snippet++;
+		} else if(*snippet == '\003') {
+			g_string_append(str, "</b>");
+			snippet++;
+		}
+	}
+
+	if(escape) {
+		*content_type = PURPLE_MESSAGE_CONTENT_TYPE_HTML;
+	}
+
+	return g_string_free(str, FALSE);
+}
+
 static sqlite3_stmt *
 purple_sqlite_history_adapter_build_query(PurpleSqliteHistoryAdapter *adapter,
                                           const gchar * search_query,
                                           gboolean remove,
+                                          gboolean *highlight,
+                                          PurpleSqliteHistoryAdapterCursor *before,
+                                          guint limit,
                                           GError **error)
 {
-	gchar **split = NULL;
-	gint i = 0;
+	GPtrArray *tokens = NULL;
+	GList *accounts = NULL;
 	GList *ins = NULL;
 	GList *froms = NULL;
-	GList *keywords = NULL;
+	GString *terms = NULL;
+	GString *excluded = NULL;
 	GString *query = NULL;
 	GList *iter = NULL;
+	gchar *match = NULL;
+	const gchar *operator = NULL;
 	gboolean first = FALSE;
+	gboolean rank = FALSE;
 	sqlite3_stmt *prepared_statement = NULL;
 	gint index = 1;
 	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
@@ -160,31 +549,104 @@ purple_sqlite_history_adapter_build_query(PurpleSqliteHistoryAdapter *adapter,
 
 	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
 
-	split = g_strsplit(search_query, " ", -1);
-	for(i = 0; split[i] != NULL; i++) {
-		if(g_str_has_prefix(split[i], "in:")) {
-			if(split[i][3] == '\0') {
+	if(highlight != NULL) {
+		*highlight = FALSE;
+	}
+
+	terms = g_string_new(NULL);
+	excluded = g_string_new(NULL);
+
+	tokens = purple_sqlite_history_adapter_split_query(search_query);
+	for(guint i = 0; i < tokens->len; i++) {
+		const gchar *token = g_ptr_array_index(tokens, i);
+		gchar *term = NULL;
+
+		if(g_str_has_prefix(token, "account:")) {
+			if(token[8] == '\0') {
 				continue;
 			}
-			ins = g_list_prepend(ins, g_strdup(split[i]+3));
+			accounts = g_list_append(accounts,
+			                         purple_sqlite_history_adapter_unquote(token+8));
 			query_items++;
-		} else if(g_str_has_prefix(split[i], "from:")) {
-			if(split[i][5] == '\0') {
+		} else if(g_str_has_prefix(token, "in:")) {
+			if(token[3] == '\0') {
 				continue;
 			}
-			froms = g_list_prepend(froms, g_strdup(split[i]+5));
+			ins = g_list_append(ins,
+			                    purple_sqlite_history_adapter_unquote(token+3));
 			query_items++;
-		} else {
-			if(split[i][0] == '\0') {
+		} else if(g_str_has_prefix(token, "from:")) {
+			if(token[5] == '\0') {
 				continue;
 			}
-			keywords = g_list_prepend(keywords,
-			                          g_strdup_printf("%%%s%%", split[i]));
+			froms = g_list_append(froms,
+			                      purple_sqlite_history_adapter_unquote(token+5));
 			query_items++;
+		} else if(purple_strequal(token, "sort:rank")) {
+			rank = TRUE;
+		} else if(purple_strequal(token, "sort:time")) {
+			rank = FALSE;
+		} else if(purple_strequal(token, "highlight:on")) {
+			if(highlight != NULL) {
+				*highlight = TRUE;
+			}
+		} else if(purple_strequal(token, "highlight:off")) {
+			if(highlight != NULL) {
+				*highlight = FALSE;
+			}
+		} else if((purple_strequal(token, "AND") ||
+		           purple_strequal(token, "OR") ||
+		           purple_strequal(token, "NOT")) &&
+		          terms->len > 0 && operator == NULL)
+		{
+			/* Operators are only valid between two terms, anywhere else
+			 * they're treated as a plain search term.
+			 */
+			operator = token;
+		} else if(token[0] == '-' && token[1] != '\0') {
+			term = purple_sqlite_history_adapter_fts_term(token + 1);
+			if(term != NULL) {
+				g_string_append_printf(excluded, " NOT %s", term);
+				query_items++;
+			}
+		} else {
+			term = purple_sqlite_history_adapter_fts_term(token);
+			if(term != NULL) {
+				if(terms->len > 0) {
+					g_string_append_printf(terms, " %s ",
+					                       operator != NULL ? operator : "AND");
+				}
+				g_string_append(terms, term);
+				operator = NULL;
+				query_items++;
+			}
 		}
+
+		g_free(term);
+	}
+
+	g_clear_pointer(&tokens, g_ptr_array_unref);
+
+	if(terms->len == 0 && excluded->len > 0) {
+		g_set_error_literal(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		                    "Excluded terms require at least one search "
+		                    "term.");
+
+		g_string_free(terms, TRUE);
+		g_string_free(excluded, TRUE);
+		g_list_free_full(accounts, g_free);
+		g_list_free_full(ins, g_free);
+		g_list_free_full(froms, g_free);
+
+		return NULL;
+	}
+
+	if(terms->len > 0) {
+		match = g_strdup_printf("(%s)%s", terms->str, excluded->str);
 	}
 
-	g_clear_pointer(&split, g_strfreev);
+	g_string_free(terms, TRUE);
+	g_string_free(excluded, TRUE);
 
 	if(remove) {
 		if(query_items != 0) {
@@ -194,20 +656,39 @@ purple_sqlite_history_adapter_build_query(PurpleSqliteHistoryAdapter *adapter,
 			            "Attempting to remove messages without "
 			            "query parameters.");
 
+			g_list_free_full(accounts, g_free);
+			g_list_free_full(ins, g_free);
+			g_list_free_full(froms, g_free);
+
 			return NULL;
 		}
 	} else {
 		query = g_string_new("SELECT "
-		                     "message_id, author, author_name_color, "
-		                     "author_alias, recipient, content_type, "
-		                     "content, client_timestamp "
-		                     "FROM message_log WHERE TRUE\n");
+		                     "message_log.message_id, message_log.author, "
+		                     "message_log.author_name_color, "
+		                     "message_log.author_alias, "
+		                     "message_log.recipient, "
+		                     "message_log.content_type, "
+		                     "message_log.content, "
+		                     "message_log.client_timestamp, "
+		                     "message_log.rowid, ");
+
+		if(match != NULL) {
+			g_string_append(query,
+			                "snippet(message_log_fts, 0, char(2), char(3), "
+			                "'...', 16) "
+			                "FROM message_log_fts CROSS JOIN message_log "
+			                "ON message_log.rowid = message_log_fts.rowid "
+			                "WHERE TRUE\n");
+		} else {
+			g_string_append(query, "NULL FROM message_log WHERE TRUE\n");
+		}
 	}
 
-	if(ins != NULL) {
+	if(accounts != NULL) {
 		first = TRUE;
-		g_string_append(query, "AND (conversation_id IN (");
-		for(iter = ins; iter != NULL; iter = iter->next) {
+		g_string_append(query, "AND (message_log.account IN (");
+		for(iter = accounts; iter != NULL; iter = iter->next) {
 			if(!first) {
 				g_string_append(query, ", ");
 			}
@@ -217,10 +698,10 @@ purple_sqlite_history_adapter_build_query(PurpleSqliteHistoryAdapter *adapter,
 		g_string_append(query, "))");
 	}
 
-	if(froms != NULL) {
+	if(ins != NULL) {
 		first = TRUE;
-		g_string_append(query, "AND (author IN (");
-		for(iter = froms; iter != NULL; iter = iter->next) {
+		g_string_append(query, "AND (message_log.conversation_id IN (");
+		for(iter = ins; iter != NULL; iter = iter->next) {
 			if(!first) {
 				g_string_append(query, ", ");
 			}
@@ -230,17 +711,46 @@ purple_sqlite_history_adapter_build_query(PurpleSqliteHistoryAdapter *adapter,
 		g_string_append(query, "))");
 	}
 
-	if(keywords != NULL) {
+	if(froms != NULL) {
 		first = TRUE;
-		g_string_append(query, "AND (");
-		for(iter = keywords; iter != NULL; iter = iter->next) {
+		g_string_append(query, "AND (message_log.author IN (");
+		for(iter = froms; iter != NULL; iter = iter->next) {
 			if(!first) {
-				g_string_append(query, " OR ");
+				g_string_append(query, ", ");
 			}
 			first = FALSE;
-			g_string_append(query, " content LIKE ? ");
+			g_string_append(query, "?");
+		}
+		g_string_append(query, "))");
+	}
+
+	if(match != NULL) {
+		if(remove) {
+			g_string_append(query,
+			                "AND (message_log.rowid IN (SELECT rowid FROM "
+			                "message_log_fts WHERE message_log_fts MATCH ?))");
+		} else {
+			g_string_append(query, "AND (message_log_fts MATCH ?)");
+		}
+	}
+
+	if(!remove && limit > 0) {
+		/* Pages are walked backwards in time using the timestamp and rowid
+		 * of the oldest message in the previous page, which lets sqlite seek
+		 * straight to it using the conversation index rather than counting
+		 * through everything newer with an OFFSET.
+		 */
+		if(before != NULL) {
+			g_string_append(query,
+			                "AND ((message_log.client_timestamp, "
+			                "message_log.rowid) < (?, ?))");
 		}
-		g_string_append(query, ")");
+
+		g_string_append(query,
+		                "\nORDER BY message_log.client_timestamp DESC, "
+		                "message_log.rowid DESC LIMIT ?");
+	} else if(!remove && match != NULL && rank) {
+		g_string_append(query, "\nORDER BY message_log_fts.rank");
 	}
 	g_string_append(query, ";");
 
@@ -253,13 +763,20 @@ purple_sqlite_history_adapter_build_query(PurpleSqliteHistoryAdapter *adapter,
 		            "Error creating the prepared statement: %s",
 		            sqlite3_errmsg(priv->db));
 
+		g_list_free_full(accounts, g_free);
 		g_list_free_full(ins, g_free);
 		g_list_free_full(froms, g_free);
-		g_list_free_full(keywords, g_free);
+		g_free(match);
 
 		return NULL;
 	}
 
+	while(accounts != NULL) {
+		sqlite3_bind_text(prepared_statement, index++,
+		                  (const char *)accounts->data, -1, g_free);
+		accounts = g_list_delete_link(accounts, accounts);
+	}
+
 	while(ins != NULL) {
 		sqlite3_bind_text(prepared_statement, index++,
 		                  (const char *)ins->data, -1, g_free);
@@ -272,15 +789,111 @@ purple_sqlite_history_adapter_build_query(PurpleSqliteHistoryAdapter *adapter,
 		froms = g_list_delete_link(froms, froms);
 	}
 
-	while(keywords != NULL) {
-		sqlite3_bind_text(prepared_statement, index++,
-		                  (const char *)keywords->data, -1, g_free);
-		keywords = g_list_delete_link(keywords, keywords);
+	if(match != NULL) {
+		sqlite3_bind_text(prepared_statement, index++, match, -1, g_free);
+	}
+
+	if(!remove && limit > 0) {
+		if(before != NULL) {
+			sqlite3_bind_text(prepared_statement, index++, before->timestamp,
+			                  -1, SQLITE_TRANSIENT);
+			sqlite3_bind_int64(prepared_statement, index++, before->rowid);
+		}
+
+		sqlite3_bind_int(prepared_statement, index++, (gint)MIN(limit, G_MAXINT));
 	}
 
 	return prepared_statement;
 }
 
+/* Creates a message from the current row of a statement created by
+ * purple_sqlite_history_adapter_build_query().
+ */
+static PurpleMessage *
+purple_sqlite_history_adapter_message_from_row(sqlite3_stmt *prepared_statement,
+                                               gboolean highlight)
+{
+	PurpleMessage *message = NULL;
+	PurpleMessageContentType ct;
+	GDateTime *g_date_time = NULL;
+	const gchar *message_id = NULL;
+	const gchar *author = NULL;
+	const gchar *author_name_color = NULL;
+	const gchar *author_alias = NULL;
+	const gchar *recipient = NULL;
+	const gchar *content = NULL;
+	const gchar *content_type = NULL;
+	const gchar *timestamp = NULL;
+	const gchar *snippet = NULL;
+	gchar *highlighted = NULL;
+
+	message_id = (const gchar *)sqlite3_column_text(prepared_statement, 0);
+	author = (const gchar *)sqlite3_column_text(prepared_statement, 1);
+	author_name_color = (const gchar *)sqlite3_column_text(prepared_statement, 2);
+	author_alias = (const gchar *)sqlite3_column_text(prepared_statement, 3);
+	recipient = (const gchar *)sqlite3_column_text(prepared_statement, 4);
+	content_type = (const gchar *)sqlite3_column_text(prepared_statement, 5);
+	ct = purple_sqlite_history_adapter_get_content_type_enum(content_type);
+	content = (const gchar *)sqlite3_column_text(prepared_statement, 6);
+	timestamp = (const gchar *)sqlite3_column_text(prepared_statement, 7);
+	g_date_time = g_date_time_new_from_iso8601(timestamp, NULL);
+	snippet = (const gchar *)sqlite3_column_text(prepared_statement, 9);
+
+	if(highlight && snippet != NULL) {
+		highlighted = purple_sqlite_history_adapter_format_snippet(snippet,
+		                                                           &ct);
+		content = highlighted;
+	}
+
+	message = g_object_new(PURPLE_TYPE_MESSAGE,
+	                       "id", message_id,
+	                       "author", author,
+	                       "author_name_color", author_name_color,
+	                       "author_alias", author_alias,
+	                       "recipient", recipient,
+	                       "contents", content,
+	                       "content_type", ct,
+	                       "timestamp", g_date_time,
+	                       NULL);
+
+	g_free(highlighted);
+
+	if(g_date_time != NULL) {
+		g_date_time_unref(g_date_time);
+	}
+
+	return message;
+}
+
+static gboolean
+purple_sqlite_history_adapter_parse_cursor(const gchar *cursor,
+                                           PurpleSqliteHistoryAdapterCursor *out,
+                                           GError **error)
+{
+	const gchar *separator = NULL;
+	gchar *end = NULL;
+
+	separator = strrchr(cursor, '|');
+	if(separator == NULL || separator == cursor) {
+		g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		            "Invalid cursor '%s'", cursor);
+
+		return FALSE;
+	}
+
+	out->rowid = g_ascii_strtoll(separator + 1, &end, 10);
+	if(end == NULL || end == separator + 1 || *end != '\0') {
+		g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		            "Invalid cursor '%s'", cursor);
+
+		return FALSE;
+	}
+
+	out->timestamp = g_strndup(cursor, separator - cursor);
+
+	return TRUE;
+}
+
 /******************************************************************************
  * PurpleHistoryAdapter Implementation
  *****************************************************************************/
@@ -318,12 +931,37 @@ purple_sqlite_history_adapter_activate(PurpleHistoryAdapter *adapter,
 		return FALSE;
 	}
 
+	/* Write ahead logging lets us commit without rewriting the database and
+	 * keeps readers from blocking on the writer. This is a no-op for
+	 * in-memory databases.
+	 */
+	sqlite3_exec(priv->db, "PRAGMA journal_mode = WAL;", NULL, NULL, NULL);
+	purple_sqlite_history_adapter_apply_synchronous(sqlite_adapter);
+
 	if(!purple_sqlite_history_adapter_run_migrations(sqlite_adapter, error)) {
 		g_clear_pointer(&priv->db, sqlite3_close);
 
 		return FALSE;
 	}
 
+	sqlite3_prepare_v2(priv->db,
+	                   "INSERT INTO message_log(protocol, account, "
+	                   "conversation_id, message_id, author, "
+	                   "author_name_color, author_alias, recipient, "
+	                   "content_type, content, client_timestamp) "
+	                   "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+	                   -1, &priv->insert_statement, NULL);
+
+	if(priv->insert_statement == NULL) {
+		g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		            "Error creating the prepared statement: %s",
+		            sqlite3_errmsg(priv->db));
+
+		g_clear_pointer(&priv->db, sqlite3_close);
+
+		return FALSE;
+	}
+
 	return TRUE;
 }
 
@@ -333,10 +971,31 @@ purple_sqlite_history_adapter_deactivate(PurpleHistoryAdapter *adapter,
 {
 	PurpleSqliteHistoryAdapter *sqlite_adapter = NULL;
 	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	GError *flush_error = NULL;
 
 	sqlite_adapter = PURPLE_SQLITE_HISTORY_ADAPTER(adapter);
 	priv = purple_sqlite_history_adapter_get_instance_private(sqlite_adapter);
-	g_clear_pointer(&priv->db, sqlite3_close);
+
+	/* Failing to write the last batch shouldn't keep us from shutting down,
+	 * so just make some noise about it.
+	 */
+	if(!purple_sqlite_history_adapter_flush(sqlite_adapter, &flush_error)) {
+		purple_debug_warning("sqlite-history-adapter",
+		                     "failed to write messages: %s",
+		                     flush_error != NULL ? flush_error->message :
+		                                           "unknown error");
+		g_clear_error(&flush_error);
+	}
+
+	/* An async query may still have a statement open on a worker thread.
+	 * sqlite3_close_v2 will hold on to the connection until that statement
+	 * is finalized, and the generation tells the worker to stop.
+	 */
+	g_mutex_lock(&priv->lock);
+	g_clear_pointer(&priv->insert_statement, sqlite3_finalize);
+	g_clear_pointer(&priv->db, sqlite3_close_v2);
+	priv->generation++;
+	g_mutex_unlock(&priv->lock);
 
 	return TRUE;
 }
@@ -349,6 +1008,7 @@ purple_sqlite_history_adapter_query(PurpleHistoryAdapter *adapter,
 	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
 	sqlite3_stmt *prepared_statement = NULL;
 	GList *results = NULL;
+	gboolean highlight = FALSE;
 
 	sqlite_adapter = PURPLE_SQLITE_HISTORY_ADAPTER(adapter);
 	priv = purple_sqlite_history_adapter_get_instance_private(sqlite_adapter);
@@ -360,50 +1020,31 @@ purple_sqlite_history_adapter_query(PurpleHistoryAdapter *adapter,
 		return FALSE;
 	}
 
-	prepared_statement = purple_sqlite_history_adapter_build_query(sqlite_adapter,
-	                                                               query,
-	                                                               FALSE,
+	/* Make sure anything that's still queued is visible to the query. */
+	if(!purple_sqlite_history_adapter_flush(sqlite_adapter, error)) {
+		return NULL;
+	}
+
+	g_mutex_lock(&priv->lock);
+
+	prepared_statement = purple_sqlite_history_adapter_build_query(sqlite_adapter,
+	                                                               query,
+	                                                               FALSE,
+	                                                               &highlight,
+	                                                               NULL, 0,
 	                                                               error);
 
 	if(prepared_statement == NULL) {
+		g_mutex_unlock(&priv->lock);
+
 		return NULL;
 	}
 
 	while(sqlite3_step(prepared_statement) == SQLITE_ROW) {
 		PurpleMessage *message = NULL;
-		PurpleMessageContentType ct;
-		GDateTime *g_date_time = NULL;
-		const gchar *message_id = NULL;
-		const gchar *author = NULL;
-		const gchar *author_name_color = NULL;
-		const gchar *author_alias = NULL;
-		const gchar *recipient = NULL;
-		const gchar *content = NULL;
-		const gchar *content_type = NULL;
-		const gchar *timestamp = NULL;
-
-		message_id = (const gchar *)sqlite3_column_text(prepared_statement, 0);
-		author = (const gchar *)sqlite3_column_text(prepared_statement, 1);
-		author_name_color = (const gchar *)sqlite3_column_text(prepared_statement, 2);
-		author_alias = (const gchar *)sqlite3_column_text(prepared_statement, 3);
-		recipient = (const gchar *)sqlite3_column_text(prepared_statement, 4);
-		content_type = (const gchar *)sqlite3_column_text(prepared_statement, 5);
-		ct = purple_sqlite_history_adapter_get_content_type_enum(content_type);
-		content = (const gchar *)sqlite3_column_text(prepared_statement, 6);
-		timestamp = (const gchar *)sqlite3_column_text(prepared_statement, 7);
-		g_date_time = g_date_time_new_from_iso8601(timestamp, NULL);
-
-		message = g_object_new(PURPLE_TYPE_MESSAGE,
-		                       "id", message_id,
-		                       "author", author,
-		                       "author_name_color", author_name_color,
-		                       "author_alias", author_alias,
-		                       "recipient", recipient,
-		                       "contents", content,
-		                       "content_type", ct,
-		                       "timestamp", g_date_time,
-		                       NULL);
 
+		message = purple_sqlite_history_adapter_message_from_row(prepared_statement,
+		                                                         highlight);
 		results = g_list_prepend(results, message);
 	}
 
@@ -411,9 +1052,328 @@ purple_sqlite_history_adapter_query(PurpleHistoryAdapter *adapter,
 
 	sqlite3_finalize(prepared_statement);
 
+	g_mutex_unlock(&priv->lock);
+
 	return results;
 }
 
+static GList *
+purple_sqlite_history_adapter_query_page(PurpleHistoryAdapter *adapter,
+                                         const gchar *query,
+                                         const gchar *cursor,
+                                         guint limit,
+                                         gchar **next_cursor,
+                                         GError **error)
+{
+	PurpleSqliteHistoryAdapter *sqlite_adapter = NULL;
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	PurpleSqliteHistoryAdapterCursor before = {NULL, 0};
+	sqlite3_stmt *prepared_statement = NULL;
+	GList *results = NULL;
+	gchar *last_timestamp = NULL;
+	gint64 last_rowid = 0;
+	gboolean highlight = FALSE;
+	guint count = 0;
+
+	sqlite_adapter = PURPLE_SQLITE_HISTORY_ADAPTER(adapter);
+	priv = purple_sqlite_history_adapter_get_instance_private(sqlite_adapter);
+
+	if(priv->db == NULL) {
+		g_set_error_literal(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		                    _("Adapter has not been activated"));
+
+		return NULL;
+	}
+
+	if(cursor != NULL &&
+	   !purple_sqlite_history_adapter_parse_cursor(cursor, &before, error))
+	{
+		return NULL;
+	}
+
+	if(!purple_sqlite_history_adapter_flush(sqlite_adapter, error)) {
+		g_free(before.timestamp);
+
+		return NULL;
+	}
+
+	g_mutex_lock(&priv->lock);
+
+	prepared_statement = purple_sqlite_history_adapter_build_query(sqlite_adapter,
+	                                                               query,
+	                                                               FALSE,
+	                                                               &highlight,
+	                                                               cursor != NULL ? &before : NULL,
+	                                                               limit,
+	                                                               error);
+	g_free(before.timestamp);
+
+	if(prepared_statement == NULL) {
+		g_mutex_unlock(&priv->lock);
+
+		return NULL;
+	}
+
+	/* The rows come back newest first, so prepending them leaves the page in
+	 * chronological order.
+	 */
+	while(sqlite3_step(prepared_statement) == SQLITE_ROW) {
+		PurpleMessage *message = NULL;
+
+		message = purple_sqlite_history_adapter_message_from_row(prepared_statement,
+		                                                         highlight);
+		results = g_list_prepend(results, message);
+
+		g_free(last_timestamp);
+		last_timestamp = g_strdup((const gchar *)sqlite3_column_text(prepared_statement, 7));
+		last_rowid = sqlite3_column_int64(prepared_statement, 8);
+
+		count++;
+	}
+
+	sqlite3_finalize(prepared_statement);
+
+	g_mutex_unlock(&priv->lock);
+
+	/* A short page means we've reached the beginning of the log. */
+	if(next_cursor != NULL) {
+		if(count == limit && last_timestamp != NULL) {
+			*next_cursor = g_strdup_printf("%s|%" G_GINT64_FORMAT,
+			                               last_timestamp, last_rowid);
+		} else {
+			*next_cursor = NULL;
+		}
+	}
+
+	g_free(last_timestamp);
+
+	return results;
+}
+
+static void
+purple_sqlite_history_adapter_query_data_free(gpointer data) {
+	PurpleSqliteHistoryAdapterQueryData *query_data = data;
+
+	g_free(query_data->query);
+	g_clear_object(&query_data->store);
+	g_free(query_data);
+}
+
+static void
+purple_sqlite_history_adapter_query_batch_free(gpointer data) {
+	PurpleSqliteHistoryAdapterQueryBatch *batch = data;
+
+	g_clear_object(&batch->store);
+	g_clear_object(&batch->cancellable);
+	g_clear_pointer(&batch->messages, g_ptr_array_unref);
+	g_free(batch);
+}
+
+/* Runs in the main context of the caller to hand a batch of results over. */
+static gboolean
+purple_sqlite_history_adapter_query_batch_cb(gpointer data) {
+	PurpleSqliteHistoryAdapterQueryBatch *batch = data;
+	guint position = 0;
+
+	if(g_cancellable_is_cancelled(batch->cancellable)) {
+		return G_SOURCE_REMOVE;
+	}
+
+	position = g_list_model_get_n_items(G_LIST_MODEL(batch->store));
+	g_list_store_splice(batch->store, position, 0, batch->messages->pdata,
+	                    batch->messages->len);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+purple_sqlite_history_adapter_query_thread(GTask *task, gpointer source,
+                                           gpointer task_data,
+                                           GCancellable *cancellable)
+{
+	PurpleSqliteHistoryAdapter *adapter = source;
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	PurpleSqliteHistoryAdapterQueryData *data = task_data;
+	sqlite3_stmt *prepared_statement = NULL;
+	GError *error = NULL;
+	gboolean highlight = FALSE;
+	gboolean done = FALSE;
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	g_mutex_lock(&priv->lock);
+
+	if(priv->generation != data->generation || priv->db == NULL) {
+		g_mutex_unlock(&priv->lock);
+
+		g_task_return_new_error(task, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		                        _("Adapter has been deactivated"));
+
+		return;
+	}
+
+	prepared_statement = purple_sqlite_history_adapter_build_query(adapter,
+	                                                               data->query,
+	                                                               FALSE,
+	                                                               &highlight,
+	                                                               NULL, 0,
+	                                                               &error);
+
+	g_mutex_unlock(&priv->lock);
+
+	if(prepared_statement == NULL) {
+		g_task_return_error(task, error);
+
+		return;
+	}
+
+	/* We only hold the lock while stepping through a single batch so that
+	 * writes from the main thread never have to wait on a whole query.
+	 */
+	while(!done) {
+		PurpleSqliteHistoryAdapterQueryBatch *batch = NULL;
+		GPtrArray *messages = NULL;
+		GSource *source = NULL;
+
+		if(g_cancellable_set_error_if_cancelled(cancellable, &error)) {
+			break;
+		}
+
+		messages = g_ptr_array_new_full(PURPLE_SQLITE_HISTORY_ADAPTER_QUERY_BATCH_SIZE,
+		                                g_object_unref);
+
+		g_mutex_lock(&priv->lock);
+
+		if(priv->generation != data->generation) {
+			g_set_error_literal(&error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+			                    _("Adapter has been deactivated"));
+			done = TRUE;
+		}
+
+		while(!done &&
+		      messages->len < PURPLE_SQLITE_HISTORY_ADAPTER_QUERY_BATCH_SIZE)
+		{
+			gint result = sqlite3_step(prepared_statement);
+
+			if(result == SQLITE_ROW) {
+				PurpleMessage *message = NULL;
+
+				message = purple_sqlite_history_adapter_message_from_row(prepared_statement,
+				                                                         highlight);
+				g_ptr_array_add(messages, message);
+			} else {
+				if(result != SQLITE_DONE) {
+					g_set_error(&error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+					            "Error querying the database: %s",
+					            sqlite3_errmsg(sqlite3_db_handle(prepared_statement)));
+				}
+
+				done = TRUE;
+			}
+		}
+
+		g_mutex_unlock(&priv->lock);
+
+		if(messages->len == 0) {
+			g_ptr_array_unref(messages);
+
+			continue;
+		}
+
+		batch = g_new0(PurpleSqliteHistoryAdapterQueryBatch, 1);
+		batch->store = g_object_ref(data->store);
+		batch->messages = messages;
+		if(cancellable != NULL) {
+			batch->cancellable = g_object_ref(cancellable);
+		}
+
+		/* These are queued in the same context and at the same priority as
+		 * the task's result, so they are all dispatched before the callback
+		 * is called. They're always attached rather than invoked, since
+		 * g_main_context_invoke() would run the callback right here on this
+		 * thread if it could acquire the context.
+		 */
+		source = g_idle_source_new();
+		g_source_set_priority(source, g_task_get_priority(task));
+		g_source_set_callback(source,
+		                      purple_sqlite_history_adapter_query_batch_cb,
+		                      batch,
+		                      purple_sqlite_history_adapter_query_batch_free);
+		g_source_attach(source, g_task_get_context(task));
+		g_source_unref(source);
+	}
+
+	g_mutex_lock(&priv->lock);
+	sqlite3_finalize(prepared_statement);
+	g_mutex_unlock(&priv->lock);
+
+	if(error != NULL) {
+		g_task_return_error(task, error);
+	} else {
+		g_task_return_boolean(task, TRUE);
+	}
+}
+
+static void
+purple_sqlite_history_adapter_query_async(PurpleHistoryAdapter *adapter,
+                                          const gchar *query,
+                                          GListStore *store,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer data)
+{
+	PurpleSqliteHistoryAdapter *sqlite_adapter = NULL;
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	PurpleSqliteHistoryAdapterQueryData *query_data = NULL;
+	GTask *task = NULL;
+	GError *error = NULL;
+
+	sqlite_adapter = PURPLE_SQLITE_HISTORY_ADAPTER(adapter);
+	priv = purple_sqlite_history_adapter_get_instance_private(sqlite_adapter);
+
+	task = g_task_new(adapter, cancellable, callback, data);
+	g_task_set_source_tag(task, purple_sqlite_history_adapter_query_async);
+
+	if(priv->db == NULL) {
+		g_task_return_new_error(task, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		                        _("Adapter has not been activated"));
+		g_object_unref(task);
+
+		return;
+	}
+
+	/* Pending writes are owned by the main thread, so get them into the
+	 * database before handing off to the worker.
+	 */
+	if(!purple_sqlite_history_adapter_flush(sqlite_adapter, &error)) {
+		g_task_return_error(task, error);
+		g_object_unref(task);
+
+		return;
+	}
+
+	query_data = g_new0(PurpleSqliteHistoryAdapterQueryData, 1);
+	query_data->query = g_strdup(query);
+	query_data->store = g_object_ref(store);
+	query_data->generation = priv->generation;
+
+	g_task_set_task_data(task, query_data,
+	                     purple_sqlite_history_adapter_query_data_free);
+	g_task_run_in_thread(task, purple_sqlite_history_adapter_query_thread);
+
+	g_object_unref(task);
+}
+
+static gboolean
+purple_sqlite_history_adapter_query_finish(PurpleHistoryAdapter *adapter,
+                                           GAsyncResult *result,
+                                           GError **error)
+{
+	g_return_val_if_fail(g_task_is_valid(result, adapter), FALSE);
+
+	return g_task_propagate_boolean(G_TASK(result), error);
+}
+
 static gboolean
 purple_sqlite_history_adapter_remove(PurpleHistoryAdapter *adapter,
                                      const gchar *query, GError **error)
@@ -433,12 +1393,22 @@ purple_sqlite_history_adapter_remove(PurpleHistoryAdapter *adapter,
 		return FALSE;
 	}
 
+	if(!purple_sqlite_history_adapter_flush(sqlite_adapter, error)) {
+		return FALSE;
+	}
+
+	g_mutex_lock(&priv->lock);
+
 	prepared_statement = purple_sqlite_history_adapter_build_query(sqlite_adapter,
 	                                                               query,
 	                                                               TRUE,
+	                                                               NULL,
+	                                                               NULL, 0,
 	                                                               error);
 
 	if(prepared_statement == NULL) {
+		g_mutex_unlock(&priv->lock);
+
 		return FALSE;
 	}
 
@@ -450,12 +1420,15 @@ purple_sqlite_history_adapter_remove(PurpleHistoryAdapter *adapter,
 		            sqlite3_errmsg(priv->db));
 
 		sqlite3_finalize(prepared_statement);
+		g_mutex_unlock(&priv->lock);
 
 		return FALSE;
 	}
 
 	sqlite3_finalize(prepared_statement);
 
+	g_mutex_unlock(&priv->lock);
+
 	return TRUE;
 }
 
@@ -464,20 +1437,9 @@ purple_sqlite_history_adapter_write(PurpleHistoryAdapter *adapter,
                                     PurpleConversation *conversation,
                                     PurpleMessage *message, GError **error)
 {
-	PurpleAccount *account = NULL;
 	PurpleSqliteHistoryAdapter *sqlite_adapter = NULL;
 	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
-	sqlite3_stmt *prepared_statement = NULL;
-	gchar *timestamp = NULL;
-	gchar *content_type = NULL;
-	const gchar * message_id = NULL;
-	const gchar *script = NULL;
-	gint result = 0;
-
-	script = "INSERT INTO message_log(protocol, account, conversation_id, "
-			 "message_id, author, author_name_color, author_alias, "
-			 "recipient, content_type, content, client_timestamp) "
-	         "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+	PurpleSqliteHistoryAdapterRow *row = NULL;
 
 	sqlite_adapter = PURPLE_SQLITE_HISTORY_ADAPTER(adapter);
 	priv = purple_sqlite_history_adapter_get_instance_private(sqlite_adapter);
@@ -489,68 +1451,34 @@ purple_sqlite_history_adapter_write(PurpleHistoryAdapter *adapter,
 		return FALSE;
 	}
 
-	sqlite3_prepare_v2(priv->db, script, -1, &prepared_statement, NULL);
-
-	if(prepared_statement == NULL) {
-		g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
-		            "Error creating the prepared statement: %s",
-		            sqlite3_errmsg(priv->db));
-		return FALSE;
-	}
-
-	account = purple_conversation_get_account(conversation);
+	row = purple_sqlite_history_adapter_row_new(conversation, message);
 
-	sqlite3_bind_text(prepared_statement,
-	                  1, purple_account_get_protocol_name(account), -1,
-	                  SQLITE_STATIC);
-	sqlite3_bind_text(prepared_statement,
-	                  2, purple_account_get_username(account), -1,
-	                  SQLITE_STATIC);
-	sqlite3_bind_text(prepared_statement,
-	                  3, purple_conversation_get_name(conversation), -1,
-	                  SQLITE_STATIC);
-	message_id = purple_message_get_id(message);
-	if(message_id != NULL) {
-		sqlite3_bind_text(prepared_statement, 4, message_id, -1,
-		                  SQLITE_STATIC);
-	} else {
-		sqlite3_bind_text(prepared_statement, 4, g_uuid_string_random(), -1,
-		                  g_free);
-	}
-	sqlite3_bind_text(prepared_statement,
-	                  5, purple_message_get_author(message), -1,
-	                  SQLITE_STATIC);
-	sqlite3_bind_text(prepared_statement,
-	                  6, purple_message_get_author_name_color(message), -1,
-	                  SQLITE_STATIC);
-	sqlite3_bind_text(prepared_statement,
-	                  7, purple_message_get_author_alias(message), -1,
-	                  SQLITE_STATIC);
-	sqlite3_bind_text(prepared_statement,
-	                  8, purple_message_get_recipient(message), -1,
-	                  SQLITE_STATIC);
-	content_type = purple_sqlite_history_adapter_get_content_type(purple_message_get_content_type(message));
-	sqlite3_bind_text(prepared_statement,
-	                  9, content_type, -1, SQLITE_STATIC);
-	sqlite3_bind_text(prepared_statement,
-	                  10, purple_message_get_contents(message), -1,
-	                  SQLITE_STATIC);
-	timestamp = g_date_time_format_iso8601(purple_message_get_timestamp(message));
-	sqlite3_bind_text(prepared_statement, 11, timestamp, -1, g_free);
+	/* Without batching we write the message right away so that the caller
+	 * gets the result.
+	 */
+	if(priv->batch_size <= 1 && g_queue_is_empty(priv->pending)) {
+		gboolean ret = FALSE;
 
-	result = sqlite3_step(prepared_statement);
+		g_mutex_lock(&priv->lock);
+		ret = purple_sqlite_history_adapter_insert_row(sqlite_adapter, row,
+		                                               error);
+		g_mutex_unlock(&priv->lock);
+		purple_sqlite_history_adapter_row_free(row);
 
-	if(result != SQLITE_DONE) {
-		g_set_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
-		            "Error writing to the database: %s",
-		            sqlite3_errmsg(priv->db));
+		return ret;
+	}
 
-		sqlite3_finalize(prepared_statement);
+	g_queue_push_tail(priv->pending, row);
 
-		return FALSE;
+	if(g_queue_get_length(priv->pending) >= priv->batch_size) {
+		return purple_sqlite_history_adapter_flush(sqlite_adapter, error);
 	}
 
-	sqlite3_finalize(prepared_statement);
+	if(priv->flush_id == 0) {
+		priv->flush_id = g_timeout_add(priv->batch_interval,
+		                               purple_sqlite_history_adapter_flush_cb,
+		                               sqlite_adapter);
+	}
 
 	return TRUE;
 }
@@ -569,6 +1497,18 @@ purple_sqlite_history_adapter_get_property(GObject *obj, guint param_id,
 			g_value_set_string(value,
 			                   purple_sqlite_history_adapter_get_filename(adapter));
 			break;
+		case PROP_SYNCHRONOUS:
+			g_value_set_enum(value,
+			                 purple_sqlite_history_adapter_get_synchronous(adapter));
+			break;
+		case PROP_BATCH_SIZE:
+			g_value_set_uint(value,
+			                 purple_sqlite_history_adapter_get_batch_size(adapter));
+			break;
+		case PROP_BATCH_INTERVAL:
+			g_value_set_uint(value,
+			                 purple_sqlite_history_adapter_get_batch_interval(adapter));
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, param_id, pspec);
 			break;
@@ -587,6 +1527,18 @@ purple_sqlite_history_adapter_set_property(GObject *obj, guint param_id,
 			purple_sqlite_history_adapter_set_filename(adapter,
 			                                           g_value_get_string(value));
 			break;
+		case PROP_SYNCHRONOUS:
+			purple_sqlite_history_adapter_set_synchronous(adapter,
+			                                              g_value_get_enum(value));
+			break;
+		case PROP_BATCH_SIZE:
+			purple_sqlite_history_adapter_set_batch_size(adapter,
+			                                             g_value_get_uint(value));
+			break;
+		case PROP_BATCH_INTERVAL:
+			purple_sqlite_history_adapter_set_batch_interval(adapter,
+			                                                 g_value_get_uint(value));
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, param_id, pspec);
 			break;
@@ -607,14 +1559,28 @@ purple_sqlite_history_adapter_finalize(GObject *obj) {
 		g_warning("PurpleSqliteHistoryAdapter was finalized before being "
 		          "deactivated");
 
-		g_clear_pointer(&priv->db, sqlite3_close);
+		g_clear_pointer(&priv->insert_statement, sqlite3_finalize);
+		g_clear_pointer(&priv->db, sqlite3_close_v2);
 	}
 
+	g_mutex_clear(&priv->lock);
+
+	g_clear_handle_id(&priv->flush_id, g_source_remove);
+	g_queue_free_full(priv->pending,
+	                  (GDestroyNotify)purple_sqlite_history_adapter_row_free);
+
 	G_OBJECT_CLASS(purple_sqlite_history_adapter_parent_class)->finalize(obj);
 }
 
 static void
 purple_sqlite_history_adapter_init(PurpleSqliteHistoryAdapter *adapter) {
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	g_mutex_init(&priv->lock);
+
+	priv->pending = g_queue_new();
 }
 
 static void
@@ -630,6 +1596,9 @@ purple_sqlite_history_adapter_class_init(PurpleSqliteHistoryAdapterClass *klass)
 	adapter_class->activate = purple_sqlite_history_adapter_activate;
 	adapter_class->deactivate = purple_sqlite_history_adapter_deactivate;
 	adapter_class->query = purple_sqlite_history_adapter_query;
+	adapter_class->query_page = purple_sqlite_history_adapter_query_page;
+	adapter_class->query_async = purple_sqlite_history_adapter_query_async;
+	adapter_class->query_finish = purple_sqlite_history_adapter_query_finish;
 	adapter_class->remove = purple_sqlite_history_adapter_remove;
 	adapter_class->write = purple_sqlite_history_adapter_write;
 
@@ -646,6 +1615,53 @@ purple_sqlite_history_adapter_class_init(PurpleSqliteHistoryAdapterClass *klass)
 		G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS
 	);
 
+	/**
+	 * PurpleSqliteHistoryAdapter:synchronous:
+	 *
+	 * How aggressively sqlite should sync the database to disk. See
+	 * #PurpleSqliteHistoryAdapterSynchronous for details.
+	 *
+	 * Since: 3.0.0
+	 */
+	properties[PROP_SYNCHRONOUS] = g_param_spec_enum(
+		"synchronous", "synchronous",
+		"How aggressively the database is synced to disk",
+		PURPLE_TYPE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS,
+		PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_NORMAL,
+		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * PurpleSqliteHistoryAdapter:batch-size:
+	 *
+	 * The maximum number of messages that will be queued before they are
+	 * written to the database in a single transaction. A value of 0 or 1
+	 * writes every message as soon as it is received.
+	 *
+	 * Since: 3.0.0
+	 */
+	properties[PROP_BATCH_SIZE] = g_param_spec_uint(
+		"batch-size", "batch-size",
+		"The maximum number of messages to write in a single transaction",
+		0, G_MAXUINT, PURPLE_SQLITE_HISTORY_ADAPTER_DEFAULT_BATCH_SIZE,
+		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * PurpleSqliteHistoryAdapter:batch-interval:
+	 *
+	 * The maximum number of milliseconds a message will be queued before
+	 * it is written to the database.
+	 *
+	 * Since: 3.0.0
+	 */
+	properties[PROP_BATCH_INTERVAL] = g_param_spec_uint(
+		"batch-interval", "batch-interval",
+		"The maximum time in milliseconds to queue messages for",
+		0, G_MAXUINT, PURPLE_SQLITE_HISTORY_ADAPTER_DEFAULT_BATCH_INTERVAL,
+		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS
+	);
+
 	g_object_class_install_properties(obj_class, N_PROPERTIES, properties);
 }
 
@@ -672,3 +1688,172 @@ purple_sqlite_history_adapter_get_filename(PurpleSqliteHistoryAdapter *adapter)
 
 	return priv->filename;
 }
+
+PurpleSqliteHistoryAdapterSynchronous
+purple_sqlite_history_adapter_get_synchronous(PurpleSqliteHistoryAdapter *adapter)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_SQLITE_HISTORY_ADAPTER(adapter),
+	                     PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_NORMAL);
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	return priv->synchronous;
+}
+
+void
+purple_sqlite_history_adapter_set_synchronous(PurpleSqliteHistoryAdapter *adapter,
+                                              PurpleSqliteHistoryAdapterSynchronous synchronous)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+
+	g_return_if_fail(PURPLE_IS_SQLITE_HISTORY_ADAPTER(adapter));
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	if(priv->synchronous == synchronous) {
+		return;
+	}
+
+	priv->synchronous = synchronous;
+	purple_sqlite_history_adapter_apply_synchronous(adapter);
+
+	g_object_notify_by_pspec(G_OBJECT(adapter), properties[PROP_SYNCHRONOUS]);
+}
+
+guint
+purple_sqlite_history_adapter_get_batch_size(PurpleSqliteHistoryAdapter *adapter)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_SQLITE_HISTORY_ADAPTER(adapter), 0);
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	return priv->batch_size;
+}
+
+void
+purple_sqlite_history_adapter_set_batch_size(PurpleSqliteHistoryAdapter *adapter,
+                                             guint batch_size)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+
+	g_return_if_fail(PURPLE_IS_SQLITE_HISTORY_ADAPTER(adapter));
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	if(priv->batch_size == batch_size) {
+		return;
+	}
+
+	priv->batch_size = batch_size;
+
+	g_object_notify_by_pspec(G_OBJECT(adapter), properties[PROP_BATCH_SIZE]);
+}
+
+guint
+purple_sqlite_history_adapter_get_batch_interval(PurpleSqliteHistoryAdapter *adapter)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_SQLITE_HISTORY_ADAPTER(adapter), 0);
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	return priv->batch_interval;
+}
+
+void
+purple_sqlite_history_adapter_set_batch_interval(PurpleSqliteHistoryAdapter *adapter,
+                                                 guint batch_interval)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+
+	g_return_if_fail(PURPLE_IS_SQLITE_HISTORY_ADAPTER(adapter));
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	if(priv->batch_interval == batch_interval) {
+		return;
+	}
+
+	priv->batch_interval = batch_interval;
+
+	g_object_notify_by_pspec(G_OBJECT(adapter), properties[PROP_BATCH_INTERVAL]);
+}
+
+gboolean
+purple_sqlite_history_adapter_flush(PurpleSqliteHistoryAdapter *adapter,
+                                    GError **error)
+{
+	PurpleSqliteHistoryAdapterPrivate *priv = NULL;
+	PurpleSqliteHistoryAdapterRow *row = NULL;
+	GError *first_error = NULL;
+	gchar *error_msg = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_SQLITE_HISTORY_ADAPTER(adapter), FALSE);
+
+	priv = purple_sqlite_history_adapter_get_instance_private(adapter);
+
+	g_clear_handle_id(&priv->flush_id, g_source_remove);
+
+	if(g_queue_is_empty(priv->pending)) {
+		return TRUE;
+	}
+
+	if(priv->db == NULL) {
+		g_set_error_literal(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		                    _("Adapter has not been activated"));
+
+		return FALSE;
+	}
+
+	/* Everything goes into a single transaction so we only sync once per
+	 * batch rather than once per message. A row that fails to insert only
+	 * rolls back its own statement, so we keep going and report the first
+	 * error once the rest of the batch has been written.
+	 */
+	g_mutex_lock(&priv->lock);
+
+	sqlite3_exec(priv->db, "BEGIN;", NULL, NULL, NULL);
+
+	while((row = g_queue_pop_head(priv->pending)) != NULL) {
+		GError *row_error = NULL;
+
+		if(!purple_sqlite_history_adapter_insert_row(adapter, row,
+		                                             &row_error))
+		{
+			if(first_error == NULL) {
+				first_error = row_error;
+			} else {
+				g_clear_error(&row_error);
+			}
+		}
+
+		purple_sqlite_history_adapter_row_free(row);
+	}
+
+	sqlite3_exec(priv->db, "COMMIT;", NULL, NULL, &error_msg);
+
+	if(error_msg != NULL) {
+		g_clear_error(&first_error);
+		g_set_error(&first_error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0,
+		            "Error committing to the database: %s", error_msg);
+
+		sqlite3_free(error_msg);
+
+		sqlite3_exec(priv->db, "ROLLBACK;", NULL, NULL, NULL);
+	}
+
+	g_mutex_unlock(&priv->lock);
+
+	if(first_error != NULL) {
+		g_propagate_error(error, first_error);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
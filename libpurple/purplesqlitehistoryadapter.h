@@ -31,12 +31,67 @@
 
 G_BEGIN_DECLS
 
+/**
+ * PurpleSqliteHistoryAdapterSynchronous:
+ * @PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_OFF: Never wait for data to be
+ *                                                 synced to disk.
+ * @PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_NORMAL: Sync at the most critical
+ *                                                    moments. Combined with
+ *                                                    write ahead logging this
+ *                                                    can only lose the most
+ *                                                    recent transactions on
+ *                                                    power loss.
+ * @PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_FULL: Sync every transaction.
+ * @PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_EXTRA: Like
+ *                                                   %PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_FULL
+ *                                                   but also syncs the
+ *                                                   directory.
+ *
+ * The values of sqlite's synchronous pragma.
+ *
+ * Since: 3.0.0
+ */
+typedef enum {
+	PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_OFF = 0,
+	PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_NORMAL = 1,
+	PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_FULL = 2,
+	PURPLE_SQLITE_HISTORY_ADAPTER_SYNCHRONOUS_EXTRA = 3,
+} PurpleSqliteHistoryAdapterSynchronous;
+
 /**
  * PurpleSqliteHistoryAdapter:
  *
  * #PurpleSqliteHistoryAdapter is a class that allows interfacing with an
  * SQLite database to store history. It is a subclass of @PurpleHistoryAdapter.
  *
+ * Message contents are indexed with SQLite's FTS5 extension. Queries are made
+ * up of whitespace separated tokens:
+ *
+ * - `account:<username>` limits results to the given account.
+ * - `in:<conversation>` limits results to the given conversation.
+ * - `from:<author>` limits results to messages from the given author.
+ * - `word` matches messages containing `word`. Multiple words must all
+ *   match unless they are joined with `OR`.
+ * - `"some phrase"` matches messages containing the exact phrase.
+ * - `word*` matches messages containing a word starting with `word`.
+ * - `-word` excludes messages containing `word`.
+ * - `AND`, `OR`, and `NOT` combine the terms on either side of them.
+ * - `sort:rank` orders results by relevance rather than by time.
+ * - `highlight:on` replaces the contents of each result with a snippet of
+ *   HTML where the matches are wrapped in `<b>` tags.
+ *
+ * Quotes may also be used with `account:`, `in:`, and `from:` to match values
+ * with spaces in them.
+ *
+ * Messages are not written immediately. They are queued and then written in
+ * a single transaction once #PurpleSqliteHistoryAdapter:batch-size messages
+ * are waiting or #PurpleSqliteHistoryAdapter:batch-interval milliseconds have
+ * passed, whichever happens first. Any queued messages are written before a
+ * query or removal is run and when the adapter is deactivated.
+ *
+ * Asynchronous queries are run in a worker thread and their results are added
+ * to the store in batches from the thread-default main context of the caller.
+ *
  * Since: 3.0.0
  */
 
@@ -68,6 +123,92 @@ PurpleHistoryAdapter *purple_sqlite_history_adapter_new(const gchar *filename);
  */
 const gchar *purple_sqlite_history_adapter_get_filename(PurpleSqliteHistoryAdapter *adapter);
 
+/**
+ * purple_sqlite_history_adapter_get_synchronous:
+ * @adapter: The instance.
+ *
+ * Gets how aggressively @adapter syncs its database to disk.
+ *
+ * Returns: The synchronous level of @adapter.
+ *
+ * Since: 3.0.0
+ */
+PurpleSqliteHistoryAdapterSynchronous purple_sqlite_history_adapter_get_synchronous(PurpleSqliteHistoryAdapter *adapter);
+
+/**
+ * purple_sqlite_history_adapter_set_synchronous:
+ * @adapter: The instance.
+ * @synchronous: The new synchronous level.
+ *
+ * Sets how aggressively @adapter syncs its database to disk.
+ *
+ * Since: 3.0.0
+ */
+void purple_sqlite_history_adapter_set_synchronous(PurpleSqliteHistoryAdapter *adapter, PurpleSqliteHistoryAdapterSynchronous synchronous);
+
+/**
+ * purple_sqlite_history_adapter_get_batch_size:
+ * @adapter: The instance.
+ *
+ * Gets the maximum number of messages that @adapter will queue before writing
+ * them.
+ *
+ * Returns: The batch size of @adapter.
+ *
+ * Since: 3.0.0
+ */
+guint purple_sqlite_history_adapter_get_batch_size(PurpleSqliteHistoryAdapter *adapter);
+
+/**
+ * purple_sqlite_history_adapter_set_batch_size:
+ * @adapter: The instance.
+ * @batch_size: The new batch size.
+ *
+ * Sets the maximum number of messages that @adapter will queue before writing
+ * them. Setting this to 0 or 1 makes @adapter write every message right away.
+ *
+ * Since: 3.0.0
+ */
+void purple_sqlite_history_adapter_set_batch_size(PurpleSqliteHistoryAdapter *adapter, guint batch_size);
+
+/**
+ * purple_sqlite_history_adapter_get_batch_interval:
+ * @adapter: The instance.
+ *
+ * Gets the maximum number of milliseconds that @adapter will queue a message
+ * for.
+ *
+ * Returns: The batch interval of @adapter.
+ *
+ * Since: 3.0.0
+ */
+guint purple_sqlite_history_adapter_get_batch_interval(PurpleSqliteHistoryAdapter *adapter);
+
+/**
+ * purple_sqlite_history_adapter_set_batch_interval:
+ * @adapter: The instance.
+ * @batch_interval: The new batch interval in milliseconds.
+ *
+ * Sets the maximum number of milliseconds that @adapter will queue a message
+ * for.
+ *
+ * Since: 3.0.0
+ */
+void purple_sqlite_history_adapter_set_batch_interval(PurpleSqliteHistoryAdapter *adapter, guint batch_interval);
+
+/**
+ * purple_sqlite_history_adapter_flush:
+ * @adapter: The instance.
+ * @error: Return address for a #GError, or %NULL.
+ *
+ * Writes any queued messages to the database in a single transaction.
+ *
+ * Returns: %TRUE on success, otherwise %FALSE with @error set.
+ *
+ * Since: 3.0.0
+ */
+gboolean purple_sqlite_history_adapter_flush(PurpleSqliteHistoryAdapter *adapter, GError **error);
+
 G_END_DECLS
 
 #endif /* PURPLE_SQLITE_HISTORY_ADAPTER */
@@ -40,16 +40,34 @@
  * bytes queued with #purple_queued_output_stream_clear_queue() to avoid
  * excessive errors returned in
  * #purple_queued_output_stream_push_bytes_async()'s async callback.
+ *
+ * Everything that gets queued while a write is in progress is written with
+ * a single vectored write once it finishes, so a burst of small pushes costs
+ * a couple of writes instead of one per push.
  */
 struct _PurpleQueuedOutputStream
 {
 	GFilterOutputStream parent;
 };
 
+/* The most buffers we hand to a single vectored write. Anything left over
+ * just goes out with the next one. */
+#define PURPLE_QUEUED_OUTPUT_STREAM_MAX_VECTORS 64
+
 typedef struct
 {
-	GAsyncQueue *queue;
+	GQueue queue;
 	gboolean pending_queued;
+
+	guint corked;
+
+	/* The write that's currently in progress, if any. */
+	gboolean writing;
+	GTask *batch[PURPLE_QUEUED_OUTPUT_STREAM_MAX_VECTORS];
+	GOutputVector vectors[PURPLE_QUEUED_OUTPUT_STREAM_MAX_VECTORS];
+	guint n_batch;
+
+	gsize bytes_in_flight;
 } PurpleQueuedOutputStreamPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(PurpleQueuedOutputStream,
@@ -59,76 +77,156 @@ G_DEFINE_TYPE_WITH_PRIVATE(PurpleQueuedOutputStream,
  * Helpers
  *****************************************************************************/
 
-static void purple_queued_output_stream_start_push_bytes_async(GTask *task);
+static void purple_queued_output_stream_start_write(
+		PurpleQueuedOutputStream *stream);
+
+static gsize
+purple_queued_output_stream_task_get_size(GTask *task)
+{
+	return g_bytes_get_size(g_task_get_task_data(task));
+}
+
+/* Gives up the pending flag once there's nothing left to write. */
+static void
+purple_queued_output_stream_finish_writing(PurpleQueuedOutputStream *stream)
+{
+	PurpleQueuedOutputStreamPrivate *priv = purple_queued_output_stream_get_instance_private(stream);
+
+	priv->writing = FALSE;
+
+	if (g_queue_is_empty(&priv->queue) && priv->pending_queued) {
+		priv->pending_queued = FALSE;
+		g_output_stream_clear_pending(G_OUTPUT_STREAM(stream));
+	}
+}
 
 static void
-purple_queued_output_stream_push_bytes_async_cb(GObject *source,
+purple_queued_output_stream_writev_async_cb(GObject *source,
 		GAsyncResult *res, gpointer user_data)
 {
-	GTask *task = G_TASK(user_data);
-	PurpleQueuedOutputStream *stream = g_task_get_source_object(task);
+	PurpleQueuedOutputStream *stream = PURPLE_QUEUED_OUTPUT_STREAM(user_data);
 	PurpleQueuedOutputStreamPrivate *priv = purple_queued_output_stream_get_instance_private(stream);
-	gssize written;
-	GBytes *bytes;
-	gsize size;
+	GQueue finished = G_QUEUE_INIT;
+	GTask *task;
+	gsize written = 0;
+	guint i;
 	GError *error = NULL;
 
-	written = g_output_stream_write_bytes_finish(G_OUTPUT_STREAM(source),
-			res, &error);
+	g_output_stream_writev_finish(G_OUTPUT_STREAM(source), res, &written,
+			&error);
+
+	/* Work out which of the batched requests made it out completely.
+	 * Callbacks are only called once the stream's state is consistent
+	 * again, as they may clear the queue or push more data. */
+	for (i = 0; i < priv->n_batch; i++) {
+		gsize size;
+
+		task = priv->batch[i];
+		size = purple_queued_output_stream_task_get_size(task);
+
+		if (error == NULL && written >= size) {
+			written -= size;
+			priv->bytes_in_flight -= size;
+			g_queue_push_tail(&finished, task);
+		} else if (error == NULL) {
+			break;
+		} else {
+			priv->bytes_in_flight -= size;
+			g_queue_push_tail(&finished, task);
+		}
+	}
 
-	bytes = g_task_get_task_data(task);
-	size = g_bytes_get_size(bytes);
+	/* Put back what wasn't written, in order, to go out with the next
+	 * write. */
+	if (i < priv->n_batch && written > 0) {
+		GBytes *bytes = g_task_get_task_data(priv->batch[i]);
+		gsize size = g_bytes_get_size(bytes);
 
-	if (written < 0) {
-		/* Error occurred, return error */
-		g_task_return_error(task, error);
-		g_clear_object(&task);
-	} else if (size > written) {
-		/* Partial write, prepare to send remaining data */
-		bytes = g_bytes_new_from_bytes(bytes, written, size - written);
-		g_task_set_task_data(task, bytes,
+		priv->bytes_in_flight -= written;
+		g_task_set_task_data(priv->batch[i],
+				g_bytes_new_from_bytes(bytes, written, size - written),
 				(GDestroyNotify)g_bytes_unref);
-	} else {
-		/* Full write, this task is finished */
-		g_task_return_boolean(task, TRUE);
-		g_clear_object(&task);
 	}
-
-	/* If g_task_return_* was called in this function, the callback
-	 * may have cleared the stream. If so, there will be no remaining
-	 * tasks to process here.
-	 */
-
-	if (task == NULL) {
-		/* Any queued data left? */
-		task = g_async_queue_try_pop(priv->queue);
+	while (priv->n_batch > i) {
+		g_queue_push_head(&priv->queue, priv->batch[--priv->n_batch]);
 	}
+	priv->n_batch = 0;
 
-	if (task != NULL) {
-		/* More to process */
-		purple_queued_output_stream_start_push_bytes_async(task);
+	if (priv->corked == 0 && !g_queue_is_empty(&priv->queue)) {
+		purple_queued_output_stream_start_write(stream);
 	} else {
-		/* All done */
-		priv->pending_queued = FALSE;
-		g_output_stream_clear_pending(G_OUTPUT_STREAM(stream));
+		purple_queued_output_stream_finish_writing(stream);
 	}
+
+	while ((task = g_queue_pop_head(&finished)) != NULL) {
+		if (error != NULL) {
+			g_task_return_error(task, g_error_copy(error));
+		} else {
+			g_task_return_boolean(task, TRUE);
+		}
+		g_object_unref(task);
+	}
+
+	g_clear_error(&error);
+	g_object_unref(stream);
 }
 
+/* Writes as much of the queue as fits in one vectored write. Requests that
+ * were cancelled while waiting are failed instead of being written. */
 static void
-purple_queued_output_stream_start_push_bytes_async(GTask *task)
+purple_queued_output_stream_start_write(PurpleQueuedOutputStream *stream)
 {
-	PurpleQueuedOutputStream *stream = g_task_get_source_object(task);
+	PurpleQueuedOutputStreamPrivate *priv = purple_queued_output_stream_get_instance_private(stream);
 	GOutputStream *base_stream;
+	GCancellable *cancellable = NULL;
+	GQueue cancelled = G_QUEUE_INIT;
+	GTask *task;
+	int io_priority = G_PRIORITY_DEFAULT;
 
-	base_stream = g_filter_output_stream_get_base_stream(
-			G_FILTER_OUTPUT_STREAM(stream));
+	priv->writing = TRUE;
+	priv->n_batch = 0;
+
+	while (priv->n_batch < PURPLE_QUEUED_OUTPUT_STREAM_MAX_VECTORS &&
+			(task = g_queue_pop_head(&priv->queue)) != NULL) {
+		GBytes *bytes = g_task_get_task_data(task);
+
+		if (g_cancellable_is_cancelled(g_task_get_cancellable(task))) {
+			priv->bytes_in_flight -= g_bytes_get_size(bytes);
+			g_queue_push_tail(&cancelled, task);
+			continue;
+		}
+
+		if (priv->n_batch == 0) {
+			io_priority = g_task_get_priority(task);
+		}
+
+		priv->vectors[priv->n_batch].buffer = g_bytes_get_data(bytes,
+				&priv->vectors[priv->n_batch].size);
+		priv->batch[priv->n_batch++] = task;
+	}
+
+	if (priv->n_batch > 0) {
+		/* A lone request can be cancelled on its own, a batch shared
+		 * by several of them can't. */
+		if (priv->n_batch == 1) {
+			cancellable = g_task_get_cancellable(priv->batch[0]);
+		}
+
+		base_stream = g_filter_output_stream_get_base_stream(
+				G_FILTER_OUTPUT_STREAM(stream));
+
+		g_output_stream_writev_async(base_stream, priv->vectors,
+				priv->n_batch, io_priority, cancellable,
+				purple_queued_output_stream_writev_async_cb,
+				g_object_ref(stream));
+	} else {
+		purple_queued_output_stream_finish_writing(stream);
+	}
 
-	g_output_stream_write_bytes_async(base_stream,
-			g_task_get_task_data(task),
-			g_task_get_priority(task),
-			g_task_get_cancellable(task),
-			purple_queued_output_stream_push_bytes_async_cb,
-			task);
+	while ((task = g_queue_pop_head(&cancelled)) != NULL) {
+		g_task_return_error_if_cancelled(task);
+		g_object_unref(task);
+	}
 }
 
 /******************************************************************************
@@ -141,7 +239,9 @@ purple_queued_output_stream_dispose(GObject *object)
 	PurpleQueuedOutputStream *stream = PURPLE_QUEUED_OUTPUT_STREAM(object);
 	PurpleQueuedOutputStreamPrivate *priv = purple_queued_output_stream_get_instance_private(stream);
 
-	g_clear_pointer(&priv->queue, g_async_queue_unref);
+	/* Every queued request holds a reference on the stream, so there
+	 * shouldn't be any left at this point. */
+	g_queue_clear_full(&priv->queue, g_object_unref);
 
 	G_OBJECT_CLASS(purple_queued_output_stream_parent_class)->dispose(object);
 }
@@ -158,7 +258,7 @@ static void
 purple_queued_output_stream_init(PurpleQueuedOutputStream *stream)
 {
 	PurpleQueuedOutputStreamPrivate *priv = purple_queued_output_stream_get_instance_private(stream);
-	priv->queue = g_async_queue_new_full((GDestroyNotify)g_bytes_unref);
+	g_queue_init(&priv->queue);
 	priv->pending_queued = FALSE;
 }
 
@@ -219,12 +319,13 @@ purple_queued_output_stream_push_bytes_async(PurpleQueuedOutputStream *stream,
 	g_clear_error (&error);
 	priv->pending_queued = TRUE;
 
-	if (set_pending) {
-		/* Start processing if there were no pending operations */
-		purple_queued_output_stream_start_push_bytes_async(task);
-	} else {
-		/* Otherwise queue the data */
-		g_async_queue_push(priv->queue, task);
+	g_queue_push_tail(&priv->queue, task);
+	priv->bytes_in_flight += g_bytes_get_size(bytes);
+
+	/* Start processing if there's no write in progress, otherwise the data
+	 * goes out together with everything else queued in the meantime. */
+	if (!priv->writing && priv->corked == 0) {
+		purple_queued_output_stream_start_write(stream);
 	}
 }
 
@@ -250,9 +351,71 @@ purple_queued_output_stream_clear_queue(PurpleQueuedOutputStream *stream)
 
 	priv = purple_queued_output_stream_get_instance_private(stream);
 
-	while ((task = g_async_queue_try_pop(priv->queue)) != NULL) {
+	while ((task = g_queue_pop_head(&priv->queue)) != NULL) {
+		priv->bytes_in_flight -=
+				purple_queued_output_stream_task_get_size(task);
 		g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
 				"PurpleQueuedOutputStream queue cleared");
 		g_object_unref(task);
 	}
+
+	/* A corked stream may be holding the pending flag with nothing being
+	 * written. */
+	if (!priv->writing) {
+		purple_queued_output_stream_finish_writing(stream);
+	}
+}
+
+void
+purple_queued_output_stream_cork(PurpleQueuedOutputStream *stream)
+{
+	PurpleQueuedOutputStreamPrivate *priv = NULL;
+
+	g_return_if_fail(PURPLE_IS_QUEUED_OUTPUT_STREAM(stream));
+
+	priv = purple_queued_output_stream_get_instance_private(stream);
+	priv->corked++;
+}
+
+void
+purple_queued_output_stream_uncork(PurpleQueuedOutputStream *stream)
+{
+	PurpleQueuedOutputStreamPrivate *priv = NULL;
+
+	g_return_if_fail(PURPLE_IS_QUEUED_OUTPUT_STREAM(stream));
+
+	priv = purple_queued_output_stream_get_instance_private(stream);
+
+	g_return_if_fail(priv->corked > 0);
+
+	priv->corked--;
+	if (priv->corked == 0 && !priv->writing &&
+			!g_queue_is_empty(&priv->queue)) {
+		purple_queued_output_stream_start_write(stream);
+	}
+}
+
+guint
+purple_queued_output_stream_get_queue_depth(PurpleQueuedOutputStream *stream)
+{
+	PurpleQueuedOutputStreamPrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_QUEUED_OUTPUT_STREAM(stream), 0);
+
+	priv = purple_queued_output_stream_get_instance_private(stream);
+
+	return g_queue_get_length(&priv->queue) + priv->n_batch;
+}
+
+gsize
+purple_queued_output_stream_get_bytes_in_flight(
+		PurpleQueuedOutputStream *stream)
+{
+	PurpleQueuedOutputStreamPrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_QUEUED_OUTPUT_STREAM(stream), 0);
+
+	priv = purple_queued_output_stream_get_instance_private(stream);
+
+	return priv->bytes_in_flight;
 }
@@ -110,6 +110,54 @@ gboolean purple_queued_output_stream_push_bytes_finish(
  */
 void purple_queued_output_stream_clear_queue(PurpleQueuedOutputStream *stream);
 
+/*
+ * purple_queued_output_stream_cork
+ * @stream: #PurpleQueuedOutputStream to cork
+ *
+ * Holds back writing of anything pushed to @stream until
+ * #purple_queued_output_stream_uncork() is called, so that a burst of small
+ * pushes can be written all at once. Calls may be nested, the data is
+ * written when the last one is undone. A write that's already in progress
+ * still finishes.
+ *
+ * The stream can't be closed while it's holding back data.
+ */
+void purple_queued_output_stream_cork(PurpleQueuedOutputStream *stream);
+
+/*
+ * purple_queued_output_stream_uncork
+ * @stream: #PurpleQueuedOutputStream to uncork
+ *
+ * Undoes a #purple_queued_output_stream_cork() call, and writes everything
+ * that was pushed in the meantime if it was the last one.
+ */
+void purple_queued_output_stream_uncork(PurpleQueuedOutputStream *stream);
+
+/*
+ * purple_queued_output_stream_get_queue_depth
+ * @stream: #PurpleQueuedOutputStream to query
+ *
+ * Gets the number of push requests that haven't finished yet, including the
+ * ones being written right now.
+ *
+ * Returns: The number of unfinished requests.
+ */
+guint purple_queued_output_stream_get_queue_depth(
+		PurpleQueuedOutputStream *stream);
+
+/*
+ * purple_queued_output_stream_get_bytes_in_flight
+ * @stream: #PurpleQueuedOutputStream to query
+ *
+ * Gets the number of bytes that were pushed to @stream, but haven't been
+ * written to the base stream yet. Protocols can use this to stop producing
+ * data while a slow connection catches up.
+ *
+ * Returns: The number of bytes not yet written.
+ */
+gsize purple_queued_output_stream_get_bytes_in_flight(
+		PurpleQueuedOutputStream *stream);
+
 G_END_DECLS
 
 #endif /* PURPLE_QUEUED_OUTPUT_STREAM_H */
@@ -0,0 +1,34 @@
+-- message_log_fts is an external content full text index over
+-- message_log.content.  It does not store a copy of the content, it just
+-- references the rowid of message_log, so the triggers below are responsible
+-- for keeping it in sync.
+CREATE VIRTUAL TABLE IF NOT EXISTS message_log_fts USING fts5
+(
+        content,
+        content='message_log',
+        content_rowid='rowid',
+        tokenize='unicode61 remove_diacritics 2'
+);
+
+CREATE TRIGGER IF NOT EXISTS message_log_fts_insert AFTER INSERT ON message_log
+BEGIN
+        INSERT INTO message_log_fts(rowid, content)
+                VALUES(new.rowid, new.content);
+END;
+
+CREATE TRIGGER IF NOT EXISTS message_log_fts_delete AFTER DELETE ON message_log
+BEGIN
+        INSERT INTO message_log_fts(message_log_fts, rowid, content)
+                VALUES('delete', old.rowid, old.content);
+END;
+
+CREATE TRIGGER IF NOT EXISTS message_log_fts_update AFTER UPDATE OF content ON message_log
+BEGIN
+        INSERT INTO message_log_fts(message_log_fts, rowid, content)
+                VALUES('delete', old.rowid, old.content);
+        INSERT INTO message_log_fts(rowid, content)
+                VALUES(new.rowid, new.content);
+END;
+
+-- Index everything that was logged before this migration.
+INSERT INTO message_log_fts(message_log_fts) VALUES('rebuild');
@@ -0,0 +1,5 @@
+-- Used when loading scrollback for a single conversation. The rowid is
+-- implicitly part of every index, so this also covers the
+-- (client_timestamp, rowid) ordering used for paging.
+CREATE INDEX IF NOT EXISTS message_log_conversation
+        ON message_log(account, conversation_id, client_timestamp);
@@ -29,6 +29,7 @@
 #include "notify.h"
 #include "purpleaccountmanager.h"
 #include "purplemarkup.h"
+#include "purpleprivate.h"
 #include "savedstatuses.h"
 #include "request.h"
 #include "status.h"
@@ -328,7 +329,6 @@ static void
 sync_statuses(void)
 {
 	PurpleXmlNode *node;
-	char *data;
 
 	if (!statuses_loaded)
 	{
@@ -338,10 +338,7 @@ sync_statuses(void)
 	}
 
 	node = statuses_to_xmlnode();
-	data = purple_xmlnode_to_formatted_str(node, NULL);
-	purple_util_write_data_to_config_file("status.xml", data, -1);
-	g_free(data);
-	purple_xmlnode_free(node);
+	_purple_util_write_xml_to_config_file("status.xml", node);
 }
 
 static gboolean
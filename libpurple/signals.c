@@ -33,6 +33,11 @@ typedef struct
 	GHashTable *signals;
 	size_t signal_count;
 
+	/* Signals indexed by their id, so that emitting by id doesn't need to
+	 * hash the name. Slot 0 is unused as 0 is never a valid id.
+	 */
+	GPtrArray *signals_by_id;
+
 	gulong next_signal_id;
 
 } PurpleInstanceData;
@@ -47,8 +52,16 @@ typedef struct
 	GType *value_types;
 	GType ret_type;
 
-	GList *handlers;
+	/* The handlers are kept sorted by priority in a flat array. While the
+	 * signal is being emitted the array can't be moved around, so
+	 * disconnected handlers are only marked by clearing their callback and
+	 * new handlers are queued in pending_handlers until the emission is done.
+	 */
+	GArray *handlers;
+	GArray *pending_handlers;
 	size_t handler_count;
+	guint emitting;
+	gboolean needs_compaction;
 
 	gulong next_handler_id;
 } PurpleSignalData;
@@ -70,6 +83,7 @@ static void
 destroy_instance_data(PurpleInstanceData *instance_data)
 {
 	g_hash_table_destroy(instance_data->signals);
+	g_ptr_array_free(instance_data->signals_by_id, TRUE);
 
 	g_free(instance_data);
 }
@@ -77,11 +91,42 @@ destroy_instance_data(PurpleInstanceData *instance_data)
 static void
 destroy_signal_data(PurpleSignalData *signal_data)
 {
-	g_list_free_full(signal_data->handlers, g_free);
+	g_array_free(signal_data->handlers, TRUE);
+	if (signal_data->pending_handlers != NULL)
+		g_array_free(signal_data->pending_handlers, TRUE);
 	g_free(signal_data->value_types);
 	g_free(signal_data);
 }
 
+static PurpleSignalData *
+find_signal_by_id(void *instance, gulong signal_id)
+{
+	PurpleInstanceData *instance_data;
+
+	instance_data =
+		(PurpleInstanceData *)g_hash_table_lookup(instance_table, instance);
+
+	if (instance_data == NULL ||
+		signal_id >= instance_data->signals_by_id->len)
+	{
+		return NULL;
+	}
+
+	return g_ptr_array_index(instance_data->signals_by_id, signal_id);
+}
+
+static void
+clear_signal_id(PurpleInstanceData *instance_data, const char *signal)
+{
+	PurpleSignalData *signal_data;
+
+	signal_data =
+		(PurpleSignalData *)g_hash_table_lookup(instance_data->signals, signal);
+
+	if (signal_data != NULL)
+		g_ptr_array_index(instance_data->signals_by_id, signal_data->id) = NULL;
+}
+
 gulong
 purple_signal_register(void *instance, const char *signal,
 					 PurpleSignalMarshalFunc marshal,
@@ -109,6 +154,9 @@ purple_signal_register(void *instance, const char *signal,
 			g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 								  (GDestroyNotify)destroy_signal_data);
 
+		instance_data->signals_by_id = g_ptr_array_new();
+		g_ptr_array_add(instance_data->signals_by_id, NULL);
+
 		g_hash_table_insert(instance_table, instance, instance_data);
 	}
 
@@ -118,6 +166,8 @@ purple_signal_register(void *instance, const char *signal,
 	signal_data->next_handler_id = 1;
 	signal_data->ret_type        = ret_type;
 	signal_data->num_values      = num_values;
+	signal_data->handlers        =
+		g_array_new(FALSE, FALSE, sizeof(PurpleSignalHandlerData));
 
 	if (num_values > 0)
 	{
@@ -133,8 +183,12 @@ purple_signal_register(void *instance, const char *signal,
 		va_end(args);
 	}
 
+	/* Registering the same name again replaces the old signal. */
+	clear_signal_id(instance_data, signal);
+
 	g_hash_table_insert(instance_data->signals,
 						g_strdup(signal), signal_data);
+	g_ptr_array_add(instance_data->signals_by_id, signal_data);
 
 	instance_data->next_signal_id++;
 	instance_data->signal_count++;
@@ -155,6 +209,7 @@ purple_signal_unregister(void *instance, const char *signal)
 
 	g_return_if_fail(instance_data != NULL);
 
+	clear_signal_id(instance_data, signal);
 	g_hash_table_remove(instance_data->signals, signal);
 
 	instance_data->signal_count--;
@@ -180,6 +235,30 @@ purple_signals_unregister_by_instance(void *instance)
 	/* g_return_if_fail(found); */
 }
 
+gulong
+purple_signal_lookup(void *instance, const char *signal)
+{
+	PurpleInstanceData *instance_data;
+	PurpleSignalData *signal_data;
+
+	g_return_val_if_fail(instance != NULL, 0);
+	g_return_val_if_fail(signal   != NULL, 0);
+
+	instance_data =
+		(PurpleInstanceData *)g_hash_table_lookup(instance_table, instance);
+
+	if (instance_data == NULL)
+		return 0;
+
+	signal_data =
+		(PurpleSignalData *)g_hash_table_lookup(instance_data->signals, signal);
+
+	if (signal_data == NULL)
+		return 0;
+
+	return signal_data->id;
+}
+
 void
 purple_signal_get_types(void *instance, const char *signal,
 					   GType *ret_type,
@@ -212,12 +291,92 @@ purple_signal_get_types(void *instance, const char *signal,
 		*ret_type = signal_data->ret_type;
 }
 
-static gint handler_priority(void * a, void * b) {
-	PurpleSignalHandlerData *ah = (PurpleSignalHandlerData*)a;
-	PurpleSignalHandlerData *bh = (PurpleSignalHandlerData*)b;
-	if (ah->priority > bh->priority) return 1;
-	if (ah->priority < bh->priority) return -1;
-	return 0;
+/*
+ * Handlers are inserted before the first handler with the same or a higher
+ * priority, which is the order the old sorted GList gave them.
+ */
+static void
+insert_handler_sorted(GArray *handlers, PurpleSignalHandlerData *handler_data)
+{
+	guint low = 0, high = handlers->len;
+
+	while (low < high)
+	{
+		guint mid = low + (high - low) / 2;
+		PurpleSignalHandlerData *other =
+			&g_array_index(handlers, PurpleSignalHandlerData, mid);
+
+		if (other->priority < handler_data->priority)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	g_array_insert_val(handlers, low, *handler_data);
+}
+
+/*
+ * Applies any changes that were made to the handlers while the signal was
+ * being emitted.
+ */
+static void
+sync_handlers(PurpleSignalData *signal_data)
+{
+	guint i;
+
+	if (signal_data->needs_compaction)
+	{
+		guint j = 0;
+
+		for (i = 0; i < signal_data->handlers->len; i++)
+		{
+			PurpleSignalHandlerData *handler_data =
+				&g_array_index(signal_data->handlers,
+							   PurpleSignalHandlerData, i);
+
+			if (handler_data->cb == NULL)
+				continue;
+
+			if (i != j)
+			{
+				g_array_index(signal_data->handlers,
+							  PurpleSignalHandlerData, j) = *handler_data;
+			}
+
+			j++;
+		}
+
+		g_array_set_size(signal_data->handlers, j);
+		signal_data->needs_compaction = FALSE;
+	}
+
+	if (signal_data->pending_handlers != NULL)
+	{
+		for (i = 0; i < signal_data->pending_handlers->len; i++)
+		{
+			insert_handler_sorted(signal_data->handlers,
+								  &g_array_index(signal_data->pending_handlers,
+												 PurpleSignalHandlerData, i));
+		}
+
+		g_array_set_size(signal_data->pending_handlers, 0);
+	}
+}
+
+static void
+remove_handler(PurpleSignalData *signal_data, GArray *handlers, guint index)
+{
+	if (handlers == signal_data->handlers && signal_data->emitting > 0)
+	{
+		g_array_index(handlers, PurpleSignalHandlerData, index).cb = NULL;
+		signal_data->needs_compaction = TRUE;
+	}
+	else
+	{
+		g_array_remove_index(handlers, index);
+	}
+
+	signal_data->handler_count--;
 }
 
 static gulong
@@ -226,7 +385,7 @@ signal_connect_common(void *instance, const char *signal, void *handle,
 {
 	PurpleInstanceData *instance_data;
 	PurpleSignalData *signal_data;
-	PurpleSignalHandlerData *handler_data;
+	PurpleSignalHandlerData handler_data;
 
 	g_return_val_if_fail(instance != NULL, 0);
 	g_return_val_if_fail(signal   != NULL, 0);
@@ -255,19 +414,32 @@ signal_connect_common(void *instance, const char *signal, void *handle,
 	}
 
 	/* Create the signal handler data */
-	handler_data = g_new0(PurpleSignalHandlerData, 1);
-	handler_data->id        = signal_data->next_handler_id;
-	handler_data->cb        = func;
-	handler_data->handle    = handle;
-	handler_data->data      = data;
-	handler_data->use_vargs = use_vargs;
-	handler_data->priority = priority;
-
-	signal_data->handlers = g_list_insert_sorted(signal_data->handlers, handler_data, (GCompareFunc)handler_priority);
+	handler_data.id        = signal_data->next_handler_id;
+	handler_data.cb        = func;
+	handler_data.handle    = handle;
+	handler_data.data      = data;
+	handler_data.use_vargs = use_vargs;
+	handler_data.priority  = priority;
+
+	if (signal_data->emitting > 0)
+	{
+		if (signal_data->pending_handlers == NULL)
+		{
+			signal_data->pending_handlers =
+				g_array_new(FALSE, FALSE, sizeof(PurpleSignalHandlerData));
+		}
+
+		g_array_append_val(signal_data->pending_handlers, handler_data);
+	}
+	else
+	{
+		insert_handler_sorted(signal_data->handlers, &handler_data);
+	}
+
 	signal_data->handler_count++;
 	signal_data->next_handler_id++;
 
-	return handler_data->id;
+	return handler_data.id;
 }
 
 gulong
@@ -298,14 +470,53 @@ purple_signal_connect_vargs(void *instance, const char *signal, void *handle,
 	return signal_connect_common(instance, signal, handle, func, data, PURPLE_SIGNAL_PRIORITY_DEFAULT, TRUE);
 }
 
+/*
+ * Removes the first handler in handlers that matches handle and func, or every
+ * handler for handle if func is NULL. Returns whether anything was removed.
+ */
+static gboolean
+disconnect_handlers(PurpleSignalData *signal_data, GArray *handlers,
+					void *handle, GCallback func)
+{
+	gboolean found = FALSE;
+	guint i = 0;
+
+	if (handlers == NULL)
+		return FALSE;
+
+	while (i < handlers->len)
+	{
+		PurpleSignalHandlerData *handler_data =
+			&g_array_index(handlers, PurpleSignalHandlerData, i);
+		guint len = handlers->len;
+
+		if (handler_data->cb == NULL || handler_data->handle != handle ||
+			(func != NULL && handler_data->cb != func))
+		{
+			i++;
+			continue;
+		}
+
+		remove_handler(signal_data, handlers, i);
+		found = TRUE;
+
+		if (func != NULL)
+			break;
+
+		/* During an emission the handler is only cleared, not removed. */
+		if (handlers->len == len)
+			i++;
+	}
+
+	return found;
+}
+
 void
 purple_signal_disconnect(void *instance, const char *signal,
 					   void *handle, GCallback func)
 {
 	PurpleInstanceData *instance_data;
 	PurpleSignalData *signal_data;
-	PurpleSignalHandlerData *handler_data;
-	GList *l;
 	gboolean found = FALSE;
 
 	g_return_if_fail(instance != NULL);
@@ -329,53 +540,25 @@ purple_signal_disconnect(void *instance, const char *signal,
 	}
 
 	/* Find the handler data. */
-	for (l = signal_data->handlers; l != NULL; l = l->next)
+	found = disconnect_handlers(signal_data, signal_data->handlers, handle,
+								func);
+	if (!found)
 	{
-		handler_data = (PurpleSignalHandlerData *)l->data;
-
-		if (handler_data->handle == handle && handler_data->cb == func)
-		{
-			g_free(handler_data);
-
-			signal_data->handlers = g_list_delete_link(signal_data->handlers,
-												       l);
-			signal_data->handler_count--;
-
-			found = TRUE;
-
-			break;
-		}
+		found = disconnect_handlers(signal_data, signal_data->pending_handlers,
+									handle, func);
 	}
 
 	/* See note somewhere about this actually helping developers.. */
 	g_return_if_fail(found);
 }
 
-/*
- * TODO: Make this all more efficient by storing a list of handlers, keyed
- *       to a handle.
- */
 static void
 disconnect_handle_from_signals(const char *signal,
 							   PurpleSignalData *signal_data, void *handle)
 {
-	GList *l, *l_next;
-	PurpleSignalHandlerData *handler_data;
-
-	for (l = signal_data->handlers; l != NULL; l = l_next)
-	{
-		handler_data = (PurpleSignalHandlerData *)l->data;
-		l_next = l->next;
-
-		if (handler_data->handle == handle)
-		{
-			g_free(handler_data);
-
-			signal_data->handler_count--;
-			signal_data->handlers = g_list_delete_link(signal_data->handlers,
-			                                           l);
-		}
-	}
+	disconnect_handlers(signal_data, signal_data->handlers, handle, NULL);
+	disconnect_handlers(signal_data, signal_data->pending_handlers, handle,
+						NULL);
 }
 
 static void
@@ -396,6 +579,72 @@ purple_signals_disconnect_by_handle(void *handle)
 						 (GHFunc)disconnect_handle_from_instance, handle);
 }
 
+/*
+ * Calls the handlers of signal_data in order. If return_1 is set, emission
+ * stops at the first handler to return something other than NULL.
+ */
+static void *
+signal_emit_common(PurpleSignalData *signal_data, va_list args,
+				   gboolean return_1)
+{
+	void *ret_val = NULL;
+	va_list tmp;
+	guint i;
+
+	/* Most signals have nobody listening, so don't bother with anything
+	 * else in that case.
+	 */
+	if (signal_data->handler_count == 0)
+		return NULL;
+
+	signal_data->emitting++;
+
+	for (i = 0; i < signal_data->handlers->len; i++)
+	{
+		PurpleSignalHandlerData *handler_data =
+			&g_array_index(signal_data->handlers, PurpleSignalHandlerData, i);
+
+		/* This was disconnected during the emission. */
+		if (handler_data->cb == NULL)
+			continue;
+
+		/* This is necessary because a va_list may only be
+		 * evaluated once */
+		G_VA_COPY(tmp, args);
+
+		if (handler_data->use_vargs)
+		{
+			if (return_1)
+			{
+				ret_val = ((void *(*)(va_list, void *))handler_data->cb)(
+					tmp, handler_data->data);
+			}
+			else
+			{
+				((void (*)(va_list, void *))handler_data->cb)(tmp,
+															  handler_data->data);
+			}
+		}
+		else
+		{
+			signal_data->marshal(handler_data->cb, tmp, handler_data->data,
+								 return_1 ? &ret_val : NULL);
+		}
+
+		va_end(tmp);
+
+		if (ret_val != NULL)
+			break;
+	}
+
+	signal_data->emitting--;
+
+	if (signal_data->emitting == 0)
+		sync_handlers(signal_data);
+
+	return ret_val;
+}
+
 void
 purple_signal_emit(void *instance, const char *signal, ...)
 {
@@ -414,9 +663,6 @@ purple_signal_emit_vargs(void *instance, const char *signal, va_list args)
 {
 	PurpleInstanceData *instance_data;
 	PurpleSignalData *signal_data;
-	PurpleSignalHandlerData *handler_data;
-	GList *l, *l_next;
-	va_list tmp;
 
 	g_return_if_fail(instance != NULL);
 	g_return_if_fail(signal   != NULL);
@@ -434,29 +680,7 @@ purple_signal_emit_vargs(void *instance, const char *signal, va_list args)
 		return;
 	}
 
-	for (l = signal_data->handlers; l != NULL; l = l_next)
-	{
-		l_next = l->next;
-
-		handler_data = (PurpleSignalHandlerData *)l->data;
-
-		/* This is necessary because a va_list may only be
-		 * evaluated once */
-		G_VA_COPY(tmp, args);
-
-		if (handler_data->use_vargs)
-		{
-			((void (*)(va_list, void *))handler_data->cb)(tmp,
-														  handler_data->data);
-		}
-		else
-		{
-			signal_data->marshal(handler_data->cb, tmp,
-								 handler_data->data, NULL);
-		}
-
-		va_end(tmp);
-	}
+	signal_emit_common(signal_data, args, FALSE);
 }
 
 void *
@@ -481,9 +705,6 @@ purple_signal_emit_vargs_return_1(void *instance, const char *signal,
 {
 	PurpleInstanceData *instance_data;
 	PurpleSignalData *signal_data;
-	PurpleSignalHandlerData *handler_data;
-	GList *l, *l_next;
-	va_list tmp;
 
 	g_return_val_if_fail(instance != NULL, NULL);
 	g_return_val_if_fail(signal   != NULL, NULL);
@@ -501,32 +722,66 @@ purple_signal_emit_vargs_return_1(void *instance, const char *signal,
 		return 0;
 	}
 
-	for (l = signal_data->handlers; l != NULL; l = l_next)
-	{
-		void *ret_val = NULL;
+	return signal_emit_common(signal_data, args, TRUE);
+}
 
-		l_next = l->next;
+void
+purple_signal_emit_by_id(void *instance, gulong signal_id, ...)
+{
+	PurpleSignalData *signal_data;
+	va_list args;
 
-		handler_data = (PurpleSignalHandlerData *)l->data;
+	g_return_if_fail(instance  != NULL);
+	g_return_if_fail(signal_id != 0);
 
-		G_VA_COPY(tmp, args);
-		if (handler_data->use_vargs)
-		{
-			ret_val = ((void *(*)(va_list, void *))handler_data->cb)(
-				tmp, handler_data->data);
-		}
-		else
-		{
-			signal_data->marshal(handler_data->cb, tmp,
-								 handler_data->data, &ret_val);
-		}
-		va_end(tmp);
+	signal_data = find_signal_by_id(instance, signal_id);
 
-		if (ret_val != NULL)
-			return ret_val;
+	if (signal_data == NULL) {
+		purple_debug_error("signals", "Signal data for id %lu not found!",
+						   signal_id);
+		return;
 	}
 
-	return NULL;
+	va_start(args, signal_id);
+	signal_emit_common(signal_data, args, FALSE);
+	va_end(args);
+}
+
+void *
+purple_signal_emit_by_id_return_1(void *instance, gulong signal_id, ...)
+{
+	PurpleSignalData *signal_data;
+	void *ret_val;
+	va_list args;
+
+	g_return_val_if_fail(instance  != NULL, NULL);
+	g_return_val_if_fail(signal_id != 0, NULL);
+
+	signal_data = find_signal_by_id(instance, signal_id);
+
+	if (signal_data == NULL) {
+		purple_debug_error("signals", "Signal data for id %lu not found!",
+						   signal_id);
+		return NULL;
+	}
+
+	va_start(args, signal_id);
+	ret_val = signal_emit_common(signal_data, args, TRUE);
+	va_end(args);
+
+	return ret_val;
+}
+
+gboolean
+purple_signal_has_handlers(void *instance, gulong signal_id)
+{
+	PurpleSignalData *signal_data;
+
+	g_return_val_if_fail(instance != NULL, FALSE);
+
+	signal_data = find_signal_by_id(instance, signal_id);
+
+	return signal_data != NULL && signal_data->handler_count > 0;
 }
 
 void
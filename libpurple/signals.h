@@ -114,6 +114,20 @@ void purple_signal_unregister(void *instance, const char *signal);
  */
 void purple_signals_unregister_by_instance(void *instance);
 
+/**
+ * purple_signal_lookup:
+ * @instance: The instance the signal is registered to.
+ * @signal:   The signal name.
+ *
+ * Looks up the ID of a signal so that it can be emitted with
+ * purple_signal_emit_by_id(). This is the same ID that
+ * purple_signal_register() returned.
+ *
+ * Returns: The signal ID local to @instance, or 0 if the signal isn't
+ *          registered.
+ */
+gulong purple_signal_lookup(void *instance, const char *signal);
+
 /**
  * purple_signal_get_types:
  * @instance:           The instance the signal is registered to.
@@ -302,6 +316,45 @@ void *purple_signal_emit_return_1(void *instance, const char *signal, ...);
 void *purple_signal_emit_vargs_return_1(void *instance, const char *signal,
 									  va_list args);
 
+/**
+ * purple_signal_emit_by_id:
+ * @instance:  The instance emitting the signal.
+ * @signal_id: The ID of the signal being emitted.
+ * @...:       The arguments to pass to the callbacks.
+ *
+ * Emits a signal by the ID returned from purple_signal_register() or
+ * purple_signal_lookup(). This avoids looking up the signal by name, which
+ * matters for signals that are emitted for every message.
+ */
+void purple_signal_emit_by_id(void *instance, gulong signal_id, ...);
+
+/**
+ * purple_signal_emit_by_id_return_1:
+ * @instance:  The instance emitting the signal.
+ * @signal_id: The ID of the signal being emitted.
+ * @...:       The arguments to pass to the callbacks.
+ *
+ * Emits a signal by its ID and returns the first non-NULL return value.
+ *
+ * Further signal handlers are NOT called after a handler returns
+ * something other than NULL.
+ *
+ * Returns: The first non-NULL return value
+ */
+void *purple_signal_emit_by_id_return_1(void *instance, gulong signal_id, ...);
+
+/**
+ * purple_signal_has_handlers:
+ * @instance:  The instance the signal is registered to.
+ * @signal_id: The ID of the signal.
+ *
+ * Checks if anything is connected to a signal. This can be used to skip
+ * building expensive arguments for a signal that nobody is listening to.
+ *
+ * Returns: %TRUE if the signal has at least one handler, %FALSE otherwise.
+ */
+gboolean purple_signal_has_handlers(void *instance, gulong signal_id);
+
 /**
  * purple_signals_init:
  *
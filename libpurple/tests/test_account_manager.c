@@ -130,6 +130,67 @@ test_purple_account_manager_find(void) {
 	g_clear_object(&manager);
 }
 
+static void
+test_purple_account_manager_find_by_id(void) {
+	PurpleAccount *account = NULL, *found = NULL;
+	PurpleAccountManager *manager = NULL;
+	const gchar *id = NULL;
+
+	manager = g_object_new(PURPLE_TYPE_ACCOUNT_MANAGER, NULL);
+	account = purple_account_new("test", "test");
+	id = purple_account_get_id(account);
+
+	found = purple_account_manager_find_by_id(manager, id);
+	g_assert_null(found);
+
+	purple_account_manager_add(manager, account);
+	found = purple_account_manager_find_by_id(manager, id);
+	g_assert_true(found == account);
+
+	purple_account_manager_remove(manager, account);
+	found = purple_account_manager_find_by_id(manager, id);
+	g_assert_null(found);
+
+	/* Cleanup */
+	g_clear_object(&account);
+	g_clear_object(&manager);
+}
+
+static void
+test_purple_account_manager_find_after_change(void) {
+	PurpleAccount *account = NULL, *found = NULL;
+	PurpleAccountManager *manager = NULL;
+
+	manager = g_object_new(PURPLE_TYPE_ACCOUNT_MANAGER, NULL);
+	account = purple_account_new("test", "test");
+
+	purple_account_manager_add(manager, account);
+
+	/* Changing the username should update the index. */
+	purple_account_set_username(account, "test2");
+	found = purple_account_manager_find(manager, "test", "test");
+	g_assert_null(found);
+	found = purple_account_manager_find(manager, "test2", "test");
+	g_assert_true(found == account);
+
+	/* As should changing the protocol. */
+	purple_account_set_protocol_id(account, "other");
+	found = purple_account_manager_find(manager, "test2", "test");
+	g_assert_null(found);
+	found = purple_account_manager_find(manager, "test2", "other");
+	g_assert_true(found == account);
+
+	/* Once removed, changes should no longer be tracked. */
+	purple_account_manager_remove(manager, account);
+	purple_account_set_username(account, "test3");
+	found = purple_account_manager_find(manager, "test3", "other");
+	g_assert_null(found);
+
+	/* Cleanup */
+	g_clear_object(&account);
+	g_clear_object(&manager);
+}
+
 /******************************************************************************
  * Foreach Tests
  *****************************************************************************/
@@ -203,6 +264,10 @@ main(gint argc, gchar *argv[]) {
 	                test_purple_account_manager_add_remove);
 	g_test_add_func("/account-manager/find",
 	                test_purple_account_manager_find);
+	g_test_add_func("/account-manager/find-by-id",
+	                test_purple_account_manager_find_by_id);
+	g_test_add_func("/account-manager/find/after-change",
+	                test_purple_account_manager_find_after_change);
 	g_test_add_func("/account-manager/foreach",
 	                test_purple_account_manager_foreach);
 
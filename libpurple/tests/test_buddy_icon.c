@@ -0,0 +1,397 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+#include "test_ui.h"
+
+#define TEST_BUDDY_ICON_SIZE (1024)
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static PurpleAccount *account = NULL;
+
+static guchar *
+test_buddy_icon_data_new(guint8 fill) {
+	guchar *data = g_malloc(TEST_BUDDY_ICON_SIZE);
+
+	memcpy(data, "GIF8", 4);
+	memset(data + 4, fill, TEST_BUDDY_ICON_SIZE - 4);
+
+	return data;
+}
+
+static void
+test_buddy_icon_assert_stream(PurpleBuddyIcon *icon, guint8 fill) {
+	GInputStream *stream = purple_buddy_icon_get_stream(icon);
+	GError *error = NULL;
+	guchar *data = g_malloc(TEST_BUDDY_ICON_SIZE + 1);
+	gsize read = 0;
+
+	g_input_stream_read_all(stream, data, TEST_BUDDY_ICON_SIZE + 1, &read,
+	                        NULL, &error);
+	g_assert_no_error(error);
+	g_assert_cmpuint(read, ==, TEST_BUDDY_ICON_SIZE);
+	for(gsize i = 4; i < TEST_BUDDY_ICON_SIZE; i++) {
+		g_assert_cmpuint(data[i], ==, fill);
+	}
+
+	g_free(data);
+	g_object_unref(stream);
+}
+
+static PurpleGroup *
+test_buddy_icon_group_new(const gchar *name) {
+	PurpleGroup *group = purple_group_new(name);
+
+	purple_blist_add_group(group, NULL);
+
+	return group;
+}
+
+static PurpleBuddy *
+test_buddy_icon_buddy_new(const gchar *name, guint8 fill) {
+	PurpleBuddy *buddy = purple_buddy_new(account, name, NULL);
+
+	purple_blist_add_buddy(buddy, NULL, NULL, NULL);
+	purple_buddy_icons_set_for_user(account, name,
+	                                test_buddy_icon_data_new(fill),
+	                                TEST_BUDDY_ICON_SIZE, NULL);
+	g_assert_nonnull(purple_buddy_get_icon(buddy));
+
+	return buddy;
+}
+
+static void
+test_buddy_icon_remove_group(PurpleGroup *group) {
+	purple_buddy_icons_node_set_custom_icon(PURPLE_BLIST_NODE(group), NULL, 0);
+	purple_blist_remove_group(group);
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_buddy_icon_cache_lru(void) {
+	PurpleBuddyIconsCacheStats before, stats;
+	PurpleGroup *groups[3];
+	PurpleImage *images[3], *image = NULL;
+
+	purple_buddy_icons_get_cache_stats(&before);
+	purple_buddy_icons_set_cache_budget(2 * TEST_BUDDY_ICON_SIZE);
+
+	for(guint i = 0; i < G_N_ELEMENTS(groups); i++) {
+		gchar *name = g_strdup_printf("lru%u", i);
+
+		groups[i] = test_buddy_icon_group_new(name);
+		images[i] = purple_buddy_icons_node_set_custom_icon(
+			PURPLE_BLIST_NODE(groups[i]), test_buddy_icon_data_new('a' + i),
+			TEST_BUDDY_ICON_SIZE);
+		g_object_add_weak_pointer(G_OBJECT(images[i]), (gpointer *)&images[i]);
+
+		g_free(name);
+	}
+
+	/* The first is the least recently used, so it's released to make room
+	 * for the third. */
+	g_assert_null(images[0]);
+	g_assert_nonnull(images[1]);
+	g_assert_nonnull(images[2]);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 2);
+	g_assert_cmpuint(stats.bytes_held, ==,
+	                 before.bytes_held + 2 * TEST_BUDDY_ICON_SIZE);
+	g_assert_cmpuint(stats.evictions, ==, before.evictions + 1);
+
+	/* Using the second makes the third the least recently used. */
+	image = purple_buddy_icons_node_find_custom_icon(PURPLE_BLIST_NODE(groups[1]));
+	g_assert_true(image == images[1]);
+	g_object_unref(image);
+
+	/* So it's the one released when the first is read back. */
+	image = purple_buddy_icons_node_find_custom_icon(PURPLE_BLIST_NODE(groups[0]));
+	g_assert_nonnull(image);
+	g_assert_cmpuint(purple_image_get_data_size(image), ==,
+	                 TEST_BUDDY_ICON_SIZE);
+	g_object_unref(image);
+
+	g_assert_nonnull(images[1]);
+	g_assert_null(images[2]);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 2);
+	g_assert_cmpuint(stats.bytes_held, ==,
+	                 before.bytes_held + 2 * TEST_BUDDY_ICON_SIZE);
+	g_assert_cmpuint(stats.evictions, ==, before.evictions + 2);
+	g_assert_cmpuint(stats.file_reads, ==, before.file_reads + 1);
+
+	/* Lowering the budget releases everything but the most recently used. */
+	purple_buddy_icons_set_cache_budget(TEST_BUDDY_ICON_SIZE);
+	g_assert_null(images[1]);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 1);
+	g_assert_cmpuint(stats.evictions, ==, before.evictions + 3);
+
+	for(guint i = 0; i < G_N_ELEMENTS(groups); i++) {
+		test_buddy_icon_remove_group(groups[i]);
+	}
+	purple_buddy_icons_set_cache_budget(8 * 1024 * 1024);
+}
+
+static void
+test_buddy_icon_cache_shared(void) {
+	PurpleBuddyIconsCacheStats before, stats;
+	PurpleGroup *first, *second, *other;
+	PurpleImage *shared = NULL, *image = NULL;
+
+	purple_buddy_icons_get_cache_stats(&before);
+	purple_buddy_icons_set_cache_budget(TEST_BUDDY_ICON_SIZE);
+
+	/* Both groups end up with the same image, and the first group's entry is
+	 * released for the second's. */
+	first = test_buddy_icon_group_new("shared0");
+	second = test_buddy_icon_group_new("shared1");
+	shared = purple_buddy_icons_node_set_custom_icon(PURPLE_BLIST_NODE(first),
+	                                                 test_buddy_icon_data_new('a'),
+	                                                 TEST_BUDDY_ICON_SIZE);
+	image = purple_buddy_icons_node_set_custom_icon(PURPLE_BLIST_NODE(second),
+	                                                test_buddy_icon_data_new('a'),
+	                                                TEST_BUDDY_ICON_SIZE);
+	g_assert_true(image == shared);
+	g_object_add_weak_pointer(G_OBJECT(shared), (gpointer *)&shared);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 1);
+	g_assert_cmpuint(stats.images, ==, before.images + 1);
+	g_assert_nonnull(shared);
+
+	/* Releasing the second's removes the image from the cache entirely, so
+	 * it's gone rather than left behind for entries that no longer exist. */
+	other = test_buddy_icon_group_new("shared2");
+	purple_buddy_icons_node_set_custom_icon(PURPLE_BLIST_NODE(other),
+	                                        test_buddy_icon_data_new('b'),
+	                                        TEST_BUDDY_ICON_SIZE);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 1);
+	g_assert_cmpuint(stats.images, ==, before.images + 1);
+	g_assert_cmpuint(stats.bytes_held, ==,
+	                 before.bytes_held + TEST_BUDDY_ICON_SIZE);
+	g_assert_null(shared);
+
+	/* Both groups can still read it back from disk, and share it again. */
+	image = purple_buddy_icons_node_find_custom_icon(PURPLE_BLIST_NODE(first));
+	g_assert_nonnull(image);
+	g_object_unref(image);
+	shared = purple_buddy_icons_node_find_custom_icon(PURPLE_BLIST_NODE(second));
+	g_assert_true(shared == image);
+	g_object_unref(shared);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 1);
+	g_assert_cmpuint(stats.images, ==, before.images + 1);
+	g_assert_cmpuint(stats.file_reads, ==, before.file_reads + 2);
+
+	test_buddy_icon_remove_group(first);
+	test_buddy_icon_remove_group(second);
+	test_buddy_icon_remove_group(other);
+	purple_buddy_icons_set_cache_budget(8 * 1024 * 1024);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries);
+	g_assert_cmpuint(stats.images, ==, before.images);
+}
+
+static void
+test_buddy_icon_cache_buddies(void) {
+	PurpleBuddyIconsCacheStats before, stats;
+	PurpleBuddy *alice, *bob;
+	PurpleBuddyIcon *icon;
+	gconstpointer data;
+
+	purple_buddy_icons_get_cache_stats(&before);
+	purple_buddy_icons_set_cache_budget(TEST_BUDDY_ICON_SIZE);
+
+	/* Alice's icon is released for bob's, but she keeps it. */
+	alice = test_buddy_icon_buddy_new("alice", 'a');
+	bob = test_buddy_icon_buddy_new("bob", 'b');
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 1);
+	g_assert_cmpuint(stats.bytes_held, ==,
+	                 before.bytes_held + TEST_BUDDY_ICON_SIZE);
+	g_assert_cmpuint(stats.evictions, ==, before.evictions + 1);
+
+	/* Using it reads it back and releases bob's. */
+	icon = purple_buddy_get_icon(alice);
+	g_assert_nonnull(icon);
+	test_buddy_icon_assert_stream(icon, 'a');
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 1);
+	g_assert_cmpuint(stats.evictions, ==, before.evictions + 2);
+
+	test_buddy_icon_assert_stream(purple_buddy_get_icon(bob), 'b');
+
+	/* Once someone has a pointer to alice's data it has to stay. */
+	data = purple_buddy_icon_get_data(purple_buddy_get_icon(alice), NULL);
+	g_assert_nonnull(data);
+	test_buddy_icon_assert_stream(purple_buddy_get_icon(bob), 'b');
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries + 2);
+	g_assert_cmpuint(stats.bytes_held, ==,
+	                 before.bytes_held + 2 * TEST_BUDDY_ICON_SIZE);
+	g_assert_cmpuint(stats.evictions, ==, before.evictions + 4);
+	g_assert_cmpuint(((const guchar *)data)[4], ==, 'a');
+
+	purple_blist_remove_buddy(alice);
+	purple_blist_remove_buddy(bob);
+	purple_buddy_icons_set_cache_budget(8 * 1024 * 1024);
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.entries, ==, before.entries);
+}
+
+typedef struct {
+	PurpleBuddyIcon *icons[2];
+	guint finished;
+} TestBuddyIconFindData;
+
+static void
+test_buddy_icon_find_async_cb(G_GNUC_UNUSED GObject *obj, GAsyncResult *res,
+                              gpointer data)
+{
+	TestBuddyIconFindData *find = data;
+	GError *error = NULL;
+
+	g_assert_cmpuint(find->finished, <, G_N_ELEMENTS(find->icons));
+
+	find->icons[find->finished] = purple_buddy_icons_find_finish(res, &error);
+	g_assert_no_error(error);
+	find->finished++;
+}
+
+static void
+test_buddy_icon_find_async_shared(void) {
+	PurpleBuddyIconsCacheStats before, stats;
+	TestBuddyIconFindData find = { .finished = 0 };
+	PurpleBuddy *buddy;
+
+	/* Dropping the buddy's reference leaves the icon only on disk. */
+	buddy = test_buddy_icon_buddy_new("carol", 'c');
+	purple_buddy_set_icon(buddy, NULL);
+	g_assert_nonnull(purple_blist_node_get_string(PURPLE_BLIST_NODE(buddy),
+	                                              "buddy_icon"));
+
+	purple_buddy_icons_get_cache_stats(&before);
+
+	purple_buddy_icons_find_async(account, "carol", NULL,
+	                              test_buddy_icon_find_async_cb, &find);
+	purple_buddy_icons_find_async(account, "carol", NULL,
+	                              test_buddy_icon_find_async_cb, &find);
+	while(find.finished < G_N_ELEMENTS(find.icons)) {
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	/* Both got the same icon from a single read. */
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.file_reads, ==, before.file_reads + 1);
+
+	g_assert_nonnull(find.icons[0]);
+	g_assert_true(find.icons[0] == find.icons[1]);
+	g_assert_true(purple_buddy_get_icon(buddy) == find.icons[0]);
+	test_buddy_icon_assert_stream(find.icons[0], 'c');
+
+	/* Now that it's in memory, finding it again doesn't read anything. */
+	find.finished = 0;
+	purple_buddy_icon_unref(find.icons[0]);
+	purple_buddy_icon_unref(find.icons[1]);
+	purple_buddy_icons_find_async(account, "carol", NULL,
+	                              test_buddy_icon_find_async_cb, &find);
+	while(find.finished < 1) {
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	purple_buddy_icons_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.file_reads, ==, before.file_reads + 1);
+	g_assert_true(purple_buddy_get_icon(buddy) == find.icons[0]);
+	purple_buddy_icon_unref(find.icons[0]);
+
+	purple_blist_remove_buddy(buddy);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	PurpleAccountManager *manager = NULL;
+	GError *error = NULL;
+	GDir *dir = NULL;
+	const gchar *name = NULL;
+	gchar *cache_dir = NULL;
+	gint ret;
+
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+	cache_dir = g_dir_make_tmp("purple-test-buddy-icon-XXXXXX", &error);
+	g_assert_no_error(error);
+	purple_buddy_icons_set_cache_dir(cache_dir);
+
+	manager = purple_account_manager_get_default();
+	account = purple_account_new("test", "test");
+	purple_account_manager_add(manager, account);
+
+	g_test_add_func("/buddy-icon/cache/lru", test_buddy_icon_cache_lru);
+	g_test_add_func("/buddy-icon/cache/shared", test_buddy_icon_cache_shared);
+	g_test_add_func("/buddy-icon/cache/buddies",
+	                test_buddy_icon_cache_buddies);
+	g_test_add_func("/buddy-icon/find-async/shared",
+	                test_buddy_icon_find_async_shared);
+
+	ret = g_test_run();
+
+	purple_account_manager_remove(manager, account);
+	g_clear_object(&account);
+
+	dir = g_dir_open(cache_dir, 0, NULL);
+	if(dir != NULL) {
+		while((name = g_dir_read_name(dir)) != NULL) {
+			gchar *path = g_build_filename(cache_dir, name, NULL);
+
+			g_remove(path);
+			g_free(path);
+		}
+		g_dir_close(dir);
+	}
+	g_rmdir(cache_dir);
+	g_free(cache_dir);
+
+	return ret;
+}
@@ -0,0 +1,442 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <purple.h>
+
+#include "test_ui.h"
+
+/* These mirror BLIST_JOURNAL_FILENAME and BLIST_JOURNAL_MIN_ENTRIES in
+ * buddylist.c. */
+#define TEST_BUDDY_LIST_JOURNAL "blist-journal.xml"
+#define TEST_BUDDY_LIST_JOURNAL_MIN_ENTRIES (1000)
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static gchar *user_dir = NULL;
+static PurpleAccount *account = NULL;
+
+/* Unloading the buddy list writes out anything that's pending, so this is
+ * the same as quitting and starting again. */
+static void
+test_buddy_list_reload(void) {
+	purple_blist_uninit();
+	purple_blist_init();
+	purple_blist_boot();
+}
+
+static void
+test_buddy_list_setup(void) {
+	GError *error = NULL;
+
+	user_dir = g_dir_make_tmp("purple-test-buddy-list-XXXXXX", &error);
+	g_assert_no_error(error);
+	purple_util_set_user_dir(user_dir);
+
+	test_buddy_list_reload();
+}
+
+static void
+test_buddy_list_teardown(void) {
+	gchar *path = NULL;
+
+	purple_blist_uninit();
+
+	path = g_build_filename(purple_config_dir(), "blist.xml", NULL);
+	g_remove(path);
+	g_free(path);
+
+	path = g_build_filename(purple_config_dir(), TEST_BUDDY_LIST_JOURNAL,
+	                        NULL);
+	g_remove(path);
+	g_free(path);
+
+	g_rmdir(purple_config_dir());
+	g_rmdir(user_dir);
+	g_clear_pointer(&user_dir, g_free);
+
+	purple_util_set_user_dir(NULL);
+}
+
+/* Adds a group called Friends with alice in it and writes it out, so that
+ * blist.xml exists and there's no journal. */
+static void
+test_buddy_list_populate(void) {
+	PurpleGroup *group = NULL;
+	PurpleBuddy *buddy = NULL;
+
+	group = purple_group_new("Friends");
+	purple_blist_add_group(group, NULL);
+
+	buddy = purple_buddy_new(account, "alice", NULL);
+	purple_blist_add_buddy(buddy, NULL, group, NULL);
+
+	test_buddy_list_reload();
+}
+
+static PurpleBlistNode *
+test_buddy_list_find_alice(void) {
+	PurpleBuddy *buddy = purple_blist_find_buddy(account, "alice");
+
+	g_assert_nonnull(buddy);
+
+	return PURPLE_BLIST_NODE(buddy);
+}
+
+static PurpleBlistNode *
+test_buddy_list_find_friends(void) {
+	PurpleGroup *group = purple_blist_find_group("Friends");
+
+	g_assert_nonnull(group);
+
+	return PURPLE_BLIST_NODE(group);
+}
+
+static guint
+test_buddy_list_get_generation(void) {
+	PurpleXmlNode *node = NULL;
+	const gchar *generation = NULL;
+	guint ret;
+
+	node = purple_util_read_xml_from_config_file("blist.xml", "buddy list");
+	g_assert_nonnull(node);
+
+	generation = purple_xmlnode_get_attrib(node, "generation");
+	g_assert_nonnull(generation);
+	ret = strtoul(generation, NULL, 10);
+
+	purple_xmlnode_free(node);
+
+	return ret;
+}
+
+static gchar *
+test_buddy_list_journal_path(void) {
+	return g_build_filename(purple_config_dir(), TEST_BUDDY_LIST_JOURNAL,
+	                        NULL);
+}
+
+/* Returns the number of records in the journal, not counting its header, or
+ * -1 if there isn't one. */
+static gint
+test_buddy_list_journal_records(void) {
+	gchar *path = test_buddy_list_journal_path();
+	gchar *contents = NULL;
+	gchar **lines = NULL;
+	gint records = 0;
+
+	if(!g_file_get_contents(path, &contents, NULL, NULL)) {
+		g_free(path);
+
+		return -1;
+	}
+	g_free(path);
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_assert_nonnull(lines[0]);
+	g_assert_true(g_str_has_prefix(lines[0], "<journal "));
+	for(guint i = 1; lines[i] != NULL; i++) {
+		if(*lines[i] != '\0') {
+			records++;
+		}
+	}
+
+	g_strfreev(lines);
+	g_free(contents);
+
+	return records;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_buddy_list_journal_replay(void) {
+	guint generation;
+
+	test_buddy_list_setup();
+	test_buddy_list_populate();
+
+	generation = test_buddy_list_get_generation();
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, -1);
+
+	purple_blist_node_set_string(test_buddy_list_find_alice(), "note",
+	                             "first");
+	purple_buddy_set_local_alias(PURPLE_BUDDY(test_buddy_list_find_alice()),
+	                             "Alice");
+	purple_blist_node_set_string(test_buddy_list_find_friends(), "color",
+	                             "red");
+	test_buddy_list_reload();
+
+	/* Both changes to alice are in a single record and blist.xml wasn't
+	 * touched. */
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, 2);
+
+	g_assert_cmpstr(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                             "note"),
+	                ==, "first");
+	g_assert_cmpstr(purple_buddy_get_local_alias(
+	                    PURPLE_BUDDY(test_buddy_list_find_alice())),
+	                ==, "Alice");
+	g_assert_cmpstr(purple_blist_node_get_string(test_buddy_list_find_friends(),
+	                                             "color"),
+	                ==, "red");
+
+	/* Removing a setting is journaled too, and later records win. */
+	purple_blist_node_remove_setting(test_buddy_list_find_alice(), "note");
+	test_buddy_list_reload();
+
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, 3);
+	g_assert_null(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                           "note"));
+	g_assert_cmpstr(purple_blist_node_get_string(test_buddy_list_find_friends(),
+	                                             "color"),
+	                ==, "red");
+
+	test_buddy_list_teardown();
+}
+
+static void
+test_buddy_list_journal_stale(void) {
+	gchar *path = NULL, *contents = NULL, *header = NULL, *stale = NULL;
+	guint generation;
+
+	test_buddy_list_setup();
+	test_buddy_list_populate();
+
+	generation = test_buddy_list_get_generation();
+
+	purple_blist_node_set_string(test_buddy_list_find_alice(), "note",
+	                             "first");
+	test_buddy_list_reload();
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, 1);
+
+	/* Make it look like it was left behind for an older blist.xml. */
+	path = test_buddy_list_journal_path();
+	g_assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+	header = g_strdup_printf("<journal generation='%u'/>", generation - 1);
+	stale = g_strconcat(header, strchr(contents, '\n'), NULL);
+	g_assert_true(g_file_set_contents(path, stale, -1, NULL));
+
+	test_buddy_list_reload();
+	g_assert_null(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                           "note"));
+
+	/* Ignoring it means blist.xml is rewritten, which removes it. */
+	test_buddy_list_reload();
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation + 1);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, -1);
+	g_assert_null(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                           "note"));
+
+	g_free(path);
+	g_free(contents);
+	g_free(header);
+	g_free(stale);
+
+	test_buddy_list_teardown();
+}
+
+static void
+test_buddy_list_journal_truncated(void) {
+	gchar *path = NULL, *contents = NULL;
+	gsize length = 0;
+	guint generation;
+
+	test_buddy_list_setup();
+	test_buddy_list_populate();
+
+	generation = test_buddy_list_get_generation();
+
+	purple_blist_node_set_string(test_buddy_list_find_alice(), "note",
+	                             "first");
+	test_buddy_list_reload();
+	purple_blist_node_set_string(test_buddy_list_find_friends(), "color",
+	                             "red");
+	test_buddy_list_reload();
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, 2);
+
+	/* Cut the last record off part way through, like a crash while it was
+	 * being appended would. */
+	path = test_buddy_list_journal_path();
+	g_assert_true(g_file_get_contents(path, &contents, &length, NULL));
+	g_assert_cmpuint(length, >, 4);
+	g_assert_true(g_file_set_contents(path, contents, length - 4, NULL));
+
+	/* Everything up to the damaged record is still replayed. */
+	test_buddy_list_reload();
+	g_assert_cmpstr(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                             "note"),
+	                ==, "first");
+	g_assert_null(purple_blist_node_get_string(test_buddy_list_find_friends(),
+	                                           "color"));
+
+	/* And written into blist.xml, since the journal can't be appended to. */
+	test_buddy_list_reload();
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation + 1);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, -1);
+	g_assert_cmpstr(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                             "note"),
+	                ==, "first");
+
+	g_free(path);
+	g_free(contents);
+
+	test_buddy_list_teardown();
+}
+
+static void
+test_buddy_list_journal_structural(void) {
+	PurpleBuddy *buddy = NULL;
+	guint generation;
+
+	test_buddy_list_setup();
+	test_buddy_list_populate();
+
+	generation = test_buddy_list_get_generation();
+
+	/* A new buddy can't be journaled, which takes anything else that was
+	 * pending with it into blist.xml. */
+	purple_blist_node_set_string(test_buddy_list_find_alice(), "note",
+	                             "first");
+	buddy = purple_buddy_new(account, "bob", NULL);
+	purple_blist_add_buddy(buddy, NULL,
+	                       PURPLE_GROUP(test_buddy_list_find_friends()), NULL);
+	test_buddy_list_reload();
+
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation + 1);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, -1);
+	g_assert_nonnull(purple_blist_find_buddy(account, "bob"));
+	g_assert_cmpstr(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                             "note"),
+	                ==, "first");
+
+	/* Removing one after something was journaled replaces the journal. */
+	purple_blist_node_set_string(test_buddy_list_find_alice(), "note",
+	                             "second");
+	test_buddy_list_reload();
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation + 1);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, 1);
+
+	purple_blist_remove_buddy(purple_blist_find_buddy(account, "bob"));
+	test_buddy_list_reload();
+
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation + 2);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, -1);
+	g_assert_null(purple_blist_find_buddy(account, "bob"));
+	g_assert_cmpstr(purple_blist_node_get_string(test_buddy_list_find_alice(),
+	                                             "note"),
+	                ==, "second");
+
+	test_buddy_list_teardown();
+}
+
+static void
+test_buddy_list_journal_compaction(void) {
+	guint generation;
+
+	test_buddy_list_setup();
+
+	for(guint i = 0; i < TEST_BUDDY_LIST_JOURNAL_MIN_ENTRIES; i++) {
+		gchar *name = g_strdup_printf("group%u", i);
+
+		purple_blist_add_group(purple_group_new(name), NULL);
+		g_free(name);
+	}
+	test_buddy_list_reload();
+
+	generation = test_buddy_list_get_generation();
+
+	/* The journal can hold exactly the minimum number of records. */
+	for(guint i = 0; i < TEST_BUDDY_LIST_JOURNAL_MIN_ENTRIES; i++) {
+		gchar *name = g_strdup_printf("group%u", i);
+
+		purple_blist_node_set_string(
+			PURPLE_BLIST_NODE(purple_blist_find_group(name)), "color", "red");
+		g_free(name);
+	}
+	test_buddy_list_reload();
+
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==,
+	                TEST_BUDDY_LIST_JOURNAL_MIN_ENTRIES);
+
+	/* One more compacts it into blist.xml. */
+	purple_blist_node_set_string(
+		PURPLE_BLIST_NODE(purple_blist_find_group("group0")), "color",
+		"blue");
+	test_buddy_list_reload();
+
+	g_assert_cmpuint(test_buddy_list_get_generation(), ==, generation + 1);
+	g_assert_cmpint(test_buddy_list_journal_records(), ==, -1);
+	g_assert_cmpstr(purple_blist_node_get_string(
+	                    PURPLE_BLIST_NODE(purple_blist_find_group("group0")),
+	                    "color"),
+	                ==, "blue");
+	g_assert_cmpstr(purple_blist_node_get_string(
+	                    PURPLE_BLIST_NODE(purple_blist_find_group("group1")),
+	                    "color"),
+	                ==, "red");
+
+	test_buddy_list_teardown();
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	PurpleAccountManager *manager = NULL;
+	gint ret;
+
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+	/* The buddy list only keeps buddies of accounts the manager knows about
+	 * when it's loaded. */
+	manager = purple_account_manager_get_default();
+	account = purple_account_new("test", "test");
+	purple_account_manager_add(manager, account);
+
+	g_test_add_func("/buddy-list/journal/replay",
+	                test_buddy_list_journal_replay);
+	g_test_add_func("/buddy-list/journal/stale",
+	                test_buddy_list_journal_stale);
+	g_test_add_func("/buddy-list/journal/truncated",
+	                test_buddy_list_journal_truncated);
+	g_test_add_func("/buddy-list/journal/structural",
+	                test_buddy_list_journal_structural);
+	g_test_add_func("/buddy-list/journal/compaction",
+	                test_buddy_list_journal_compaction);
+
+	ret = g_test_run();
+
+	purple_account_manager_remove(manager, account);
+	g_clear_object(&account);
+
+	return ret;
+}
@@ -0,0 +1,484 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include <purple.h>
+
+#include "test_ui.h"
+
+/******************************************************************************
+ * TestPurpleProtocolChat Implementation
+ *****************************************************************************/
+static GType test_purple_protocol_chat_get_type(void);
+
+typedef struct {
+	PurpleProtocol parent;
+
+	gboolean case_insensitive;
+} TestPurpleProtocolChat;
+
+typedef struct {
+	PurpleProtocolClass parent;
+} TestPurpleProtocolChatClass;
+
+static gchar *
+test_purple_protocol_chat_get_user_key(PurpleProtocolChat *protocol_chat,
+                                       const gchar *who)
+{
+	TestPurpleProtocolChat *test_chat = (TestPurpleProtocolChat *)protocol_chat;
+
+	if(!test_chat->case_insensitive) {
+		return NULL;
+	}
+
+	return g_ascii_strdown(who, -1);
+}
+
+static void
+test_purple_protocol_chat_iface_init(PurpleProtocolChatInterface *iface) {
+	iface->get_user_key = test_purple_protocol_chat_get_user_key;
+}
+
+G_DEFINE_TYPE_WITH_CODE(
+	TestPurpleProtocolChat,
+	test_purple_protocol_chat,
+	PURPLE_TYPE_PROTOCOL,
+	G_IMPLEMENT_INTERFACE(
+		PURPLE_TYPE_PROTOCOL_CHAT,
+		test_purple_protocol_chat_iface_init
+	)
+);
+
+static void
+test_purple_protocol_chat_init(TestPurpleProtocolChat *protocol_chat) {
+}
+
+static void
+test_purple_protocol_chat_class_init(TestPurpleProtocolChatClass *klass) {
+}
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static TestPurpleProtocolChat *protocol = NULL;
+static PurpleAccount *account = NULL;
+static PurpleConnection *connection = NULL;
+
+static gpointer
+test_purple_chat_conversation_quiet(G_GNUC_UNUSED PurpleChatConversation *chat,
+                                    G_GNUC_UNUSED const gchar *user,
+                                    G_GNUC_UNUSED gpointer data)
+{
+	/* Keep joins and parts from writing system messages. */
+	return GINT_TO_POINTER(TRUE);
+}
+
+static PurpleChatConversation *
+test_purple_chat_conversation_new(gboolean case_insensitive) {
+	protocol->case_insensitive = case_insensitive;
+
+	return g_object_new(PURPLE_TYPE_CHAT_CONVERSATION,
+	                    "account", account,
+	                    "name", "#pidgin",
+	                    NULL);
+}
+
+static void
+test_purple_chat_conversation_free(PurpleChatConversation *chat) {
+	PurpleConversationManager *manager = NULL;
+
+	purple_chat_conversation_leave(chat);
+
+	manager = purple_conversation_manager_get_default();
+	purple_conversation_manager_unregister(manager, PURPLE_CONVERSATION(chat));
+
+	g_object_unref(chat);
+}
+
+typedef struct {
+	guint emitted;
+	guint users;
+} TestPurpleChatConversationBulkData;
+
+static void
+test_purple_chat_conversation_users_joined_cb(G_GNUC_UNUSED PurpleChatConversation *chat,
+                                              GList *users, gpointer data)
+{
+	TestPurpleChatConversationBulkData *bulk_data = data;
+
+	bulk_data->emitted++;
+	bulk_data->users += g_list_length(users);
+}
+
+static void
+test_purple_chat_conversation_users_left_cb(G_GNUC_UNUSED PurpleChatConversation *chat,
+                                            GList *names,
+                                            G_GNUC_UNUSED const gchar *reason,
+                                            gpointer data)
+{
+	TestPurpleChatConversationBulkData *bulk_data = data;
+
+	bulk_data->emitted++;
+	bulk_data->users += g_list_length(names);
+}
+
+typedef struct {
+	guint renamed;
+	PurpleChatUser *old_user;
+	PurpleChatUser *new_user;
+} TestPurpleChatConversationRenameData;
+
+static TestPurpleChatConversationRenameData rename_data;
+
+static void
+test_purple_chat_conversation_rename_user_cb(PurpleChatConversation *chat,
+                                             const gchar *old_name,
+                                             const gchar *new_name,
+                                             G_GNUC_UNUSED const gchar *new_alias)
+{
+	rename_data.renamed++;
+	rename_data.old_user = purple_chat_conversation_find_user(chat, old_name);
+	rename_data.new_user = purple_chat_conversation_find_user(chat, new_name);
+}
+
+static PurpleConversationUiOps test_purple_chat_conversation_ui_ops = {
+	.chat_rename_user = test_purple_chat_conversation_rename_user_cb,
+};
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_purple_chat_conversation_users(void) {
+	PurpleChatConversation *chat = test_purple_chat_conversation_new(FALSE);
+
+	purple_chat_conversation_add_user(chat, "Alice", NULL,
+	                                  PURPLE_CHAT_USER_NONE, FALSE);
+	purple_chat_conversation_add_user(chat, "bob", NULL, PURPLE_CHAT_USER_OP,
+	                                  FALSE);
+
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 2);
+	g_assert_cmpstr(purple_chat_user_get_name(
+		purple_chat_conversation_find_user(chat, "Alice")), ==, "Alice");
+	g_assert_null(purple_chat_conversation_find_user(chat, "alice"));
+
+	/* Renaming keeps the flags and drops the old name. */
+	purple_chat_conversation_rename_user(chat, "bob", "robert");
+	g_assert_null(purple_chat_conversation_find_user(chat, "bob"));
+	g_assert_cmpint(purple_chat_user_get_flags(
+		purple_chat_conversation_find_user(chat, "robert")), ==,
+		PURPLE_CHAT_USER_OP);
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 2);
+
+	purple_chat_conversation_remove_user(chat, "Alice", NULL);
+	g_assert_false(purple_chat_conversation_has_user(chat, "Alice"));
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 1);
+
+	purple_chat_conversation_clear_users(chat);
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 0);
+
+	test_purple_chat_conversation_free(chat);
+}
+
+static void
+test_purple_chat_conversation_users_protocol_key(void) {
+	PurpleChatConversation *chat = test_purple_chat_conversation_new(TRUE);
+	PurpleChatUser *chat_user = NULL;
+
+	purple_chat_conversation_add_user(chat, "Alice", NULL,
+	                                  PURPLE_CHAT_USER_NONE, FALSE);
+
+	/* The protocol says names are case insensitive. */
+	chat_user = purple_chat_conversation_find_user(chat, "ALICE");
+	g_assert_nonnull(chat_user);
+	g_assert_cmpstr(purple_chat_user_get_name(chat_user), ==, "Alice");
+
+	/* A rename that only changes the case has to keep the user around. */
+	purple_chat_conversation_rename_user(chat, "Alice", "alice");
+	chat_user = purple_chat_conversation_find_user(chat, "Alice");
+	g_assert_nonnull(chat_user);
+	g_assert_cmpstr(purple_chat_user_get_name(chat_user), ==, "alice");
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 1);
+
+	purple_chat_conversation_remove_user(chat, "ALICE", NULL);
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 0);
+
+	test_purple_chat_conversation_free(chat);
+}
+
+static void
+test_purple_chat_conversation_users_protocol_key_ui(void) {
+	PurpleChatConversation *chat = test_purple_chat_conversation_new(TRUE);
+	PurpleChatUser *chat_user = NULL;
+
+	rename_data.renamed = 0;
+	rename_data.old_user = NULL;
+	rename_data.new_user = NULL;
+	purple_conversation_set_ui_ops(PURPLE_CONVERSATION(chat),
+	                               &test_purple_chat_conversation_ui_ops);
+
+	purple_chat_conversation_add_user(chat, "alice", NULL,
+	                                  PURPLE_CHAT_USER_VOICE, FALSE);
+	chat_user = purple_chat_conversation_find_user(chat, "alice");
+
+	/* The UI has to be able to find the user it already knows about under
+	 * the old name, and the same user under the new one.
+	 */
+	purple_chat_conversation_rename_user(chat, "alice", "Alice");
+	g_assert_cmpuint(rename_data.renamed, ==, 1);
+	g_assert_true(rename_data.old_user == chat_user);
+	g_assert_true(rename_data.new_user == chat_user);
+
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 1);
+	g_assert_true(purple_chat_conversation_find_user(chat, "ALICE") ==
+	              chat_user);
+	g_assert_cmpstr(purple_chat_user_get_name(chat_user), ==, "Alice");
+	g_assert_cmpint(purple_chat_user_get_flags(chat_user), ==,
+	                PURPLE_CHAT_USER_VOICE);
+
+	purple_conversation_set_ui_ops(PURPLE_CONVERSATION(chat), NULL);
+	test_purple_chat_conversation_free(chat);
+}
+
+static void
+test_purple_chat_conversation_users_bulk(void) {
+	PurpleChatConversation *chat = test_purple_chat_conversation_new(TRUE);
+	const gchar *users[] = { "Alice", "bob", "Carol" };
+	const gchar *remove[] = { "ALICE", "carol", "dave" };
+	PurpleChatUserFlags flags[] = {
+		PURPLE_CHAT_USER_OP, PURPLE_CHAT_USER_NONE, PURPLE_CHAT_USER_VOICE
+	};
+	TestPurpleChatConversationBulkData joined = {0, 0}, left = {0, 0};
+
+	purple_signal_connect(purple_conversations_get_handle(),
+	                      "chat-users-joined", chat,
+	                      G_CALLBACK(test_purple_chat_conversation_users_joined_cb),
+	                      &joined);
+	purple_signal_connect(purple_conversations_get_handle(),
+	                      "chat-users-left", chat,
+	                      G_CALLBACK(test_purple_chat_conversation_users_left_cb),
+	                      &left);
+
+	purple_chat_conversation_add_users_bulk(chat, users, flags,
+	                                        G_N_ELEMENTS(users));
+
+	/* One emission for all three users. */
+	g_assert_cmpuint(joined.emitted, ==, 1);
+	g_assert_cmpuint(joined.users, ==, 3);
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 3);
+	g_assert_cmpint(purple_chat_user_get_flags(
+		purple_chat_conversation_find_user(chat, "alice")), ==,
+		PURPLE_CHAT_USER_OP);
+	g_assert_cmpint(purple_chat_user_get_flags(
+		purple_chat_conversation_find_user(chat, "Carol")), ==,
+		PURPLE_CHAT_USER_VOICE);
+	g_assert_false(purple_chat_user_is_buddy(
+		purple_chat_conversation_find_user(chat, "bob")));
+
+	/* Users that aren't in the chat are skipped. */
+	purple_chat_conversation_remove_users_bulk(chat, remove,
+	                                           G_N_ELEMENTS(remove), NULL);
+	g_assert_cmpuint(left.emitted, ==, 1);
+	g_assert_cmpuint(left.users, ==, 2);
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 1);
+	g_assert_true(purple_chat_conversation_has_user(chat, "bob"));
+
+	purple_signals_disconnect_by_handle(chat);
+
+	test_purple_chat_conversation_free(chat);
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_PURPLE_CHAT_CONVERSATION_PERF_USERS (10000)
+
+/* This is how the users table was keyed before each user kept its key. */
+static guint
+test_purple_chat_conversation_collate_hash(gconstpointer data) {
+	gchar *collated = g_utf8_collate_key((const gchar *)data, -1);
+	guint hash = g_str_hash(collated);
+
+	g_free(collated);
+
+	return hash;
+}
+
+static gboolean
+test_purple_chat_conversation_collate_equal(gconstpointer a, gconstpointer b) {
+	return !g_utf8_collate(a, b);
+}
+
+static gdouble
+test_purple_chat_conversation_perf_add_remove(gboolean case_insensitive,
+                                              GList *names, GList *flags)
+{
+	PurpleChatConversation *chat = NULL;
+	gdouble elapsed = 0.0;
+
+	chat = test_purple_chat_conversation_new(case_insensitive);
+
+	g_test_timer_start();
+	purple_chat_conversation_add_users(chat, names, NULL, flags, FALSE);
+	for(GList *l = names; l != NULL; l = l->next) {
+		g_assert_true(purple_chat_conversation_has_user(chat, l->data));
+	}
+	purple_chat_conversation_remove_users(chat, names, NULL);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 0);
+
+	test_purple_chat_conversation_free(chat);
+
+	return elapsed;
+}
+
+static gdouble
+test_purple_chat_conversation_perf_add_remove_bulk(const gchar **names,
+                                                   PurpleChatUserFlags *flags,
+                                                   guint n)
+{
+	PurpleChatConversation *chat = NULL;
+	gdouble elapsed = 0.0;
+
+	chat = test_purple_chat_conversation_new(TRUE);
+
+	g_test_timer_start();
+	purple_chat_conversation_add_users_bulk(chat, names, flags, n);
+	for(guint i = 0; i < n; i++) {
+		g_assert_true(purple_chat_conversation_has_user(chat, names[i]));
+	}
+	purple_chat_conversation_remove_users_bulk(chat, names, n, NULL);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(purple_chat_conversation_get_users_count(chat), ==, 0);
+
+	test_purple_chat_conversation_free(chat);
+
+	return elapsed;
+}
+
+static void
+test_purple_chat_conversation_perf_users(void) {
+	GHashTable *table = NULL;
+	GList *names = NULL, *flags = NULL;
+	gdouble collated = 0.0, cached = 0.0, protocol_key = 0.0, bulk = 0.0;
+	guint n = TEST_PURPLE_CHAT_CONVERSATION_PERF_USERS;
+	const gchar **bulk_names = g_new(const gchar *, n);
+	PurpleChatUserFlags *bulk_flags = g_new0(PurpleChatUserFlags, n);
+	guint i = 0;
+
+	for(i = 0; i < n; i++) {
+		names = g_list_prepend(names, g_strdup_printf("User%u", i));
+		flags = g_list_prepend(flags, GINT_TO_POINTER(PURPLE_CHAT_USER_NONE));
+	}
+	i = 0;
+	for(GList *l = names; l != NULL; l = l->next) {
+		bulk_names[i++] = l->data;
+	}
+
+	/* Just the table operations as they used to be done. */
+	table = g_hash_table_new_full(test_purple_chat_conversation_collate_hash,
+	                              test_purple_chat_conversation_collate_equal,
+	                              g_free, NULL);
+	g_test_timer_start();
+	for(GList *l = names; l != NULL; l = l->next) {
+		g_hash_table_replace(table, g_strdup(l->data), l->data);
+	}
+	for(GList *l = names; l != NULL; l = l->next) {
+		g_assert_nonnull(g_hash_table_lookup(table, l->data));
+	}
+	for(GList *l = names; l != NULL; l = l->next) {
+		g_hash_table_remove(table, l->data);
+	}
+	collated = g_test_timer_elapsed();
+	g_hash_table_destroy(table);
+
+	cached = test_purple_chat_conversation_perf_add_remove(FALSE, names,
+	                                                       flags);
+	protocol_key = test_purple_chat_conversation_perf_add_remove(TRUE, names,
+	                                                             flags);
+	bulk = test_purple_chat_conversation_perf_add_remove_bulk(bulk_names,
+	                                                          bulk_flags, n);
+
+	g_test_message("%u users added, found and removed from a table keyed by "
+	               "collation in %f seconds", n, collated);
+	g_test_message("%u users added, found and removed with cached collation "
+	               "keys in %f seconds", n, cached);
+	g_test_message("%u users added, found and removed with protocol keys in "
+	               "%f seconds", n, protocol_key);
+	g_test_minimized_result(bulk,
+	                        "%u users added, found and removed in bulk with "
+	                        "protocol keys in %f seconds", n, bulk);
+
+	g_free(bulk_names);
+	g_free(bulk_flags);
+	g_list_free_full(names, g_free);
+	g_list_free(flags);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	gint ret = 0;
+
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+	protocol = g_object_new(test_purple_protocol_chat_get_type(),
+	                        "id", "prpl-chat-conversation-test",
+	                        NULL);
+	account = purple_account_new("test", "prpl-chat-conversation-test");
+	connection = g_object_new(PURPLE_TYPE_CONNECTION,
+	                          "account", account,
+	                          "protocol", protocol,
+	                          NULL);
+
+	purple_signal_connect(purple_conversations_get_handle(),
+	                      "chat-user-joining", protocol,
+	                      G_CALLBACK(test_purple_chat_conversation_quiet),
+	                      NULL);
+	purple_signal_connect(purple_conversations_get_handle(),
+	                      "chat-user-leaving", protocol,
+	                      G_CALLBACK(test_purple_chat_conversation_quiet),
+	                      NULL);
+
+	g_test_add_func("/chat-conversation/users",
+	                test_purple_chat_conversation_users);
+	g_test_add_func("/chat-conversation/users/protocol-key",
+	                test_purple_chat_conversation_users_protocol_key);
+	g_test_add_func("/chat-conversation/users/protocol-key/ui",
+	                test_purple_chat_conversation_users_protocol_key_ui);
+	g_test_add_func("/chat-conversation/users/bulk",
+	                test_purple_chat_conversation_users_bulk);
+
+	if(g_test_perf()) {
+		g_test_add_func("/chat-conversation/perf/users",
+		                test_purple_chat_conversation_perf_users);
+	}
+
+	ret = g_test_run();
+
+	purple_signals_disconnect_by_handle(protocol);
+
+	return ret;
+}
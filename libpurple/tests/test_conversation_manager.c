@@ -0,0 +1,369 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include <purple.h>
+
+#include "test_ui.h"
+
+/******************************************************************************
+ * Register/Unregister Tests
+ *****************************************************************************/
+static void
+test_purple_conversation_manager_signal_called(G_GNUC_UNUSED PurpleConversationManager *manager,
+                                               G_GNUC_UNUSED PurpleConversation *conversation,
+                                               gpointer data)
+{
+	gboolean *called = data;
+
+	*called = TRUE;
+}
+
+static void
+test_purple_conversation_manager_register_unregister(void) {
+	PurpleAccount *account = NULL;
+	PurpleConversation *conversation = NULL;
+	PurpleConversationManager *manager = NULL;
+	gboolean signal_called = FALSE;
+
+	manager = g_object_new(PURPLE_TYPE_CONVERSATION_MANAGER, NULL);
+	account = purple_account_new("test", "test");
+	conversation = g_object_new(PURPLE_TYPE_IM_CONVERSATION,
+	                            "account", account,
+	                            "name", "pidgy",
+	                            NULL);
+
+	g_signal_connect(manager, "registered",
+	                 G_CALLBACK(test_purple_conversation_manager_signal_called),
+	                 &signal_called);
+	g_signal_connect(manager, "unregistered",
+	                 G_CALLBACK(test_purple_conversation_manager_signal_called),
+	                 &signal_called);
+
+	g_assert_true(purple_conversation_manager_register(manager, conversation));
+	g_assert_true(signal_called);
+	g_assert_true(purple_conversation_manager_is_registered(manager,
+	                                                        conversation));
+
+	/* Registering a second time should fail without emitting the signal. */
+	signal_called = FALSE;
+	g_assert_false(purple_conversation_manager_register(manager,
+	                                                    conversation));
+	g_assert_false(signal_called);
+
+	g_assert_true(purple_conversation_manager_unregister(manager,
+	                                                     conversation));
+	g_assert_true(signal_called);
+	g_assert_false(purple_conversation_manager_is_registered(manager,
+	                                                         conversation));
+	g_assert_null(purple_conversation_manager_find(manager, account,
+	                                               "pidgy"));
+
+	/* Cleanup */
+	g_clear_object(&conversation);
+	g_clear_object(&account);
+	g_clear_object(&manager);
+}
+
+/******************************************************************************
+ * Find Tests
+ *****************************************************************************/
+static void
+test_purple_conversation_manager_find(void) {
+	PurpleAccount *account1 = NULL, *account2 = NULL;
+	PurpleConversation *im = NULL, *chat = NULL;
+	PurpleConversationManager *manager = NULL;
+
+	manager = g_object_new(PURPLE_TYPE_CONVERSATION_MANAGER, NULL);
+	account1 = purple_account_new("test1", "test");
+	account2 = purple_account_new("test2", "test");
+
+	im = g_object_new(PURPLE_TYPE_IM_CONVERSATION,
+	                  "account", account1,
+	                  "name", "pidgy",
+	                  NULL);
+	chat = g_object_new(PURPLE_TYPE_CHAT_CONVERSATION,
+	                    "account", account1,
+	                    "name", "#pidgin",
+	                    "chat-id", 42,
+	                    NULL);
+
+	purple_conversation_manager_register(manager, im);
+	purple_conversation_manager_register(manager, chat);
+
+	g_assert_true(purple_conversation_manager_find(manager, account1,
+	                                               "pidgy") == im);
+	g_assert_true(purple_conversation_manager_find(manager, account1,
+	                                               "#pidgin") == chat);
+	g_assert_true(purple_conversation_manager_find_im(manager, account1,
+	                                                  "pidgy") == im);
+	g_assert_true(purple_conversation_manager_find_chat(manager, account1,
+	                                                    "#pidgin") == chat);
+	g_assert_true(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account1,
+	                                                          42) == chat);
+
+	/* The wrong type, the wrong id, or the wrong account shouldn't match. */
+	g_assert_null(purple_conversation_manager_find_im(manager, account1,
+	                                                  "#pidgin"));
+	g_assert_null(purple_conversation_manager_find_chat(manager, account1,
+	                                                    "pidgy"));
+	g_assert_null(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account1, 7));
+	g_assert_null(purple_conversation_manager_find(manager, account2,
+	                                               "pidgy"));
+	g_assert_null(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account2, 42));
+
+	/* Cleanup */
+	purple_conversation_manager_unregister(manager, im);
+	purple_conversation_manager_unregister(manager, chat);
+
+	g_clear_object(&im);
+	g_clear_object(&chat);
+	g_clear_object(&account1);
+	g_clear_object(&account2);
+	g_clear_object(&manager);
+}
+
+static void
+test_purple_conversation_manager_find_after_change(void) {
+	PurpleAccount *account = NULL;
+	PurpleConversation *chat = NULL;
+	PurpleConversationManager *manager = NULL;
+
+	manager = g_object_new(PURPLE_TYPE_CONVERSATION_MANAGER, NULL);
+	account = purple_account_new("test", "test");
+	chat = g_object_new(PURPLE_TYPE_CHAT_CONVERSATION,
+	                    "account", account,
+	                    "name", "#pidgin",
+	                    "chat-id", 1,
+	                    NULL);
+
+	purple_conversation_manager_register(manager, chat);
+
+	/* Renaming the conversation should move it in the index. */
+	purple_conversation_set_name(chat, "#finch");
+	g_assert_null(purple_conversation_manager_find_chat(manager, account,
+	                                                    "#pidgin"));
+	g_assert_true(purple_conversation_manager_find_chat(manager, account,
+	                                                    "#finch") == chat);
+
+	/* As should changing the chat id. */
+	purple_chat_conversation_set_id(PURPLE_CHAT_CONVERSATION(chat), 2);
+	g_assert_null(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account, 1));
+	g_assert_true(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account,
+	                                                          2) == chat);
+
+	/* Once unregistered, changes should no longer be tracked. */
+	purple_conversation_manager_unregister(manager, chat);
+	purple_conversation_set_name(chat, "#pidgin");
+	g_assert_null(purple_conversation_manager_find_chat(manager, account,
+	                                                    "#pidgin"));
+
+	/* Cleanup */
+	g_clear_object(&chat);
+	g_clear_object(&account);
+	g_clear_object(&manager);
+}
+
+static void
+test_purple_conversation_manager_find_shared_key(void) {
+	PurpleAccount *account = NULL;
+	PurpleConversation *chat1 = NULL, *chat2 = NULL;
+	PurpleConversationManager *manager = NULL;
+
+	manager = g_object_new(PURPLE_TYPE_CONVERSATION_MANAGER, NULL);
+	account = purple_account_new("test", "test");
+	chat1 = g_object_new(PURPLE_TYPE_CHAT_CONVERSATION,
+	                     "account", account,
+	                     "name", "#pidgin",
+	                     "chat-id", 1,
+	                     NULL);
+	chat2 = g_object_new(PURPLE_TYPE_CHAT_CONVERSATION,
+	                     "account", account,
+	                     "name", "#pidgin",
+	                     "chat-id", 1,
+	                     NULL);
+
+	purple_conversation_manager_register(manager, chat1);
+	purple_conversation_manager_register(manager, chat2);
+
+	/* The newest conversation wins. */
+	g_assert_true(purple_conversation_manager_find_chat(manager, account,
+	                                                    "#pidgin") == chat2);
+	g_assert_true(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account,
+	                                                          1) == chat2);
+
+	/* Removing it should make the older one findable again. */
+	purple_conversation_manager_unregister(manager, chat2);
+	g_assert_true(purple_conversation_manager_find_chat(manager, account,
+	                                                    "#pidgin") == chat1);
+	g_assert_true(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account,
+	                                                          1) == chat1);
+
+	/* Removing the shadowed one first must leave the newest one indexed. */
+	purple_conversation_manager_register(manager, chat2);
+	purple_conversation_manager_unregister(manager, chat1);
+	g_assert_true(purple_conversation_manager_find_chat(manager, account,
+	                                                    "#pidgin") == chat2);
+	g_assert_true(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account,
+	                                                          1) == chat2);
+
+	purple_conversation_manager_unregister(manager, chat2);
+	g_assert_null(purple_conversation_manager_find_chat(manager, account,
+	                                                    "#pidgin"));
+	g_assert_null(purple_conversation_manager_find_chat_by_id(manager,
+	                                                          account, 1));
+
+	/* Cleanup */
+	g_clear_object(&chat1);
+	g_clear_object(&chat2);
+	g_clear_object(&account);
+	g_clear_object(&manager);
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_PURPLE_CONVERSATION_MANAGER_PERF_CONVERSATIONS (10000)
+
+typedef struct {
+	PurpleAccount *account;
+	const gchar *name;
+	PurpleConversation *found;
+} TestPurpleConversationManagerScanData;
+
+/* This is how lookups were done before the manager kept an index. */
+static void
+test_purple_conversation_manager_scan_func(PurpleConversation *conversation,
+                                           gpointer data)
+{
+	TestPurpleConversationManagerScanData *scan_data = data;
+
+	if(scan_data->found != NULL ||
+	   !PURPLE_IS_IM_CONVERSATION(conversation) ||
+	   purple_conversation_get_account(conversation) != scan_data->account ||
+	   !purple_strequal(purple_conversation_get_name(conversation),
+	                    scan_data->name))
+	{
+		return;
+	}
+
+	scan_data->found = conversation;
+}
+
+static void
+test_purple_conversation_manager_perf_find_im(void) {
+	PurpleAccount *account = NULL;
+	PurpleConversationManager *manager = NULL;
+	GPtrArray *conversations = NULL;
+	gchar **names = NULL;
+	gdouble indexed = 0.0, scanned = 0.0;
+	guint n = TEST_PURPLE_CONVERSATION_MANAGER_PERF_CONVERSATIONS;
+
+	manager = g_object_new(PURPLE_TYPE_CONVERSATION_MANAGER, NULL);
+	account = purple_account_new("test", "test");
+	conversations = g_ptr_array_new_with_free_func(g_object_unref);
+	names = g_new0(gchar *, n + 1);
+
+	for(guint i = 0; i < n; i++) {
+		PurpleConversation *conversation = NULL;
+
+		names[i] = g_strdup_printf("buddy%u", i);
+		conversation = g_object_new(PURPLE_TYPE_IM_CONVERSATION,
+		                            "account", account,
+		                            "name", names[i],
+		                            NULL);
+		purple_conversation_manager_register(manager, conversation);
+		g_ptr_array_add(conversations, conversation);
+	}
+
+	g_test_timer_start();
+	for(guint i = 0; i < n; i++) {
+		PurpleConversation *found = NULL;
+
+		found = purple_conversation_manager_find_im(manager, account,
+		                                            names[i]);
+		g_assert_true(found == g_ptr_array_index(conversations, i));
+	}
+	indexed = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for(guint i = 0; i < n; i++) {
+		TestPurpleConversationManagerScanData data = {
+			.account = account,
+			.name = names[i],
+		};
+
+		purple_conversation_manager_foreach(manager,
+		                                    test_purple_conversation_manager_scan_func,
+		                                    &data);
+		g_assert_true(data.found == g_ptr_array_index(conversations, i));
+	}
+	scanned = g_test_timer_elapsed();
+
+	g_test_minimized_result(indexed,
+	                        "%u indexed find_im lookups in %f seconds", n,
+	                        indexed);
+	g_test_message("%u linear scan lookups in %f seconds", n, scanned);
+
+	/* Cleanup */
+	for(guint i = 0; i < n; i++) {
+		purple_conversation_manager_unregister(manager,
+		                                       g_ptr_array_index(conversations,
+		                                                         i));
+	}
+
+	g_ptr_array_free(conversations, TRUE);
+	g_strfreev(names);
+	g_clear_object(&account);
+	g_clear_object(&manager);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+	g_test_add_func("/conversation-manager/register-unregister",
+	                test_purple_conversation_manager_register_unregister);
+	g_test_add_func("/conversation-manager/find",
+	                test_purple_conversation_manager_find);
+	g_test_add_func("/conversation-manager/find/after-change",
+	                test_purple_conversation_manager_find_after_change);
+	g_test_add_func("/conversation-manager/find/shared-key",
+	                test_purple_conversation_manager_find_shared_key);
+
+	if(g_test_perf()) {
+		g_test_add_func("/conversation-manager/perf/find-im",
+		                test_purple_conversation_manager_perf_find_im);
+	}
+
+	return g_test_run();
+}
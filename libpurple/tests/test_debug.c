@@ -0,0 +1,135 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include <purple.h>
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static const gchar *
+test_purple_debug_count(guint *count) {
+	(*count)++;
+
+	return "counted";
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_purple_debug_enabled(void) {
+	/* Everything starts out enabled. */
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-a"));
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_FATAL, "test-a"));
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_MISC, NULL));
+
+	/* Disabling a level for one category doesn't affect the others. */
+	purple_debug_set_enabled("test-a", PURPLE_DEBUG_MISC, FALSE);
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-a"));
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_INFO, "test-a"));
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_ALL, "test-a"));
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-b"));
+
+	purple_debug_set_enabled("test-a", PURPLE_DEBUG_ALL, FALSE);
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_ALL, "test-a"));
+
+	/* The default applies to categories without their own settings. */
+	purple_debug_set_enabled(NULL, PURPLE_DEBUG_MISC, FALSE);
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-b"));
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_INFO, "test-b"));
+	purple_debug_set_enabled(NULL, PURPLE_DEBUG_MISC, TRUE);
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-b"));
+
+	/* Resetting goes back to the default. */
+	purple_debug_reset_enabled("test-a");
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-a"));
+}
+
+static void
+test_purple_debug_categories(void) {
+	GList *categories = NULL;
+
+	purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-z");
+	purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-y");
+
+	categories = purple_debug_get_categories();
+	g_assert_nonnull(g_list_find_custom(categories, "test-y",
+	                                    (GCompareFunc)g_strcmp0));
+	g_assert_true(g_list_find_custom(categories, "test-y",
+	                                 (GCompareFunc)g_strcmp0)->next ==
+	              g_list_find_custom(categories, "test-z",
+	                                 (GCompareFunc)g_strcmp0));
+
+	g_list_free_full(categories, g_free);
+}
+
+static void
+test_purple_debug_disabled(void) {
+	/* With debugging off everywhere, nothing is enabled. */
+	purple_debug_set_enabled(NULL, PURPLE_DEBUG_ALL, FALSE);
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_ERROR, "test-off"));
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_ERROR, NULL));
+
+	/* But a single category can still be turned on. */
+	purple_debug_set_enabled("test-on", PURPLE_DEBUG_ERROR, TRUE);
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_ERROR, "test-on"));
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_MISC, "test-on"));
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_ERROR, "test-off"));
+
+	purple_debug_reset_enabled("test-on");
+	g_assert_false(purple_debug_is_enabled(PURPLE_DEBUG_ERROR, "test-on"));
+
+	purple_debug_set_enabled(NULL, PURPLE_DEBUG_ALL, TRUE);
+	g_assert_true(purple_debug_is_enabled(PURPLE_DEBUG_ERROR, "test-off"));
+}
+
+static void
+test_purple_debug_lazy(void) {
+	guint count = 0;
+
+	purple_debug_set_enabled("test-lazy", PURPLE_DEBUG_MISC, FALSE);
+
+	/* The arguments shouldn't be evaluated for a disabled level... */
+	PURPLE_DEBUG_LAZY(PURPLE_DEBUG_MISC, "test-lazy", "%s\n",
+	                  test_purple_debug_count(&count));
+	g_assert_cmpuint(count, ==, 0);
+
+	/* ...but should be for an enabled one. */
+	PURPLE_DEBUG_LAZY(PURPLE_DEBUG_INFO, "test-lazy", "%s\n",
+	                  test_purple_debug_count(&count));
+	g_assert_cmpuint(count, ==, 1);
+
+	purple_debug_reset_enabled("test-lazy");
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/debug/enabled", test_purple_debug_enabled);
+	g_test_add_func("/debug/categories", test_purple_debug_categories);
+	g_test_add_func("/debug/disabled", test_purple_debug_disabled);
+	g_test_add_func("/debug/lazy", test_purple_debug_lazy);
+
+	return g_test_run();
+}
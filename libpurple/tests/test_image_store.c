@@ -0,0 +1,253 @@
+/*
+ * Purple
+ *
+ * Purple is the legal property of its developers, whose names are too
+ * numerous to list here. Please refer to the COPYRIGHT file distributed
+ * with this source distribution
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02111-1301 USA
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include <purple.h>
+
+#define TEST_IMAGE_STORE_SIZE (1024)
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static gchar *user_dir = NULL;
+
+static PurpleImage *
+test_image_store_image_new(guint8 fill) {
+	guint8 *data = g_malloc(TEST_IMAGE_STORE_SIZE);
+
+	memset(data, fill, TEST_IMAGE_STORE_SIZE);
+
+	return purple_image_new_take_data(data, TEST_IMAGE_STORE_SIZE);
+}
+
+static void
+test_image_store_assert_image(PurpleImage *image, guint8 fill) {
+	const guint8 *data = purple_image_get_data(image);
+
+	g_assert_nonnull(data);
+	g_assert_cmpuint(purple_image_get_data_size(image), ==,
+	                 TEST_IMAGE_STORE_SIZE);
+	for(gsize i = 0; i < TEST_IMAGE_STORE_SIZE; i++) {
+		g_assert_cmpuint(data[i], ==, fill);
+	}
+}
+
+/* Spilling happens in a worker thread, so run the main loop until it's
+ * done. */
+static void
+test_image_store_wait_spilled(guint files, gsize bytes_held) {
+	PurpleImageStoreStats stats;
+
+	purple_image_store_get_stats(&stats);
+	while(stats.spill_files < files || stats.bytes_held > bytes_held) {
+		g_main_context_iteration(NULL, TRUE);
+		purple_image_store_get_stats(&stats);
+	}
+}
+
+static void
+test_image_store_setup(void) {
+	GError *error = NULL;
+
+	user_dir = g_dir_make_tmp("purple-test-image-store-XXXXXX", &error);
+	g_assert_no_error(error);
+	purple_util_set_user_dir(user_dir);
+
+	_purple_image_store_init();
+}
+
+static void
+test_image_store_teardown(void) {
+	gchar *cache_dir = g_build_filename(user_dir, "cache", NULL);
+
+	_purple_image_store_uninit();
+	purple_image_store_set_budget(32 * 1024 * 1024);
+
+	g_rmdir(cache_dir);
+	g_rmdir(user_dir);
+	g_free(cache_dir);
+	g_clear_pointer(&user_dir, g_free);
+
+	purple_util_set_user_dir(NULL);
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_image_store_deduplicate(void) {
+	PurpleImageStoreStats stats;
+	PurpleImage *first, *second, *other;
+	guint first_id, second_id, other_id;
+
+	test_image_store_setup();
+
+	first = test_image_store_image_new('a');
+	second = test_image_store_image_new('a');
+	other = test_image_store_image_new('b');
+
+	first_id = purple_image_store_add(first);
+	second_id = purple_image_store_add(second);
+	other_id = purple_image_store_add_temporary(other);
+
+	g_assert_cmpuint(first_id, ==, second_id);
+	g_assert_cmpuint(first_id, !=, other_id);
+	g_assert_true(purple_image_store_get(second_id) == first);
+
+	/* Adding the same image again isn't a new add. */
+	g_assert_cmpuint(purple_image_store_add(first), ==, first_id);
+
+	purple_image_store_get_stats(&stats);
+	g_assert_cmpuint(stats.adds, ==, 3);
+	g_assert_cmpuint(stats.hits, ==, 1);
+	g_assert_cmpuint(stats.images, ==, 2);
+	g_assert_cmpuint(stats.bytes_held, ==, 2 * TEST_IMAGE_STORE_SIZE);
+
+	/* The duplicate isn't kept by the store. */
+	g_object_add_weak_pointer(G_OBJECT(second), (gpointer *)&second);
+	g_object_unref(second);
+	g_assert_null(second);
+
+	g_object_unref(first);
+	g_object_unref(other);
+
+	test_image_store_teardown();
+}
+
+static void
+test_image_store_spill(void) {
+	PurpleImageStoreStats stats;
+	PurpleImage *image;
+	guint ids[3];
+
+	test_image_store_setup();
+
+	purple_image_store_set_budget(2 * TEST_IMAGE_STORE_SIZE);
+
+	for(guint i = 0; i < G_N_ELEMENTS(ids); i++) {
+		image = test_image_store_image_new('a' + i);
+		ids[i] = purple_image_store_add(image);
+		g_object_unref(image);
+	}
+
+	/* The first image is the least recently used, so it should get spilled
+	 * to make room for the third. */
+	test_image_store_wait_spilled(1, 2 * TEST_IMAGE_STORE_SIZE);
+
+	purple_image_store_get_stats(&stats);
+	g_assert_cmpuint(stats.images, ==, 3);
+	g_assert_cmpuint(stats.bytes_held, ==, 2 * TEST_IMAGE_STORE_SIZE);
+	g_assert_cmpuint(stats.spill_files, ==, 1);
+	g_assert_cmpuint(stats.bytes_spilled, ==, TEST_IMAGE_STORE_SIZE);
+	g_assert_cmpuint(stats.reloads, ==, 0);
+
+	/* Looking it up doesn't read it back until the contents are used. */
+	image = purple_image_store_get(ids[0]);
+	g_assert_cmpuint(purple_image_get_data_size(image), ==,
+	                 TEST_IMAGE_STORE_SIZE);
+	purple_image_store_get_stats(&stats);
+	g_assert_cmpuint(stats.reloads, ==, 0);
+	g_assert_cmpuint(stats.bytes_held, ==, 2 * TEST_IMAGE_STORE_SIZE);
+
+	/* Using them counts it again and spills the second in its place. */
+	test_image_store_assert_image(image, 'a');
+
+	purple_image_store_get_stats(&stats);
+	g_assert_cmpuint(stats.reloads, ==, 1);
+	g_assert_cmpuint(stats.bytes_held, ==, 3 * TEST_IMAGE_STORE_SIZE);
+
+	test_image_store_wait_spilled(2, 2 * TEST_IMAGE_STORE_SIZE);
+
+	/* Reading the second back spills the third, since the first is pinned
+	 * by the data pointer handed out for it. */
+	test_image_store_assert_image(purple_image_store_get(ids[1]), 'b');
+	test_image_store_wait_spilled(3, 2 * TEST_IMAGE_STORE_SIZE);
+
+	test_image_store_assert_image(purple_image_store_get(ids[2]), 'c');
+
+	purple_image_store_get_stats(&stats);
+	g_assert_cmpuint(stats.reloads, ==, 3);
+	g_assert_cmpuint(stats.bytes_held, ==, 3 * TEST_IMAGE_STORE_SIZE);
+
+	test_image_store_teardown();
+}
+
+static void
+test_image_store_borrowed(void) {
+	PurpleImageStoreStats stats;
+	PurpleImage *image, *borrowed;
+	const guint8 *data;
+	GBytes *contents;
+	guint id;
+
+	test_image_store_setup();
+
+	purple_image_store_set_budget(TEST_IMAGE_STORE_SIZE);
+
+	/* Someone is holding on to the data of the first image without a
+	 * reference. */
+	borrowed = test_image_store_image_new('a');
+	id = purple_image_store_add(borrowed);
+	g_object_unref(borrowed);
+	data = purple_image_get_data(purple_image_store_get(id));
+
+	/* Something that only used the contents doesn't pin the second. */
+	image = test_image_store_image_new('b');
+	purple_image_store_add(image);
+	contents = purple_image_get_contents(image);
+	g_bytes_unref(contents);
+	g_object_unref(image);
+
+	image = test_image_store_image_new('c');
+	purple_image_store_add(image);
+	g_object_unref(image);
+
+	test_image_store_wait_spilled(1, 2 * TEST_IMAGE_STORE_SIZE);
+
+	/* The first image was the least recently used, but only the second was
+	 * spilled, and the data that was handed out is still there. */
+	purple_image_store_get_stats(&stats);
+	g_assert_cmpuint(stats.spill_files, ==, 1);
+	g_assert_cmpuint(stats.bytes_held, ==, 2 * TEST_IMAGE_STORE_SIZE);
+	for(gsize i = 0; i < TEST_IMAGE_STORE_SIZE; i++) {
+		g_assert_cmpuint(data[i], ==, 'a');
+	}
+
+	test_image_store_teardown();
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/image-store/deduplicate", test_image_store_deduplicate);
+	g_test_add_func("/image-store/spill", test_image_store_spill);
+	g_test_add_func("/image-store/borrowed", test_image_store_borrowed);
+
+	return g_test_run();
+}
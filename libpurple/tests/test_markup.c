@@ -21,6 +21,7 @@
  */
 
 #include <glib.h>
+#include <string.h>
 
 #include <purple.h>
 
@@ -220,6 +221,183 @@ test_util_markup_html_to_xhtml(void) {
 	}
 }
 
+static void
+test_util_markup_linkify(void) {
+	gint i;
+	struct {
+		gchar *text;
+		gchar *linkified;
+	} data[] = {
+		{
+			"no links here",
+			"no links here",
+		}, {
+			"see http://example.com/a?b=c, then",
+			"see <A HREF=\"http://example.com/a?b=c\">http://example.com/a?b=c</A>, then",
+		}, {
+			"(http://www.example.com) www.example.com",
+			"(<A HREF=\"http://www.example.com\">http://www.example.com</A>) <A HREF=\"http://www.example.com\">www.example.com</A>",
+		}, {
+			"mail me@example.com.",
+			"mail <A HREF=\"mailto:me@example.com\">me@example.com</A>.",
+		}, {
+			"<a href=\"http://x\">http://x</a> ftp.example.org",
+			"<a href=\"http://x\">http://x</a> <A HREF=\"ftp://ftp.example.org\">ftp.example.org</A>",
+		}, {
+			"\xc3\xa9t\xc3\xa9 xmpp:room@conference.example.com",
+			"\xc3\xa9t\xc3\xa9 <A HREF=\"xmpp:room@conference.example.com\">xmpp:room@conference.example.com</A>",
+		}, {
+			"awww.example.com www..example.com",
+			"awww.example.com www..example.com",
+		}, {
+			"FTP://EXAMPLE.COM https://example.com/x",
+			"<A HREF=\"FTP://EXAMPLE.COM\">FTP://EXAMPLE.COM</A> <A HREF=\"https://example.com/x\">https://example.com/x</A>",
+		}, {
+			NULL, NULL,
+		}
+	};
+
+	for(i = 0; data[i].text; i++) {
+		gchar *linkified = purple_markup_linkify(data[i].text);
+
+		g_assert_cmpstr(data[i].linkified, ==, linkified);
+		g_free(linkified);
+	}
+}
+
+static void
+test_util_markup_strip_html(void) {
+	gint i;
+	struct {
+		gchar *markup;
+		gchar *stripped;
+	} data[] = {
+		{
+			"plain text",
+			"plain text",
+		}, {
+			"a\tb\nc",
+			"a b c",
+		}, {
+			"<b>bold</b> &amp; more",
+			"bold & more",
+		}, {
+			"<a href=\"http://example.com\">link</a>",
+			"link (http://example.com)",
+		}, {
+			"<script>x < y</script>after",
+			"after",
+		}, {
+			"line<br>next",
+			"line\nnext",
+		}, {
+			"</td>  <td>cell",
+			"\tcell",
+		}, {
+			NULL, NULL,
+		}
+	};
+
+	for(i = 0; data[i].markup; i++) {
+		gchar *stripped = purple_markup_strip_html(data[i].markup);
+
+		g_assert_cmpstr(data[i].stripped, ==, stripped);
+		g_free(stripped);
+	}
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_UTIL_MARKUP_PERF_MESSAGES (20000)
+
+/* Builds messages like the ones that go through these for every incoming
+ * message: mostly plain text, some formatting, the odd link and address. */
+static GPtrArray *
+test_util_markup_perf_corpus(gsize *bytes) {
+	GPtrArray *corpus = g_ptr_array_new_with_free_func(g_free);
+
+	*bytes = 0;
+
+	for(guint i = 0; i < TEST_UTIL_MARKUP_PERF_MESSAGES; i++) {
+		gchar *message = NULL;
+
+		switch(i % 5) {
+		case 0:
+			message = g_strdup_printf(
+				"hey, did anyone manage to build the release from "
+				"yesterday? mine fails in the same spot as message %u", i);
+			break;
+		case 1:
+			message = g_strdup_printf(
+				"<b>note</b>: the schedule moved, see "
+				"https://example.com/schedule/%u?tz=utc for details", i);
+			break;
+		case 2:
+			message = g_strdup_printf(
+				"<font color=\"#ff0000\">sure</font> &amp; thanks, "
+				"send it to someone%u@example.org when you're done", i);
+			break;
+		case 3:
+			message = g_strdup_printf(
+				"I'll be around for the next few hours so feel free to "
+				"ping me with whatever comes up (ticket %u)", i);
+			break;
+		default:
+			message = g_strdup_printf(
+				"<a href=\"http://example.net/%u\">this one</a> is "
+				"already linked, www.example.net/%u is not", i, i);
+			break;
+		}
+
+		*bytes += strlen(message);
+		g_ptr_array_add(corpus, message);
+	}
+
+	return corpus;
+}
+
+static void
+test_util_markup_perf_corpus_run(void) {
+	GPtrArray *corpus = NULL;
+	gdouble linkify = 0.0, strip = 0.0, xhtml = 0.0;
+	gsize bytes = 0;
+
+	corpus = test_util_markup_perf_corpus(&bytes);
+
+	g_test_timer_start();
+	for(guint i = 0; i < corpus->len; i++) {
+		g_free(purple_markup_linkify(g_ptr_array_index(corpus, i)));
+	}
+	linkify = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for(guint i = 0; i < corpus->len; i++) {
+		g_free(purple_markup_strip_html(g_ptr_array_index(corpus, i)));
+	}
+	strip = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for(guint i = 0; i < corpus->len; i++) {
+		gchar *out = NULL, *plain = NULL;
+
+		purple_markup_html_to_xhtml(g_ptr_array_index(corpus, i), &out,
+		                            &plain);
+		g_free(out);
+		g_free(plain);
+	}
+	xhtml = g_test_timer_elapsed();
+
+	g_test_message("purple_markup_strip_html: %f seconds", strip);
+	g_test_message("purple_markup_html_to_xhtml: %f seconds", xhtml);
+	g_test_minimized_result(linkify,
+	                        "purple_markup_linkify: %u messages (%"
+	                        G_GSIZE_FORMAT " bytes) in %f seconds",
+	                        corpus->len, bytes, linkify);
+
+	g_ptr_array_free(corpus, TRUE);
+}
+
 /******************************************************************************
  * Main
  *****************************************************************************/
@@ -229,6 +407,13 @@ main(gint argc, gchar **argv) {
 
 	g_test_add_func("/util/markup/html to xhtml",
 	                test_util_markup_html_to_xhtml);
+	g_test_add_func("/util/markup/linkify", test_util_markup_linkify);
+	g_test_add_func("/util/markup/strip html", test_util_markup_strip_html);
+
+	if(g_test_perf()) {
+		g_test_add_func("/util/markup/perf/corpus",
+		                test_util_markup_perf_corpus_run);
+	}
 
 	return g_test_run();
 }
@@ -259,6 +259,85 @@ test_queued_output_stream_push_bytes_async_error(void) {
 	g_clear_object(&output);
 }
 
+static void
+test_queued_output_stream_cork(void) {
+	GMemoryOutputStream *output;
+	PurpleQueuedOutputStream *queued;
+	GBytes *bytes;
+	gchar *all_test_bytes_data;
+	GError *err = NULL;
+	int done = 3;
+	gboolean ret = FALSE;
+
+	output = G_MEMORY_OUTPUT_STREAM(g_memory_output_stream_new_resizable());
+	g_assert_nonnull(output);
+
+	queued = purple_queued_output_stream_new(G_OUTPUT_STREAM(output));
+	g_assert_true(PURPLE_IS_QUEUED_OUTPUT_STREAM(queued));
+
+	purple_queued_output_stream_cork(queued);
+
+	bytes = g_bytes_new_static(test_bytes_data, test_bytes_data_len);
+	purple_queued_output_stream_push_bytes_async(queued, bytes,
+			G_PRIORITY_DEFAULT, NULL,
+			test_queued_output_stream_push_bytes_async_multiple_cb,
+			&done);
+	g_bytes_unref(bytes);
+
+	bytes = g_bytes_new_static(test_bytes_data2, test_bytes_data_len2);
+	purple_queued_output_stream_push_bytes_async(queued, bytes,
+			G_PRIORITY_DEFAULT, NULL,
+			test_queued_output_stream_push_bytes_async_multiple_cb,
+			&done);
+	g_bytes_unref(bytes);
+
+	bytes = g_bytes_new_static(test_bytes_data3, test_bytes_data_len3);
+	purple_queued_output_stream_push_bytes_async(queued, bytes,
+			G_PRIORITY_DEFAULT, NULL,
+			test_queued_output_stream_push_bytes_async_multiple_cb,
+			&done);
+	g_bytes_unref(bytes);
+
+	/* Nothing may be written while corked. */
+	while (g_main_context_iteration(NULL, FALSE)) {
+	}
+
+	g_assert_cmpint(done, ==, 3);
+	g_assert_cmpuint(g_memory_output_stream_get_data_size(output), ==, 0);
+	g_assert_cmpuint(purple_queued_output_stream_get_queue_depth(queued),
+			==, 3);
+	g_assert_cmpuint(purple_queued_output_stream_get_bytes_in_flight(queued),
+			==, test_bytes_data_len + test_bytes_data_len2 +
+			test_bytes_data_len3);
+
+	purple_queued_output_stream_uncork(queued);
+
+	while (done > 0) {
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	g_assert_cmpuint(purple_queued_output_stream_get_queue_depth(queued),
+			==, 0);
+	g_assert_cmpuint(purple_queued_output_stream_get_bytes_in_flight(queued),
+			==, 0);
+
+	all_test_bytes_data = g_strconcat((const gchar *)test_bytes_data,
+			test_bytes_data2, test_bytes_data3, NULL);
+
+	g_assert_cmpmem(g_memory_output_stream_get_data(output),
+			g_memory_output_stream_get_data_size(output),
+			all_test_bytes_data, strlen(all_test_bytes_data));
+
+	g_free(all_test_bytes_data);
+
+	ret = g_output_stream_close(G_OUTPUT_STREAM(queued), NULL, &err);
+	g_assert_no_error(err);
+	g_assert_true(ret);
+
+	g_clear_object(&queued);
+	g_clear_object(&output);
+}
+
 /******************************************************************************
  * Main
  *****************************************************************************/
@@ -276,6 +355,8 @@ main(gint argc, gchar **argv) {
 			test_queued_output_stream_push_bytes_async_multiple);
 	g_test_add_func("/queued-output-stream/push-bytes-async-error",
 			test_queued_output_stream_push_bytes_async_error);
+	g_test_add_func("/queued-output-stream/cork",
+			test_queued_output_stream_cork);
 
 	return g_test_run();
 }
@@ -0,0 +1,258 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include <purple.h>
+
+#include "test_ui.h"
+
+static gint test_instance = 0;
+static gint test_handle = 0;
+
+/******************************************************************************
+ * Handlers
+ *****************************************************************************/
+static void
+test_purple_signals_append_a(GString *order, G_GNUC_UNUSED gpointer data) {
+	g_string_append_c(order, 'a');
+}
+
+static void
+test_purple_signals_append_b(GString *order, G_GNUC_UNUSED gpointer data) {
+	g_string_append_c(order, 'b');
+}
+
+static void
+test_purple_signals_append_c(GString *order, G_GNUC_UNUSED gpointer data) {
+	g_string_append_c(order, 'c');
+}
+
+static void
+test_purple_signals_disconnect_b(GString *order, G_GNUC_UNUSED gpointer data) {
+	g_string_append_c(order, 'd');
+
+	purple_signal_disconnect(&test_instance, "test", &test_handle,
+	                         G_CALLBACK(test_purple_signals_append_b));
+	purple_signal_connect(&test_instance, "test", &test_handle,
+	                      G_CALLBACK(test_purple_signals_append_c), NULL);
+}
+
+static gpointer
+test_purple_signals_return_null(G_GNUC_UNUSED gpointer arg,
+                                G_GNUC_UNUSED gpointer data)
+{
+	return NULL;
+}
+
+static gpointer
+test_purple_signals_return_data(G_GNUC_UNUSED gpointer arg, gpointer data) {
+	return data;
+}
+
+static void
+test_purple_signals_count(G_GNUC_UNUSED gpointer arg, gpointer data) {
+	guint *count = data;
+
+	(*count)++;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_purple_signals_priority(void) {
+	GString *order = g_string_new(NULL);
+
+	purple_signal_register(&test_instance, "test",
+	                       purple_marshal_VOID__POINTER, G_TYPE_NONE, 1,
+	                       G_TYPE_POINTER);
+
+	purple_signal_connect_priority(&test_instance, "test", &test_handle,
+	                               G_CALLBACK(test_purple_signals_append_c),
+	                               NULL, PURPLE_SIGNAL_PRIORITY_HIGHEST);
+	purple_signal_connect(&test_instance, "test", &test_handle,
+	                      G_CALLBACK(test_purple_signals_append_b), NULL);
+	purple_signal_connect_priority(&test_instance, "test", &test_handle,
+	                               G_CALLBACK(test_purple_signals_append_a),
+	                               NULL, PURPLE_SIGNAL_PRIORITY_LOWEST);
+
+	purple_signal_emit(&test_instance, "test", order);
+	g_assert_cmpstr(order->str, ==, "abc");
+
+	/* Once everything is disconnected nothing should be called. */
+	purple_signals_disconnect_by_handle(&test_handle);
+	g_string_truncate(order, 0);
+	purple_signal_emit(&test_instance, "test", order);
+	g_assert_cmpstr(order->str, ==, "");
+
+	purple_signals_unregister_by_instance(&test_instance);
+	g_string_free(order, TRUE);
+}
+
+static void
+test_purple_signals_modify_during_emission(void) {
+	GString *order = g_string_new(NULL);
+
+	purple_signal_register(&test_instance, "test",
+	                       purple_marshal_VOID__POINTER, G_TYPE_NONE, 1,
+	                       G_TYPE_POINTER);
+
+	purple_signal_connect_priority(&test_instance, "test", &test_handle,
+	                               G_CALLBACK(test_purple_signals_disconnect_b),
+	                               NULL, PURPLE_SIGNAL_PRIORITY_LOWEST);
+	purple_signal_connect(&test_instance, "test", &test_handle,
+	                      G_CALLBACK(test_purple_signals_append_b), NULL);
+
+	/* b was disconnected before its turn, and c was connected during the
+	 * emission so it shouldn't be called until the next one.
+	 */
+	purple_signal_emit(&test_instance, "test", order);
+	g_assert_cmpstr(order->str, ==, "d");
+
+	g_string_truncate(order, 0);
+	purple_signal_disconnect(&test_instance, "test", &test_handle,
+	                         G_CALLBACK(test_purple_signals_disconnect_b));
+	purple_signal_emit(&test_instance, "test", order);
+	g_assert_cmpstr(order->str, ==, "c");
+
+	purple_signals_disconnect_by_handle(&test_handle);
+	purple_signals_unregister_by_instance(&test_instance);
+	g_string_free(order, TRUE);
+}
+
+static void
+test_purple_signals_disconnect_first(void) {
+	guint first = 0, second = 0;
+
+	purple_signal_register(&test_instance, "test",
+	                       purple_marshal_VOID__POINTER, G_TYPE_NONE, 1,
+	                       G_TYPE_POINTER);
+
+	purple_signal_connect(&test_instance, "test", &test_handle,
+	                      G_CALLBACK(test_purple_signals_count), &first);
+	purple_signal_connect(&test_instance, "test", &test_handle,
+	                      G_CALLBACK(test_purple_signals_count), &second);
+
+	/* Handlers with the same priority are called newest first. With the same
+	 * handle and callback connected twice, disconnecting removes the first
+	 * one that would be called.
+	 */
+	purple_signal_disconnect(&test_instance, "test", &test_handle,
+	                         G_CALLBACK(test_purple_signals_count));
+	purple_signal_emit(&test_instance, "test", NULL);
+	g_assert_cmpuint(first, ==, 1);
+	g_assert_cmpuint(second, ==, 0);
+
+	purple_signals_disconnect_by_handle(&test_handle);
+	purple_signals_unregister_by_instance(&test_instance);
+}
+
+static void
+test_purple_signals_emit_by_id(void) {
+	gulong id = 0;
+	gpointer ret = NULL;
+
+	id = purple_signal_register(&test_instance, "test",
+	                            purple_marshal_POINTER__POINTER,
+	                            G_TYPE_POINTER, 1, G_TYPE_POINTER);
+	g_assert_cmpuint(id, !=, 0);
+	g_assert_cmpuint(purple_signal_lookup(&test_instance, "test"), ==, id);
+	g_assert_cmpuint(purple_signal_lookup(&test_instance, "nope"), ==, 0);
+
+	g_assert_false(purple_signal_has_handlers(&test_instance, id));
+
+	purple_signal_connect(&test_instance, "test", &test_handle,
+	                      G_CALLBACK(test_purple_signals_return_null), NULL);
+	purple_signal_connect_priority(&test_instance, "test", &test_handle,
+	                               G_CALLBACK(test_purple_signals_return_data),
+	                               &test_handle,
+	                               PURPLE_SIGNAL_PRIORITY_HIGHEST);
+	g_assert_true(purple_signal_has_handlers(&test_instance, id));
+
+	ret = purple_signal_emit_by_id_return_1(&test_instance, id, NULL);
+	g_assert_true(ret == &test_handle);
+
+	purple_signals_disconnect_by_handle(&test_handle);
+	g_assert_false(purple_signal_has_handlers(&test_instance, id));
+
+	purple_signals_unregister_by_instance(&test_instance);
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_PURPLE_SIGNALS_PERF_EMISSIONS (1000000)
+
+static void
+test_purple_signals_perf_emit(void) {
+	gulong id = 0;
+	gdouble by_name = 0.0, by_id = 0.0;
+	guint count = 0;
+
+	id = purple_signal_register(&test_instance, "test",
+	                            purple_marshal_VOID__POINTER, G_TYPE_NONE, 1,
+	                            G_TYPE_POINTER);
+	purple_signal_connect(&test_instance, "test", &test_handle,
+	                      G_CALLBACK(test_purple_signals_count), &count);
+
+	g_test_timer_start();
+	for(guint i = 0; i < TEST_PURPLE_SIGNALS_PERF_EMISSIONS; i++) {
+		purple_signal_emit(&test_instance, "test", NULL);
+	}
+	by_name = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for(guint i = 0; i < TEST_PURPLE_SIGNALS_PERF_EMISSIONS; i++) {
+		purple_signal_emit_by_id(&test_instance, id, NULL);
+	}
+	by_id = g_test_timer_elapsed();
+
+	g_assert_cmpuint(count, ==, 2 * TEST_PURPLE_SIGNALS_PERF_EMISSIONS);
+
+	g_test_message("%d emissions by name in %f seconds",
+	               TEST_PURPLE_SIGNALS_PERF_EMISSIONS, by_name);
+	g_test_minimized_result(by_id, "%d emissions by id in %f seconds",
+	                        TEST_PURPLE_SIGNALS_PERF_EMISSIONS, by_id);
+
+	purple_signals_disconnect_by_handle(&test_handle);
+	purple_signals_unregister_by_instance(&test_instance);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+	g_test_add_func("/signals/priority", test_purple_signals_priority);
+	g_test_add_func("/signals/modify-during-emission",
+	                test_purple_signals_modify_during_emission);
+	g_test_add_func("/signals/disconnect-first",
+	                test_purple_signals_disconnect_first);
+	g_test_add_func("/signals/emit-by-id", test_purple_signals_emit_by_id);
+
+	if(g_test_perf()) {
+		g_test_add_func("/signals/perf/emit", test_purple_signals_perf_emit);
+	}
+
+	return g_test_run();
+}
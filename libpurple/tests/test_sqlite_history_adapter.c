@@ -0,0 +1,580 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <purple.h>
+
+#include "test_ui.h"
+
+#define PURPLE_GLOBAL_HEADER_INSIDE
+#include "../purpleprivate.h"
+#undef PURPLE_GLOBAL_HEADER_INSIDE
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static const gchar *test_messages[][2] = {
+	{"alice", "the quick brown fox"},
+	{"bob", "jumped over the lazy dog"},
+	{"alice", "a fox is quick"},
+	{"carol", "pidgin & finch <3"},
+	{"bob", "foxes are everywhere"},
+};
+
+static PurpleHistoryAdapter *
+test_purple_sqlite_history_adapter_new(PurpleConversation **conversation) {
+	PurpleAccount *account = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	GError *error = NULL;
+	gboolean result = FALSE;
+
+	adapter = purple_sqlite_history_adapter_new(":memory:");
+	result = purple_history_adapter_activate(adapter, &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+
+	account = purple_account_new("test", "test");
+	*conversation = g_object_new(PURPLE_TYPE_IM_CONVERSATION,
+	                             "account", account,
+	                             "name", "pidgy",
+	                             NULL);
+
+	for(gsize i = 0; i < G_N_ELEMENTS(test_messages); i++) {
+		PurpleMessage *message = NULL;
+
+		message = purple_message_new_outgoing(test_messages[i][0], "pidgy",
+		                                      test_messages[i][1], 0);
+
+		result = purple_history_adapter_write(adapter, *conversation,
+		                                      message, &error);
+		g_assert_no_error(error);
+		g_assert_true(result);
+
+		g_clear_object(&message);
+	}
+
+	return adapter;
+}
+
+static void
+test_purple_sqlite_history_adapter_free(PurpleHistoryAdapter *adapter,
+                                        PurpleConversation *conversation)
+{
+	GError *error = NULL;
+	gboolean result = FALSE;
+
+	result = purple_history_adapter_deactivate(adapter, &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+
+	g_clear_object(&adapter);
+	g_clear_object(&conversation);
+}
+
+static guint
+test_purple_sqlite_history_adapter_count(PurpleHistoryAdapter *adapter,
+                                         const gchar *query)
+{
+	GList *results = NULL;
+	GError *error = NULL;
+	guint count = 0;
+
+	results = purple_history_adapter_query(adapter, query, &error);
+	g_assert_no_error(error);
+
+	count = g_list_length(results);
+	g_list_free_full(results, g_object_unref);
+
+	return count;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+static void
+test_purple_sqlite_history_adapter_search(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+
+	/* No terms returns everything. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter, ""),
+	                 ==, 5);
+
+	/* A single term. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter, "fox"),
+	                 ==, 2);
+
+	/* Multiple terms must all match. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "fox brown"),
+	                 ==, 1);
+
+	/* Unless they're joined with OR. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "brown OR dog"),
+	                 ==, 2);
+
+	/* Phrases. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "\"quick brown\""),
+	                 ==, 1);
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "\"brown quick\""),
+	                 ==, 0);
+
+	/* Prefixes. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter, "fox*"),
+	                 ==, 3);
+
+	/* Exclusions. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "fox -brown"),
+	                 ==, 1);
+
+	/* Mixed with the other filters. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "from:bob fox*"),
+	                 ==, 1);
+
+	/* Punctuation shouldn't be treated as fts syntax. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "finch <3"),
+	                 ==, 1);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_search_excluded_only(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	GList *results = NULL;
+	GError *error = NULL;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+
+	results = purple_history_adapter_query(adapter, "-fox", &error);
+	g_assert_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0);
+	g_assert_null(results);
+	g_clear_error(&error);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_search_highlight(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	PurpleMessage *message = NULL;
+	GList *results = NULL;
+	GError *error = NULL;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+
+	results = purple_history_adapter_query(adapter, "finch highlight:on",
+	                                       &error);
+	g_assert_no_error(error);
+	g_assert_cmpuint(g_list_length(results), ==, 1);
+
+	message = PURPLE_MESSAGE(results->data);
+	g_assert_cmpstr(purple_message_get_contents(message), ==,
+	                "pidgin &amp; <b>finch</b> &lt;3");
+	g_assert_cmpint(purple_message_get_content_type(message), ==,
+	                PURPLE_MESSAGE_CONTENT_TYPE_HTML);
+
+	g_list_free_full(results, g_object_unref);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_search_rank(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	GList *results = NULL;
+	GError *error = NULL;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+
+	/* The shortest message has the best bm25 score even though it was
+	 * written last.
+	 */
+	results = purple_history_adapter_query(adapter, "fox* sort:rank",
+	                                       &error);
+	g_assert_no_error(error);
+	g_assert_cmpuint(g_list_length(results), ==, 3);
+	g_assert_cmpstr(purple_message_get_contents(results->data), ==,
+	                "foxes are everywhere");
+
+	g_list_free_full(results, g_object_unref);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_remove(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	GError *error = NULL;
+	gboolean result = FALSE;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+
+	result = purple_history_adapter_remove(adapter, "fox", &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+
+	/* The index has to be kept in sync with the removals. */
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter, "fox"),
+	                 ==, 0);
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "quick"),
+	                 ==, 0);
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter, ""),
+	                 ==, 3);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_query_page(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	GList *results = NULL;
+	GError *error = NULL;
+	gchar *cursor = NULL;
+	gchar *next_cursor = NULL;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+
+	/* The first page is the newest messages in chronological order. */
+	results = purple_history_adapter_query_page(adapter, "in:pidgy", NULL, 2,
+	                                            &cursor, &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(cursor);
+	g_assert_cmpuint(g_list_length(results), ==, 2);
+	g_assert_cmpstr(purple_message_get_contents(results->data), ==,
+	                "pidgin & finch <3");
+	g_assert_cmpstr(purple_message_get_contents(results->next->data), ==,
+	                "foxes are everywhere");
+	g_list_free_full(results, g_object_unref);
+
+	/* The next page picks up where the previous one left off. */
+	results = purple_history_adapter_query_page(adapter, "in:pidgy", cursor, 2,
+	                                            &next_cursor, &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(next_cursor);
+	g_assert_cmpuint(g_list_length(results), ==, 2);
+	g_assert_cmpstr(purple_message_get_contents(results->data), ==,
+	                "jumped over the lazy dog");
+	g_assert_cmpstr(purple_message_get_contents(results->next->data), ==,
+	                "a fox is quick");
+	g_list_free_full(results, g_object_unref);
+	g_free(cursor);
+	cursor = next_cursor;
+
+	/* The last page is short and doesn't have a cursor. */
+	results = purple_history_adapter_query_page(adapter, "in:pidgy", cursor, 2,
+	                                            &next_cursor, &error);
+	g_assert_no_error(error);
+	g_assert_null(next_cursor);
+	g_assert_cmpuint(g_list_length(results), ==, 1);
+	g_assert_cmpstr(purple_message_get_contents(results->data), ==,
+	                "the quick brown fox");
+	g_list_free_full(results, g_object_unref);
+	g_free(cursor);
+
+	/* Bad cursors are rejected. */
+	results = purple_history_adapter_query_page(adapter, "", "garbage", 2,
+	                                            NULL, &error);
+	g_assert_error(error, PURPLE_HISTORY_ADAPTER_DOMAIN, 0);
+	g_assert_null(results);
+	g_clear_error(&error);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_query_async_cb(GObject *source,
+                                                  GAsyncResult *result,
+                                                  gpointer data)
+{
+	GMainLoop *loop = data;
+	GError *error = NULL;
+	gboolean ret = FALSE;
+
+	ret = purple_history_adapter_query_finish(PURPLE_HISTORY_ADAPTER(source),
+	                                          result, &error);
+	g_assert_no_error(error);
+	g_assert_true(ret);
+
+	g_main_loop_quit(loop);
+}
+
+static void
+test_purple_sqlite_history_adapter_query_async(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	PurpleMessage *message = NULL;
+	GListStore *store = NULL;
+	GMainLoop *loop = NULL;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+	store = g_list_store_new(PURPLE_TYPE_MESSAGE);
+	loop = g_main_loop_new(NULL, FALSE);
+
+	purple_history_adapter_query_async(adapter, "fox*", store, NULL,
+	                                   test_purple_sqlite_history_adapter_query_async_cb,
+	                                   loop);
+	g_main_loop_run(loop);
+
+	/* All of the batches are in the store by the time the callback runs. */
+	g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(store)), ==, 3);
+
+	message = g_list_model_get_item(G_LIST_MODEL(store), 0);
+	g_assert_cmpstr(purple_message_get_contents(message), ==,
+	                "the quick brown fox");
+	g_clear_object(&message);
+
+	g_main_loop_unref(loop);
+	g_clear_object(&store);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_query_async_cancelled_cb(GObject *source,
+                                                            GAsyncResult *result,
+                                                            gpointer data)
+{
+	GMainLoop *loop = data;
+	GError *error = NULL;
+	gboolean ret = FALSE;
+
+	ret = purple_history_adapter_query_finish(PURPLE_HISTORY_ADAPTER(source),
+	                                          result, &error);
+	g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert_false(ret);
+	g_clear_error(&error);
+
+	g_main_loop_quit(loop);
+}
+
+static void
+test_purple_sqlite_history_adapter_query_async_cancelled(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	GCancellable *cancellable = NULL;
+	GListStore *store = NULL;
+	GMainLoop *loop = NULL;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+	store = g_list_store_new(PURPLE_TYPE_MESSAGE);
+	loop = g_main_loop_new(NULL, FALSE);
+	cancellable = g_cancellable_new();
+
+	g_cancellable_cancel(cancellable);
+
+	purple_history_adapter_query_async(adapter, "", store, cancellable,
+	                                   test_purple_sqlite_history_adapter_query_async_cancelled_cb,
+	                                   loop);
+	g_main_loop_run(loop);
+
+	g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(store)), ==, 0);
+
+	g_clear_object(&cancellable);
+	g_main_loop_unref(loop);
+	g_clear_object(&store);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+static void
+test_purple_sqlite_history_adapter_batch_flush(void) {
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	PurpleSqliteHistoryAdapter *sqlite_adapter = NULL;
+	PurpleMessage *message = NULL;
+	GError *error = NULL;
+	gboolean result = FALSE;
+
+	adapter = test_purple_sqlite_history_adapter_new(&conversation);
+	sqlite_adapter = PURPLE_SQLITE_HISTORY_ADAPTER(adapter);
+
+	purple_sqlite_history_adapter_set_batch_size(sqlite_adapter, 10);
+
+	/* Queued messages have to show up in queries. */
+	message = purple_message_new_outgoing("alice", "pidgy", "queued", 0);
+	result = purple_history_adapter_write(adapter, conversation, message,
+	                                      &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+	g_clear_object(&message);
+
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "queued"),
+	                 ==, 1);
+
+	/* As do messages that are explicitly flushed. */
+	message = purple_message_new_outgoing("alice", "pidgy", "flushed", 0);
+	result = purple_history_adapter_write(adapter, conversation, message,
+	                                      &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+	g_clear_object(&message);
+
+	result = purple_sqlite_history_adapter_flush(sqlite_adapter, &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+
+	g_assert_cmpuint(test_purple_sqlite_history_adapter_count(adapter,
+	                                                          "flushed"),
+	                 ==, 1);
+
+	test_purple_sqlite_history_adapter_free(adapter, conversation);
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_PERF_MESSAGES (10000)
+
+static void
+test_purple_sqlite_history_adapter_perf_write(gconstpointer data) {
+	PurpleAccount *account = NULL;
+	PurpleConversation *conversation = NULL;
+	PurpleHistoryAdapter *adapter = NULL;
+	GError *error = NULL;
+	gchar *dir = NULL;
+	gchar *filename = NULL;
+	gdouble elapsed = 0.0;
+	gboolean result = FALSE;
+	guint batch_size = GPOINTER_TO_UINT(data);
+
+	dir = g_dir_make_tmp("purple-history-XXXXXX", &error);
+	g_assert_no_error(error);
+
+	/* Use a real file so that the numbers include syncing to disk. */
+	filename = g_build_filename(dir, "history.db", NULL);
+	adapter = purple_sqlite_history_adapter_new(filename);
+	purple_sqlite_history_adapter_set_batch_size(PURPLE_SQLITE_HISTORY_ADAPTER(adapter),
+	                                             batch_size);
+
+	result = purple_history_adapter_activate(adapter, &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+
+	account = purple_account_new("test", "test");
+	conversation = g_object_new(PURPLE_TYPE_IM_CONVERSATION,
+	                            "account", account,
+	                            "name", "flooder",
+	                            NULL);
+
+	g_test_timer_start();
+
+	for(gint i = 0; i < TEST_PERF_MESSAGES; i++) {
+		PurpleMessage *message = NULL;
+		gchar *contents = g_strdup_printf("message number %d", i);
+
+		message = purple_message_new_incoming("flooder", contents, 0, 0);
+		result = purple_history_adapter_write(adapter, conversation, message,
+		                                      &error);
+		g_assert_no_error(error);
+		g_assert_true(result);
+
+		g_clear_object(&message);
+		g_free(contents);
+	}
+
+	result = purple_sqlite_history_adapter_flush(PURPLE_SQLITE_HISTORY_ADAPTER(adapter),
+	                                             &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_maximized_result(TEST_PERF_MESSAGES / elapsed,
+	                        "%.0f messages/s with a batch size of %u",
+	                        TEST_PERF_MESSAGES / elapsed, batch_size);
+
+	result = purple_history_adapter_deactivate(adapter, &error);
+	g_assert_no_error(error);
+	g_assert_true(result);
+
+	g_clear_object(&adapter);
+	g_clear_object(&conversation);
+
+	g_remove(filename);
+	g_free(filename);
+
+	/* Clean up anything sqlite's write ahead log may have left behind. */
+	filename = g_build_filename(dir, "history.db-wal", NULL);
+	g_remove(filename);
+	g_free(filename);
+	filename = g_build_filename(dir, "history.db-shm", NULL);
+	g_remove(filename);
+	g_free(filename);
+
+	g_rmdir(dir);
+	g_free(dir);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+	g_test_add_func("/sqlite-history-adapter/search",
+	                test_purple_sqlite_history_adapter_search);
+	g_test_add_func("/sqlite-history-adapter/search/excluded-only",
+	                test_purple_sqlite_history_adapter_search_excluded_only);
+	g_test_add_func("/sqlite-history-adapter/search/highlight",
+	                test_purple_sqlite_history_adapter_search_highlight);
+	g_test_add_func("/sqlite-history-adapter/search/rank",
+	                test_purple_sqlite_history_adapter_search_rank);
+	g_test_add_func("/sqlite-history-adapter/remove",
+	                test_purple_sqlite_history_adapter_remove);
+	g_test_add_func("/sqlite-history-adapter/query-page",
+	                test_purple_sqlite_history_adapter_query_page);
+	g_test_add_func("/sqlite-history-adapter/query-async",
+	                test_purple_sqlite_history_adapter_query_async);
+	g_test_add_func("/sqlite-history-adapter/query-async/cancelled",
+	                test_purple_sqlite_history_adapter_query_async_cancelled);
+	g_test_add_func("/sqlite-history-adapter/batch/flush",
+	                test_purple_sqlite_history_adapter_batch_flush);
+
+	/* These are only run with -m perf. */
+	if(g_test_perf()) {
+		g_test_add_data_func("/sqlite-history-adapter/perf/write/unbatched",
+		                     GUINT_TO_POINTER(1),
+		                     test_purple_sqlite_history_adapter_perf_write);
+		g_test_add_data_func("/sqlite-history-adapter/perf/write/batched",
+		                     GUINT_TO_POINTER(100),
+		                     test_purple_sqlite_history_adapter_perf_write);
+	}
+
+	return g_test_run();
+}
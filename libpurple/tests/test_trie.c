@@ -339,6 +339,196 @@ test_trie_multi_find(void) {
 	g_slist_free_full(tries, g_object_unref);
 }
 
+static void
+test_trie_compact_replace(void) {
+	PurpleTrie *trie;
+	const gchar *in;
+	gchar *out;
+	gsize default_size;
+
+	trie = purple_trie_new();
+	purple_trie_set_reset_on_match(trie, FALSE);
+
+	purple_trie_add(trie, "test", (gpointer)0x1001);
+	purple_trie_add(trie, "testing", (gpointer)0x1002);
+	purple_trie_add(trie, "overtested", (gpointer)0x1003);
+	purple_trie_add(trie, "trie", (gpointer)0x1004);
+	purple_trie_add(trie, "tree", (gpointer)0x1005);
+	purple_trie_add(trie, "implement", (gpointer)0x1006);
+	purple_trie_add(trie, "implementation", (gpointer)0x1007);
+
+	default_size = purple_trie_get_memory_size(trie);
+	purple_trie_set_compact(trie, TRUE);
+	g_assert_true(purple_trie_get_compact(trie));
+	g_assert_cmpuint(purple_trie_get_memory_size(trie), <, default_size);
+
+	in = "Alice is testing her trie implementation, "
+		"but she's far away from making test tree overtested";
+
+	out = purple_trie_replace(trie, in, test_trie_replace_cb, (gpointer)1);
+
+	g_assert_cmpstr(
+		"Alice is [1:1002] her [1:1004] [1:1006]ation,"
+		" but she's far away from making test [1:1005] [1:1003]",
+		==,
+		out
+	);
+	g_free(out);
+
+	/* Modifying it rebuilds the compact layout. */
+	purple_trie_add(trie, "Alice", (gpointer)0x1008);
+	purple_trie_remove(trie, "tree");
+
+	out = purple_trie_replace(trie, in, test_trie_replace_cb, (gpointer)1);
+
+	g_assert_cmpstr(
+		"[1:1008] is [1:1002] her [1:1004] [1:1006]ation,"
+		" but she's far away from making test tree [1:1003]",
+		==,
+		out
+	);
+	g_free(out);
+
+	g_object_unref(trie);
+}
+
+static void
+test_trie_compact_multi_find(void) {
+	PurpleTrie *trie1, *trie2, *trie3;
+	GSList *tries = NULL;
+	const gchar *in;
+	int out;
+
+	trie1 = purple_trie_new();
+	trie2 = purple_trie_new();
+	trie3 = purple_trie_new();
+	purple_trie_set_reset_on_match(trie1, FALSE);
+	purple_trie_set_reset_on_match(trie2, TRUE);
+	purple_trie_set_reset_on_match(trie3, FALSE);
+
+	/* Compact and default tries can be mixed. */
+	purple_trie_set_compact(trie1, TRUE);
+	purple_trie_set_compact(trie3, TRUE);
+
+	tries = g_slist_append(tries, trie1);
+	tries = g_slist_append(tries, trie2);
+	tries = g_slist_append(tries, trie3);
+
+	purple_trie_add(trie1, "test", (gpointer)0x10011);
+	purple_trie_add(trie1, "trie1", (gpointer)0x10012);
+	purple_trie_add(trie1, "Alice", (gpointer)0x10013);
+
+	purple_trie_add(trie2, "test", (gpointer)0x10021);
+	purple_trie_add(trie2, "trie2", (gpointer)0x10022);
+	purple_trie_add(trie2, "example", (gpointer)0x10023);
+	purple_trie_add(trie2, "Ali", (gpointer)0x10024);
+
+	purple_trie_add(trie3, "teser", (gpointer)0x10031);
+	purple_trie_add(trie3, "trie3", (gpointer)0x10032);
+	purple_trie_add(trie3, "tester", (gpointer)0x10033);
+	purple_trie_add(trie3, "example", (gpointer)0x10034);
+	purple_trie_add(trie3, "Al", (gpointer)0x10035);
+
+	in = "test tester trie trie1 trie2 trie3 example Alice";
+
+	find_sum = 0;
+	out = purple_trie_multi_find(tries, in,
+		test_trie_find_cb, (gpointer)0x10);
+
+	g_assert_cmpint(9, ==, out);
+	g_assert_cmpint(2 * 0x11 + 0x33 + 0x12 + 0x22 +
+		0x32 + 0x23 + 0x35 + 0x13, ==, find_sum);
+
+	g_slist_free_full(tries, g_object_unref);
+}
+
+/******************************************************************************
+ * Performance Tests
+ *****************************************************************************/
+#define TEST_TRIE_PERF_WORDS (50000)
+#define TEST_TRIE_PERF_TEXT_SIZE (1024 * 1024)
+
+static gchar *
+test_trie_perf_word(GRand *rand) {
+	gint len = g_rand_int_range(rand, 4, 13);
+	gchar *word = g_malloc(len + 1);
+
+	for(gint i = 0; i < len; i++) {
+		word[i] = g_rand_int_range(rand, 'a', 'z' + 1);
+	}
+	word[len] = '\0';
+
+	return word;
+}
+
+static void
+test_trie_perf_layout(PurpleTrie *trie, const gchar *layout,
+                      const gchar *text) {
+	gdouble build, search;
+	gulong found;
+
+	g_test_timer_start();
+	purple_trie_get_memory_size(trie);
+	build = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	found = purple_trie_find(trie, text, NULL, NULL);
+	search = g_test_timer_elapsed();
+
+	g_test_message("%s layout: %" G_GSIZE_FORMAT " bytes, built in %f "
+	               "seconds, %lu matches in %f seconds (%.1f MiB/s)",
+	               layout, purple_trie_get_memory_size(trie), build, found,
+	               search, TEST_TRIE_PERF_TEXT_SIZE / search / 1048576.0);
+	g_test_minimized_result(search, "%s layout search: %f seconds", layout,
+	                        search);
+}
+
+static void
+test_trie_perf_compact(void) {
+	PurpleTrie *trie;
+	GPtrArray *words;
+	GString *text;
+	GRand *rand = g_rand_new_with_seed(20);
+
+	trie = purple_trie_new();
+	words = g_ptr_array_new_with_free_func(g_free);
+
+	while(purple_trie_get_size(trie) < TEST_TRIE_PERF_WORDS) {
+		gchar *word = test_trie_perf_word(rand);
+
+		if(purple_trie_add(trie, word, NULL)) {
+			g_ptr_array_add(words, word);
+		} else {
+			g_free(word);
+		}
+	}
+
+	/* Half of the text is dictionary words, the other half is noise. */
+	text = g_string_sized_new(TEST_TRIE_PERF_TEXT_SIZE + 16);
+	while(text->len < TEST_TRIE_PERF_TEXT_SIZE) {
+		if(g_rand_boolean(rand)) {
+			g_string_append(text, g_ptr_array_index(words,
+				g_rand_int_range(rand, 0, words->len)));
+		} else {
+			gchar *noise = test_trie_perf_word(rand);
+
+			g_string_append(text, noise);
+			g_free(noise);
+		}
+		g_string_append_c(text, ' ');
+	}
+	g_string_truncate(text, TEST_TRIE_PERF_TEXT_SIZE);
+
+	test_trie_perf_layout(trie, "default", text->str);
+	purple_trie_set_compact(trie, TRUE);
+	test_trie_perf_layout(trie, "compact", text->str);
+
+	g_string_free(text, TRUE);
+	g_ptr_array_free(words, TRUE);
+	g_rand_free(rand);
+	g_object_unref(trie);
+}
+
 gint
 main(gint argc, gchar **argv) {
 	g_test_init(&argc, &argv, NULL);
@@ -368,5 +558,14 @@ main(gint argc, gchar **argv) {
 	g_test_add_func("/trie/multi_find",
 	                test_trie_multi_find);
 
+	g_test_add_func("/trie/compact/replace",
+	                test_trie_compact_replace);
+	g_test_add_func("/trie/compact/multi_find",
+	                test_trie_compact_multi_find);
+
+	if(g_test_perf()) {
+		g_test_add_func("/trie/perf/compact", test_trie_perf_compact);
+	}
+
 	return g_test_run();
 }
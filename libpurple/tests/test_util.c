@@ -21,9 +21,12 @@
  *
  */
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include <purple.h>
 
+#include "../purpleprivate.h"
+
 /******************************************************************************
  * filename escape tests
  *****************************************************************************/
@@ -221,6 +224,58 @@ test_uri_escape_for_open(void) {
 	g_free(result);
 }
 
+/******************************************************************************
+ * background write tests
+ *****************************************************************************/
+static PurpleXmlNode *
+test_util_write_snapshot(const char *value) {
+	PurpleXmlNode *node = purple_xmlnode_new("test");
+
+	purple_xmlnode_set_attrib(node, "value", value);
+
+	return node;
+}
+
+static void
+test_util_write_xml_to_config_file(void) {
+	GError *error = NULL;
+	gchar *tmp, *path, *contents = NULL;
+	PurpleXmlNode *node;
+
+	tmp = g_dir_make_tmp("purple-test-util-XXXXXX", &error);
+	g_assert_no_error(error);
+	purple_util_set_user_dir(tmp);
+
+	/* The config directory doesn't exist yet, so this also checks that it's
+	 * created. The second snapshot should replace the first if the worker
+	 * hasn't got to it, and be written after it otherwise.
+	 */
+	_purple_util_write_xml_to_config_file("test.xml",
+	                                      test_util_write_snapshot("first"));
+	_purple_util_write_xml_to_config_file("test.xml",
+	                                      test_util_write_snapshot("second"));
+	_purple_util_write_flush();
+
+	path = g_build_filename(purple_config_dir(), "test.xml", NULL);
+	g_file_get_contents(path, &contents, NULL, &error);
+	g_assert_no_error(error);
+
+	node = purple_xmlnode_from_str(contents, -1);
+	g_assert_nonnull(node);
+	g_assert_cmpstr(purple_xmlnode_get_attrib(node, "value"), ==, "second");
+	purple_xmlnode_free(node);
+
+	g_remove(path);
+	g_rmdir(purple_config_dir());
+	g_rmdir(tmp);
+
+	g_free(contents);
+	g_free(path);
+	g_free(tmp);
+
+	purple_util_set_user_dir(NULL);
+}
+
 /******************************************************************************
  * MANE
  *****************************************************************************/
@@ -248,5 +303,8 @@ main(gint argc, gchar **argv) {
 	g_test_add_func("/util/test_uri_escape_for_open",
 	                test_uri_escape_for_open);
 
+	g_test_add_func("/util/write/xml-to-config-file",
+	                test_util_write_xml_to_config_file);
+
 	return g_test_run();
 }
@@ -0,0 +1,200 @@
+/*
+ * Purple - Internet Messaging Library
+ * Copyright (C) Pidgin Developers <devel@pidgin.im>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#ifdef G_OS_UNIX
+#include <glib-unix.h>
+#include <unistd.h>
+#endif
+
+#include <purple.h>
+
+#include "test_ui.h"
+#include "../purpleprivate.h"
+
+/******************************************************************************
+ * Helpers
+ *****************************************************************************/
+static void
+test_purple_xfer_notify_counter(G_GNUC_UNUSED GObject *obj,
+                                G_GNUC_UNUSED GParamSpec *pspec,
+                                gpointer data)
+{
+	guint *counter = data;
+
+	(*counter)++;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+#ifdef G_OS_UNIX
+static void
+test_purple_xfer_read_into(void) {
+	PurpleAccount *account = NULL;
+	PurpleXfer *xfer = NULL;
+	guchar buffer[16];
+	gint fds[2];
+	gssize r = 0;
+
+	g_assert_true(g_unix_open_pipe(fds, 0, NULL));
+	g_assert_true(g_unix_set_fd_nonblocking(fds[0], TRUE, NULL));
+
+	account = purple_account_new("test", "test");
+	xfer = purple_xfer_new(account, PURPLE_XFER_TYPE_RECEIVE, "pidgy");
+	purple_xfer_set_size(xfer, 10);
+	purple_xfer_set_fd(xfer, fds[0]);
+
+	/* Nothing has been written yet so nothing should be read. */
+	r = purple_xfer_read_into(xfer, buffer, sizeof(buffer));
+	g_assert_cmpint(r, ==, 0);
+
+	g_assert_cmpint(write(fds[1], "0123456789abcdef", 16), ==, 16);
+
+	/* We shouldn't read more than the caller asked for... */
+	r = purple_xfer_read_into(xfer, buffer, 4);
+	g_assert_cmpint(r, ==, 4);
+	g_assert_cmpmem(buffer, r, "0123", 4);
+	purple_xfer_set_bytes_sent(xfer, 4);
+
+	/* ...or more than is left of the file. */
+	r = purple_xfer_read_into(xfer, buffer, sizeof(buffer));
+	g_assert_cmpint(r, ==, 6);
+	g_assert_cmpmem(buffer, r, "456789", 6);
+	purple_xfer_set_bytes_sent(xfer, 10);
+
+	r = purple_xfer_read_into(xfer, buffer, sizeof(buffer));
+	g_assert_cmpint(r, ==, 0);
+
+	/* Cleanup */
+	close(fds[0]);
+	close(fds[1]);
+	g_clear_object(&xfer);
+	g_clear_object(&account);
+}
+#endif /* G_OS_UNIX */
+
+static void
+test_purple_xfer_throughput(void) {
+	PurpleAccount *account = NULL;
+	PurpleXfer *xfer = NULL;
+	gint64 now = G_USEC_PER_SEC;
+	guint notified = 0;
+
+	account = purple_account_new("test", "test");
+	xfer = purple_xfer_new(account, PURPLE_XFER_TYPE_RECEIVE, "pidgy");
+	purple_xfer_set_size(xfer, 1000);
+
+	g_signal_connect(xfer, "notify::throughput",
+	                 G_CALLBACK(test_purple_xfer_notify_counter), &notified);
+
+	g_assert_cmpfloat_with_epsilon(purple_xfer_get_throughput(xfer), 0.0,
+	                               0.001);
+
+	/* The rate is only recalculated every half second. */
+	_purple_xfer_sample_throughput(xfer, 100, now);
+	g_assert_cmpuint(notified, ==, 0);
+
+	now += G_USEC_PER_SEC / 2;
+	_purple_xfer_sample_throughput(xfer, 100, now);
+	g_assert_cmpuint(notified, ==, 1);
+	g_assert_cmpfloat_with_epsilon(purple_xfer_get_throughput(xfer), 400.0,
+	                               0.001);
+
+	/* While nothing moves, it falls... */
+	now += G_USEC_PER_SEC / 2;
+	_purple_xfer_sample_throughput(xfer, 0, now);
+	g_assert_cmpuint(notified, ==, 2);
+	g_assert_cmpfloat_with_epsilon(purple_xfer_get_throughput(xfer), 200.0,
+	                               0.001);
+
+	/* ...all the way to zero. */
+	for(gint i = 0; i < 10; i++) {
+		now += G_USEC_PER_SEC / 2;
+		_purple_xfer_sample_throughput(xfer, 0, now);
+	}
+	g_assert_cmpfloat_with_epsilon(purple_xfer_get_throughput(xfer), 0.0,
+	                               0.001);
+
+	/* Cleanup */
+	g_clear_object(&xfer);
+	g_clear_object(&account);
+}
+
+static void
+test_purple_xfer_stalls(void) {
+	PurpleAccount *account = NULL;
+	PurpleXfer *xfer = NULL;
+	gint64 now = G_USEC_PER_SEC;
+	guint notified = 0;
+
+	account = purple_account_new("test", "test");
+	xfer = purple_xfer_new(account, PURPLE_XFER_TYPE_RECEIVE, "pidgy");
+
+	g_signal_connect(xfer, "notify::stalls",
+	                 G_CALLBACK(test_purple_xfer_notify_counter), &notified);
+
+	g_assert_cmpuint(purple_xfer_get_stalls(xfer), ==, 0);
+
+	/* Being woken up without any data isn't a stall by itself. */
+	_purple_xfer_sample_throughput(xfer, 100, now);
+	for(gint i = 0; i < 10; i++) {
+		now += G_USEC_PER_SEC / 10;
+		_purple_xfer_sample_throughput(xfer, 0, now);
+	}
+	g_assert_cmpuint(purple_xfer_get_stalls(xfer), ==, 0);
+
+	/* Going a couple of seconds without any is, but only once however many
+	 * times we're woken up.
+	 */
+	for(gint i = 0; i < 20; i++) {
+		now += G_USEC_PER_SEC / 10;
+		_purple_xfer_sample_throughput(xfer, 0, now);
+	}
+	g_assert_cmpuint(purple_xfer_get_stalls(xfer), ==, 1);
+	g_assert_cmpuint(notified, ==, 1);
+
+	/* Once data moves again, the next stall is counted too. */
+	_purple_xfer_sample_throughput(xfer, 100, now);
+	now += 2 * G_USEC_PER_SEC;
+	_purple_xfer_sample_throughput(xfer, 0, now);
+	g_assert_cmpuint(purple_xfer_get_stalls(xfer), ==, 2);
+	g_assert_cmpuint(notified, ==, 2);
+
+	/* Cleanup */
+	g_clear_object(&xfer);
+	g_clear_object(&account);
+}
+
+/******************************************************************************
+ * Main
+ *****************************************************************************/
+gint
+main(gint argc, gchar *argv[]) {
+	g_test_init(&argc, &argv, NULL);
+
+	test_ui_purple_init();
+
+#ifdef G_OS_UNIX
+	g_test_add_func("/xfer/read-into", test_purple_xfer_read_into);
+#endif
+	g_test_add_func("/xfer/throughput", test_purple_xfer_throughput);
+	g_test_add_func("/xfer/stalls", test_purple_xfer_stalls);
+
+	return g_test_run();
+}
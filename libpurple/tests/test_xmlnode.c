@@ -21,6 +21,7 @@
  *
  */
 #include <glib.h>
+#include <string.h>
 
 #include <purple.h>
 
@@ -134,6 +135,37 @@ test_strip_prefixes(void) {
 	purple_xmlnode_free(xml);
 }
 
+static void
+test_xmlnode_to_str(void) {
+	PurpleXmlNode *message, *body;
+	GString *str;
+	gchar *xml;
+	gint len = 0;
+
+	message = purple_xmlnode_new("message");
+	purple_xmlnode_set_attrib(message, "to", "a'b\"c");
+	purple_xmlnode_set_attrib(message, "type", "chat");
+	body = purple_xmlnode_new_child(message, "body");
+	purple_xmlnode_insert_data(body, "1 < 2 & \x01 ok", -1);
+	purple_xmlnode_new_child(message, "active");
+
+	xml = purple_xmlnode_to_str(message, &len);
+	g_assert_cmpstr(xml, ==,
+		"<message to='a&apos;b&quot;c' type='chat'>"
+			"<body>1 &lt; 2 &amp; &#x1; ok</body>"
+			"<active/>"
+		"</message>");
+	g_assert_cmpint(len, ==, strlen(xml));
+
+	str = g_string_new("<stream>");
+	purple_xmlnode_append_to_string(message, str);
+	g_assert_cmpstr(str->str + strlen("<stream>"), ==, xml);
+
+	g_string_free(str, TRUE);
+	g_free(xml);
+	purple_xmlnode_free(message);
+}
+
 gint
 main(gint argc, gchar **argv) {
 	g_test_init(&argc, &argv, NULL);
@@ -144,6 +176,8 @@ main(gint argc, gchar **argv) {
 	                test_xmlnode_prefixes);
 	g_test_add_func("/xmlnode/strip_prefixes",
 	                test_strip_prefixes);
+	g_test_add_func("/xmlnode/to_str",
+	                test_xmlnode_to_str);
 
 	return g_test_run();
 }
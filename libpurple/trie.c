@@ -42,6 +42,8 @@
 typedef struct _PurpleTrieRecord PurpleTrieRecord;
 typedef struct _PurpleTrieState PurpleTrieState;
 typedef struct _PurpleTrieRecordList PurpleTrieRecordList;
+typedef struct _PurpleTrieCompact PurpleTrieCompact;
+typedef struct _PurpleTrieCompactState PurpleTrieCompactState;
 
 /**
  * PurpleTrie:
@@ -63,8 +65,13 @@ typedef struct
 	GHashTable *records_map;
 	gsize records_total_size;
 
+	gboolean compact;
+
 	PurpleMemoryPool *states_mempool;
 	PurpleTrieState *root_state;
+	gsize states_size;
+
+	PurpleTrieCompact *compact_states;
 } PurpleTriePrivate;
 
 struct _PurpleTrieRecord
@@ -93,11 +100,39 @@ struct _PurpleTrieState
 	PurpleTrieRecord *found_word;
 };
 
+/* The read-only layout used when PurpleTrie:compact is set. States are
+ * numbered in breadth-first order, so the root is 0 and 0 can also mean "no
+ * such child". The edges of a state are stored sorted by character in
+ * edge_chars and edge_targets, from its first_edge up to the first_edge of
+ * the next state (there is a sentinel state at the end). The root is where
+ * most characters end up, so it gets a direct lookup table instead. */
+struct _PurpleTrieCompactState
+{
+	PurpleTrieRecord *found_word;
+	guint32 first_edge;
+	guint32 longest_suffix;
+};
+
+struct _PurpleTrieCompact
+{
+	PurpleTrieCompactState *states;
+	guint n_states;
+
+	guchar *edge_chars;
+	guint32 *edge_targets;
+	guint n_edges;
+
+	guint32 root[256];
+};
+
 typedef struct
 {
 	PurpleTrieState *state;
-
 	PurpleTrieState *root_state;
+
+	PurpleTrieCompact *compact;
+	guint32 compact_state;
+
 	gboolean reset_on_match;
 
 	PurpleTrieReplaceCb replace_cb;
@@ -110,6 +145,7 @@ enum
 {
 	PROP_ZERO,
 	PROP_RESET_ON_MATCH,
+	PROP_COMPACT,
 	PROP_LAST
 };
 
@@ -202,13 +238,25 @@ purple_record_list_remove(PurpleTrieRecordList *head,
  * States management
  ******************************************************************************/
 
+static void
+purple_trie_compact_free(PurpleTrieCompact *compact)
+{
+	g_free(compact->states);
+	g_free(compact->edge_chars);
+	g_free(compact->edge_targets);
+	g_free(compact);
+}
+
 static void
 purple_trie_states_cleanup(PurpleTriePrivate *priv)
 {
 	if (priv->root_state != NULL) {
 		purple_memory_pool_cleanup(priv->states_mempool);
 		priv->root_state = NULL;
+		priv->states_size = 0;
 	}
+
+	g_clear_pointer(&priv->compact_states, purple_trie_compact_free);
 }
 
 /* Allocates a state and binds it to the parent. */
@@ -221,6 +269,7 @@ purple_trie_state_new(PurpleTriePrivate *priv, PurpleTrieState *parent,
 	state = purple_memory_pool_alloc0(priv->states_mempool,
 		sizeof(PurpleTrieState), sizeof(gpointer));
 	g_return_val_if_fail(state != NULL, NULL);
+	priv->states_size += sizeof(PurpleTrieState);
 
 	if (parent == NULL)
 		return state;
@@ -232,6 +281,7 @@ purple_trie_state_new(PurpleTriePrivate *priv, PurpleTrieState *parent,
 			/* PurpleTrieState *children[G_MAXUCHAR + 1] */
 			256 * sizeof(gpointer),
 			sizeof(gpointer));
+		priv->states_size += 256 * sizeof(gpointer);
 	}
 
 	if (parent->children == NULL) {
@@ -245,6 +295,97 @@ purple_trie_state_new(PurpleTriePrivate *priv, PurpleTrieState *parent,
 	return state;
 }
 
+/* Converts a built trie to the compact layout. */
+static PurpleTrieCompact *
+purple_trie_compact_new(PurpleTrieState *root)
+{
+	PurpleTrieCompact *compact;
+	GHashTable *indexes;
+	GPtrArray *order;
+	guint i, edge, n_edges = 0;
+
+	/* Number the states breadth-first. Every child is numbered after its
+	 * parent, so the root gets 0. */
+	indexes = g_hash_table_new(g_direct_hash, g_direct_equal);
+	order = g_ptr_array_new();
+	g_ptr_array_add(order, root);
+
+	for (i = 0; i < order->len; i++) {
+		PurpleTrieState *state = g_ptr_array_index(order, i);
+		guint character;
+
+		if (state->children == NULL)
+			continue;
+
+		for (character = 0; character < 256; character++) {
+			PurpleTrieState *child = state->children[character];
+
+			if (child == NULL)
+				continue;
+
+			g_hash_table_insert(indexes, child,
+				GUINT_TO_POINTER(order->len));
+			g_ptr_array_add(order, child);
+			n_edges++;
+		}
+	}
+
+	compact = g_new0(PurpleTrieCompact, 1);
+	compact->n_states = order->len;
+	compact->states = g_new0(PurpleTrieCompactState, order->len + 1);
+	compact->n_edges = n_edges;
+	compact->edge_chars = g_new(guchar, n_edges);
+	compact->edge_targets = g_new(guint32, n_edges);
+
+	edge = 0;
+	for (i = 0; i < order->len; i++) {
+		PurpleTrieState *state = g_ptr_array_index(order, i);
+		PurpleTrieCompactState *cstate = &compact->states[i];
+		guint character;
+
+		cstate->found_word = state->found_word;
+		cstate->first_edge = edge;
+		/* The root doesn't have a suffix, and isn't in indexes. Both
+		 * end up as 0. */
+		cstate->longest_suffix = GPOINTER_TO_UINT(
+			g_hash_table_lookup(indexes, state->longest_suffix));
+
+		if (state->children == NULL)
+			continue;
+
+		for (character = 0; character < 256; character++) {
+			PurpleTrieState *child = state->children[character];
+
+			if (child == NULL)
+				continue;
+
+			compact->edge_chars[edge] = character;
+			compact->edge_targets[edge] = GPOINTER_TO_UINT(
+				g_hash_table_lookup(indexes, child));
+			edge++;
+		}
+	}
+	compact->states[order->len].first_edge = edge;
+
+	for (edge = 0; edge < compact->states[1].first_edge; edge++) {
+		compact->root[compact->edge_chars[edge]] =
+			compact->edge_targets[edge];
+	}
+
+	g_ptr_array_free(order, TRUE);
+	g_hash_table_destroy(indexes);
+
+	return compact;
+}
+
+static gsize
+purple_trie_compact_get_size(PurpleTrieCompact *compact)
+{
+	return sizeof(PurpleTrieCompact) +
+		(compact->n_states + 1) * sizeof(PurpleTrieCompactState) +
+		compact->n_edges * (sizeof(guchar) + sizeof(guint32));
+}
+
 static gboolean
 purple_trie_states_build(PurpleTriePrivate *priv)
 {
@@ -253,7 +394,7 @@ purple_trie_states_build(PurpleTriePrivate *priv)
 	PurpleTrieRecordList *reclist, *it;
 	gulong cur_len;
 
-	if (priv->root_state != NULL)
+	if (priv->root_state != NULL || priv->compact_states != NULL)
 		return TRUE;
 
 	if (priv->records_total_size < PURPLE_TRIE_LARGE_THRESHOLD) {
@@ -351,6 +492,15 @@ purple_trie_states_build(PurpleTriePrivate *priv)
 
 	g_object_unref(reclist_mpool);
 
+	if (priv->compact) {
+		priv->compact_states = purple_trie_compact_new(root);
+
+		/* We don't need the pointer based states anymore. */
+		purple_memory_pool_cleanup(priv->states_mempool);
+		priv->root_state = NULL;
+		priv->states_size = 0;
+	}
+
 	return TRUE;
 }
 
@@ -358,9 +508,86 @@ purple_trie_states_build(PurpleTriePrivate *priv)
  * Searching
  ******************************************************************************/
 
+static void
+purple_trie_machine_init(PurpleTrieMachine *m, PurpleTriePrivate *priv)
+{
+	purple_trie_states_build(priv);
+
+	m->state = priv->root_state;
+	m->root_state = priv->root_state;
+	m->compact = priv->compact_states;
+	m->compact_state = 0;
+	m->reset_on_match = priv->reset_on_match;
+}
+
+static void
+purple_trie_machine_reset(PurpleTrieMachine *m)
+{
+	m->state = m->root_state;
+	m->compact_state = 0;
+}
+
+static PurpleTrieRecord *
+purple_trie_machine_found_word(PurpleTrieMachine *m)
+{
+	if (m->compact)
+		return m->compact->states[m->compact_state].found_word;
+
+	return m->state->found_word;
+}
+
+/* Returns the child of state for character, or 0 if there isn't one. */
+static guint32
+purple_trie_compact_child(PurpleTrieCompact *compact, guint32 state,
+                          guchar character)
+{
+	guint32 low, high;
+
+	if (state == 0)
+		return compact->root[character];
+
+	low = compact->states[state].first_edge;
+	high = compact->states[state + 1].first_edge;
+	while (low < high) {
+		guint32 middle = low + (high - low) / 2;
+		guchar edge = compact->edge_chars[middle];
+
+		if (edge == character)
+			return compact->edge_targets[middle];
+
+		if (edge < character)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return 0;
+}
+
 static void
 purple_trie_advance(PurpleTrieMachine *m, const guchar character)
 {
+	if (m->compact) {
+		/* Same as below, with state numbers. */
+		while (TRUE) {
+			guint32 child = purple_trie_compact_child(m->compact,
+				m->compact_state, character);
+
+			if (child != 0) {
+				m->compact_state = child;
+				break;
+			}
+
+			if (m->compact_state == 0)
+				break;
+
+			m->compact_state = m->compact->states[
+				m->compact_state].longest_suffix;
+		}
+
+		return;
+	}
+
 	/* change state after processing a character */
 	while (TRUE) {
 		/* Perfect fit - next character is the same, as the child of the
@@ -382,20 +609,21 @@ purple_trie_advance(PurpleTrieMachine *m, const guchar character)
 static gboolean
 purple_trie_replace_do_replacement(PurpleTrieMachine *m, GString *out)
 {
+	PurpleTrieRecord *found_word = purple_trie_machine_found_word(m);
 	gboolean was_replaced = FALSE;
 	gsize str_old_len;
 
 	/* if we reached a "found" state, let's process it */
-	if (!m->state->found_word)
+	if (!found_word)
 		return FALSE;
 
 	/* let's get back to the beginning of the word */
-	g_assert(out->len >= m->state->found_word->word_len - 1);
+	g_assert(out->len >= found_word->word_len - 1);
 	str_old_len = out->len;
-	out->len -= m->state->found_word->word_len - 1;
+	out->len -= found_word->word_len - 1;
 
-	was_replaced = m->replace_cb(out, m->state->found_word->word,
-		m->state->found_word->data, m->user_data);
+	was_replaced = m->replace_cb(out, found_word->word, found_word->data,
+		m->user_data);
 
 	/* output was untouched, revert to the previous position */
 	if (!was_replaced)
@@ -403,7 +631,7 @@ purple_trie_replace_do_replacement(PurpleTrieMachine *m, GString *out)
 
 	/* XXX */
 	if (was_replaced || m->reset_on_match)
-		m->state = m->root_state;
+		purple_trie_machine_reset(m);
 
 	return was_replaced;
 }
@@ -411,21 +639,22 @@ purple_trie_replace_do_replacement(PurpleTrieMachine *m, GString *out)
 static gboolean
 purple_trie_find_do_discovery(PurpleTrieMachine *m)
 {
+	PurpleTrieRecord *found_word = purple_trie_machine_found_word(m);
 	gboolean was_accepted;
 
 	/* if we reached a "found" state, let's process it */
-	if (!m->state->found_word)
+	if (!found_word)
 		return FALSE;
 
 	if (m->find_cb) {
-		was_accepted = m->find_cb(m->state->found_word->word,
-			m->state->found_word->data, m->user_data);
+		was_accepted = m->find_cb(found_word->word, found_word->data,
+			m->user_data);
 	} else {
 		was_accepted = TRUE;
 	}
 
 	if (was_accepted && m->reset_on_match)
-		m->state = m->root_state;
+		purple_trie_machine_reset(m);
 
 	return was_accepted;
 }
@@ -447,11 +676,7 @@ purple_trie_replace(PurpleTrie *trie, const gchar *src,
 
 	priv = purple_trie_get_instance_private(trie);
 
-	purple_trie_states_build(priv);
-
-	machine.state = priv->root_state;
-	machine.root_state = priv->root_state;
-	machine.reset_on_match = priv->reset_on_match;
+	purple_trie_machine_init(&machine, priv);
 	machine.replace_cb = replace_cb;
 	machine.user_data = user_data;
 
@@ -505,11 +730,7 @@ purple_trie_multi_replace(const GSList *tries, const gchar *src,
 
 		priv = purple_trie_get_instance_private(trie);
 
-		purple_trie_states_build(priv);
-
-		machines[i].state = priv->root_state;
-		machines[i].root_state = priv->root_state;
-		machines[i].reset_on_match = priv->reset_on_match;
+		purple_trie_machine_init(&machines[i], priv);
 		machines[i].replace_cb = replace_cb;
 		machines[i].user_data = user_data;
 	}
@@ -537,8 +758,7 @@ purple_trie_multi_replace(const GSList *tries, const gchar *src,
 		/* If we replaced a word, reset _all_ machines */
 		if (was_replaced) {
 			for (m_idx = 0; m_idx < tries_count; m_idx++) {
-				machines[m_idx].state =
-					machines[m_idx].root_state;
+				purple_trie_machine_reset(&machines[m_idx]);
 			}
 		}
 	}
@@ -563,11 +783,7 @@ purple_trie_find(PurpleTrie *trie, const gchar *src,
 
 	priv = purple_trie_get_instance_private(trie);
 
-	purple_trie_states_build(priv);
-
-	machine.state = priv->root_state;
-	machine.root_state = priv->root_state;
-	machine.reset_on_match = priv->reset_on_match;
+	purple_trie_machine_init(&machine, priv);
 	machine.find_cb = find_cb;
 	machine.user_data = user_data;
 
@@ -617,11 +833,7 @@ purple_trie_multi_find(const GSList *tries, const gchar *src,
 
 		priv = purple_trie_get_instance_private(trie);
 
-		purple_trie_states_build(priv);
-
-		machines[i].state = priv->root_state;
-		machines[i].root_state = priv->root_state;
-		machines[i].reset_on_match = priv->reset_on_match;
+		purple_trie_machine_init(&machines[i], priv);
 		machines[i].find_cb = find_cb;
 		machines[i].user_data = user_data;
 	}
@@ -647,8 +859,7 @@ purple_trie_multi_find(const GSList *tries, const gchar *src,
 			for (m_idx = 0; m_idx < tries_count; m_idx++) {
 				if (!machines[m_idx].reset_on_match)
 					continue;
-				machines[m_idx].state =
-					machines[m_idx].root_state;
+				purple_trie_machine_reset(&machines[m_idx]);
 			}
 		}
 	}
@@ -738,6 +949,23 @@ purple_trie_get_size(PurpleTrie *trie)
 	return g_hash_table_size(priv->records_map);
 }
 
+gsize
+purple_trie_get_memory_size(PurpleTrie *trie)
+{
+	PurpleTriePrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_TRIE(trie), 0);
+
+	priv = purple_trie_get_instance_private(trie);
+
+	purple_trie_states_build(priv);
+
+	if (priv->compact_states != NULL)
+		return purple_trie_compact_get_size(priv->compact_states);
+
+	return priv->states_size;
+}
+
 
 /*******************************************************************************
  * API implementation
@@ -766,6 +994,36 @@ purple_trie_set_reset_on_match(PurpleTrie *trie, gboolean reset)
 	g_object_notify_by_pspec(G_OBJECT(trie), properties[PROP_RESET_ON_MATCH]);
 }
 
+gboolean
+purple_trie_get_compact(PurpleTrie *trie)
+{
+	PurpleTriePrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_TRIE(trie), FALSE);
+
+	priv = purple_trie_get_instance_private(trie);
+	return priv->compact;
+}
+
+void
+purple_trie_set_compact(PurpleTrie *trie, gboolean compact)
+{
+	PurpleTriePrivate *priv = NULL;
+
+	g_return_if_fail(PURPLE_IS_TRIE(trie));
+
+	priv = purple_trie_get_instance_private(trie);
+
+	if (priv->compact == compact)
+		return;
+
+	/* The states will be built in the new layout on the next search. */
+	priv->compact = compact;
+	purple_trie_states_cleanup(priv);
+
+	g_object_notify_by_pspec(G_OBJECT(trie), properties[PROP_COMPACT]);
+}
+
 /*******************************************************************************
  * Object stuff
  ******************************************************************************/
@@ -796,6 +1054,8 @@ purple_trie_finalize(GObject *obj)
 	PurpleTriePrivate *priv =
 			purple_trie_get_instance_private(PURPLE_TRIE(obj));
 
+	purple_trie_states_cleanup(priv);
+
 	g_hash_table_destroy(priv->records_map);
 	g_object_unref(priv->records_obj_mempool);
 	g_object_unref(priv->records_str_mempool);
@@ -815,6 +1075,9 @@ purple_trie_get_property(GObject *obj, guint param_id, GValue *value,
 		case PROP_RESET_ON_MATCH:
 			g_value_set_boolean(value, priv->reset_on_match);
 			break;
+		case PROP_COMPACT:
+			g_value_set_boolean(value, priv->compact);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, param_id, pspec);
 	}
@@ -831,6 +1094,9 @@ purple_trie_set_property(GObject *obj, guint param_id,
 		case PROP_RESET_ON_MATCH:
 			priv->reset_on_match = g_value_get_boolean(value);
 			break;
+		case PROP_COMPACT:
+			purple_trie_set_compact(trie, g_value_get_boolean(value));
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, param_id, pspec);
 	}
@@ -854,5 +1120,13 @@ purple_trie_class_init(PurpleTrieClass *klass)
 		"you perform only find operations.", TRUE,
 		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
 
+	properties[PROP_COMPACT] = g_param_spec_boolean("compact",
+		"Compact", "Determines, if the search states should be kept in "
+		"a compact, read-only layout. It takes far less memory than "
+		"the default one, at the cost of a slightly slower lookup of "
+		"each character and a longer rebuild after modifications.",
+		FALSE,
+		G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties(obj_class, PROP_LAST, properties);
 }
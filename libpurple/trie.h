@@ -97,6 +97,7 @@ G_BEGIN_DECLS
  * Its main drawback is a significant memory usage - every internal trie node
  * needs about 1kB of memory on 32-bit machine and 2kB on 64-bit. Fortunately,
  * the trie grows slower when more words (with common prefixes) are added.
+ * For big sets of words, that are rarely modified, see #PurpleTrie:compact.
  * We could avoid invalidating the whole tree when altering it, but it would
  * require figuring out, how to update <literal>longest_suffix</literal> fields
  * in satisfying time.
@@ -145,6 +146,35 @@ purple_trie_get_reset_on_match(PurpleTrie *trie);
 void
 purple_trie_set_reset_on_match(PurpleTrie *trie, gboolean reset);
 
+/**
+ * purple_trie_get_compact:
+ * @trie: the trie.
+ *
+ * Checks, if the trie keeps its internal structure in the compact layout.
+ *
+ * Returns: %TRUE, if the compact layout is used, %FALSE otherwise.
+ */
+gboolean
+purple_trie_get_compact(PurpleTrie *trie);
+
+/**
+ * purple_trie_set_compact:
+ * @trie: the trie.
+ * @compact: %TRUE, if trie should use the compact layout, %FALSE otherwise.
+ *
+ * Switches the internal structure of the trie between the default layout and
+ * a compact, read-only one. The compact layout is built from the default one
+ * on the next search and only stores the transitions that exist, so it needs
+ * a few bytes per character of the stored words instead of about 2kB per
+ * internal node. Lookups and the results are the same, but each step is a bit
+ * slower and every modification of the trie throws the whole structure away.
+ *
+ * It's meant for big dictionaries that are built once and then searched many
+ * times.
+ */
+void
+purple_trie_set_compact(PurpleTrie *trie, gboolean compact);
+
 /**
  * purple_trie_add:
  * @trie: the trie.
@@ -190,6 +220,19 @@ purple_trie_remove(PurpleTrie *trie, const gchar *word);
 guint
 purple_trie_get_size(PurpleTrie *trie);
 
+/**
+ * purple_trie_get_memory_size:
+ * @trie: the trie.
+ *
+ * Returns the memory used by the internal search structure of the trie, not
+ * counting the stored words themselves. The structure is built first, if it
+ * isn't already.
+ *
+ * Returns: the size in bytes.
+ */
+gsize
+purple_trie_get_memory_size(PurpleTrie *trie);
+
 /**
  * purple_trie_replace:
  * @trie: the trie.
@@ -36,12 +36,16 @@
 
 #include <json-glib/json-glib.h>
 
+static void purple_util_write_shutdown(void);
+
 void
 purple_util_init(void) {
 }
 
 void
 purple_util_uninit(void) {
+	purple_util_write_shutdown();
+
 	purple_util_set_user_dir(NULL);
 }
 
@@ -81,10 +85,58 @@ purple_date_format_full(const struct tm *tm)
 /**************************************************************************
  * Path/Filename Functions
  **************************************************************************/
+/* Creates dir if it doesn't exist. This is only called once writing a file in
+ * it has failed, rather than checking every time, since it nearly always does.
+ */
+static gboolean
+purple_util_ensure_dir(const char *dir, GError **error)
+{
+	if (g_mkdir(dir, S_IRUSR | S_IWUSR | S_IXUSR) == -1 && errno != EEXIST) {
+		int errsv = errno;
+
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv),
+		            "Error creating directory %s: %s", dir, g_strerror(errsv));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+purple_util_write_file_in_dir(const char *dir, const char *filename_full,
+                              const char *data, gssize size,
+                              GFileSetContentsFlags flags, int mode,
+                              GError **error)
+{
+	GError *local_error = NULL;
+
+	if (size == -1) {
+		size = strlen(data);
+	}
+
+	if (g_file_set_contents_full(filename_full, data, size, flags, mode,
+	                             &local_error))
+	{
+		return TRUE;
+	}
+
+	if (!g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT) ||
+	    !purple_util_ensure_dir(dir, NULL))
+	{
+		g_propagate_error(error, local_error);
+		return FALSE;
+	}
+	g_clear_error(&local_error);
+
+	return g_file_set_contents_full(filename_full, data, size, flags, mode,
+	                                error);
+}
+
 static gboolean
 purple_util_write_data_to_file_common(const char *dir, const char *filename, const char *data, gssize size)
 {
 	gchar *filename_full;
+	GError *error = NULL;
 	gboolean ret = FALSE;
 
 	g_return_val_if_fail(dir != NULL, FALSE);
@@ -92,22 +144,240 @@ purple_util_write_data_to_file_common(const char *dir, const char *filename, con
 	purple_debug_misc("util", "Writing file %s to directory %s",
 			  filename, dir);
 
-	/* Ensure the directory exists */
-	if (!g_file_test(dir, G_FILE_TEST_IS_DIR))
-	{
-		if (g_mkdir(dir, S_IRUSR | S_IWUSR | S_IXUSR) == -1)
-		{
-			purple_debug_error("util", "Error creating directory %s: %s\n",
-					   dir, g_strerror(errno));
-			return FALSE;
+	filename_full = g_build_filename(dir, filename, NULL);
+	ret = purple_util_write_file_in_dir(dir, filename_full, data, size,
+	                                    G_FILE_SET_CONTENTS_CONSISTENT, 0666,
+	                                    &error);
+	if (!ret) {
+		purple_debug_error("util", "Error writing file %s: %s",
+		                   filename_full, error->message);
+		g_clear_error(&error);
+	}
+	g_free(filename_full);
+
+	return ret;
+}
+
+/**************************************************************************
+ * Background Writes
+ **************************************************************************/
+/* Configuration files are snapshotted as an xmlnode on the main thread and
+ * then formatted and written on a single worker thread, so they're written in
+ * the order they were requested. A snapshot that hasn't been picked up by the
+ * worker yet is replaced by a newer one for the same file, so a file that's
+ * saved repeatedly is only written once.
+ */
+typedef struct {
+	gchar *dir;
+	gchar *filename_full;
+	PurpleXmlNode *node;
+
+	guint requests;
+	gint64 queued;
+
+	/* Set by the worker for the report. */
+	gsize size;
+	gint64 write_time;
+	gint64 latency;
+	gboolean success;
+	gchar *error;
+} PurpleUtilWriteJob;
+
+static GThreadPool *write_pool = NULL;
+static GMutex write_lock;
+static GCond write_cond;
+static GHashTable *write_pending = NULL; /* filename_full -> PurpleUtilWriteJob */
+static GQueue write_finished = G_QUEUE_INIT;
+static guint write_outstanding = 0;
+static guint write_report_source = 0;
+
+static void
+purple_util_write_job_free(PurpleUtilWriteJob *job)
+{
+	g_free(job->dir);
+	g_free(job->filename_full);
+	g_clear_pointer(&job->node, purple_xmlnode_free);
+	g_free(job->error);
+	g_free(job);
+}
+
+/* Runs on the main thread so that the debug ui ops are only ever called from
+ * there. */
+static gboolean
+purple_util_write_report_cb(G_GNUC_UNUSED gpointer data)
+{
+	PurpleUtilWriteJob *job;
+
+	g_mutex_lock(&write_lock);
+	write_report_source = 0;
+	g_mutex_unlock(&write_lock);
+
+	while (TRUE) {
+		g_mutex_lock(&write_lock);
+		job = g_queue_pop_head(&write_finished);
+		g_mutex_unlock(&write_lock);
+
+		if (job == NULL) {
+			break;
 		}
+
+		if (job->success) {
+			purple_debug_misc("util",
+			                  "Wrote %s (%" G_GSIZE_FORMAT " bytes, %u "
+			                  "request(s)) in %" G_GINT64_FORMAT " ms, %"
+			                  G_GINT64_FORMAT " ms after it was requested",
+			                  job->filename_full, job->size, job->requests,
+			                  job->write_time / 1000, job->latency / 1000);
+		} else {
+			purple_debug_error("util", "Error writing file %s: %s",
+			                   job->filename_full, job->error);
+		}
+
+		purple_util_write_job_free(job);
 	}
 
-	filename_full = g_build_filename(dir, filename, NULL);
-	ret = g_file_set_contents(filename_full, data, size, NULL);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+purple_util_write_worker(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	PurpleUtilWriteJob *job = NULL;
+	GError *error = NULL;
+	gchar *filename_full = data;
+	gchar *contents;
+	gint64 start;
+	int len = 0;
+
+	g_mutex_lock(&write_lock);
+	g_hash_table_steal_extended(write_pending, filename_full, NULL,
+	                            (gpointer *)&job);
+	if (job == NULL) {
+		/* Newer snapshots replace the pending job in place, so each push
+		 * has its own job. Don't leave _purple_util_write_flush() waiting
+		 * if that ever changes. */
+		g_warn_if_reached();
+		write_outstanding--;
+		g_cond_broadcast(&write_cond);
+		g_mutex_unlock(&write_lock);
+		g_free(filename_full);
+
+		return;
+	}
+	g_mutex_unlock(&write_lock);
 	g_free(filename_full);
 
-	return ret;
+	start = g_get_monotonic_time();
+
+	contents = purple_xmlnode_to_formatted_str(job->node, &len);
+	g_clear_pointer(&job->node, purple_xmlnode_free);
+
+	job->size = len;
+	job->success = purple_util_write_file_in_dir(job->dir, job->filename_full,
+	                                             contents, len,
+	                                             G_FILE_SET_CONTENTS_CONSISTENT |
+	                                             G_FILE_SET_CONTENTS_DURABLE,
+	                                             0600, &error);
+	if (!job->success) {
+		job->error = g_strdup(error->message);
+		g_clear_error(&error);
+	}
+	g_free(contents);
+
+	job->write_time = g_get_monotonic_time() - start;
+	job->latency = g_get_monotonic_time() - job->queued;
+
+	g_mutex_lock(&write_lock);
+	g_queue_push_tail(&write_finished, job);
+	if (write_report_source == 0) {
+		write_report_source = g_idle_add(purple_util_write_report_cb, NULL);
+	}
+	write_outstanding--;
+	g_cond_broadcast(&write_cond);
+	g_mutex_unlock(&write_lock);
+}
+
+void
+_purple_util_write_xml_to_config_file(const char *filename, PurpleXmlNode *node)
+{
+	PurpleUtilWriteJob *job = NULL;
+	const char *dir = purple_config_dir();
+	gchar *filename_full;
+
+	g_return_if_fail(filename != NULL);
+	g_return_if_fail(node != NULL);
+
+	if (write_pool == NULL) {
+		write_pending = g_hash_table_new(g_str_hash, g_str_equal);
+		write_pool = g_thread_pool_new(purple_util_write_worker, NULL, 1,
+		                               FALSE, NULL);
+	}
+
+	filename_full = g_build_filename(dir, filename, NULL);
+
+	g_mutex_lock(&write_lock);
+
+	job = g_hash_table_lookup(write_pending, filename_full);
+	if (job != NULL) {
+		/* The worker hasn't started on the last snapshot yet, so this one
+		 * can just replace it. */
+		purple_xmlnode_free(job->node);
+		job->node = node;
+		job->requests++;
+
+		g_mutex_unlock(&write_lock);
+		g_free(filename_full);
+
+		return;
+	}
+
+	job = g_new0(PurpleUtilWriteJob, 1);
+	job->dir = g_strdup(dir);
+	job->filename_full = g_strdup(filename_full);
+	job->node = node;
+	job->requests = 1;
+	job->queued = g_get_monotonic_time();
+
+	g_hash_table_insert(write_pending, job->filename_full, job);
+	write_outstanding++;
+
+	g_mutex_unlock(&write_lock);
+
+	g_thread_pool_push(write_pool, filename_full, NULL);
+}
+
+void
+_purple_util_write_flush(void)
+{
+	if (write_pool == NULL) {
+		return;
+	}
+
+	g_mutex_lock(&write_lock);
+	while (write_outstanding > 0) {
+		g_cond_wait(&write_cond, &write_lock);
+	}
+	if (write_report_source != 0) {
+		g_source_remove(write_report_source);
+		write_report_source = 0;
+	}
+	g_mutex_unlock(&write_lock);
+
+	purple_util_write_report_cb(NULL);
+}
+
+static void
+purple_util_write_shutdown(void)
+{
+	if (write_pool == NULL) {
+		return;
+	}
+
+	_purple_util_write_flush();
+
+	g_thread_pool_free(write_pool, FALSE, TRUE);
+	write_pool = NULL;
+	g_clear_pointer(&write_pending, g_hash_table_destroy);
 }
 
 gboolean
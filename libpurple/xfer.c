@@ -20,11 +20,23 @@
  *
  */
 
+#ifdef __linux__
+/* splice() and F_SETPIPE_SZ are GNU extensions. */
+# define _GNU_SOURCE
+#endif
+
 #include <glib/gi18n-lib.h>
 
 #include "internal.h"
 #include "glibcompat.h" /* for purple_g_stat on win32 */
 
+#ifdef HAVE_SENDFILE
+# include <sys/sendfile.h>
+#endif
+#ifdef HAVE_SPLICE
+# include <fcntl.h>
+#endif
+
 #include <glib/gstdio.h>
 
 #include "debug.h"
@@ -37,6 +49,7 @@
 #include "purple-gio.h"
 #include "purpleconversationmanager.h"
 #include "purpleenums.h"
+#include "purpleprivate.h"
 #include "request.h"
 #include "server.h"
 #include "util.h"
@@ -45,6 +58,20 @@
 #define FT_INITIAL_BUFFER_SIZE 4096
 #define FT_MAX_BUFFER_SIZE     65535
 
+/* How much we ask the kernel to move at once when it's doing the copying. */
+#define FT_ZERO_COPY_CHUNK_SIZE (1024 * 1024)
+
+/* How many idle FT_MAX_BUFFER_SIZE buffers we hold on to for new transfers. */
+#define FT_BUFFER_POOL_SIZE    8
+
+/* How often, in microseconds, the throughput property is recalculated. */
+#define FT_THROUGHPUT_INTERVAL (G_USEC_PER_SEC / 2)
+
+/* How long, in microseconds, a transfer has to go without moving any data
+ * before it counts as stalled.
+ */
+#define FT_STALL_THRESHOLD (2 * G_USEC_PER_SEC)
+
 typedef struct _PurpleXferPrivate  PurpleXferPrivate;
 
 static PurpleXferUiOps *xfer_ui_ops = NULL;
@@ -78,8 +105,27 @@ struct _PurpleXferPrivate {
 	gint64 start_time;           /* When the transfer of data began.    */
 	gint64 end_time;             /* When the transfer of data ended.    */
 
-	size_t current_buffer_size;  /* This gradually increases for fast
-	                                 network connections.               */
+	size_t current_buffer_size;  /* This grows for fast network
+	                                connections and shrinks again when
+	                                the other side can't keep up.      */
+	guchar *io_buffer;           /* FT_MAX_BUFFER_SIZE bytes from the
+	                                buffer pool, used for each chunk.   */
+
+	gint64 sample_time;          /* When the current throughput sample
+	                                started.                            */
+	goffset sample_bytes;        /* Bytes moved during that sample.     */
+	gdouble throughput;          /* Smoothed bytes per second.          */
+	guint throughput_timer;      /* Samples the throughput while no
+	                                data is moving.                     */
+	gint64 progress_time;        /* When data last moved.               */
+	gboolean stalled;            /* Whether the current stall has been
+	                                counted.                            */
+	guint stalls;                /* Times no data moved for
+	                                FT_STALL_THRESHOLD.                 */
+
+	gboolean zero_copy;          /* Whether the kernel is moving the data
+	                                between fd and dest_fp for us.      */
+	int pipe_fds[2];             /* Used to splice received data.       */
 
 	PurpleXferStatus status;     /* File Transfer's status.             */
 
@@ -128,11 +174,15 @@ enum
 	PROP_STATUS,
 	PROP_PROGRESS,
 	PROP_VISIBLE,
+	PROP_THROUGHPUT,
+	PROP_STALLS,
 	PROP_LAST
 };
 
 static GParamSpec *properties[PROP_LAST];
 
+static GPtrArray *buffer_pool = NULL;
+
 /* GObject signal enums */
 enum
 {
@@ -1097,15 +1147,118 @@ purple_xfer_set_bytes_sent(PurpleXfer *xfer, goffset bytes_sent)
 	g_return_if_fail(PURPLE_IS_XFER(xfer));
 
 	priv = purple_xfer_get_instance_private(xfer);
-	priv->bytes_sent = bytes_sent;
 
 	obj = G_OBJECT(xfer);
 	g_object_freeze_notify(obj);
+
+	if (bytes_sent > priv->bytes_sent) {
+		_purple_xfer_sample_throughput(xfer, bytes_sent - priv->bytes_sent,
+		                               g_get_monotonic_time());
+	}
+
+	priv->bytes_sent = bytes_sent;
+
 	g_object_notify_by_pspec(obj, properties[PROP_BYTES_SENT]);
 	g_object_notify_by_pspec(obj, properties[PROP_PROGRESS]);
 	g_object_thaw_notify(obj);
 }
 
+void
+_purple_xfer_sample_throughput(PurpleXfer *xfer, goffset bytes, gint64 now)
+{
+	PurpleXferPrivate *priv = NULL;
+
+	g_return_if_fail(PURPLE_IS_XFER(xfer));
+
+	priv = purple_xfer_get_instance_private(xfer);
+
+	if (priv->sample_time == 0) {
+		priv->sample_time = now;
+	}
+
+	if (bytes > 0) {
+		priv->sample_bytes += bytes;
+		priv->progress_time = now;
+		priv->stalled = FALSE;
+	} else if (!priv->stalled && priv->progress_time != 0 &&
+	           now - priv->progress_time >= FT_STALL_THRESHOLD)
+	{
+		/* Count the stall once, not every time we're woken up during it. */
+		priv->stalled = TRUE;
+		priv->stalls++;
+		g_object_notify_by_pspec(G_OBJECT(xfer), properties[PROP_STALLS]);
+	}
+
+	if (now - priv->sample_time >= FT_THROUGHPUT_INTERVAL) {
+		gdouble rate = (gdouble)priv->sample_bytes * G_USEC_PER_SEC /
+		               (now - priv->sample_time);
+		gboolean changed = FALSE;
+
+		/* Smooth it out so the UIs don't jump around on every sample. */
+		if (priv->throughput > 0.0) {
+			rate = (priv->throughput + rate) / 2.0;
+		}
+
+		/* While nothing moves it halves every sample, so stop at zero. */
+		if (rate < 1.0) {
+			rate = 0.0;
+		}
+
+		priv->sample_time = now;
+		priv->sample_bytes = 0;
+
+		/* Anything under a byte per second isn't worth waking the UI for.
+		 * Rates below that are zero, so starting or stopping always is.
+		 */
+		changed = ABS(rate - priv->throughput) >= 1.0;
+		priv->throughput = rate;
+
+		if (changed) {
+			g_object_notify_by_pspec(G_OBJECT(xfer),
+			                         properties[PROP_THROUGHPUT]);
+		}
+	}
+}
+
+static gboolean
+purple_xfer_throughput_cb(gpointer data)
+{
+	_purple_xfer_sample_throughput(PURPLE_XFER(data), 0,
+	                               g_get_monotonic_time());
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+purple_xfer_stop_throughput_timer(PurpleXfer *xfer)
+{
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
+
+	g_clear_handle_id(&priv->throughput_timer, g_source_remove);
+}
+
+gdouble
+purple_xfer_get_throughput(PurpleXfer *xfer)
+{
+	PurpleXferPrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_XFER(xfer), 0.0);
+
+	priv = purple_xfer_get_instance_private(xfer);
+	return priv->throughput;
+}
+
+guint
+purple_xfer_get_stalls(PurpleXfer *xfer)
+{
+	PurpleXferPrivate *priv = NULL;
+
+	g_return_val_if_fail(PURPLE_IS_XFER(xfer), 0);
+
+	priv = purple_xfer_get_instance_private(xfer);
+	return priv->stalls;
+}
+
 PurpleXferUiOps *
 purple_xfer_get_ui_ops(PurpleXfer *xfer)
 {
@@ -1117,29 +1270,105 @@ purple_xfer_get_ui_ops(PurpleXfer *xfer)
 	return priv->ui_ops;
 }
 
+/*
+ * Buffers are handed back to a small pool when a transfer is done with them
+ * so that the next transfer doesn't have to allocate its own.
+ */
+static guchar *
+purple_xfer_buffer_pool_acquire(void)
+{
+	if (buffer_pool != NULL && buffer_pool->len > 0) {
+		return g_ptr_array_steal_index_fast(buffer_pool,
+		                                    buffer_pool->len - 1);
+	}
+
+	return g_malloc(FT_MAX_BUFFER_SIZE);
+}
+
 static void
-purple_xfer_increase_buffer_size(PurpleXfer *xfer)
+purple_xfer_buffer_pool_release(guchar *buffer)
+{
+	if (buffer == NULL) {
+		return;
+	}
+
+	if (buffer_pool == NULL) {
+		buffer_pool = g_ptr_array_new_with_free_func(g_free);
+	}
+
+	if (buffer_pool->len < FT_BUFFER_POOL_SIZE) {
+		g_ptr_array_add(buffer_pool, buffer);
+	} else {
+		g_free(buffer);
+	}
+}
+
+static guchar *
+purple_xfer_get_io_buffer(PurpleXfer *xfer)
 {
 	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
 
-	priv->current_buffer_size = MIN(priv->current_buffer_size * 1.5,
-			FT_MAX_BUFFER_SIZE);
+	if (priv->io_buffer == NULL) {
+		priv->io_buffer = purple_xfer_buffer_pool_acquire();
+	}
+
+	return priv->io_buffer;
 }
 
-static gssize
-do_read(PurpleXfer *xfer, guchar **buffer, gsize size)
+static void
+purple_xfer_release_io_buffer(PurpleXfer *xfer)
 {
-	PurpleXferPrivate *priv = NULL;
-	gssize r;
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
 
-	g_return_val_if_fail(PURPLE_IS_XFER(xfer), 0);
-	g_return_val_if_fail(buffer != NULL, 0);
+	purple_xfer_buffer_pool_release(priv->io_buffer);
+	priv->io_buffer = NULL;
+}
 
-	priv = purple_xfer_get_instance_private(xfer);
+/*
+ * Grows the buffer when a whole chunk went through, which means the network
+ * is fast and the buffer is too small, and shrinks it when only a small part
+ * of a chunk did, which means we're asking for more than the other side can
+ * keep up with.
+ */
+static void
+purple_xfer_adjust_buffer_size(PurpleXfer *xfer, gsize requested,
+                               gssize transferred)
+{
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
 
-	*buffer = g_malloc0(size);
+	if (transferred <= 0 || requested == 0) {
+		return;
+	}
 
-	r = read(priv->fd, *buffer, size);
+	if ((gsize)transferred >= priv->current_buffer_size) {
+		priv->current_buffer_size = MIN(priv->current_buffer_size * 1.5,
+		                                FT_MAX_BUFFER_SIZE);
+	} else if ((gsize)transferred < requested / 4) {
+		priv->current_buffer_size = MAX(priv->current_buffer_size / 2,
+		                                FT_INITIAL_BUFFER_SIZE);
+	}
+}
+
+static gsize
+purple_xfer_get_read_size(PurpleXfer *xfer)
+{
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
+
+	if (purple_xfer_get_size(xfer) == 0) {
+		return priv->current_buffer_size;
+	}
+
+	return MIN((gsize)purple_xfer_get_bytes_remaining(xfer),
+	           priv->current_buffer_size);
+}
+
+static gssize
+do_read_into(PurpleXfer *xfer, guchar *buffer, gsize size)
+{
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
+	gssize r;
+
+	r = read(priv->fd, buffer, size);
 	if (r < 0 && errno == EAGAIN) {
 		r = 0;
 	} else if (r < 0) {
@@ -1151,10 +1380,20 @@ do_read(PurpleXfer *xfer, guchar **buffer, gsize size)
 	return r;
 }
 
+static gssize
+do_read(PurpleXfer *xfer, guchar **buffer, gsize size)
+{
+	g_return_val_if_fail(PURPLE_IS_XFER(xfer), 0);
+	g_return_val_if_fail(buffer != NULL, 0);
+
+	*buffer = g_malloc(size);
+
+	return do_read_into(xfer, *buffer, size);
+}
+
 gssize
 purple_xfer_read(PurpleXfer *xfer, guchar **buffer)
 {
-	PurpleXferPrivate *priv = NULL;
 	PurpleXferClass *klass = NULL;
 	gsize s;
 	gssize r;
@@ -1162,16 +1401,7 @@ purple_xfer_read(PurpleXfer *xfer, guchar **buffer)
 	g_return_val_if_fail(PURPLE_IS_XFER(xfer), 0);
 	g_return_val_if_fail(buffer != NULL, 0);
 
-	priv = purple_xfer_get_instance_private(xfer);
-
-	if (purple_xfer_get_size(xfer) == 0) {
-		s = priv->current_buffer_size;
-	} else {
-		s = MIN(
-			(gssize)purple_xfer_get_bytes_remaining(xfer),
-			(gssize)priv->current_buffer_size
-		);
-	}
+	s = purple_xfer_get_read_size(xfer);
 
 	klass = PURPLE_XFER_GET_CLASS(xfer);
 	if(klass && klass->read) {
@@ -1180,15 +1410,42 @@ purple_xfer_read(PurpleXfer *xfer, guchar **buffer)
 		r = do_read(xfer, buffer, s);
 	}
 
-	if (r >= 0 && (gsize)r == priv->current_buffer_size) {
-		/*
-		 * We managed to read the entire buffer.  This means our
-		 * network is fast and our buffer is too small, so make it
-		 * bigger.
-		 */
-		purple_xfer_increase_buffer_size(xfer);
+	purple_xfer_adjust_buffer_size(xfer, s, r);
+
+	return r;
+}
+
+gssize
+purple_xfer_read_into(PurpleXfer *xfer, guchar *buffer, gsize size)
+{
+	PurpleXferClass *klass = NULL;
+	gsize s;
+	gssize r;
+
+	g_return_val_if_fail(PURPLE_IS_XFER(xfer), 0);
+	g_return_val_if_fail(buffer != NULL, 0);
+
+	s = MIN(purple_xfer_get_read_size(xfer), size);
+	if (s == 0) {
+		return 0;
+	}
+
+	klass = PURPLE_XFER_GET_CLASS(xfer);
+	if(klass == NULL || klass->read == NULL || klass->read == do_read) {
+		r = do_read_into(xfer, buffer, s);
+	} else {
+		/* The protocol only knows how to hand us a new buffer. */
+		guchar *tmp = NULL;
+
+		r = klass->read(xfer, &tmp, s);
+		if (r > 0) {
+			memcpy(buffer, tmp, r);
+		}
+		g_free(tmp);
 	}
 
+	purple_xfer_adjust_buffer_size(xfer, s, r);
+
 	return r;
 }
 
@@ -1223,6 +1480,9 @@ purple_xfer_write(PurpleXfer *xfer, const guchar *buffer, gsize size)
 		(gssize)purple_xfer_get_bytes_remaining(xfer),
 		(gssize)size
 	);
+	if (s == 0) {
+		return 0;
+	}
 
 	klass = PURPLE_XFER_GET_CLASS(xfer);
 	if(klass && klass->write) {
@@ -1334,13 +1594,199 @@ do_data_not_sent(PurpleXfer *xfer, const guchar *buffer, gsize size)
 	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
 
 	if (priv->buffer == NULL) {
-		priv->buffer = g_byte_array_sized_new(FT_INITIAL_BUFFER_SIZE);
+		priv->buffer = g_byte_array_sized_new(FT_MAX_BUFFER_SIZE);
+	}
+
+	/* If there's already data queued, buffer points into it and what wasn't
+	 * sent is left in place by do_transfer.
+	 */
+	if (priv->buffer->len == 0) {
 		g_byte_array_append(priv->buffer, buffer, size);
 	}
 
 	return TRUE;
 }
 
+/*
+ * When the protocol just hands us a plain fd and nobody else is handling the
+ * local file, we can let the kernel move the data between the socket and the
+ * file instead of copying it through userspace.
+ */
+static gboolean
+purple_xfer_can_zero_copy(PurpleXfer *xfer)
+{
+#if defined(HAVE_SENDFILE) || defined(HAVE_SPLICE)
+	PurpleXferClass *klass = PURPLE_XFER_GET_CLASS(xfer);
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
+
+	if (priv->fd == -1 || priv->dest_fp == NULL) {
+		return FALSE;
+	}
+
+	if (klass->read != do_read || klass->write != do_write ||
+	    klass->read_local != do_read_local ||
+	    klass->write_local != do_write_local)
+	{
+		return FALSE;
+	}
+
+	if (g_signal_has_handler_pending(xfer, signals[SIG_READ_LOCAL], 0, TRUE) ||
+	    g_signal_has_handler_pending(xfer, signals[SIG_WRITE_LOCAL], 0, TRUE))
+	{
+		return FALSE;
+	}
+
+#ifdef HAVE_SENDFILE
+	if (priv->type == PURPLE_XFER_TYPE_SEND) {
+		return TRUE;
+	}
+#endif
+
+#ifdef HAVE_SPLICE
+	if (priv->type == PURPLE_XFER_TYPE_RECEIVE) {
+		if (pipe(priv->pipe_fds) != 0) {
+			purple_debug_warning("xfer", "Unable to create pipe: %s",
+			                     g_strerror(errno));
+			priv->pipe_fds[0] = priv->pipe_fds[1] = -1;
+
+			return FALSE;
+		}
+
+#ifdef F_SETPIPE_SZ
+		/* This is only a hint, the default size still works. */
+		fcntl(priv->pipe_fds[1], F_SETPIPE_SZ, FT_ZERO_COPY_CHUNK_SIZE);
+#endif
+
+		return TRUE;
+	}
+#endif
+#endif /* HAVE_SENDFILE || HAVE_SPLICE */
+
+	return FALSE;
+}
+
+/*
+ * Switches back to copying through userspace, which is needed if the kernel
+ * turns out not to support the fds we gave it.
+ */
+static void
+purple_xfer_stop_zero_copy(PurpleXfer *xfer)
+{
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
+
+	purple_debug_info("xfer", "Falling back to buffered transfer for %s",
+	                  purple_xfer_get_local_filename(xfer));
+
+	priv->zero_copy = FALSE;
+
+	if (priv->pipe_fds[0] != -1) {
+		close(priv->pipe_fds[0]);
+		close(priv->pipe_fds[1]);
+		priv->pipe_fds[0] = priv->pipe_fds[1] = -1;
+	}
+
+	/* The kernel used explicit offsets, so the stream is still wherever
+	 * do_open_local left it.
+	 */
+	fseek(priv->dest_fp, priv->bytes_sent, SEEK_SET);
+}
+
+/*
+ * Returns the number of bytes that were moved, 0 if we should try again
+ * later, or -1 if the transfer should not continue.
+ */
+static gssize
+do_transfer_zero_copy(PurpleXfer *xfer)
+{
+	PurpleXferPrivate *priv = purple_xfer_get_instance_private(xfer);
+	int file_fd = fileno(priv->dest_fp);
+	off_t offset = priv->bytes_sent;
+	gssize r = -1;
+	gsize s;
+
+	if (purple_xfer_get_size(xfer) == 0) {
+		s = FT_ZERO_COPY_CHUNK_SIZE;
+	} else {
+		s = MIN((gsize)purple_xfer_get_bytes_remaining(xfer),
+		        FT_ZERO_COPY_CHUNK_SIZE);
+	}
+
+#ifdef HAVE_SENDFILE
+	if (priv->type == PURPLE_XFER_TYPE_SEND) {
+		/* Same as the buffered path, let the protocol keep the connection
+		 * open if it wants to.
+		 */
+		if (s == 0) {
+			if (priv->watcher) {
+				purple_input_remove(priv->watcher);
+				purple_xfer_set_watcher(xfer, 0);
+			}
+			return -1;
+		}
+
+		r = sendfile(priv->fd, file_fd, &offset, s);
+		if (r < 0 && errno == EAGAIN) {
+			return 0;
+		} else if (r < 0 && (errno == EINVAL || errno == ENOSYS)) {
+			purple_xfer_stop_zero_copy(xfer);
+			return 0;
+		} else if (r < 0) {
+			purple_debug_error("xfer", "sendfile failed! %s",
+			                   g_strerror(errno));
+			purple_xfer_cancel_remote(xfer);
+			return -1;
+		} else if (r == 0) {
+			purple_debug_error("xfer", "Unable to read file.");
+			purple_xfer_cancel_local(xfer);
+			return -1;
+		}
+	}
+#endif
+
+#ifdef HAVE_SPLICE
+	if (priv->type == PURPLE_XFER_TYPE_RECEIVE) {
+		gssize moved = 0;
+
+		r = splice(priv->fd, NULL, priv->pipe_fds[1], NULL, s,
+		           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (r < 0 && errno == EAGAIN) {
+			return 0;
+		} else if (r < 0 && (errno == EINVAL || errno == ENOSYS)) {
+			purple_xfer_stop_zero_copy(xfer);
+			return 0;
+		} else if (r <= 0) {
+			purple_xfer_cancel_remote(xfer);
+			return -1;
+		}
+
+		/* Everything that went into the pipe has to come back out before we
+		 * return so it's never left holding data.
+		 */
+		while (moved < r) {
+			gssize w = splice(priv->pipe_fds[0], NULL, file_fd, &offset,
+			                  r - moved, SPLICE_F_MOVE);
+
+			if (w < 0 && errno == EINTR) {
+				continue;
+			} else if (w <= 0) {
+				purple_debug_error("xfer", "Unable to write file: %s",
+				                   g_strerror(errno));
+				purple_xfer_cancel_local(xfer);
+				return -1;
+			}
+
+			moved += w;
+		}
+	}
+#endif
+
+	if (r > 0) {
+		purple_xfer_set_bytes_sent(xfer, priv->bytes_sent + r);
+	}
+
+	return r;
+}
+
 static void
 do_transfer(PurpleXfer *xfer)
 {
@@ -1348,17 +1794,21 @@ do_transfer(PurpleXfer *xfer)
 	guchar *buffer = NULL;
 	gssize r = 0;
 
-	if (priv->type == PURPLE_XFER_TYPE_RECEIVE) {
-		r = purple_xfer_read(xfer, &buffer);
+	if (priv->zero_copy) {
+		r = do_transfer_zero_copy(xfer);
+		if (r < 0) {
+			return;
+		}
+	} else if (priv->type == PURPLE_XFER_TYPE_RECEIVE) {
+		buffer = purple_xfer_get_io_buffer(xfer);
+		r = purple_xfer_read_into(xfer, buffer, FT_MAX_BUFFER_SIZE);
 		if (r > 0) {
 			if (!purple_xfer_write_file(xfer, buffer, r)) {
-				g_free(buffer);
 				return;
 			}
 
 		} else if(r < 0) {
 			purple_xfer_cancel_remote(xfer);
-			g_free(buffer);
 			return;
 		}
 	} else if (priv->type == PURPLE_XFER_TYPE_SEND) {
@@ -1380,7 +1830,7 @@ do_transfer(PurpleXfer *xfer)
 			return;
 		}
 
-		if (priv->buffer) {
+		if (priv->buffer && priv->buffer->len > 0) {
 			existing_buffer = TRUE;
 			if (priv->buffer->len < s) {
 				s -= priv->buffer->len;
@@ -1390,8 +1840,9 @@ do_transfer(PurpleXfer *xfer)
 			}
 		}
 
+		buffer = purple_xfer_get_io_buffer(xfer);
+
 		if (read_more) {
-			buffer = g_new(guchar, s);
 			result = purple_xfer_read_file(xfer, buffer, s);
 			if (result == 0) {
 				/*
@@ -1407,18 +1858,18 @@ do_transfer(PurpleXfer *xfer)
 				/* Need to indicate the protocol is still ready... */
 				priv->ready |= PURPLE_XFER_READY_PROTOCOL;
 
-				g_free(buffer);
 				g_return_if_reached();
 			}
 			if (result < 0) {
-				g_free(buffer);
 				return;
 			}
 		}
 
-		if (priv->buffer) {
+		/* Only copy into the queue when there's something already waiting
+		 * in it, otherwise we can send straight from the chunk buffer.
+		 */
+		if (existing_buffer) {
 			g_byte_array_append(priv->buffer, buffer, result);
-			g_free(buffer);
 			buffer = priv->buffer->data;
 			result = priv->buffer->len;
 		}
@@ -1428,28 +1879,22 @@ do_transfer(PurpleXfer *xfer)
 		if (r == -1) {
 			purple_debug_error("xfer", "do_write failed! %s\n", g_strerror(errno));
 			purple_xfer_cancel_remote(xfer);
-			if (!priv->buffer)
-				/* We don't free buffer if priv->buffer is set, because in
-				   that case buffer doesn't belong to us. */
-				g_free(buffer);
 			return;
-		} else if (r == result) {
-			/*
-			 * We managed to write the entire buffer.  This means our
-			 * network is fast and our buffer is too small, so make it
-			 * bigger.
-			 */
-			purple_xfer_increase_buffer_size(xfer);
-		} else {
+		}
+
+		purple_xfer_adjust_buffer_size(xfer, result, r);
+
+		if (r < result) {
 			gboolean handler_result = FALSE;
 			g_signal_emit(xfer, signals[SIG_DATA_NOT_SENT], 0, buffer + r,
 			              result - r, &handler_result);
 			if (!handler_result) {
 				purple_xfer_cancel_local(xfer);
+				return;
 			}
 		}
 
-		if (existing_buffer && priv->buffer) {
+		if (existing_buffer) {
 			/*
 			 * Remove what we wrote
 			 * If we wrote the whole buffer the byte array will be empty
@@ -1460,6 +1905,10 @@ do_transfer(PurpleXfer *xfer)
 		}
 	}
 
+	if (r == 0) {
+		_purple_xfer_sample_throughput(xfer, 0, g_get_monotonic_time());
+	}
+
 	if (r > 0) {
 		PurpleXferClass *klass = PURPLE_XFER_GET_CLASS(xfer);
 
@@ -1467,8 +1916,6 @@ do_transfer(PurpleXfer *xfer)
 			klass->ack(xfer, buffer, r);
 	}
 
-	g_free(buffer);
-
 	if (purple_xfer_get_bytes_sent(xfer) >= purple_xfer_get_size(xfer) &&
 			!purple_xfer_is_completed(xfer)) {
 		purple_xfer_set_completed(xfer, TRUE);
@@ -1547,6 +1994,12 @@ begin_transfer(PurpleXfer *xfer, PurpleInputCondition cond)
 	}
 
 	if (priv->fd != -1) {
+		priv->zero_copy = purple_xfer_can_zero_copy(xfer);
+		if (priv->zero_copy) {
+			purple_debug_info("xfer", "Using zero-copy transfer for %s",
+			                  purple_xfer_get_local_filename(xfer));
+		}
+
 		purple_xfer_set_watcher(
 			xfer,
 			purple_input_add(priv->fd, cond, transfer_cb, xfer)
@@ -1554,6 +2007,17 @@ begin_transfer(PurpleXfer *xfer, PurpleInputCondition cond)
 	}
 
 	priv->start_time = g_get_monotonic_time();
+	priv->sample_time = priv->start_time;
+	priv->progress_time = priv->start_time;
+
+	/* Keep sampling when no data arrives, so the rate falls and stalls are
+	 * noticed even without any wakeups.
+	 */
+	if (priv->throughput_timer == 0) {
+		priv->throughput_timer = g_timeout_add(FT_THROUGHPUT_INTERVAL / 1000,
+		                                       purple_xfer_throughput_cb,
+		                                       xfer);
+	}
 
 	g_object_notify_by_pspec(G_OBJECT(xfer), properties[PROP_START_TIME]);
 
@@ -1723,6 +2187,7 @@ purple_xfer_end(PurpleXfer *xfer)
 	}
 
 	priv->end_time = g_get_monotonic_time();
+	purple_xfer_stop_throughput_timer(xfer);
 
 	g_object_notify_by_pspec(G_OBJECT(xfer), properties[PROP_END_TIME]);
 
@@ -1750,6 +2215,8 @@ purple_xfer_end(PurpleXfer *xfer)
 		priv->dest_fp = NULL;
 	}
 
+	purple_xfer_release_io_buffer(xfer);
+
 	g_object_unref(xfer);
 }
 
@@ -1781,6 +2248,7 @@ purple_xfer_cancel_local(PurpleXfer *xfer)
 
 	purple_xfer_set_status(xfer, PURPLE_XFER_STATUS_CANCEL_LOCAL);
 	priv->end_time = g_get_monotonic_time();
+	purple_xfer_stop_throughput_timer(xfer);
 
 	g_object_notify_by_pspec(G_OBJECT(xfer), properties[PROP_END_TIME]);
 
@@ -1821,6 +2289,8 @@ purple_xfer_cancel_local(PurpleXfer *xfer)
 		priv->dest_fp = NULL;
 	}
 
+	purple_xfer_release_io_buffer(xfer);
+
 	g_object_unref(xfer);
 }
 
@@ -1841,6 +2311,7 @@ purple_xfer_cancel_remote(PurpleXfer *xfer)
 	purple_request_close_with_handle(xfer);
 	purple_xfer_set_status(xfer, PURPLE_XFER_STATUS_CANCEL_REMOTE);
 	priv->end_time = g_get_monotonic_time();
+	purple_xfer_stop_throughput_timer(xfer);
 
 	g_object_notify_by_pspec(G_OBJECT(xfer), properties[PROP_END_TIME]);
 
@@ -1884,6 +2355,8 @@ purple_xfer_cancel_remote(PurpleXfer *xfer)
 		priv->dest_fp = NULL;
 	}
 
+	purple_xfer_release_io_buffer(xfer);
+
 	g_object_unref(xfer);
 }
 
@@ -2097,6 +2570,12 @@ purple_xfer_get_property(GObject *obj, guint param_id, GValue *value,
 		case PROP_VISIBLE:
 			g_value_set_boolean(value, purple_xfer_get_visible(xfer));
 			break;
+		case PROP_THROUGHPUT:
+			g_value_set_double(value, purple_xfer_get_throughput(xfer));
+			break;
+		case PROP_STALLS:
+			g_value_set_uint(value, purple_xfer_get_stalls(xfer));
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, param_id, pspec);
 			break;
@@ -2111,6 +2590,8 @@ purple_xfer_init(PurpleXfer *xfer)
 	priv->ui_ops = purple_xfers_get_ui_ops();
 	priv->current_buffer_size = FT_INITIAL_BUFFER_SIZE;
 	priv->fd = -1;
+	priv->pipe_fds[0] = -1;
+	priv->pipe_fds[1] = -1;
 	priv->ready = PURPLE_XFER_READY_NONE;
 }
 
@@ -2156,6 +2637,14 @@ purple_xfer_finalize(GObject *object)
 		g_byte_array_free(priv->buffer, TRUE);
 	}
 
+	purple_xfer_release_io_buffer(xfer);
+	purple_xfer_stop_throughput_timer(xfer);
+
+	if (priv->pipe_fds[0] != -1) {
+		close(priv->pipe_fds[0]);
+		close(priv->pipe_fds[1]);
+	}
+
 	g_free(priv->thumbnail_data);
 	g_free(priv->thumbnail_mimetype);
 
@@ -2275,6 +2764,17 @@ purple_xfer_class_init(PurpleXferClass *klass)
 	        "Hint for UIs whether this transfer should be visible.", FALSE,
 	        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+	properties[PROP_THROUGHPUT] = g_param_spec_double(
+	        "throughput", "Throughput",
+	        "The recent transfer rate in bytes per second.", 0.0, G_MAXDOUBLE,
+	        0.0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+	properties[PROP_STALLS] = g_param_spec_uint(
+	        "stalls", "Stalls",
+	        "The number of times the transfer went a while without moving any "
+	        "data.",
+	        0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties(obj_class, PROP_LAST, properties);
 
 	/* Signals */
@@ -2475,6 +2975,8 @@ purple_xfers_uninit(void)
 
 	purple_signals_disconnect_by_handle(handle);
 	purple_signals_unregister_by_instance(handle);
+
+	g_clear_pointer(&buffer_pool, g_ptr_array_unref);
 }
 
 void
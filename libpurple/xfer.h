@@ -129,7 +129,9 @@ struct _PurpleXferUiOps
  * @cancel_recv: Handler for cancelling a receiving file transfer.
  * @read: Called when reading data from the file transfer.
  * @write: Called when writing data to the file transfer.
- * @ack: Called when a file transfer is acknowledged.
+ * @ack: Called when a file transfer is acknowledged. @buffer is %NULL when
+ *       the data was moved directly between the socket and the local file
+ *       by the kernel.
  * @open_local: The vfunc for PurpleXfer::open-local. Since: 3.0.0
  * @query_local: The vfunc for PurpleXfer::query-local. Since: 3.0.0
  * @read_local: The vfunc for PurpleXfer::read-local. Since: 3.0.0
@@ -425,6 +427,36 @@ gint64 purple_xfer_get_start_time(PurpleXfer *xfer);
  */
 gint64 purple_xfer_get_end_time(PurpleXfer *xfer);
 
+/**
+ * purple_xfer_get_throughput:
+ * @xfer: The file transfer.
+ *
+ * Returns the recent transfer rate of @xfer. Unlike dividing the bytes sent by
+ * the elapsed time, this follows changes in speed during the transfer. It is
+ * recalculated a couple of times per second while the transfer is running,
+ * falling towards zero while no data moves, and #PurpleXfer:throughput is
+ * notified when it changes.
+ *
+ * Returns: The smoothed transfer rate in bytes per second.
+ *
+ * Since: 3.0.0
+ */
+gdouble purple_xfer_get_throughput(PurpleXfer *xfer);
+
+/**
+ * purple_xfer_get_stalls:
+ * @xfer: The file transfer.
+ *
+ * Returns how many times @xfer went for a couple of seconds without moving any
+ * data. Each such period is counted once, however often the transfer was woken
+ * up during it.
+ *
+ * Returns: The number of stalls.
+ *
+ * Since: 3.0.0
+ */
+guint purple_xfer_get_stalls(PurpleXfer *xfer);
+
 /**
  * purple_xfer_set_fd:
  * @xfer:      The file transfer.
@@ -566,6 +598,22 @@ PurpleXferUiOps *purple_xfer_get_ui_ops(PurpleXfer *xfer);
  */
 gssize purple_xfer_read(PurpleXfer *xfer, guchar **buffer);
 
+/**
+ * purple_xfer_read_into:
+ * @xfer:   The file transfer.
+ * @buffer: The buffer to read the data into.
+ * @size:   The size of @buffer.
+ *
+ * Reads in data from a file transfer stream into memory owned by the caller.
+ * At most @size bytes are read, and fewer if less of the file remains or the
+ * transfer has reduced its chunk size.
+ *
+ * Returns: The number of bytes read, 0 if no data was available, or -1.
+ *
+ * Since: 3.0.0
+ */
+gssize purple_xfer_read_into(PurpleXfer *xfer, guchar *buffer, gsize size);
+
 /**
  * purple_xfer_write:
  * @xfer:   The file transfer.
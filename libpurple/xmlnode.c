@@ -55,6 +55,30 @@ new_node(const char *name, PurpleXmlNodeType type)
 	return node;
 }
 
+static PurpleXmlNode *
+new_pooled_node(PurpleMemoryPool *pool, PurpleXmlNodeType type)
+{
+	PurpleXmlNode *node;
+
+	node = purple_memory_pool_alloc0(pool, sizeof(PurpleXmlNode),
+	                                 sizeof(gpointer));
+	node->type = type;
+	node->pool = g_object_ref(pool);
+
+	return node;
+}
+
+/* Copies a string with the same allocator that owns the strings of node. */
+static char *
+node_strdup(PurpleXmlNode *node, const char *str)
+{
+	if(node->pool != NULL) {
+		return purple_memory_pool_strdup(node->pool, str);
+	}
+
+	return g_strdup(str);
+}
+
 PurpleXmlNode*
 purple_xmlnode_new(const char *name)
 {
@@ -71,13 +95,40 @@ purple_xmlnode_new_child(PurpleXmlNode *parent, const char *name)
 	g_return_val_if_fail(parent != NULL, NULL);
 	g_return_val_if_fail(name != NULL && *name != '\0', NULL);
 
-	node = new_node(name, PURPLE_XMLNODE_TYPE_TAG);
+	if(parent->pool != NULL) {
+		node = new_pooled_node(parent->pool, PURPLE_XMLNODE_TYPE_TAG);
+		node->name = purple_memory_pool_strdup(parent->pool, name);
+	} else {
+		node = new_node(name, PURPLE_XMLNODE_TYPE_TAG);
+	}
 
 	purple_xmlnode_insert_child(parent, node);
 
 	return node;
 }
 
+PurpleXmlNode *
+purple_xmlnode_new_pooled(PurpleMemoryPool *pool, PurpleXmlNode *parent,
+                          const char *name, const char *xmlns,
+                          const char *prefix)
+{
+	PurpleXmlNode *node;
+
+	g_return_val_if_fail(PURPLE_IS_MEMORY_POOL(pool), NULL);
+	g_return_val_if_fail(name != NULL && *name != '\0', NULL);
+
+	node = new_pooled_node(pool, PURPLE_XMLNODE_TYPE_TAG);
+	node->name = (char *)name;
+	node->xmlns = (char *)xmlns;
+	node->prefix = (char *)prefix;
+
+	if(parent != NULL) {
+		purple_xmlnode_insert_child(parent, node);
+	}
+
+	return node;
+}
+
 void
 purple_xmlnode_insert_child(PurpleXmlNode *parent, PurpleXmlNode *child)
 {
@@ -107,9 +158,15 @@ purple_xmlnode_insert_data(PurpleXmlNode *node, const char *data, gssize size)
 
 	real_size = size == -1 ? strlen(data) : (gsize)size;
 
-	child = new_node(NULL, PURPLE_XMLNODE_TYPE_DATA);
-
-	child->data = g_memdup2(data, real_size);
+	if(node->pool != NULL) {
+		child = new_pooled_node(node->pool, PURPLE_XMLNODE_TYPE_DATA);
+		child->data = purple_memory_pool_alloc(node->pool, real_size,
+		                                       sizeof(gchar));
+		memcpy(child->data, data, real_size);
+	} else {
+		child = new_node(NULL, PURPLE_XMLNODE_TYPE_DATA);
+		child->data = g_memdup2(data, real_size);
+	}
 	child->data_sz = real_size;
 
 	purple_xmlnode_insert_child(node, child);
@@ -196,11 +253,37 @@ purple_xmlnode_set_attrib_full(PurpleXmlNode *node, const char *attr, const char
 	g_return_if_fail(value != NULL);
 
 	purple_xmlnode_remove_attrib_with_namespace(node, attr, xmlns);
-	attrib_node = new_node(attr, PURPLE_XMLNODE_TYPE_ATTRIB);
+	if(node->pool != NULL) {
+		attrib_node = new_pooled_node(node->pool, PURPLE_XMLNODE_TYPE_ATTRIB);
+		attrib_node->name = purple_memory_pool_strdup(node->pool, attr);
+	} else {
+		attrib_node = new_node(attr, PURPLE_XMLNODE_TYPE_ATTRIB);
+	}
 
-	attrib_node->data = g_strdup(value);
-	attrib_node->xmlns = g_strdup(xmlns);
-	attrib_node->prefix = g_strdup(prefix);
+	attrib_node->data = node_strdup(attrib_node, value);
+	attrib_node->xmlns = node_strdup(attrib_node, xmlns);
+	attrib_node->prefix = node_strdup(attrib_node, prefix);
+
+	purple_xmlnode_insert_child(node, attrib_node);
+}
+
+void
+purple_xmlnode_add_attrib_pooled(PurpleXmlNode *node, const char *attr,
+                                 const char *xmlns, const char *prefix,
+                                 const char *value)
+{
+	PurpleXmlNode *attrib_node;
+
+	g_return_if_fail(node != NULL);
+	g_return_if_fail(node->pool != NULL);
+	g_return_if_fail(attr != NULL);
+	g_return_if_fail(value != NULL);
+
+	attrib_node = new_pooled_node(node->pool, PURPLE_XMLNODE_TYPE_ATTRIB);
+	attrib_node->name = (char *)attr;
+	attrib_node->data = (char *)value;
+	attrib_node->xmlns = (char *)xmlns;
+	attrib_node->prefix = (char *)prefix;
 
 	purple_xmlnode_insert_child(node, attrib_node);
 }
@@ -249,14 +332,17 @@ void purple_xmlnode_set_namespace(PurpleXmlNode *node, const char *xmlns)
 	g_return_if_fail(node != NULL);
 
 	tmp = node->xmlns;
-	node->xmlns = g_strdup(xmlns);
+	node->xmlns = node_strdup(node, xmlns);
 
 	if (node->namespace_map) {
 		g_hash_table_insert(node->namespace_map,
 			g_strdup(""), g_strdup(xmlns));
 	}
 
-	g_free(tmp);
+	/* Pooled strings are released along with the pool. */
+	if(node->pool == NULL) {
+		g_free(tmp);
+	}
 }
 
 const char *purple_xmlnode_get_namespace(const PurpleXmlNode *node)
@@ -296,8 +382,10 @@ void purple_xmlnode_set_prefix(PurpleXmlNode *node, const char *prefix)
 {
 	g_return_if_fail(node != NULL);
 
-	g_free(node->prefix);
-	node->prefix = g_strdup(prefix);
+	if(node->pool == NULL) {
+		g_free(node->prefix);
+	}
+	node->prefix = node_strdup(node, prefix);
 }
 
 const char *purple_xmlnode_get_prefix(const PurpleXmlNode *node)
@@ -393,15 +481,21 @@ purple_xmlnode_free(PurpleXmlNode *node)
 		x = y;
 	}
 
-	/* now dispose of ourselves */
+	if(node->namespace_map)
+		g_hash_table_destroy(node->namespace_map);
+
+	/* now dispose of ourselves; pooled nodes live in their pool's memory and
+	 * are released all at once when the last one lets go of it. */
+	if(node->pool != NULL) {
+		g_object_unref(node->pool);
+		return;
+	}
+
 	g_free(node->name);
 	g_free(node->data);
 	g_free(node->xmlns);
 	g_free(node->prefix);
 
-	if(node->namespace_map)
-		g_hash_table_destroy(node->namespace_map);
-
 	g_free(node);
 }
 
@@ -491,32 +585,84 @@ purple_xmlnode_to_str_foreach_append_ns(const char *key, const char *value,
 	}
 }
 
-static char *
-purple_xmlnode_to_str_helper(const PurpleXmlNode *node, int *len, gboolean formatting, int depth)
+/* Checks if g_markup_escape_text() would change str. It also catches a few
+ * things it wouldn't, like any 0xc2 lead byte or an embedded NUL, which are
+ * then just left to it. */
+static gboolean
+purple_xmlnode_needs_escaping(const char *str, gssize len)
 {
-	GString *text;
-	const char *prefix;
-	const PurpleXmlNode *c;
-	char *node_name, *esc, *esc2, *tab = NULL;
-	gboolean need_end = FALSE, pretty = formatting;
+	const guchar *p = (const guchar *)str;
+	const guchar *end = len < 0 ? NULL : p + len;
+
+	for (; end ? p < end : *p != '\0'; p++) {
+		switch (*p) {
+			case '&':
+			case '<':
+			case '>':
+			case '\'':
+			case '"':
+			case 0x7f:
+			case 0xc2: /* the C1 control characters */
+				return TRUE;
+			case '\t':
+			case '\n':
+			case '\r':
+				break;
+			default:
+				if (*p < 0x20)
+					return TRUE;
+		}
+	}
 
-	g_return_val_if_fail(node != NULL, NULL);
+	return FALSE;
+}
 
-	text = g_string_new("");
+static void
+purple_xmlnode_append_escaped(GString *text, const char *str, gssize len)
+{
+	char *esc;
 
-	if(pretty && depth) {
-		tab = g_strnfill(depth, '\t');
-		text = g_string_append(text, tab);
+	/* Most names, values and text don't need escaping at all, so skip the
+	 * copy g_markup_escape_text() would make. */
+	if (!purple_xmlnode_needs_escaping(str, len)) {
+		g_string_append_len(text, str, len);
+		return;
 	}
 
-	node_name = g_markup_escape_text(node->name, -1);
+	esc = g_markup_escape_text(str, len);
+	g_string_append(text, esc);
+	g_free(esc);
+}
+
+static void
+purple_xmlnode_append_tabs(GString *text, int depth)
+{
+	while (depth-- > 0)
+		g_string_append_c(text, '\t');
+}
+
+static void
+purple_xmlnode_to_str_helper(const PurpleXmlNode *node, GString *text,
+	gboolean formatting, int depth)
+{
+	const char *prefix;
+	const PurpleXmlNode *c;
+	gsize node_name_start, node_name_len;
+	gboolean need_end = FALSE, pretty = formatting;
+
+	if(pretty && depth)
+		purple_xmlnode_append_tabs(text, depth);
+
 	prefix = purple_xmlnode_get_prefix(node);
 
+	g_string_append_c(text, '<');
 	if (prefix) {
-		g_string_append_printf(text, "<%s:%s", prefix, node_name);
-	} else {
-		g_string_append_printf(text, "<%s", node_name);
+		g_string_append(text, prefix);
+		g_string_append_c(text, ':');
 	}
+	node_name_start = text->len;
+	purple_xmlnode_append_escaped(text, node->name, -1);
+	node_name_len = text->len - node_name_start;
 
 	if (node->namespace_map) {
 		g_hash_table_foreach(node->namespace_map,
@@ -534,24 +680,25 @@ purple_xmlnode_to_str_helper(const PurpleXmlNode *node, int *len, gboolean forma
 			parent_xmlns = purple_xmlnode_get_default_namespace(node->parent);
 		if (!purple_strequal(xmlns, parent_xmlns))
 		{
-			char *escaped_xmlns = g_markup_escape_text(xmlns, -1);
-			g_string_append_printf(text, " xmlns='%s'", escaped_xmlns);
-			g_free(escaped_xmlns);
+			g_string_append(text, " xmlns='");
+			purple_xmlnode_append_escaped(text, xmlns, -1);
+			g_string_append_c(text, '\'');
 		}
 	}
 	for(c = node->child; c; c = c->next)
 	{
 		if(c->type == PURPLE_XMLNODE_TYPE_ATTRIB) {
 			const char *aprefix = purple_xmlnode_get_prefix(c);
-			esc = g_markup_escape_text(c->name, -1);
-			esc2 = g_markup_escape_text(c->data, -1);
+
+			g_string_append_c(text, ' ');
 			if (aprefix) {
-				g_string_append_printf(text, " %s:%s='%s'", aprefix, esc, esc2);
-			} else {
-				g_string_append_printf(text, " %s='%s'", esc, esc2);
+				g_string_append(text, aprefix);
+				g_string_append_c(text, ':');
 			}
-			g_free(esc);
-			g_free(esc2);
+			purple_xmlnode_append_escaped(text, c->name, -1);
+			g_string_append(text, "='");
+			purple_xmlnode_append_escaped(text, c->data, -1);
+			g_string_append_c(text, '\'');
 		} else if(c->type == PURPLE_XMLNODE_TYPE_TAG || c->type == PURPLE_XMLNODE_TYPE_DATA) {
 			if(c->type == PURPLE_XMLNODE_TYPE_DATA)
 				pretty = FALSE;
@@ -560,36 +707,48 @@ purple_xmlnode_to_str_helper(const PurpleXmlNode *node, int *len, gboolean forma
 	}
 
 	if(need_end) {
-		g_string_append_printf(text, ">%s", pretty ? NEWLINE_S : "");
+		g_string_append_c(text, '>');
+		if (pretty)
+			g_string_append(text, NEWLINE_S);
 
 		for(c = node->child; c; c = c->next)
 		{
 			if(c->type == PURPLE_XMLNODE_TYPE_TAG) {
-				int esc_len;
-				esc = purple_xmlnode_to_str_helper(c, &esc_len, pretty, depth+1);
-				text = g_string_append_len(text, esc, esc_len);
-				g_free(esc);
+				purple_xmlnode_to_str_helper(c, text, pretty, depth+1);
 			} else if(c->type == PURPLE_XMLNODE_TYPE_DATA && c->data_sz > 0) {
-				esc = g_markup_escape_text(c->data, c->data_sz);
-				text = g_string_append(text, esc);
-				g_free(esc);
+				purple_xmlnode_append_escaped(text, c->data, c->data_sz);
 			}
 		}
 
-		if(tab && pretty)
-			text = g_string_append(text, tab);
+		if(pretty && depth)
+			purple_xmlnode_append_tabs(text, depth);
+		g_string_append(text, "</");
 		if (prefix) {
-			g_string_append_printf(text, "</%s:%s>%s", prefix, node_name, formatting ? NEWLINE_S : "");
-		} else {
-			g_string_append_printf(text, "</%s>%s", node_name, formatting ? NEWLINE_S : "");
+			g_string_append(text, prefix);
+			g_string_append_c(text, ':');
 		}
+		/* The escaped name is already in text, GString copes with
+		 * appending a part of itself. */
+		g_string_append_len(text, text->str + node_name_start,
+			node_name_len);
+		g_string_append_c(text, '>');
 	} else {
-		g_string_append_printf(text, "/>%s", formatting ? NEWLINE_S : "");
+		g_string_append(text, "/>");
 	}
 
-	g_free(node_name);
+	if (formatting)
+		g_string_append(text, NEWLINE_S);
+}
 
-	g_free(tab);
+char *
+purple_xmlnode_to_str(const PurpleXmlNode *node, int *len)
+{
+	GString *text;
+
+	g_return_val_if_fail(node != NULL, NULL);
+
+	text = g_string_new(NULL);
+	purple_xmlnode_to_str_helper(node, text, FALSE, 0);
 
 	if(len)
 		*len = text->len;
@@ -597,28 +756,29 @@ purple_xmlnode_to_str_helper(const PurpleXmlNode *node, int *len, gboolean forma
 	return g_string_free(text, FALSE);
 }
 
-char *
-purple_xmlnode_to_str(const PurpleXmlNode *node, int *len)
+void
+purple_xmlnode_append_to_string(const PurpleXmlNode *node, GString *str)
 {
-	return purple_xmlnode_to_str_helper(node, len, FALSE, 0);
+	g_return_if_fail(node != NULL);
+	g_return_if_fail(str != NULL);
+
+	purple_xmlnode_to_str_helper(node, str, FALSE, 0);
 }
 
 char *
 purple_xmlnode_to_formatted_str(const PurpleXmlNode *node, int *len)
 {
-	char *xml, *xml_with_declaration;
+	GString *text;
 
 	g_return_val_if_fail(node != NULL, NULL);
 
-	xml = purple_xmlnode_to_str_helper(node, len, TRUE, 0);
-	xml_with_declaration =
-		g_strdup_printf("<?xml version='1.0' encoding='UTF-8' ?>" NEWLINE_S NEWLINE_S "%s", xml);
-	g_free(xml);
+	text = g_string_new("<?xml version='1.0' encoding='UTF-8' ?>" NEWLINE_S NEWLINE_S);
+	purple_xmlnode_to_str_helper(node, text, TRUE, 0);
 
 	if (len)
-		*len += sizeof("<?xml version='1.0' encoding='UTF-8' ?>" NEWLINE_S NEWLINE_S) - 1;
+		*len = text->len;
 
-	return xml_with_declaration;
+	return g_string_free(text, FALSE);
 }
 
 struct _xmlnode_parser_data {
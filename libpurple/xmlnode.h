@@ -30,6 +30,8 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "memorypool.h"
+
 #define PURPLE_TYPE_XMLNODE  (purple_xmlnode_get_type())
 
 /**
@@ -61,6 +63,8 @@ typedef enum
  * @next:          The next node or %NULL.
  * @prefix:        The namespace prefix if any.
  * @namespace_map: The namespace map.
+ * @pool:          The memory pool that owns the strings of this node, or
+ *                 %NULL if they were allocated on the heap.
  *
  * XmlNode is a simplified API for handling XML. An XmlNode represents an XML
  * element and has API for children as well as attributes.
@@ -79,6 +83,7 @@ struct _PurpleXmlNode
 	PurpleXmlNode *next;
 	char *prefix;
 	GHashTable *namespace_map;
+	PurpleMemoryPool *pool;
 };
 
 G_BEGIN_DECLS
@@ -113,6 +118,28 @@ PurpleXmlNode *purple_xmlnode_new(const char *name);
  */
 PurpleXmlNode *purple_xmlnode_new_child(PurpleXmlNode *parent, const char *name);
 
+/**
+ * purple_xmlnode_new_pooled:
+ * @pool:   The memory pool to allocate the node from.
+ * @parent: (nullable): The parent node.
+ * @name:   The name of the node.
+ * @xmlns:  (nullable): The namespace of the node.
+ * @prefix: (nullable): The namespace prefix of the node.
+ *
+ * Creates a new PurpleXmlNode whose memory is owned by @pool.  This is meant
+ * for parsers that build a lot of short lived trees.
+ *
+ * @name, @xmlns and @prefix are not copied, so they must outlive @pool.  The
+ * node keeps a reference on @pool until it is freed with
+ * purple_xmlnode_free(), and children and attributes that are later added to
+ * it are allocated from @pool as well.
+ *
+ * Returns: The new node.
+ *
+ * Since: 3.0.0
+ */
+PurpleXmlNode *purple_xmlnode_new_pooled(PurpleMemoryPool *pool, PurpleXmlNode *parent, const char *name, const char *xmlns, const char *prefix);
+
 /**
  * purple_xmlnode_insert_child:
  * @parent: The parent node to insert child into.
@@ -211,6 +238,23 @@ void purple_xmlnode_set_attrib(PurpleXmlNode *node, const char *attr, const char
 void purple_xmlnode_set_attrib_full(PurpleXmlNode *node, const char *attr, const char *xmlns,
 		const char *prefix, const char *value);
 
+/**
+ * purple_xmlnode_add_attrib_pooled:
+ * @node:   The node to add an attribute to.
+ * @attr:   The name of the attribute.
+ * @xmlns:  (nullable): The namespace of the attribute.
+ * @prefix: (nullable): The prefix of the attribute.
+ * @value:  The value of the attribute.
+ *
+ * Appends an attribute to a node created by purple_xmlnode_new_pooled()
+ * without copying any of the strings or checking for an existing attribute
+ * with the same name.  The strings must have been allocated from the node's
+ * pool or otherwise outlive it.
+ *
+ * Since: 3.0.0
+ */
+void purple_xmlnode_add_attrib_pooled(PurpleXmlNode *node, const char *attr, const char *xmlns, const char *prefix, const char *value);
+
 /**
  * purple_xmlnode_get_attrib:
  * @node: The node to get an attribute from.
@@ -361,6 +405,17 @@ PurpleXmlNode *purple_xmlnode_get_parent(const PurpleXmlNode *child);
  */
 char *purple_xmlnode_to_str(const PurpleXmlNode *node, int *len);
 
+/**
+ * purple_xmlnode_append_to_string:
+ * @node: The starting node to output.
+ * @str:  The string to append to.
+ *
+ * Appends the node as a string of xml to @str. This is the same as
+ * purple_xmlnode_to_str(), but lets the caller decide where the xml goes,
+ * for example into a buffer that's already big enough.
+ */
+void purple_xmlnode_append_to_string(const PurpleXmlNode *node, GString *str);
+
 /**
  * purple_xmlnode_to_formatted_str:
  * @node: The starting node to output.
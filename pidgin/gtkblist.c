@@ -1905,9 +1905,20 @@ static GdkPixbuf *pidgin_blist_get_buddy_icon(PurpleBlistNode *node,
 
 	if (data == NULL) {
 		if (buddy) {
-			/* Not sure I like this...*/
-			if (!(icon = purple_buddy_icons_find(purple_buddy_get_account(buddy), purple_buddy_get_name(buddy))))
+			/* If the icon hasn't been read from disk yet, leave the
+			 * placeholder; the node is updated once it has been. */
+			icon = purple_buddy_get_icon(buddy);
+			if (icon == NULL) {
+				if (purple_blist_node_get_string(PURPLE_BLIST_NODE(buddy),
+				                                 "buddy_icon") != NULL)
+				{
+					purple_buddy_icons_find_async(purple_buddy_get_account(buddy),
+					                              purple_buddy_get_name(buddy),
+					                              NULL, NULL, NULL);
+				}
 				return NULL;
+			}
+			purple_buddy_icon_ref(icon);
 			data = purple_buddy_icon_get_data(icon, &len);
 		}
 
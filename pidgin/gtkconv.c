@@ -71,8 +71,18 @@ typedef enum
 #define BUDDYICON_SIZE_MIN    32
 #define BUDDYICON_SIZE_MAX    96
 
+/* Adding more chat users than this at once detaches the user list from its
+ * view while they're inserted. */
+#define CHAT_USERS_BATCH_SIZE 50
+
 static GtkWidget *invite_dialog = NULL;
 
+/* These are emitted for every message we show, so skip the name lookups. */
+static gulong displaying_im_msg_signal = 0;
+static gulong displayed_im_msg_signal = 0;
+static gulong displaying_chat_msg_signal = 0;
+static gulong displayed_chat_msg_signal = 0;
+
 /* Prototypes. <-- because Paco-Paco hates this comment. */
 static void got_typing_keypress(PidginConversation *gtkconv, gboolean first);
 static void add_chat_user_common(PurpleChatConversation *chat, PurpleChatUser *cb, const char *old_name);
@@ -1241,16 +1251,10 @@ get_chat_user_status_icon(PurpleChatConversation *chat, const char *name, Purple
 }
 
 static void
-add_chat_user_common(PurpleChatConversation *chat, PurpleChatUser *cb, const char *old_name)
+insert_chat_user_row(PurpleChatConversation *chat, PurpleChatUser *cb,
+                     GtkListStore *ls, GtkTreeIter *iter)
 {
-	PidginConversation *gtkconv;
-	PurpleConversation *conv;
-	PurpleConnection *gc;
-	GtkTreeModel *tm;
-	GtkListStore *ls;
-	GtkTreePath *newpath;
 	const gchar *icon_name;
-	GtkTreeIter iter;
 	gboolean is_buddy;
 	const gchar *name, *alias;
 	gchar *tmp, *alias_key;
@@ -1261,16 +1265,6 @@ add_chat_user_common(PurpleChatConversation *chat, PurpleChatUser *cb, const cha
 	name  = purple_chat_user_get_name(cb);
 	flags = purple_chat_user_get_flags(cb);
 
-	conv    = PURPLE_CONVERSATION(chat);
-	gtkconv = PIDGIN_CONVERSATION(conv);
-	gc      = purple_conversation_get_connection(conv);
-
-	if (!gc || !purple_connection_get_protocol(gc))
-		return;
-
-	tm = gtk_tree_view_get_model(GTK_TREE_VIEW(gtkconv->list));
-	ls = GTK_LIST_STORE(tm);
-
 	icon_name = get_chat_user_status_icon(chat, name, flags);
 
 	is_buddy = purple_chat_user_is_buddy(cb);
@@ -1281,7 +1275,7 @@ add_chat_user_common(PurpleChatConversation *chat, PurpleChatUser *cb, const cha
 
 	pidgin_color_calculate_for_text(name, &color);
 
-	gtk_list_store_insert_with_values(ls, &iter,
+	gtk_list_store_insert_with_values(ls, iter,
 /*
 * The GTK docs are mute about the effects of the "row" value for performance.
 * X-Chat hardcodes their value to 0 (prepend) and -1 (append), so we will too.
@@ -1299,13 +1293,41 @@ add_chat_user_common(PurpleChatConversation *chat, PurpleChatUser *cb, const cha
 			CHAT_USERS_WEIGHT_COLUMN, is_buddy ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL,
 			-1);
 
-	newpath = gtk_tree_model_get_path(tm, &iter);
+	g_free(alias_key);
+}
+
+static void
+set_chat_user_row(PurpleChatUser *cb, GtkTreeModel *tm, GtkTreeIter *iter)
+{
+	GtkTreePath *newpath;
+
+	newpath = gtk_tree_model_get_path(tm, iter);
 	g_object_set_data_full(G_OBJECT(cb), "pidgin-tree-row",
 	                       gtk_tree_row_reference_new(tm, newpath),
 	                       (GDestroyNotify)gtk_tree_row_reference_free);
 	gtk_tree_path_free(newpath);
+}
 
-	g_free(alias_key);
+static void
+add_chat_user_common(PurpleChatConversation *chat, PurpleChatUser *cb, const char *old_name)
+{
+	PidginConversation *gtkconv;
+	PurpleConversation *conv;
+	PurpleConnection *gc;
+	GtkTreeModel *tm;
+	GtkTreeIter iter;
+
+	conv    = PURPLE_CONVERSATION(chat);
+	gtkconv = PIDGIN_CONVERSATION(conv);
+	gc      = purple_conversation_get_connection(conv);
+
+	if (!gc || !purple_connection_get_protocol(gc))
+		return;
+
+	tm = gtk_tree_view_get_model(GTK_TREE_VIEW(gtkconv->list));
+
+	insert_chat_user_row(chat, cb, GTK_LIST_STORE(tm), &iter);
+	set_chat_user_row(cb, tm, &iter);
 }
 
 static void topic_callback(GtkWidget *w, PidginConversation *gtkconv)
@@ -2032,9 +2054,9 @@ pidgin_conv_write_conv(PurpleConversation *conv, PurpleMessage *pmsg)
 	gc = purple_account_get_connection(account);
 	g_return_if_fail(gc != NULL || !(flags & (PURPLE_MESSAGE_SEND | PURPLE_MESSAGE_RECV)));
 
-	plugin_return = GPOINTER_TO_INT(purple_signal_emit_return_1(
+	plugin_return = GPOINTER_TO_INT(purple_signal_emit_by_id_return_1(
 		pidgin_conversations_get_handle(),
-		(PURPLE_IS_IM_CONVERSATION(conv) ? "displaying-im-msg" : "displaying-chat-msg"),
+		(PURPLE_IS_IM_CONVERSATION(conv) ? displaying_im_msg_signal : displaying_chat_msg_signal),
 		conv, pmsg));
 	if (plugin_return)
 	{
@@ -2047,8 +2069,8 @@ pidgin_conv_write_conv(PurpleConversation *conv, PurpleMessage *pmsg)
 		TALKATU_MESSAGE(pidgin_msg)
 	);
 
-	purple_signal_emit(pidgin_conversations_get_handle(),
-		(PURPLE_IS_IM_CONVERSATION(conv) ? "displayed-im-msg" : "displayed-chat-msg"),
+	purple_signal_emit_by_id(pidgin_conversations_get_handle(),
+		(PURPLE_IS_IM_CONVERSATION(conv) ? displayed_im_msg_signal : displayed_chat_msg_signal),
 		conv, pmsg);
 }
 
@@ -2081,8 +2103,13 @@ static void
 pidgin_conv_chat_add_users(PurpleChatConversation *chat, GList *cbuddies, gboolean new_arrivals)
 {
 	PidginConversation *gtkconv;
+	PurpleConnection *gc;
+	GtkTreeModel *tm;
 	GtkListStore *ls;
+	GArray *iters;
 	GList *l;
+	guint i, n_users;
+	gboolean detach;
 
 	char tmp[BUF_LONG];
 	int num_users;
@@ -2098,22 +2125,52 @@ pidgin_conv_chat_add_users(PurpleChatConversation *chat, GList *cbuddies, gboole
 
 	gtk_label_set_text(GTK_LABEL(gtkconv->count), tmp);
 
-	ls = GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(gtkconv->list)));
+	gc = purple_conversation_get_connection(PURPLE_CONVERSATION(chat));
+	if (!gc || !purple_connection_get_protocol(gc))
+		return;
+
+	tm = gtk_tree_view_get_model(GTK_TREE_VIEW(gtkconv->list));
+	ls = GTK_LIST_STORE(tm);
+
+	n_users = g_list_length(cbuddies);
+
+	/* Don't make the view follow every row of a big batch. */
+	detach = n_users > CHAT_USERS_BATCH_SIZE;
+	if (detach) {
+		g_object_ref(tm);
+		gtk_tree_view_set_model(GTK_TREE_VIEW(gtkconv->list), NULL);
+	}
 
 	gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(ls),  GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID,
 										 GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID);
 
-	l = cbuddies;
-	while (l != NULL) {
-		add_chat_user_common(chat, (PurpleChatUser *)l->data, NULL);
-		l = l->next;
+	/* Every row reference is updated whenever a row is inserted, so they're
+	 * only created once all of the rows are in. List store iters stay valid
+	 * until their row is removed.
+	 */
+	iters = g_array_sized_new(FALSE, FALSE, sizeof(GtkTreeIter), n_users);
+	for (l = cbuddies; l != NULL; l = l->next) {
+		GtkTreeIter iter;
+
+		insert_chat_user_row(chat, l->data, ls, &iter);
+		g_array_append_val(iters, iter);
+	}
+
+	for (l = cbuddies, i = 0; l != NULL; l = l->next, i++) {
+		set_chat_user_row(l->data, tm, &g_array_index(iters, GtkTreeIter, i));
 	}
+	g_array_free(iters, TRUE);
 
 	/* Currently GTK maintains our sorted list after it's in the tree.
 	 * This may change if it turns out we can manage it faster ourselves.
 	 */
 	gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(ls),  CHAT_USERS_ALIAS_KEY_COLUMN,
 										 GTK_SORT_ASCENDING);
+
+	if (detach) {
+		gtk_tree_view_set_model(GTK_TREE_VIEW(gtkconv->list), tm);
+		g_object_unref(tm);
+	}
 }
 
 static void
@@ -2148,12 +2205,25 @@ pidgin_conv_chat_rename_user(PurpleChatConversation *chat, const char *old_name,
 	add_chat_user_common(chat, new_chatuser, old_name);
 }
 
+static gchar *
+chat_user_remove_key(const char *name)
+{
+	gchar *folded, *key;
+
+	folded = g_utf8_casefold(name, -1);
+	key = g_utf8_collate_key(folded, -1);
+	g_free(folded);
+
+	return key;
+}
+
 static void
 pidgin_conv_chat_remove_users(PurpleChatConversation *chat, GList *users)
 {
 	PidginConversation *gtkconv;
 	GtkTreeIter iter;
 	GtkTreeModel *model;
+	GHashTable *removed;
 	GList *l;
 	char tmp[BUF_LONG];
 	int num_users;
@@ -2163,29 +2233,38 @@ pidgin_conv_chat_remove_users(PurpleChatConversation *chat, GList *users)
 
 	num_users = purple_chat_conversation_get_users_count(chat);
 
+	/* Walk the list once for all of the users instead of once per user. */
+	removed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 	for (l = users; l != NULL; l = l->next) {
-		model = gtk_tree_view_get_model(GTK_TREE_VIEW(gtkconv->list));
+		if (g_utf8_validate(l->data, -1, NULL))
+			g_hash_table_add(removed, chat_user_remove_key(l->data));
+	}
 
-		if (!gtk_tree_model_get_iter_first(GTK_TREE_MODEL(model), &iter))
-			/* XXX: Break? */
-			continue;
+	model = gtk_tree_view_get_model(GTK_TREE_VIEW(gtkconv->list));
 
+	if (g_hash_table_size(removed) > 0 &&
+	    gtk_tree_model_get_iter_first(GTK_TREE_MODEL(model), &iter))
+	{
 		do {
-			char *val;
+			char *val, *key;
 
 			gtk_tree_model_get(GTK_TREE_MODEL(model), &iter,
 							   CHAT_USERS_NAME_COLUMN, &val, -1);
 
-			if (!purple_utf8_strcasecmp((char *)l->data, val)) {
+			key = g_utf8_validate(val, -1, NULL) ? chat_user_remove_key(val) : NULL;
+			if (key != NULL && g_hash_table_contains(removed, key)) {
 				f = gtk_list_store_remove(GTK_LIST_STORE(model), &iter);
 			}
 			else
 				f = gtk_tree_model_iter_next(GTK_TREE_MODEL(model), &iter);
 
+			g_free(key);
 			g_free(val);
 		} while (f);
 	}
 
+	g_hash_table_destroy(removed);
+
 	g_snprintf(tmp, sizeof(tmp),
 			   ngettext("%d person in room", "%d people in room",
 						num_users), num_users);
@@ -2856,19 +2935,23 @@ pidgin_conversations_init(void)
 	/**********************************************************************
 	 * Register signals
 	 **********************************************************************/
-	purple_signal_register(handle, "displaying-im-msg",
+	displaying_im_msg_signal = purple_signal_register(handle,
+		"displaying-im-msg",
 		purple_marshal_BOOLEAN__POINTER_POINTER,
 		G_TYPE_BOOLEAN, 2, PURPLE_TYPE_CONVERSATION, PURPLE_TYPE_MESSAGE);
 
-	purple_signal_register(handle, "displayed-im-msg",
+	displayed_im_msg_signal = purple_signal_register(handle,
+		"displayed-im-msg",
 		purple_marshal_VOID__POINTER_POINTER, G_TYPE_NONE, 2,
 		PURPLE_TYPE_CONVERSATION, PURPLE_TYPE_MESSAGE);
 
-	purple_signal_register(handle, "displaying-chat-msg",
+	displaying_chat_msg_signal = purple_signal_register(handle,
+		"displaying-chat-msg",
 		purple_marshal_BOOLEAN__POINTER_POINTER,
 		G_TYPE_BOOLEAN, 2, PURPLE_TYPE_CONVERSATION, PURPLE_TYPE_MESSAGE);
 
-	purple_signal_register(handle, "displayed-chat-msg",
+	displayed_chat_msg_signal = purple_signal_register(handle,
+		"displayed-chat-msg",
 		purple_marshal_VOID__POINTER_POINTER, G_TYPE_NONE, 2,
 		PURPLE_TYPE_CONVERSATION, PURPLE_TYPE_MESSAGE);
 
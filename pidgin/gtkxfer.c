@@ -116,10 +116,29 @@ get_xfer_info_strings(PurpleXfer *xfer, char **kbsec, char **time_elapsed,
 
 	kb_sent = purple_xfer_get_bytes_sent(xfer) / 1000.0;
 	kb_rem  = purple_xfer_get_bytes_remaining(xfer) / 1000.0;
-	kbps = (elapsed > 0 ? (kb_sent * G_USEC_PER_SEC) / elapsed : 0);
+
+	/* While the transfer is running, show how fast it's going now rather
+	 * than the average since it started.
+	 */
+	if (!purple_xfer_is_completed(xfer) &&
+	    purple_xfer_get_throughput(xfer) > 0.0)
+	{
+		kbps = purple_xfer_get_throughput(xfer) / 1000.0;
+	} else {
+		kbps = (elapsed > 0 ? (kb_sent * G_USEC_PER_SEC) / elapsed : 0);
+	}
 
 	if (kbsec != NULL) {
-		*kbsec = g_strdup_printf(_("%.2f KB/s"), kbps);
+		guint stalls = purple_xfer_get_stalls(xfer);
+
+		if (stalls > 0) {
+			*kbsec = g_strdup_printf(ngettext("%.2f KB/s (%u stall)",
+			                                  "%.2f KB/s (%u stalls)",
+			                                  stalls),
+			                         kbps, stalls);
+		} else {
+			*kbsec = g_strdup_printf(_("%.2f KB/s"), kbps);
+		}
 	}
 
 	if (time_elapsed != NULL)
@@ -934,6 +953,10 @@ pidgin_xfer_new_xfer(PurpleXfer *xfer)
 	                 G_CALLBACK(pidgin_xfer_add_thumbnail), NULL);
 	g_signal_connect(xfer, "notify::progress",
 	                 G_CALLBACK(pidgin_xfer_progress_notify), NULL);
+	g_signal_connect(xfer, "notify::throughput",
+	                 G_CALLBACK(pidgin_xfer_progress_notify), NULL);
+	g_signal_connect(xfer, "notify::stalls",
+	                 G_CALLBACK(pidgin_xfer_progress_notify), NULL);
 	g_signal_connect(xfer, "notify::status",
 	                 G_CALLBACK(pidgin_xfer_status_notify), NULL);
 	g_signal_connect(xfer, "notify::visible",
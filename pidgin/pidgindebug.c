@@ -64,6 +64,7 @@ struct _PidginDebugWindow {
 	GtkWidget *popover;
 	GtkWidget *popover_invert;
 	GtkWidget *popover_highlight;
+	GtkWidget *categories_box;
 	gboolean invert;
 	gboolean highlight;
 	GRegex *regex;
@@ -460,6 +461,47 @@ filter_level_changed_cb(GtkWidget *combo, gpointer null)
 				gtk_combo_box_get_active(GTK_COMBO_BOX(combo)));
 }
 
+static void
+category_toggled_cb(GtkToggleButton *button, gpointer data)
+{
+	const gchar *category = data;
+
+	purple_debug_set_enabled(category, PURPLE_DEBUG_ALL,
+	                         gtk_toggle_button_get_active(button));
+}
+
+static void
+categories_toggled_cb(GtkToggleButton *button, PidginDebugWindow *win)
+{
+	GList *categories = NULL, *l = NULL;
+
+	if (!gtk_toggle_button_get_active(button)) {
+		return;
+	}
+
+	/* New categories show up as they're logged to, so rebuild the list each
+	 * time it's opened. */
+	gtk_container_foreach(GTK_CONTAINER(win->categories_box),
+	                      (GtkCallback)gtk_widget_destroy, NULL);
+
+	categories = purple_debug_get_categories();
+	for (l = categories; l != NULL; l = l->next) {
+		GtkWidget *check = gtk_check_button_new_with_label(l->data);
+
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check),
+		        purple_debug_is_enabled(PURPLE_DEBUG_ALL, l->data));
+		g_signal_connect_data(check, "toggled",
+		                      G_CALLBACK(category_toggled_cb), l->data,
+		                      (GClosureNotify)g_free, 0);
+		gtk_box_pack_start(GTK_BOX(win->categories_box), check, FALSE,
+		                   FALSE, 0);
+		gtk_widget_show(check);
+	}
+
+	/* The strings now belong to the signal handlers. */
+	g_list_free(categories);
+}
+
 static void
 pidgin_debug_window_class_init(PidginDebugWindowClass *klass) {
 	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
@@ -509,6 +551,8 @@ pidgin_debug_window_class_init(PidginDebugWindowClass *klass) {
 			widget_class, PidginDebugWindow, popover_invert);
 	gtk_widget_class_bind_template_child(
 			widget_class, PidginDebugWindow, popover_highlight);
+	gtk_widget_class_bind_template_child(
+			widget_class, PidginDebugWindow, categories_box);
 	gtk_widget_class_bind_template_callback(widget_class, save_cb);
 	gtk_widget_class_bind_template_callback(widget_class, clear_cb);
 	gtk_widget_class_bind_template_callback(widget_class, pause_cb);
@@ -522,6 +566,8 @@ pidgin_debug_window_class_init(PidginDebugWindowClass *klass) {
 			regex_key_release_cb);
 	gtk_widget_class_bind_template_callback(widget_class,
 			filter_level_changed_cb);
+	gtk_widget_class_bind_template_callback(widget_class,
+			categories_toggled_cb);
 }
 
 static void
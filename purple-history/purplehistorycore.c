@@ -28,25 +28,94 @@
 #include "../libpurple/purpleprivate.h"
 #undef PURPLE_COMPILATION
 
+static gchar *database = NULL;
+static gboolean rank = FALSE;
+static gboolean highlight = FALSE;
+static gint limit = 0;
+static gchar *before = NULL;
+
 /******************************************************************************
  * Helpers
  *****************************************************************************/
+static gboolean
+purple_history_init(GError **error) {
+	PurpleHistoryManager *manager = purple_history_manager_get_default();
+	PurpleHistoryAdapter *adapter = NULL;
+	const gchar *id = NULL;
+
+	if(database == NULL) {
+		database = g_build_filename(purple_config_dir(), "history.db", NULL);
+	}
+
+	adapter = purple_sqlite_history_adapter_new(database);
+
+	id = purple_history_adapter_get_id(adapter);
+	if(!purple_history_manager_register(manager, adapter, error)) {
+		g_clear_object(&adapter);
+
+		return FALSE;
+	}
+
+	g_clear_object(&adapter);
+
+	return purple_history_manager_set_active(manager, id, error);
+}
+
 static gboolean
 purple_history_query(const gchar *query, GError **error) {
 	PurpleHistoryManager *manager = purple_history_manager_get_default();
 	GList *results = NULL;
+	GString *full_query = NULL;
+	GError *local_error = NULL;
+
+	/* The options are just shortcuts for the query syntax of the sqlite
+	 * adapter, so append them to the query.
+	 */
+	full_query = g_string_new(query);
+	if(rank) {
+		g_string_append(full_query, " sort:rank");
+	}
+	if(highlight) {
+		g_string_append(full_query, " highlight:on");
+	}
 
-	results = purple_history_manager_query(manager, query, error);
+	if(limit > 0) {
+		gchar *next_cursor = NULL;
+
+		results = purple_history_manager_query_page(manager, full_query->str,
+		                                            before, (guint)limit,
+		                                            &next_cursor,
+		                                            &local_error);
+
+		/* Let the user know how to get to the next page. This goes to stderr
+		 * so it doesn't get mixed in with the results.
+		 */
+		if(next_cursor != NULL) {
+			g_fprintf(stderr, _("more results: --before '%s'\n"),
+			          next_cursor);
+			g_free(next_cursor);
+		}
+	} else {
+		results = purple_history_manager_query(manager, full_query->str,
+		                                       &local_error);
+	}
+	g_string_free(full_query, TRUE);
+
+	if(local_error != NULL) {
+		g_propagate_error(error, local_error);
 
-	if(error != NULL) {
 		return FALSE;
 	}
 
 	while(results != NULL) {
 		PurpleMessage *message = PURPLE_MESSAGE(results->data);
+		gchar *timestamp = NULL;
 
-		g_printf("%s: %s\n", purple_message_get_author(message),
+		timestamp = purple_message_format_timestamp(message, "%F %T");
+		g_printf("[%s] %s: %s\n", timestamp,
+		         purple_message_get_author(message),
 		         purple_message_get_contents(message));
+		g_free(timestamp);
 
 		g_clear_object(&message);
 		results = g_list_delete_link(results, results);
@@ -82,11 +151,41 @@ main(gint argc, gchar *argv[]) {
 	GOptionContext *ctx = NULL;
 	GOptionGroup *group = NULL;
 	gint exit_code = EXIT_SUCCESS;
+	GOptionEntry entries[] = {
+		{
+			"database", 'd', 0, G_OPTION_ARG_FILENAME, &database,
+			_("the history database to search"), _("FILE")
+		}, {
+			"rank", 'r', 0, G_OPTION_ARG_NONE, &rank,
+			_("order results by relevance instead of time"), NULL
+		}, {
+			"highlight", 'H', 0, G_OPTION_ARG_NONE, &highlight,
+			_("show a highlighted snippet of each result"), NULL
+		}, {
+			"limit", 'l', 0, G_OPTION_ARG_INT, &limit,
+			_("only show the newest N results"), _("N")
+		}, {
+			"before", 'b', 0, G_OPTION_ARG_STRING, &before,
+			_("continue from a previous page of results"), _("CURSOR")
+		}, {
+			NULL
+		}
+	};
 
 	ctx = g_option_context_new(_("QUERY"));
 	g_option_context_set_help_enabled(ctx, TRUE);
 	g_option_context_set_summary(ctx, _("Query purple message history"));
+	g_option_context_set_description(ctx,
+		_("Queries are made up of search terms which can be combined with "
+		  "AND, OR, and NOT.\n"
+		  "  account:NAME    only search the account NAME\n"
+		  "  in:NAME         only search the conversation NAME\n"
+		  "  from:NAME       only search messages from NAME\n"
+		  "  \"some phrase\"  search for an exact phrase\n"
+		  "  word*           search for words starting with word\n"
+		  "  -word           exclude messages containing word\n"));
 	g_option_context_set_translation_domain(ctx, GETTEXT_PACKAGE);
+	g_option_context_add_main_entries(ctx, entries, GETTEXT_PACKAGE);
 
 	group = purple_get_option_group();
 	g_option_context_add_group(ctx, group);
@@ -104,6 +203,18 @@ main(gint argc, gchar *argv[]) {
 
 	purple_history_manager_startup();
 
+	if(!purple_history_init(&error)) {
+		g_fprintf(stderr, "%s\n", error ? error->message : "unknown error");
+
+		g_clear_error(&error);
+		g_clear_pointer(&database, g_free);
+		g_clear_pointer(&before, g_free);
+
+		purple_history_manager_shutdown();
+
+		return EXIT_FAILURE;
+	}
+
 	for(gint i = 1; i < argc; i++) {
 		if(argv[i] == NULL || *argv[i] == '\0') {
 			continue;
@@ -121,6 +232,9 @@ main(gint argc, gchar *argv[]) {
 
 	purple_history_manager_shutdown();
 
+	g_clear_pointer(&database, g_free);
+	g_clear_pointer(&before, g_free);
+
 	return exit_code;
 }
 